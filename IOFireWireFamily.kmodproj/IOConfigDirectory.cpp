@@ -121,6 +121,219 @@ bool IOConfigDirectory::initWithOffset(int start, int type)
 	return true;
 }
 
+// free
+//
+//
+
+void IOConfigDirectory::free( void )
+{
+	if( reserved )
+	{
+		int i;
+		
+		if( reserved->fDecoded )
+		{
+			for( i = 0; i < fNumEntries; i++ )
+			{
+				if( reserved->fDecoded[i] )
+					reserved->fDecoded[i]->release();
+			}
+			
+			IOFree( reserved->fDecoded, fNumEntries * sizeof(OSObject*) );
+			reserved->fDecoded = NULL;
+		}
+		
+		if( reserved->fText )
+		{
+			for( i = 0; i < fNumEntries; i++ )
+			{
+				if( reserved->fText[i] )
+					reserved->fText[i]->release();
+			}
+			
+			IOFree( reserved->fText, fNumEntries * sizeof(OSString*) );
+			reserved->fText = NULL;
+		}
+		
+		if( reserved->fEntries )
+		{
+			IOFree( reserved->fEntries, fNumEntries * sizeof(UInt32) );
+			reserved->fEntries = NULL;
+		}
+		
+		IOFree( reserved, sizeof(ExpansionData) );
+		reserved = NULL;
+	}
+	
+	OSObject::free();
+}
+
+// createIndex
+//
+// parse the directory once into a host endian entry table and a
+// key to index map. used by directories whose backing ROM does not
+// change for the life of the object. key lookups then no longer walk
+// the ROM, and decoded leaves, subdirectories and text descriptors
+// are kept with the directory.
+
+IOReturn IOConfigDirectory::createIndex( void )
+{
+	IOReturn status = kIOReturnSuccess;
+	
+	if( reserved != NULL )
+	{
+		// already indexed
+		return kIOReturnSuccess;
+	}
+	
+	if( fNumEntries == 0 )
+	{
+		// nothing was loaded, stay on the unindexed path
+		status = kIOReturnNotReady;
+	}
+	
+	if( status == kIOReturnSuccess )
+	{
+		status = checkROMState();
+	}
+	
+	ExpansionData * index = NULL;
+	if( status == kIOReturnSuccess )
+	{
+		index = (ExpansionData*)IOMalloc( sizeof(ExpansionData) );
+		if( index == NULL )
+			status = kIOReturnNoMemory;
+	}
+	
+	if( status == kIOReturnSuccess )
+	{
+		bzero( index, sizeof(ExpansionData) );
+		
+		index->fEntries = (UInt32*)IOMalloc( fNumEntries * sizeof(UInt32) );
+		index->fDecoded = (OSObject**)IOMalloc( fNumEntries * sizeof(OSObject*) );
+		index->fText = (OSString**)IOMalloc( fNumEntries * sizeof(OSString*) );
+		if( index->fEntries == NULL || index->fDecoded == NULL || index->fText == NULL )
+			status = kIOReturnNoMemory;
+	}
+	
+	if( status == kIOReturnSuccess )
+	{
+		int i;
+		
+		bzero( index->fDecoded, fNumEntries * sizeof(OSObject*) );
+		bzero( index->fText, fNumEntries * sizeof(OSString*) );
+		memset( index->fKeyIndex, 0xff, sizeof(index->fKeyIndex) );
+		
+		const UInt32 * data = lockData() + fStart + 1;
+		for( i = 0; i < fNumEntries; i++ )
+		{
+			index->fEntries[i] = OSSwapBigToHostInt32( data[i] );
+		}
+		unlockData();
+		
+		// walk backwards so each slot ends up holding the first match
+		for( i = fNumEntries - 1; i >= 0; i-- )
+		{
+			UInt32 entry = index->fEntries[i];
+			UInt32 type = (entry & kConfigEntryKeyType) >> kConfigEntryKeyTypePhase;
+			UInt32 key = (entry & kConfigEntryKeyValue) >> kConfigEntryKeyValuePhase;
+			
+			index->fKeyIndex[type][key] = i;
+		}
+		
+		reserved = index;
+		index = NULL;
+	}
+	
+	if( index != NULL )
+	{
+		if( index->fEntries )
+			IOFree( index->fEntries, fNumEntries * sizeof(UInt32) );
+		
+		if( index->fDecoded )
+			IOFree( index->fDecoded, fNumEntries * sizeof(OSObject*) );
+		
+		if( index->fText )
+			IOFree( index->fText, fNumEntries * sizeof(OSString*) );
+		
+		IOFree( index, sizeof(ExpansionData) );
+	}
+	
+	return status;
+}
+
+// findKeyIndex
+//
+// returns the index of the first entry matching key (and type if given), or -1
+
+int IOConfigDirectory::findKeyIndex( int key, UInt32 type )
+{
+	int index = -1;
+	
+	if( reserved != NULL && 
+		key >= 0 && key < 64 &&
+		(type == kInvalidConfigROMEntryType || type < 4) )
+	{
+		if( type != kInvalidConfigROMEntryType )
+		{
+			index = reserved->fKeyIndex[type][key];
+		}
+		else
+		{
+			for( type = 0; type < 4; type++ )
+			{
+				int type_index = reserved->fKeyIndex[type][key];
+				if( type_index >= 0 && (index < 0 || type_index < index) )
+					index = type_index;
+			}
+		}
+	}
+	else
+	{
+		// not indexed, or a key with the type folded in
+		const UInt32 * data = lockData() + fStart + 1;
+		index = findIndex( data, fNumEntries, key, type );
+		unlockData();
+	}
+	
+	return index;
+}
+
+// getEntry
+//
+// caller has checked the rom state and the index
+
+UInt32 IOConfigDirectory::getEntry( int index )
+{
+	UInt32 entry;
+	
+	if( reserved != NULL )
+	{
+		entry = reserved->fEntries[index];
+	}
+	else
+	{
+		const UInt32 * data = lockData();
+		entry = OSSwapBigToHostInt32( data[fStart + 1 + index] );
+		unlockData();
+	}
+	
+	return entry;
+}
+
+// cacheDecodedValue
+//
+// first decoder to finish wins, the loser drops its copy
+
+void IOConfigDirectory::cacheDecodedValue( OSObject ** slot, OSObject * object )
+{
+	object->retain();
+	if( !OSCompareAndSwapPtr( NULL, object, (void * volatile *)slot ) )
+	{
+		object->release();
+	}
+}
+
 // createIterator
 //
 //
@@ -170,9 +383,7 @@ IOReturn IOConfigDirectory::getKeyType(int key, IOConfigKeyType &type)
 	
 	if( status == kIOReturnSuccess )
 	{
-		const UInt32 * data = lockData() + fStart + 1;
-		index = findIndex(data, fNumEntries, key);
-		unlockData();
+		index = findKeyIndex(key);
 
 		if( index < 0 )
 			status = kIOConfigNoEntry;
@@ -199,9 +410,7 @@ IOReturn IOConfigDirectory::getKeyValue(int key, UInt32 &value, OSString** text)
 	
 	if( status == kIOReturnSuccess )
 	{
-		const UInt32 * data = lockData() + fStart + 1;
-		index = findIndex(data, fNumEntries, key);
-		unlockData();
+		index = findKeyIndex(key);
 	
 		if( index < 0 )
         	status = kIOConfigNoEntry;
@@ -237,9 +446,7 @@ IOReturn IOConfigDirectory::getKeyValue(int key, OSData *&value, OSString** text
 
 	if( status == kIOReturnSuccess )
 	{    
-		const UInt32 * data = lockData() + fStart + 1;
-		index = findIndex(data, fNumEntries, key, kConfigLeafKeyType);
-		unlockData();
+		index = findKeyIndex(key, kConfigLeafKeyType);
 		
 		if( index < 0 )
 		{
@@ -278,9 +485,7 @@ IOReturn IOConfigDirectory::getKeyValue(int key, IOConfigDirectory *&value,
 	
 	if( status == kIOReturnSuccess )
 	{
-		const UInt32 * data = lockData() + fStart + 1;
-		index = findIndex(data, fNumEntries, key, kConfigDirectoryKeyType);
-		unlockData();
+		index = findKeyIndex(key, kConfigDirectoryKeyType);
 		
 		if( index < 0 )
 		{
@@ -318,9 +523,7 @@ IOReturn IOConfigDirectory::getKeyOffset(int key, FWAddress &value, OSString** t
 	
 	if( status == kIOReturnSuccess )
 	{
-		const UInt32 * data = lockData() + fStart + 1;
-		index = findIndex(data, fNumEntries, key, kConfigOffsetKeyType);
-		unlockData();
+		index = findKeyIndex(key, kConfigOffsetKeyType);
 	
 		if( index < 0 )
         	status = kIOConfigNoEntry;
@@ -393,9 +596,7 @@ IOReturn IOConfigDirectory::getIndexType(int index, IOConfigKeyType &type)
 	
 	if( status == kIOReturnSuccess )
 	{	
-		const UInt32 * data = lockData();
-		entry = OSSwapBigToHostInt32(data[fStart + 1 + index]);
-		unlockData();
+		entry = getEntry(index);
 
 		type = (IOConfigKeyType)((entry & kConfigEntryKeyType) >> kConfigEntryKeyTypePhase);
     }
@@ -422,9 +623,7 @@ IOReturn IOConfigDirectory::getIndexKey(int index, int &key)
 	
 	if( status == kIOReturnSuccess )
 	{
-		const UInt32 * data = lockData();	
-		entry = OSSwapBigToHostInt32(data[fStart + 1 + index]);
-		unlockData();
+		entry = getEntry(index);
 	
 		key = (IOConfigKeyType)((entry & kConfigEntryKeyValue) >> kConfigEntryKeyValuePhase);
 	}
@@ -451,9 +650,7 @@ IOReturn IOConfigDirectory::getIndexValue(int index, UInt32 &value)
 
 	if( status == kIOReturnSuccess )
 	{
-		const UInt32 * data = lockData();	
-		entry = OSSwapBigToHostInt32(data[fStart + 1 + index]);
-		unlockData();
+		entry = getEntry(index);
 	
 		// Return the value as an integer, whatever it really is.
 		value = entry & kConfigEntryValue;
@@ -484,14 +681,22 @@ IOReturn IOConfigDirectory::getIndexValue(int index, OSData *&value)
 	
 	if( status == kIOReturnSuccess )
 	{
-		data = lockData();	
-		entry = OSSwapBigToHostInt32(data[fStart + 1 + index]);
-		unlockData();
+		entry = getEntry(index);
 	
 		if( ((entry & kConfigEntryKeyType) >> kConfigEntryKeyTypePhase) != kConfigLeafKeyType)
 			status = kIOReturnBadArgument;
 	}
 	
+	if( status == kIOReturnSuccess && reserved != NULL && reserved->fDecoded[index] != NULL )
+	{
+		// hand out a copy, callers are free to modify leaf data
+		value = OSData::withData( (OSData*)reserved->fDecoded[index] );
+		if( value == NULL )
+			status = kIOReturnNoMemory;
+		
+		return status;
+	}
+	
 	if( status == kIOReturnSuccess )
 	{
 		status = getIndexOffset( index, offset );
@@ -523,6 +728,16 @@ IOReturn IOConfigDirectory::getIndexValue(int index, OSData *&value)
 			status = kIOReturnNoMemory;
 	}
 	
+	if( status == kIOReturnSuccess && reserved != NULL )
+	{
+		OSData * leaf = OSData::withData( value );
+		if( leaf )
+		{
+			cacheDecodedValue( &reserved->fDecoded[index], leaf );
+			leaf->release();
+		}
+	}
+	
     return status;
 }
 
@@ -551,9 +766,7 @@ IOReturn IOConfigDirectory::getIndexValue(int index, OSString *&value)
 
 	if( status == kIOReturnSuccess )
 	{
-		data = lockData();
-		entry = OSSwapBigToHostInt32(data[fStart + 1 + index]);
-		unlockData();
+		entry = getEntry(index);
 	
 		if( ((entry & kConfigEntryKeyValue) >> kConfigEntryKeyValuePhase) != kConfigTextualDescriptorKey )
 		{
@@ -570,6 +783,14 @@ IOReturn IOConfigDirectory::getIndexValue(int index, OSString *&value)
 			status = kIOReturnBadArgument;
 		}
 	}
+	
+	if( status == kIOReturnSuccess && reserved != NULL && reserved->fText[index] != NULL )
+	{
+		value = reserved->fText[index];
+		value->retain();
+		
+		return status;
+	}
     
 	if( status == kIOReturnSuccess )
 	{
@@ -660,6 +881,11 @@ IOReturn IOConfigDirectory::getIndexValue(int index, OSString *&value)
 			status = kIOReturnNoMemory;
 	}
 	
+	if( status == kIOReturnSuccess && reserved != NULL )
+	{
+		cacheDecodedValue( (OSObject**)&reserved->fText[index], value );
+	}
+	
 	DebugLogCond( status != kIOReturnSuccess, "IOConfigDirectory<%p>::getIndexValue -- return status 0x%x\n", this, status ) ;
 	
 	return status;
@@ -685,14 +911,20 @@ IOReturn IOConfigDirectory::getIndexValue(int index, IOConfigDirectory *&value)
 
 	if( status == kIOReturnSuccess )
 	{
-		const UInt32 * data = lockData();
-		entry = OSSwapBigToHostInt32(data[fStart + 1 + index]);
-		unlockData();
+		entry = getEntry(index);
 	
 		if( ((entry & kConfigEntryKeyType) >> kConfigEntryKeyTypePhase) != kConfigDirectoryKeyType)
 			status = kIOReturnBadArgument;
 	}
 	
+	if( status == kIOReturnSuccess && reserved != NULL && reserved->fDecoded[index] != NULL )
+	{
+		value = (IOConfigDirectory*)reserved->fDecoded[index];
+		value->retain();
+		
+		return status;
+	}
+	
 	if( status == kIOReturnSuccess )
 	{
 		status = getIndexOffset(index, offset);
@@ -704,6 +936,11 @@ IOReturn IOConfigDirectory::getIndexValue(int index, IOConfigDirectory *&value)
 		if( value == NULL )
 			status = kIOReturnNoMemory;
 	}
+	
+	if( status == kIOReturnSuccess && reserved != NULL )
+	{
+		cacheDecodedValue( (OSObject**)&reserved->fDecoded[index], value );
+	}
     
 	return status;
 }
@@ -728,9 +965,7 @@ IOReturn IOConfigDirectory::getIndexOffset(int index, FWAddress &value)
 
 	if( status == kIOReturnSuccess )
 	{
-		const UInt32 * data = lockData();
-		entry = OSSwapBigToHostInt32(data[fStart + 1 + index]);
-		unlockData();
+		entry = getEntry(index);
 	
 		if(((entry & kConfigEntryKeyType) >> kConfigEntryKeyTypePhase) == kConfigImmediateKeyType)
         	status = kIOReturnBadArgument;
@@ -773,9 +1008,7 @@ IOReturn IOConfigDirectory::getIndexOffset(int index, UInt32 &value)
 
 	if( status == kIOReturnSuccess )
 	{
-		const UInt32 * data = lockData();
-		entry = OSSwapBigToHostInt32(data[fStart + 1 + index]);
-		unlockData();
+		entry = getEntry(index);
 		
 		if(((entry & kConfigEntryKeyType) >> kConfigEntryKeyTypePhase) == kConfigImmediateKeyType)
 		{
@@ -814,9 +1047,7 @@ IOReturn IOConfigDirectory::getIndexEntry(int index, UInt32 &value)
 	
 	if( status == kIOReturnSuccess )
 	{
-		const UInt32 * data = lockData();
-		value = OSSwapBigToHostInt32(data[fStart + 1 + index]);
-		unlockData();
+		value = getEntry(index);
 	}
 	
     return status;
@@ -46,8 +46,15 @@ protected:
     
 /*! @struct ExpansionData
     @discussion This structure will be used to expand the capablilties of the class in the future.
+    It holds the optional parsed form of the directory built by createIndex().
     */    
-    struct ExpansionData { };
+    struct ExpansionData
+	{
+		UInt32 *		fEntries;						// host endian copy of the directory entries
+		SInt16			fKeyIndex[4][64];				// first entry index by [key type][key value], -1 if absent
+		OSObject **		fDecoded;						// decoded leaf or subdirectory per entry index
+		OSString **		fText;							// decoded textual descriptor per entry index
+	};
 
 /*! @var reserved
     Reserved for future use.  (Internal use only)  */
@@ -60,6 +67,13 @@ protected:
                                     OSIterator *&iterator);
     virtual IOConfigDirectory *getSubDir(int start, int type) = 0;
 
+	virtual void free( void );
+
+	IOReturn createIndex( void );
+	int findKeyIndex( int key, UInt32 type = kInvalidConfigROMEntryType );
+	UInt32 getEntry( int index );
+	void cacheDecodedValue( OSObject ** slot, OSObject * object );
+
 public:
     /*!
         @function update
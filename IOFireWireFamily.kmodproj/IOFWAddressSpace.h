@@ -136,10 +136,12 @@ protected:
 	void setExclusive( bool exclusive );
 	
 	virtual bool intersects( IOFWAddressSpace * space );
+
+	virtual bool getAddressRange( FWAddress * base, UInt32 * length );
 		
 private:
     OSMetaClassDeclareReservedUsed(IOFWAddressSpaceAux, 0);
-    OSMetaClassDeclareReservedUnused(IOFWAddressSpaceAux, 1);
+    OSMetaClassDeclareReservedUsed(IOFWAddressSpaceAux, 1);
     OSMetaClassDeclareReservedUnused(IOFWAddressSpaceAux, 2);
     OSMetaClassDeclareReservedUnused(IOFWAddressSpaceAux, 3);
     OSMetaClassDeclareReservedUnused(IOFWAddressSpaceAux, 4);
@@ -310,6 +312,17 @@ public:
 	inline bool intersects( IOFWAddressSpace * space )
 		{ return fIOFWAddressSpaceExpansion->fAuxiliary->intersects( space ); }
 
+	/*!	@function	getAddressRange
+		@abstract	Returns the fixed address range this address space responds to, if it has one.
+					Spaces with a fixed range are dispatched through the controller's address index.
+		@param		base	on return, the first address of the range.
+		@param		length	on return, the number of bytes in the range.
+		@result		True if the space has a fixed range, false if it must be probed for every request
+	*/
+
+	inline bool getAddressRange( FWAddress * base, UInt32 * length )
+		{ return fIOFWAddressSpaceExpansion->fAuxiliary->getAddressRange( base, length ); }
+
 		
 protected:
 	
@@ -188,7 +188,7 @@ bool IOFWAsyncCommand::createMemberVariables( void )
 		
 		if( success )
 		{
-			fMembers = (MemberVariables*)IOMalloc( sizeof(MemberVariables) );
+			fMembers = (MemberVariables*)allocCommandMemory( sizeof(MemberVariables) );
 			if( fMembers == NULL )
 				success = false;
 		}
@@ -221,7 +221,7 @@ void IOFWAsyncCommand::destroyMemberVariables( void )
 {
 	if( fMembers != NULL )
 	{
-		IOFree( fMembers, sizeof(MemberVariables) );
+		freeCommandMemory( fMembers, sizeof(MemberVariables) );
 		fMembers = NULL;
 	}
 }
@@ -29,6 +29,10 @@
 
 class IOFWAsyncStreamReceiver;
 class IOFWAsyncStreamReceivePort;
+class IOFWAsyncStreamListener;
+class IOFireWireMultiIsochReceivePacket;
+
+typedef void (*FWAsyncStreamPacketCallback)( void *refcon, IOFWAsyncStreamListener *listener, IOFireWireMultiIsochReceivePacket *packet );
 
 /*! @class IOFWAsyncStreamListener
 */
@@ -94,6 +98,28 @@ public:
 	@param none.
 	@result returns the counter value.	*/	
 	UInt32 getOverrunCounter();
+
+/*!	@function setPacketHandler
+	@abstract Switches the listener to zero copy delivery. The handler is passed the
+			  received packet itself instead of a copy of it. The packet's ranges 
+			  hold the packet as received, the isoch header is still little endian.
+			  Only available with multi-isoch receive.
+	@param handler The callback, or NULL to go back to copied delivery.
+	@result none.	*/	
+	void setPacketHandler( FWAsyncStreamPacketCallback handler );
+
+/*!	@function packetDone
+	@abstract Hands back a packet passed to the packet handler. Must be called once 
+			  for every packet, either from the handler or later from any context.
+			  The packet is returned to the receiver when the last listener is done.
+	@param packet The packet passed to the handler.
+	@result none.	*/	
+	void packetDone( IOFireWireMultiIsochReceivePacket *packet );
+
+/*!	@function isPacketMode
+	@abstract checks whether packets are delivered with zero copy.
+	@result   true if a packet handler is set, else false	*/	
+	inline bool isPacketMode() { return ( reserved != NULL and reserved->fPacketProc != NULL ); };
 	
 protected:
 
@@ -107,7 +133,11 @@ protected:
 /*! @struct ExpansionData
     @discussion This structure will be used to expand the capablilties of the class in the future.
     */    
-    struct ExpansionData { };
+    struct ExpansionData 
+	{
+		FWAsyncStreamPacketCallback		fPacketProc;
+		volatile UInt32					fHeldPackets;	// receiver packet slots still owed a packetDone, one bit each
+	};
 
 /*! @var reserved
     Reserved for future use.  (Internal use only)  */
@@ -124,6 +154,12 @@ private:
 /*!	function invokeClients
 	abstract Invokes client's callback function with fRefCon.	*/	
 	void invokeClients( UInt8 *buffer );
+
+/*!	function invokePacketClients
+	abstract Invokes client's packet handler with fRefCon.
+	param slot The receiver's in flight slot holding the packet.
+	result true if the handler was called and owes a packetDone.	*/	
+	bool invokePacketClients( IOFireWireMultiIsochReceivePacket *packet, int slot );
 	
     OSMetaClassDeclareReservedUnused(IOFWAsyncStreamListener, 0);
     OSMetaClassDeclareReservedUnused(IOFWAsyncStreamListener, 1);
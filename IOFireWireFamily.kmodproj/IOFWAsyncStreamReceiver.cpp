@@ -64,9 +64,7 @@ bool IOFWAsyncStreamReceiver::initAll( IOFireWireController *control, UInt32 cha
 	fActive = false;
     fInitialized = true;
 
-	fAsyncStreamClients = OSSet::withCapacity(2);
-	if( fAsyncStreamClients )
-		fAsyncStreamClientIterator = OSCollectionIterator::withCollection( fAsyncStreamClients );
+	fAsyncStreamClients = OSArray::withCapacity(2);
 
 	status = activate(control->getBroadcastSpeed());
 
@@ -96,17 +94,16 @@ bool IOFWAsyncStreamReceiver::initAll( IOFireWireController *control, UInt32 cha
 			fActive			= false;
 			fInitialized	= true;
 	
-			fAsyncStreamClients = OSSet::withCapacity(1);
-			if( fAsyncStreamClients )
-			{
-				fAsyncStreamClientIterator = OSCollectionIterator::withCollection( fAsyncStreamClients );
-			}
-			else
+			fAsyncStreamClients = OSArray::withCapacity(1);
+			if( fAsyncStreamClients == NULL )
 			{
 				status = kIOReturnError;
 			}
 	
-			status = fListener->Activate();
+			if( status == kIOReturnSuccess )
+			{
+				status = fListener->Activate();
+			}
 		}
 		else
 		{
@@ -156,6 +153,17 @@ void IOFWAsyncStreamReceiver::free()
 		fListener = NULL;
 	}
 	
+	// give back anything zero copy listeners are still holding
+	for( int i = 0; i < kMaxAsyncStreamPacketsInFlight; i++ )
+	{
+		IOFireWireMultiIsochReceivePacket * packet = fPacketRefs[i].packet;
+		if( packet )
+		{
+			fPacketRefs[i].packet = NULL;
+			packet->clientDone();
+		}
+	}
+	
 	// free the buffer 
 	if( fBufDesc ) 
 	{
@@ -172,12 +180,6 @@ void IOFWAsyncStreamReceiver::free()
 		fAsyncStreamClients->release();
 		fAsyncStreamClients = NULL;
 	}
-	
-	if( fAsyncStreamClientIterator )
-	{
-		fAsyncStreamClientIterator->release();
-		fAsyncStreamClientIterator = NULL;
-	}
 
 	fControl->openGate();
 
@@ -645,25 +647,64 @@ IOReturn IOFWAsyncStreamReceiver::receiveAsyncStream(void *refcon, IOFireWireMul
 	
 	UInt16		index	= 0;
 	IOByteCount offset	= 0;
+	IOByteCount length	= 0;
 	
-	for(;;)
+	for( index = 0; index < pPacket->numRanges; index++ )
+		length += pPacket->ranges[index].length;
+	
+	receiver->fPacketCount++;
+	receiver->fByteCount += length;
+	
+	unsigned int copyListeners = 0;
+	SInt32 packetListeners = 0;
+	unsigned int count = receiver->fAsyncStreamClients->getCount();
+	for( unsigned int i = 0; i < count; i++ )
 	{
-		if(index ==  pPacket->numRanges)
-			break;
+		IOFWAsyncStreamListener * listener = (IOFWAsyncStreamListener *)receiver->fAsyncStreamClients->getObject( i );
+		if( not listener->isPacketMode() )
+			copyListeners++;
+		else if( listener->IsNotificationOn() )
+			packetListeners++;
+	}
 	
-		IOByteCount bytesWritten	=	receiver->fBufDesc->writeBytes(offset, (void*)pPacket->ranges[index].address, pPacket->ranges[index].length);
-		offset						+=	bytesWritten;
+	// zero copy listeners get the packet itself, the receive path holds
+	// a reference of its own until it is done below. zero copy listeners
+	// that can't be handed the packet are counted as drops there
+	bool held = receiver->indicatePacketListeners( pPacket, packetListeners );
+	bool delivered = (packetListeners > 0);
+	
+	// a packet that does not fit the receive buffer would be delivered truncated
+	if( copyListeners > 0 and length <= receiver->fBufDesc->getLength() )
+	{
+		index = 0;
+		
+		for(;;)
+		{
+			if(index ==  pPacket->numRanges)
+				break;
+		
+			IOByteCount bytesWritten	=	receiver->fBufDesc->writeBytes(offset, (void*)pPacket->ranges[index].address, pPacket->ranges[index].length);
+			offset						+=	bytesWritten;
+			
+			index++;
+		}
+		
+		// Need to make the isoch header native endian
+		UInt32 *pHeader = (UInt32*)receiver->fBufDesc->getBytesNoCopy();
+		*pHeader = OSSwapLittleToHostInt32(*pHeader);
 		
-		index++;
+		receiver->indicateListeners( (UInt8*)receiver->fBufDesc->getBytesNoCopy() );
+		
+		delivered = true;
 	}
 	
-	// Need to make the isoch header native endian
-	UInt32 *pHeader = (UInt32*)receiver->fBufDesc->getBytesNoCopy();
-	*pHeader = OSSwapLittleToHostInt32(*pHeader);
-	
-	receiver->indicateListeners( (UInt8*)receiver->fBufDesc->getBytesNoCopy() );
+	if( not delivered )
+		receiver->fDropCount++;
 	
-	pPacket->clientDone();
+	if( held )
+		receiver->packetDone( pPacket );
+	else
+		pPacket->clientDone();
 	
 	return kIOReturnSuccess;
 }
@@ -685,7 +726,13 @@ void IOFWAsyncStreamReceiver::receiveAsyncStream(DCLCommandStruct *callProc)
 
 	UInt8 *buffer = proc->buffer;
 
-	receiver->indicateListeners( buffer );
+	// bytes are only counted by the multi isoch receive path
+	receiver->fPacketCount++;
+	
+	if( receiver->fAsyncStreamClients->getCount() == 0 )
+		receiver->fDropCount++;
+	else
+		receiver->indicateListeners( buffer );
 
     if( receiver->modifyDCLJumps( callProc ) == kIOReturnError ) return;
 }
@@ -696,7 +743,7 @@ bool IOFWAsyncStreamReceiver::addListener ( IOFWAsyncStreamListener *listener )
 
 	bool ret = true;
 
-    if( listener )
+    if( listener and fAsyncStreamClients->getNextIndexOfObject( listener, 0 ) == (unsigned int)-1 )
 	{
 		if(not fAsyncStreamClients->setObject( listener ))
 			ret = false;
@@ -709,14 +756,10 @@ bool IOFWAsyncStreamReceiver::addListener ( IOFWAsyncStreamListener *listener )
 
 void IOFWAsyncStreamReceiver::removeAllListeners()
 {
-	IOFWAsyncStreamListener * found;
-
 	fControl->closeGate();
 
-	fAsyncStreamClientIterator->reset();
-	
-    while( (found = (IOFWAsyncStreamListener *) fAsyncStreamClientIterator->getNextObject())) 
-		fAsyncStreamClients->removeObject(found);
+	if( fAsyncStreamClients )
+		fAsyncStreamClients->flushCollection();
 
 	fControl->openGate();
         
@@ -728,7 +771,11 @@ void IOFWAsyncStreamReceiver::removeListener ( IOFWAsyncStreamListener *listener
 	fControl->closeGate();
 	
 	if( listener )
-		fAsyncStreamClients->removeObject(listener);
+	{
+		unsigned int index = fAsyncStreamClients->getNextIndexOfObject( listener, 0 );
+		if( index != (unsigned int)-1 )
+			fAsyncStreamClients->removeObject( index );
+	}
 
 	fControl->openGate();
 	
@@ -737,13 +784,93 @@ void IOFWAsyncStreamReceiver::removeListener ( IOFWAsyncStreamListener *listener
 
 void IOFWAsyncStreamReceiver::indicateListeners ( UInt8 *buffer )
 {
-	IOFWAsyncStreamListener * found;
+	unsigned int count = fAsyncStreamClients->getCount();
+	
+	for( unsigned int index = 0; index < count; index++ )
+	{
+		IOFWAsyncStreamListener * listener = (IOFWAsyncStreamListener *)fAsyncStreamClients->getObject( index );
+		
+		// zero copy listeners were handed the packet already
+		if( not listener->isPacketMode() )
+			listener->invokeClients(buffer);
+	}
+}
 
-	fAsyncStreamClientIterator->reset();
+bool IOFWAsyncStreamReceiver::indicatePacketListeners( IOFireWireMultiIsochReceivePacket *packet, SInt32 listeners )
+{
+	if( listeners == 0 )
+		return false;
 	
-    while( (found = (IOFWAsyncStreamListener *) fAsyncStreamClientIterator->getNextObject() ) ) 
-		found->invokeClients(buffer);
+	int slot = -1;
+	for( int i = 0; i < kMaxAsyncStreamPacketsInFlight; i++ )
+	{
+		if( OSCompareAndSwapPtr( NULL, packet, (void * volatile *)&fPacketRefs[i].packet ) )
+		{
+			slot = i;
+			break;
+		}
+	}
 	
+	if( slot == -1 )
+	{
+		// every zero copy listener misses this packet
+		fDropCount += listeners;
+		DebugLog("IOFWAsyncStreamReceiver<%p>::indicatePacketListeners - too many packets held by listeners\n", this);
+		return false;
+	}
+	
+	// one reference per listener plus the one held by the receive path
+	fPacketRefs[slot].references = listeners + 1;
+	
+	SInt32 invoked = 0;
+	unsigned int count = fAsyncStreamClients->getCount();
+	for( unsigned int index = 0; index < count and invoked < listeners; index++ )
+	{
+		IOFWAsyncStreamListener * listener = (IOFWAsyncStreamListener *)fAsyncStreamClients->getObject( index );
+		if( listener->isPacketMode() and listener->invokePacketClients( packet, slot ) )
+			invoked++;
+	}
+	
+	// drop the references of listeners that turned notification off meanwhile
+	while( invoked < listeners )
+	{
+		releasePacketSlot( slot );
+		invoked++;
+	}
+	
+	return true;
+}
+
+void IOFWAsyncStreamReceiver::packetDone( IOFireWireMultiIsochReceivePacket *packet )
+{
+	int slot = findPacketSlot( packet );
+	
+	if( slot != -1 )
+		releasePacketSlot( slot );
+	else
+		DebugLog("IOFWAsyncStreamReceiver<%p>::packetDone - packet %p is not held\n", this, packet);
+}
+
+int IOFWAsyncStreamReceiver::findPacketSlot( IOFireWireMultiIsochReceivePacket *packet )
+{
+	for( int i = 0; i < kMaxAsyncStreamPacketsInFlight; i++ )
+	{
+		if( fPacketRefs[i].packet == packet )
+			return i;
+	}
+	
+	return -1;
+}
+
+void IOFWAsyncStreamReceiver::releasePacketSlot( int slot )
+{
+	IOFireWireMultiIsochReceivePacket * packet = fPacketRefs[slot].packet;
+	
+	if( OSDecrementAtomic( &fPacketRefs[slot].references ) == 1 )
+	{
+		fPacketRefs[slot].packet = NULL;
+		packet->clientDone();
+	}
 }
 
 UInt32	IOFWAsyncStreamReceiver::getClientsCount()
@@ -759,6 +886,15 @@ OSMetaClassDefineReservedUnused(IOFWAsyncStreamListener, 1);
 bool IOFWAsyncStreamListener::initAll(IOFireWireController *control, UInt32 channel, FWAsyncStreamReceiveCallback proc, void *obj)
 {
 	fControl  = control;
+	
+	if( reserved == NULL )
+	{
+		reserved = (ExpansionData*)IOMalloc( sizeof(ExpansionData) );
+		if( reserved == NULL )
+			return false;
+		
+		bzero( reserved, sizeof(ExpansionData) );
+	}
 
 	fControl->closeGate();
 
@@ -797,6 +933,14 @@ void IOFWAsyncStreamListener::free()
 
 	if( fReceiver )
 	{
+		// hand back the packets the client never did
+		UInt32 held = reserved ? OSBitAndAtomic( 0, &reserved->fHeldPackets ) : 0;
+		for( int slot = 0; held != 0; slot++, held >>= 1 )
+		{
+			if( held & 1 )
+				fReceiver->releasePacketSlot( slot );
+		}
+		
 		if( fReceiver->getClientsCount() == 0 )
 			fControl->removeAsyncStreamReceiver(fReceiver);
 
@@ -807,6 +951,12 @@ void IOFWAsyncStreamListener::free()
 
 	fControl->openGate();
 	
+	if( reserved )
+	{
+		IOFree( reserved, sizeof(ExpansionData) );
+		reserved = NULL;
+	}
+	
 	OSObject::free();
 }
 
@@ -818,6 +968,40 @@ void IOFWAsyncStreamListener::invokeClients(UInt8 *buffer)
 	}
 }																				
 
+bool IOFWAsyncStreamListener::invokePacketClients( IOFireWireMultiIsochReceivePacket *packet, int slot )
+{
+	bool invoked = false;
+	
+	FWAsyncStreamPacketCallback proc = reserved ? reserved->fPacketProc : NULL;
+	if( fNotify and proc )
+	{
+		// the handler may hand the packet back before it returns
+		OSBitOrAtomic( 1U << slot, &reserved->fHeldPackets );
+		proc( fRefCon, this, packet );
+		invoked = true;
+	}
+	
+	return invoked;
+}
+
+void IOFWAsyncStreamListener::setPacketHandler( FWAsyncStreamPacketCallback handler )
+{
+	if( reserved )
+		reserved->fPacketProc = handler;
+}
+
+void IOFWAsyncStreamListener::packetDone( IOFireWireMultiIsochReceivePacket *packet )
+{
+	int slot = fReceiver->findPacketSlot( packet );
+	UInt32 mask = (slot != -1) ? (1U << slot) : 0;
+	
+	// only drop the reference this listener holds, and only once
+	if( mask and (OSBitAndAtomic( ~mask, &reserved->fHeldPackets ) & mask) )
+		fReceiver->releasePacketSlot( slot );
+	else
+		DebugLog("IOFWAsyncStreamListener<%p>::packetDone - packet %p is not held\n", this, packet);
+}
+
 UInt32 IOFWAsyncStreamListener::getOverrunCounter()
 { 
 	return fReceiver->getOverrunCounter(); 
@@ -29,6 +29,7 @@
 
 const int kMaxAsyncStreamReceiveBuffers		= 9;
 const int kMaxAsyncStreamReceiveBufferSize	= 4096; // zzz : should determine from maxrec
+const int kMaxAsyncStreamPacketsInFlight	= 32;	// packets held by zero copy listeners, at most 32 (listeners keep a bit per slot)
 
 class IOFWAsyncStreamReceiver;
 class IOFWAsyncStreamReceivePort;
@@ -73,6 +74,30 @@ public:
 	result returns true on success, else false.	*/	
 	inline bool listens ( UInt32 channel ) { return ( fChannel == channel ); };
 
+/*!	function getChannel
+	abstract returns the channel this receiver listens on.
+	result returns the channel.	*/	
+	inline UInt32 getChannel() { return fChannel; };
+
+/*!	function getPacketCount
+	abstract returns the number of packets received on the channel.
+	result returns the counter.	*/	
+	inline UInt64 getPacketCount() { return fPacketCount; };
+
+/*!	function getByteCount
+	abstract returns the number of bytes received on the channel.
+	result returns the counter.	*/	
+	inline UInt64 getByteCount() { return fByteCount; };
+
+/*!	function getDropCount
+	abstract returns the number of packets received but not delivered, 
+			  either because they did not fit the receive buffer or 
+			  because no listener was attached. A packet that zero copy
+			  listeners could not be handed because too many packets
+			  were held already counts once for each of them.
+	result returns the counter.	*/	
+	inline UInt32 getDropCount() { return fDropCount; };
+
 /*!	function receiverActive
 	abstract Verify whether receiver is active.
 	result returns true if active,else false.	*/	
@@ -112,6 +137,13 @@ public:
 
 	UInt32	getClientsCount();
 
+/*!	function packetDone
+	abstract Drops a reference on a packet held for zero copy listeners, the 
+			  packet goes back to the multi-isoch receiver with the last one.
+	param packet The packet handed to the listeners.
+	result none.	*/	
+	void packetDone( IOFireWireMultiIsochReceivePacket *packet );
+
 protected:
 	typedef struct
 	{
@@ -127,6 +159,13 @@ protected:
 		DCLLabelPtr pSegmentLabelDCL;
 		DCLJumpPtr pSegmentJumpDCL;
 	}FWAsyncStreamReceiveSegment, *FWAsyncStreamReceiveSegmentPtr;
+	
+	// A packet held by zero copy listeners
+	typedef struct
+	{
+		IOFireWireMultiIsochReceivePacket * volatile	packet;
+		volatile SInt32									references;
+	} FWAsyncStreamPacketRef;
     
 /*! @struct ExpansionData
     @discussion This structure will be used to expand the capablilties of the class in the future.
@@ -160,8 +199,13 @@ private :
 	UInt16 						fIsoRxOverrun;
 	UInt16 						fIsoRxCallbacks;
     IORecursiveLock				*rxCommandLock;
-	OSSet						*fAsyncStreamClients;
-	OSIterator					*fAsyncStreamClientIterator;
+	OSArray						*fAsyncStreamClients;
+	
+	UInt64						fPacketCount;
+	UInt64						fByteCount;
+	UInt32						fDropCount;
+	
+	FWAsyncStreamPacketRef		fPacketRefs[kMaxAsyncStreamPacketsInFlight];
 	
 	IOFireWireMultiIsochReceiveListener *fListener;
 	
@@ -188,6 +232,12 @@ private :
 
 	void indicateListeners ( UInt8 *buffer );
 
+	bool indicatePacketListeners( IOFireWireMultiIsochReceivePacket *packet, SInt32 listeners );
+
+	int findPacketSlot( IOFireWireMultiIsochReceivePacket *packet );
+
+	void releasePacketSlot( int slot );
+
     IOReturn modifyDCLJumps( DCLCommandStruct *callProc );
 	
     OSMetaClassDeclareReservedUnused(IOFWAsyncStreamReceiver, 0);
@@ -9,4 +9,408 @@
  *
  */
 
-// Deprecated
\ No newline at end of file
+#import "IOFWBufferFillIsochPort.h"
+#import "IOFireWireController.h"
+#import "IOFireWireMultiIsochReceive.h"
+#import "FWDebugging.h"
+
+#import <IOKit/IOMemoryDescriptor.h>
+#import <libkern/OSAtomic.h>
+
+OSDefineMetaClassAndStructors(IOFWBufferFillIsochPort, IOFWIsochPort)
+
+// withBuffer
+//
+//
+
+IOFWBufferFillIsochPort *
+IOFWBufferFillIsochPort::withBuffer (
+		IOFireWireController *	control,
+		IOMemoryDescriptor *	buffer,
+		UInt32					watermark,
+		UInt32					options,
+		FWBufferFillCallback	callback,
+		void *					refcon )
+{
+	IOFWBufferFillIsochPort * port = OSTypeAlloc( IOFWBufferFillIsochPort );
+
+	if( port && !port->initWithBuffer( control, buffer, watermark, options, callback, refcon ) )
+	{
+		port->release();
+		port = NULL;
+	}
+
+	return port;
+}
+
+// initWithBuffer
+//
+//
+
+bool
+IOFWBufferFillIsochPort::initWithBuffer (
+		IOFireWireController *	control,
+		IOMemoryDescriptor *	buffer,
+		UInt32					watermark,
+		UInt32					options,
+		FWBufferFillCallback	callback,
+		void *					refcon )
+{
+	if ( ! IOFWIsochPort::init() )
+		return false;
+
+	fControl = control;
+	fOptions = options;
+	fCallback = callback;
+	fRefCon = refcon;
+
+	if ( !buffer )
+		return false;
+
+	IOByteCount length = buffer->getLength();
+
+	// room for the control block and at least one maximum size packet record
+	if ( length < sizeof(FWBufferFillControl) + 4096 || length > 0x80000000ULL )
+		return false;
+
+	fBuffer = buffer;
+	fBuffer->retain();
+
+	if ( fBuffer->prepare() != kIOReturnSuccess )
+		return false;
+
+	fBufferPrepared = true;
+
+	fMap = fBuffer->createMappingInTask( kernel_task, 0, kIOMapAnywhere );
+	if ( !fMap )
+		return false;
+
+	// indices are 32 bit and must stay naturally aligned in the mapping
+	if ( (fMap->getVirtualAddress() & (sizeof(UInt32) - 1)) != 0 )
+		return false;
+
+	fShared = (FWBufferFillControl *)fMap->getVirtualAddress();
+
+	// largest power of two that fits after the control block
+	UInt32 available = (UInt32)(length - sizeof(FWBufferFillControl));
+	UInt32 dataSize = 1U << (31 - __builtin_clz( available ));
+
+	fShared->writeIndex = 0;
+	fShared->readIndex = 0;
+	fShared->overrunCount = 0;
+	fShared->dataSize = dataSize;
+	OSMemoryBarrier();
+
+	fData = (UInt8 *)(fShared + 1);
+	fDataMask = dataSize - 1;
+
+	if ( watermark == 0 )
+		watermark = dataSize / 4;
+
+	fWatermark = (watermark > dataSize) ? dataSize : watermark;
+
+	fLock = IOLockAlloc();
+	if ( !fLock )
+		return false;
+
+	return true;
+}
+
+// free
+//
+//
+
+void
+IOFWBufferFillIsochPort::free ( void )
+{
+	if ( fListener )
+	{
+		if ( fStarted )
+			fListener->Deactivate();
+
+		fListener->release();
+		fListener = NULL;
+	}
+
+	fShared = NULL;
+	fData = NULL;
+
+	if ( fMap )
+	{
+		fMap->release();
+		fMap = NULL;
+	}
+
+	if ( fBuffer )
+	{
+		if ( fBufferPrepared )
+			fBuffer->complete();
+
+		fBuffer->release();
+		fBuffer = NULL;
+	}
+
+	if ( fLock )
+	{
+		IOLockFree( fLock );
+		fLock = NULL;
+	}
+
+	IOFWIsochPort::free();
+}
+
+#pragma mark -
+
+// getSupported
+//
+// any channel, any speed
+
+IOReturn
+IOFWBufferFillIsochPort::getSupported ( IOFWSpeed & maxSpeed, UInt64 & chanSupported )
+{
+	maxSpeed = kFWSpeedMaximum;
+	chanSupported = ~(UInt64)0;
+	return kIOReturnSuccess;
+}
+
+// allocatePort
+//
+//
+
+IOReturn
+IOFWBufferFillIsochPort::allocatePort ( IOFWSpeed speed, UInt32 chan )
+{
+	IOReturn status = kIOReturnSuccess;
+
+	IOLockLock( fLock );
+
+	if ( fListener )
+		status = kIOReturnExclusiveAccess;
+
+	if ( status == kIOReturnSuccess )
+	{
+		fListener = fControl->createMultiIsochReceiveListener( chan, &IOFWBufferFillIsochPort::receivePacket, this, NULL );
+		if ( !fListener )
+			status = kIOReturnNoMemory;
+	}
+
+	IOLockUnlock( fLock );
+
+	DebugLogCond( status, "IOFWBufferFillIsochPort<%p>::allocatePort - channel %u failed 0x%08x\n", this, (unsigned)chan, status );
+
+	return status;
+}
+
+// releasePort
+//
+//
+
+IOReturn
+IOFWBufferFillIsochPort::releasePort ( void )
+{
+	stop();
+
+	IOLockLock( fLock );
+
+	if ( fListener )
+	{
+		fListener->release();
+		fListener = NULL;
+	}
+
+	IOLockUnlock( fLock );
+
+	return kIOReturnSuccess;
+}
+
+// start
+//
+//
+
+IOReturn
+IOFWBufferFillIsochPort::start ( void )
+{
+	IOReturn status = kIOReturnSuccess;
+
+	IOLockLock( fLock );
+
+	if ( !fListener )
+		status = kIOReturnNotReady;
+
+	if ( status == kIOReturnSuccess && !fStarted )
+	{
+		status = fListener->Activate();
+		fStarted = (status == kIOReturnSuccess);
+	}
+
+	IOLockUnlock( fLock );
+
+	return status;
+}
+
+// stop
+//
+// hands the client whatever arrived since the last watermark
+
+IOReturn
+IOFWBufferFillIsochPort::stop ( void )
+{
+	bool stopped = false;
+
+	IOLockLock( fLock );
+
+	if ( fStarted )
+	{
+		fListener->Deactivate();
+		fStarted = false;
+		stopped = true;
+	}
+
+	IOLockUnlock( fLock );
+
+	if ( stopped && fWriteIndex != fNotifyIndex )
+		notify( fWriteIndex );
+
+	return kIOReturnSuccess;
+}
+
+#pragma mark -
+
+// receivePacket
+//
+// multi-isoch receive callback
+
+IOReturn
+IOFWBufferFillIsochPort::receivePacket ( void * refcon, IOFireWireMultiIsochReceivePacket * packet )
+{
+	IOFWBufferFillIsochPort * me = (IOFWBufferFillIsochPort *)refcon;
+
+	me->fillPacket( packet );
+	packet->clientDone();
+
+	return kIOReturnSuccess;
+}
+
+// fillPacket
+//
+// the receive path is the only producer
+
+void
+IOFWBufferFillIsochPort::fillPacket ( IOFireWireMultiIsochReceivePacket * packet )
+{
+	bool keepHeader = !(fOptions & kFWBufferFillStripHeader);
+	bool keepTimeStamp = !(fOptions & kFWBufferFillStripTimeStamp);
+
+	UInt32 payloadSize = packet->isochPayloadSize();
+	UInt32 payloadBytes = keepHeader ? ((payloadSize + 3) & ~3) : payloadSize;
+	UInt32 recordSize = payloadBytes + (keepHeader ? 4 : 0) + (keepTimeStamp ? 4 : 0);
+
+	// the header's length must agree with what was actually received
+	UInt32 packetBytes = 0;
+	for ( UInt32 i = 0; i < packet->numRanges; i++ )
+		packetBytes += packet->ranges[i].length;
+
+	if ( payloadBytes + 8 > packetBytes )
+	{
+		DebugLog( "IOFWBufferFillIsochPort<%p>::fillPacket - bad payload size %u\n", this, (unsigned)payloadSize );
+		return;
+	}
+
+	// a read index moved past the write index is treated as a full buffer
+	UInt32 used = fWriteIndex - fShared->readIndex;
+	if ( used > fDataMask + 1 || recordSize > fDataMask + 1 - used )
+	{
+		fOverrunCount++;
+		fShared->overrunCount = fOverrunCount;
+		return;
+	}
+
+	UInt32 writeIndex = fWriteIndex;
+
+	if ( keepHeader )
+	{
+		UInt32 header = OSSwapLittleToHostInt32( *(UInt32 *)packet->ranges[0].address );
+		copyBytes( &header, sizeof(header), &writeIndex );
+	}
+
+	copyPacketBytes( packet, 4, payloadBytes, &writeIndex );
+
+	if ( keepTimeStamp )
+	{
+		UInt32 timeStamp = packet->packetReceiveTime();
+		copyBytes( &timeStamp, sizeof(timeStamp), &writeIndex );
+	}
+
+	// publish the record only once all of it is in place
+	OSMemoryBarrier();
+	fWriteIndex = writeIndex;
+	fShared->writeIndex = writeIndex;
+
+	if ( writeIndex - fNotifyIndex >= fWatermark )
+		notify( writeIndex );
+}
+
+// copyPacketBytes
+//
+// copies 'length' bytes starting 'offset' bytes into the packet's ranges
+
+void
+IOFWBufferFillIsochPort::copyPacketBytes (
+		IOFireWireMultiIsochReceivePacket *		packet,
+		UInt32									offset,
+		UInt32									length,
+		UInt32 *								writeIndex )
+{
+	for ( UInt32 i = 0; i < packet->numRanges && length > 0; i++ )
+	{
+		UInt32 rangeLength = (UInt32)packet->ranges[i].length;
+		if ( offset >= rangeLength )
+		{
+			offset -= rangeLength;
+			continue;
+		}
+
+		UInt32 chunk = rangeLength - offset;
+		if ( chunk > length )
+			chunk = length;
+
+		copyBytes( (const UInt8 *)packet->ranges[i].address + offset, chunk, writeIndex );
+
+		offset = 0;
+		length -= chunk;
+	}
+}
+
+// copyBytes
+//
+// appends to the data area, wrapping at its end
+
+void
+IOFWBufferFillIsochPort::copyBytes ( const void * bytes, UInt32 length, UInt32 * writeIndex )
+{
+	UInt32 position = *writeIndex & fDataMask;
+	UInt32 first = fDataMask + 1 - position;
+
+	if ( first > length )
+		first = length;
+
+	bcopy( bytes, fData + position, first );
+
+	if ( length > first )
+		bcopy( (const UInt8 *)bytes + first, fData, length - first );
+
+	*writeIndex += length;
+}
+
+// notify
+//
+//
+
+void
+IOFWBufferFillIsochPort::notify ( UInt32 writeIndex )
+{
+	fNotifyIndex = writeIndex;
+
+	if ( fCallback )
+		(*fCallback)( fRefCon, this, writeIndex );
+}
@@ -9,4 +9,131 @@
  *
  */
 
-// Deprecated
\ No newline at end of file
+#ifndef _IOKIT_IOFWBUFFERFILLISOCHPORT_H
+#define _IOKIT_IOFWBUFFERFILLISOCHPORT_H
+
+#import <IOKit/firewire/IOFireWireFamilyCommon.h>
+#import <IOKit/firewire/IOFWIsochPort.h>
+#import <IOKit/IOLocks.h>
+
+class IOFireWireController;
+class IOFireWireMultiIsochReceiveListener;
+class IOFireWireMultiIsochReceivePacket;
+class IOMemoryDescriptor;
+class IOMemoryMap;
+class IOFWBufferFillIsochPort;
+
+typedef void (*FWBufferFillCallback)( void * refcon, IOFWBufferFillIsochPort * port, UInt32 writeIndex );
+
+/*! @class IOFWBufferFillIsochPort
+	@abstract A local isochronous listener that fills one large buffer.
+	@discussion Received packets on the port's channel are appended to the
+		data area of the fill buffer as one continuous byte stream, see
+		FWBufferFillControl. There are no per packet callbacks; the callback
+		is called once every 'watermark' bytes and when the port stops.
+		Receiving uses the multi-isoch receiver, so the link must support it.
+*/
+class IOFWBufferFillIsochPort : public IOFWIsochPort
+{
+    OSDeclareDefaultStructors(IOFWBufferFillIsochPort)
+
+	protected:
+
+		IOFireWireController *					fControl;
+		IOMemoryDescriptor *					fBuffer;
+		bool									fBufferPrepared;
+		IOMemoryMap *							fMap;
+		FWBufferFillControl *					fShared;
+		UInt8 *									fData;
+		UInt32									fDataMask;
+
+		UInt32									fWriteIndex;		// private copy, the shared one is only published
+		UInt32									fOverrunCount;
+
+		UInt32									fOptions;
+		UInt32									fWatermark;
+		UInt32									fNotifyIndex;		// writeIndex at the last notification
+		FWBufferFillCallback					fCallback;
+		void *									fRefCon;
+
+		IOFireWireMultiIsochReceiveListener *	fListener;
+		IOLock *								fLock;
+		bool									fStarted;
+
+	protected :
+
+		virtual void 			free ( void ) APPLE_KEXT_OVERRIDE;
+
+	public:
+
+	/*!	@function withBuffer
+		@abstract Creates a buffer-fill port.
+		@param control The controller to receive on.
+		@param buffer The fill buffer, need not be prepared. It is retained and mapped
+			into the kernel. The control block is placed at its start.
+		@param watermark The callback is called each time this many bytes have been
+			written since the last call. Pass 0 for a quarter of the data area.
+		@param options IOFWBufferFillOptions.
+		@param callback Called from the receive path, may be NULL.
+		@param refcon Passed to the callback.
+		@result The port, or NULL.	*/
+		static IOFWBufferFillIsochPort *	withBuffer (
+										IOFireWireController *	control,
+										IOMemoryDescriptor *	buffer,
+										UInt32					watermark,
+										UInt32					options,
+										FWBufferFillCallback	callback,
+										void *					refcon ) ;
+
+		virtual bool 			initWithBuffer (
+										IOFireWireController *	control,
+										IOMemoryDescriptor *	buffer,
+										UInt32					watermark,
+										UInt32					options,
+										FWBufferFillCallback	callback,
+										void *					refcon ) ;
+
+		// Return maximum speed and channels supported
+		// (bit n set = chan n supported)
+		virtual IOReturn 		getSupported (
+										IOFWSpeed &				maxSpeed,
+										UInt64 &				chanSupported ) APPLE_KEXT_OVERRIDE;
+
+		// Allocate hardware resources for port
+		virtual IOReturn 		allocatePort (
+										IOFWSpeed 				speed,
+										UInt32 					chan ) APPLE_KEXT_OVERRIDE;
+		virtual IOReturn 		releasePort ( void ) APPLE_KEXT_OVERRIDE;	// Free hardware resources
+		virtual IOReturn 		start ( void ) APPLE_KEXT_OVERRIDE;		// Start port processing packets
+		virtual IOReturn 		stop ( void ) APPLE_KEXT_OVERRIDE;		// Stop processing packets
+
+	/*!	@function getControl
+		@abstract Returns the kernel mapping of the control block.
+		@result The control block; the data area follows it.	*/
+		inline FWBufferFillControl *	getControl ( void ) const { return fShared; }
+
+	/*!	@function getOverrunCount
+		@abstract Returns the number of packets dropped because the buffer was full.
+		@result The overrun count.	*/
+		inline UInt32			getOverrunCount ( void ) const { return fOverrunCount; }
+
+	protected:
+
+		static IOReturn			receivePacket (
+										void *									refcon,
+										IOFireWireMultiIsochReceivePacket *		packet ) ;
+		void					fillPacket (
+										IOFireWireMultiIsochReceivePacket *		packet ) ;
+		void					copyPacketBytes (
+										IOFireWireMultiIsochReceivePacket *		packet,
+										UInt32									offset,
+										UInt32									length,
+										UInt32 *								writeIndex ) ;
+		void					copyBytes (
+										const void *							bytes,
+										UInt32									length,
+										UInt32 *								writeIndex ) ;
+		void					notify ( UInt32 writeIndex ) ;
+};
+
+#endif /* ! _IOKIT_IOFWBUFFERFILLISOCHPORT_H */
@@ -21,6 +21,10 @@
  */
 
 #import <IOKit/firewire/IOFireWireController.h>
+#import <IOKit/firewire/IOFWUtils.h>
+
+// system
+#import <IOKit/assert.h>
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
@@ -90,3 +94,234 @@ void IOFWCmdQ::headChanged(IOFWCommand *oldHead)
     
 }
 
+#pragma mark -
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+//
+// Deadline ordered queue
+//
+// The timeout queue is a pairing heap threaded through the commands themselves.
+// fQueueNext is the next sibling, fQueuePrev is the previous sibling or, for a first
+// child, the parent, and fMembers->fTimeoutChild is the first child. fHead is the root,
+// so it is always the command with the earliest deadline. Insert is O(1), removal
+// and deadline updates are O(log n) amortized.
+//
+
+// meldByDeadline
+//
+// both commands must be roots (no siblings, no parent)
+
+IOFWCommand * IOFWCmdQ::meldByDeadline( IOFWCommand * a, IOFWCommand * b )
+{
+	if( a == NULL )
+		return b;
+	
+	if( b == NULL )
+		return a;
+	
+	if( CMP_ABSOLUTETIME(&b->fDeadline, &a->fDeadline) == -1 )
+	{
+		IOFWCommand * temp = a;
+		a = b;
+		b = temp;
+	}
+	
+	// b becomes the first child of a
+	IOFWCommand * child = a->IOFWCommand::fMembers->fTimeoutChild;
+	b->fQueuePrev = a;
+	b->fQueueNext = child;
+	if( child )
+		child->fQueuePrev = b;
+	a->IOFWCommand::fMembers->fTimeoutChild = b;
+	
+	return a;
+}
+
+// mergePairsByDeadline
+//
+// standard two pass merge of a sibling list into a single heap
+
+IOFWCommand * IOFWCmdQ::mergePairsByDeadline( IOFWCommand * first )
+{
+	IOFWCommand * pairs = NULL;
+	
+	// first pass, meld siblings pairwise from left to right, stacking the results
+	while( first )
+	{
+		IOFWCommand * a = first;
+		IOFWCommand * b = a->fQueueNext;
+		
+		a->fQueuePrev = NULL;
+		a->fQueueNext = NULL;
+		
+		if( b == NULL )
+		{
+			a->fQueueNext = pairs;
+			pairs = a;
+			break;
+		}
+		
+		first = b->fQueueNext;
+		b->fQueuePrev = NULL;
+		b->fQueueNext = NULL;
+		
+		IOFWCommand * melded = meldByDeadline( a, b );
+		melded->fQueueNext = pairs;
+		pairs = melded;
+	}
+	
+	// second pass, meld the stacked pairs from right to left
+	IOFWCommand * root = pairs;
+	if( root )
+	{
+		pairs = root->fQueueNext;
+		root->fQueueNext = NULL;
+		
+		while( pairs )
+		{
+			IOFWCommand * next = pairs->fQueueNext;
+			pairs->fQueueNext = NULL;
+			root = meldByDeadline( root, pairs );
+			pairs = next;
+		}
+	}
+	
+	return root;
+}
+
+// linkByDeadline
+//
+//
+
+void IOFWCmdQ::linkByDeadline( IOFWCommand * cmd )
+{
+	cmd->fQueue = this;
+	cmd->fQueuePrev = NULL;
+	cmd->fQueueNext = NULL;
+	cmd->IOFWCommand::fMembers->fTimeoutChild = NULL;
+	
+	fHead = meldByDeadline( fHead, cmd );
+	fTail = NULL;
+}
+
+// unlinkByDeadline
+//
+//
+
+void IOFWCmdQ::unlinkByDeadline( IOFWCommand * cmd )
+{
+	IOFWCommand * subtree = mergePairsByDeadline( cmd->IOFWCommand::fMembers->fTimeoutChild );
+	cmd->IOFWCommand::fMembers->fTimeoutChild = NULL;
+	
+	if( cmd == fHead )
+	{
+		fHead = subtree;
+	}
+	else
+	{
+		IOFWCommand * prev = cmd->fQueuePrev;
+		
+		if( prev->IOFWCommand::fMembers->fTimeoutChild == cmd )
+			prev->IOFWCommand::fMembers->fTimeoutChild = cmd->fQueueNext;
+		else
+			prev->fQueueNext = cmd->fQueueNext;
+		
+		if( cmd->fQueueNext )
+			cmd->fQueueNext->fQueuePrev = prev;
+		
+		// everything in the subtree is later than the root, so the root stays put
+		fHead = meldByDeadline( fHead, subtree );
+	}
+	
+	cmd->fQueue = NULL;
+	cmd->fQueuePrev = NULL;
+	cmd->fQueueNext = NULL;
+}
+
+// addByDeadline
+//
+//
+
+void IOFWCmdQ::addByDeadline( IOFWCommand * cmd )
+{
+	IOFWCommand * oldHead = fHead;
+	
+	assert( cmd->fQueue == NULL );
+	
+	linkByDeadline( cmd );
+	
+	if( fHead != oldHead )
+		headChanged( oldHead );
+}
+
+// removeByDeadline
+//
+//
+
+void IOFWCmdQ::removeByDeadline( IOFWCommand * cmd )
+{
+	IOFWCommand * oldHead = fHead;
+	
+	unlinkByDeadline( cmd );
+	
+	if( oldHead == cmd )
+		headChanged( cmd );
+}
+
+// updateDeadline
+//
+// reposition a queued command after its deadline has changed.
+// the queue is only told if the earliest deadline actually moved.
+
+void IOFWCmdQ::updateDeadline( IOFWCommand * cmd )
+{
+	IOFWCommand * oldHead = fHead;
+	
+	unlinkByDeadline( cmd );
+	linkByDeadline( cmd );
+	
+	if( oldHead == cmd || fHead != oldHead )
+		headChanged( oldHead );
+}
+
+// containsByDeadline
+//
+//
+
+bool IOFWCmdQ::containsByDeadline( IOFWCommand * cmd ) const
+{
+	return (cmd->fQueue == this);
+}
+
+// nextByDeadlineWalk
+//
+// preorder walk of every command on the heap, not in deadline order.
+// the heap must not be modified while walking it.
+
+IOFWCommand * IOFWCmdQ::nextByDeadlineWalk( IOFWCommand * cmd ) const
+{
+	if( cmd == NULL )
+		return fHead;
+	
+	if( cmd->IOFWCommand::fMembers->fTimeoutChild )
+		return cmd->IOFWCommand::fMembers->fTimeoutChild;
+	
+	while( cmd )
+	{
+		if( cmd->fQueueNext )
+			return cmd->fQueueNext;
+		
+		// climb to our parent, which is whoever points at the first sibling as its child
+		IOFWCommand * prev = cmd->fQueuePrev;
+		while( prev && prev->IOFWCommand::fMembers->fTimeoutChild != cmd )
+		{
+			cmd = prev;
+			prev = prev->fQueuePrev;
+		}
+		
+		cmd = prev;
+	}
+	
+	return NULL;
+}
+
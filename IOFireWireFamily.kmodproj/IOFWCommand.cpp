@@ -62,10 +62,24 @@ bool IOFWCommand::initWithController(IOFireWireController *control)
 	
 	success = IOCommand::init();
 	
+	IOFWCommandPool * pool = NULL;
+	
 	if( success )
 	{
 		fControl = control;
-		fMembers = (IOFWCommand::MemberVariables*)IOMalloc( sizeof(MemberVariables) );
+		
+		// hold the pool for as long as we hold memory from it
+		pool = fControl->getCommandPool();
+		if( pool != NULL )
+		{
+			pool->retain();
+			fMembers = (IOFWCommand::MemberVariables*)pool->allocMemory( sizeof(MemberVariables) );
+		}
+		else
+		{
+			fMembers = (IOFWCommand::MemberVariables*)IOMalloc( sizeof(MemberVariables) );
+		}
+		
 		if( fMembers == NULL )
 			success = false;
 	}
@@ -76,6 +90,11 @@ bool IOFWCommand::initWithController(IOFireWireController *control)
 	{
 		bzero( fMembers, sizeof(MemberVariables) );
 		fMembers->fFlush = true;
+		fMembers->fCommandPool = pool;
+	}
+	else if( pool != NULL )
+	{
+		pool->release();
 	}
 	
 	return success;
@@ -91,13 +110,51 @@ void IOFWCommand::free()
 	{		
 		// free member variables
 		
-		IOFree( fMembers, sizeof(MemberVariables) );
+		IOFWCommandPool * pool = fMembers->fCommandPool;
+		
+		if( pool != NULL )
+		{
+			pool->freeMemory( fMembers, sizeof(MemberVariables) );
+			pool->release();
+		}
+		else
+		{
+			IOFree( fMembers, sizeof(MemberVariables) );
+		}
+		
 		fMembers = NULL;
 	}
 	
 	IOCommand::free();
 }
 
+// allocCommandMemory
+//
+// pool blocks are plain IOMalloc blocks, so either path can be undone by freeCommandMemory
+
+void * IOFWCommand::allocCommandMemory( vm_size_t size )
+{
+	if( fMembers != NULL && fMembers->fCommandPool != NULL )
+		return fMembers->fCommandPool->allocMemory( size );
+	
+	return IOMalloc( size );
+}
+
+// freeCommandMemory
+//
+//
+
+void IOFWCommand::freeCommandMemory( void * block, vm_size_t size )
+{
+	if( block == NULL )
+		return;
+	
+	if( fMembers != NULL && fMembers->fCommandPool != NULL )
+		fMembers->fCommandPool->freeMemory( block, size );
+	else
+		IOFree( block, size );
+}
+
 // submit
 //
 //
@@ -115,7 +172,7 @@ IOReturn IOFWCommand::submit(bool queue)
     }
     
     if(fSync) {
-        fSyncWakeup = IOFWSyncer::create();
+        fSyncWakeup = fMembers->fCommandPool ? fMembers->fCommandPool->allocSyncer() : IOFWSyncer::create();
         if(!fSyncWakeup)
             return kIOReturnNoMemory;
     }
@@ -127,7 +184,13 @@ IOReturn IOFWCommand::submit(bool queue)
 	
 	fControl->closeGate();
 	IOFWCommand::fMembers->fSubmitTimeLatched = false;
-    if( queue ) 
+	if( fSync && fControl->inSubmitBatch() )
+	{
+		// the batch holds the gate, waiting here would deadlock the work loop
+		IOLog( "IOFWCommand::submit - synchronous %s submitted inside a batch\n", getMetaClass()->getClassName() );
+		res = complete( kIOReturnNotPermitted );
+	}
+    else if( queue ) 
 	{
         IOFWCmdQ &pendingQ = fControl->getPendingQ();
         IOFWCommand *prev = pendingQ.fTail;
@@ -153,10 +216,16 @@ IOReturn IOFWCommand::submit(bool queue)
 	{
 		if(res == kIOReturnSuccess)
 		{
-			res = fSyncWakeup->wait();
+			res = fSyncWakeup->wait( false );
 #if 0
 			if (res) IOLog("%s %u: fSyncWakeup->wait returned %x\n", __FILE__, __LINE__, res) ;
 #endif
+			// hand our reference back to the pool for the next sync submit
+			if( fMembers->fCommandPool != NULL )
+				fMembers->fCommandPool->recycleSyncer( fSyncWakeup );
+			else
+				fSyncWakeup->release();
+			fSyncWakeup = NULL;
 		}
 		else
 		{
@@ -171,7 +240,7 @@ IOReturn IOFWCommand::submit(bool queue)
 	{
 		fControl->closeGate();
 
-		fControl->fFWIM->flushWaitingPackets();
+		fControl->flushSubmittedPackets();
 		
 		fControl->openGate();
 	}
@@ -298,6 +367,13 @@ void IOFWCommand::insertAfter( IOFWCommand &prev )
 
 void IOFWCommand::removeFromQ()
 {
+	// the timeout queue is ordered by deadline and keeps its own links
+	if(fQueue && fQueue == &fControl->getTimeoutQ())
+	{
+		fQueue->removeByDeadline(this);
+		return;
+	}
+	
     // Remove from queue
     if(fQueue) 
 	{
@@ -349,8 +425,19 @@ void IOFWCommand::updateTimer()
         clock_interval_to_absolutetime_interval(fTimeout, kMicrosecondScale, &delta);
         IOFWGetAbsoluteTime(&fDeadline);
         ADD_ABSOLUTETIME(&fDeadline, &delta);
-        if(fQueue) 
+        
+		IOFWCmdQ &timeoutQ = fControl->getTimeoutQ();
+		
+		if(fQueue == &timeoutQ) 
 		{
+			// reposition on the timeout queue for the new deadline, the queue's
+			// headChanged is only called if the earliest deadline moved
+			timeoutQ.updateDeadline(this);
+        }
+        else if(fQueue) 
+		{
+			// on some other queue, which is a plain list. keep it sorted by
+			// deadline the way the timeout queue used to be.
             IOFWCommand *oldHead = fQueue->fHead;
             IOFWCommand *next;
     
@@ -412,44 +499,7 @@ void IOFWCommand::updateTimer()
         else 
 		{
             // Not already on timeout queue
-            IOFWCommand *prev;
-            IOFWCmdQ &timeoutQ = fControl->getTimeoutQ();
-            // add cmd to right place in list, which is sorted by deadline
-            prev = timeoutQ.fTail;
-            while(prev) 
-			{
-                if(CMP_ABSOLUTETIME(&prev->getDeadline(), &fDeadline) != 1)
-                    break; // prev command's deadline is before new one, so insert here.
-                prev = prev->getPrevious();
-            }
-    
-            if(!prev) 
-			{
-                setHead(timeoutQ);
-            }
-            else 
-			{
-                insertAfter(*prev);
-                /** DUMP Q **/
-#if 0
-                {
-                    AbsoluteTime now, dead;
-                    IOFWGetAbsoluteTime(&now);
-                    IOLog("%s: insertAfter %s, time is %llx\n",
-                        getMetaClass()->getClassName(), prev->getMetaClass()->getClassName(), AbsoluteTime_to_scalar(&now) );
-                    {
-                        IOFWCommand *t = timeoutQ.fHead;
-                        while(t) 
-						{
-                            AbsoluteTime d = t->getDeadline();
-                            IOLog("%s:%p deadline %llx\n",
-                                t->getMetaClass()->getClassName(), t, AbsoluteTime_to_scalar(&d) );
-                            t = t->getNext();
-                        }
-                    }
-                }
-#endif
-            }
+			timeoutQ.addByDeadline(this);
         }
     }
 }
@@ -50,6 +50,7 @@ class IOFWBusCommand;
 class IOFWAsyncStreamCommand;
 class IOCommandGate;
 class IOFWAsyncPHYCommand;
+class IOFWCommandPool;
 
 struct AsyncPendingTrans;
 
@@ -61,6 +62,9 @@ struct AsyncPendingTrans;
     @field fTail Points to the tail of the queue, or NULL if queue is empty
     @function headChanged called when head command is changed, or the command
  	itself changes state.
+    @discussion Queues ordered by deadline (the controller's timeout queue) are kept as
+	a pairing heap rather than a list. fHead is still the command with the earliest
+	deadline, but getNext() no longer walks the queue in order and fTail is unused.
 */
 
 struct IOFWCmdQ
@@ -73,6 +77,19 @@ struct IOFWCmdQ
 	virtual ~IOFWCmdQ() {}
 
 	void checkProgress( void );
+
+	// deadline ordered (pairing heap) queue operations
+	void addByDeadline( IOFWCommand * cmd );
+	void removeByDeadline( IOFWCommand * cmd );
+	void updateDeadline( IOFWCommand * cmd );
+	bool containsByDeadline( IOFWCommand * cmd ) const;
+	IOFWCommand * nextByDeadlineWalk( IOFWCommand * cmd ) const;
+
+protected:
+	void linkByDeadline( IOFWCommand * cmd );
+	void unlinkByDeadline( IOFWCommand * cmd );
+	static IOFWCommand * meldByDeadline( IOFWCommand * a, IOFWCommand * b );
+	static IOFWCommand * mergePairsByDeadline( IOFWCommand * first );
 };
 
 // Callback when device command completes asynchronously
@@ -124,6 +141,8 @@ protected:
 		bool			fSubmitTimeLatched;
 	    AbsoluteTime	fSubmitTime;
 		bool			fFlush;
+		IOFWCommand *	fTimeoutChild;		// first child while on the timeout queue's heap
+		IOFWCommandPool *	fCommandPool;	// retained, MemberVariables and syncers come from here
 	};
 
 /*! @var reserved
@@ -140,6 +159,10 @@ protected:
      */
     virtual IOReturn	execute() = 0;
 
+	// subclass MemberVariables, recycled through the command pool this command holds
+	void *			allocCommandMemory( vm_size_t size );
+	void			freeCommandMemory( void * block, vm_size_t size );
+
 public:
 
     virtual bool	initWithController(IOFireWireController *control);
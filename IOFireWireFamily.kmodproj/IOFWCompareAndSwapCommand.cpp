@@ -163,7 +163,7 @@ bool IOFWCompareAndSwapCommand::createMemberVariables( void )
 		
 		if( success )
 		{
-			fMembers = (MemberVariables*)IOMalloc( sizeof(MemberVariables) );
+			fMembers = (MemberVariables*)allocCommandMemory( sizeof(MemberVariables) );
 			if( fMembers == NULL )
 				success = false;
 		}
@@ -194,7 +194,7 @@ void IOFWCompareAndSwapCommand::destroyMemberVariables( void )
 {
 	if( fMembers != NULL )
 	{
-		IOFree( fMembers, sizeof(MemberVariables) );
+		freeCommandMemory( fMembers, sizeof(MemberVariables) );
 		fMembers = NULL;
 	}
 }
@@ -378,6 +378,12 @@ IOFWDCL::importUserDCL (
 
 	IOReturn error = kIOReturnSuccess ;
 
+	// don't let a bad range count size the stack array below
+	if ( sharedData->rangeCount > sizeof( sharedData->ranges ) / sizeof( sharedData->ranges[ 0 ] ) )
+	{
+		return kIOReturnBadArgument ;
+	}
+
 	{
 		IOVirtualRange kernRanges[ sharedData->rangeCount ] ;
 		for( unsigned index=0; index < sharedData->rangeCount; ++index )
@@ -413,7 +419,14 @@ IOFWDCL::importUserDCL (
 				updateSet->setObject( dcls->getObject( userUpdateList[ index ] - 1 ) ) ;
 			}
 
-			setUpdateList( updateSet ) ;
+			// modifying a DCL usually leaves its update list alone, keep the one we
+			// have if it holds the same DCLs. the user's list can repeat entries, so
+			// compare the sets rather than the list
+			if ( !fUpdateList || !fUpdateList->isEqualTo( updateSet ) )
+			{
+				setUpdateList( updateSet ) ;
+			}
+			
 			updateSet->release() ;
 		}
 	}
@@ -940,8 +940,14 @@ struct ChannelThreadInfo
 
 void IOFWIsochChannel::handleBusReset()
 {
+	// the controller's reallocation pass restores us along with everyone else
+	if( fControl->joinIRMRealloc( this, fControl->getGeneration() ) )
+	{
+		return;
+	}
+	
 	//
-	// setup thread info and spawn a thread
+	// no pass to join, setup thread info and spawn a thread
 	//
 	
 	ChannelThreadInfo * threadInfo = (ChannelThreadInfo *)IOMalloc( sizeof(ChannelThreadInfo) );
@@ -987,6 +993,50 @@ void IOFWIsochChannel::threadFunc( void * arg )
     channel->release();		// retain occurred in handleBusReset
 }
 
+// beginRealloc
+//
+// cannot be called on the workloop
+
+bool IOFWIsochChannel::beginRealloc( UInt32 generation, UInt32 * channel, UInt32 * bandwidth )
+{
+	IOLockLock( fLock );
+	
+	// check to make sure we don't allocate twice on a generation
+	if( fGeneration == generation )
+	{
+		IOLockUnlock( fLock );
+		return false;
+	}
+	
+	*channel = fChannel;
+	*bandwidth = fBandwidth;
+	
+	return true;
+}
+
+// endRealloc
+//
+// cannot be called on the workloop
+
+void IOFWIsochChannel::endRealloc( UInt32 generation, bool reallocated )
+{
+	if( reallocated )
+	{
+		InfoLog( "IOFWIsochChannel<%p>::endRealloc() - reallocated bandwidth = %ld, channel = %ld\n", this, fBandwidth, fChannel );
+		
+		fGeneration = generation;
+		
+		FWTrace( kFWTIsoch, kTPIsochReallocBandwidth, (uintptr_t)(fControl->getLink()), fChannel, fBandwidth, kIOReturnSuccess );
+	}
+	
+	IOLockUnlock( fLock );
+	
+	if( !reallocated )
+	{
+		reallocBandwidth( generation );
+	}
+}
+
 // reallocBandwidth
 //
 // cannot be called on the workloop
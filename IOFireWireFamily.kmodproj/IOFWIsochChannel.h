@@ -95,8 +95,16 @@ public:
     virtual bool 				init( IOFireWireController *control, bool doIRM, UInt32 packetSize, 
 										IOFWSpeed prefSpeed, ForceStopNotificationProc* stopProc,
 										void *stopRefCon );
+    // joins the controller's reallocation pass, or reallocates on its own thread
     virtual void 				handleBusReset();
 
+	// Called from IOFireWireController's reallocation pass after a bus reset.
+	// beginRealloc returns the channel (64 for none) and bandwidth to restore
+	// with the channel locked; endRealloc unlocks it, and if the pass could not
+	// restore the resources, reallocates them the old way.
+	bool						beginRealloc( UInt32 generation, UInt32 * channel, UInt32 * bandwidth );
+	void						endRealloc( UInt32 generation, bool reallocated );
+
     // Called by clients
     virtual IOReturn 			setTalker(IOFWIsochPort *talker);
     virtual IOReturn 			addListener(IOFWIsochPort *listener);
@@ -311,8 +311,7 @@ UInt32 IOFWPhysicalAddressSpace::doRead(UInt16 nodeID, IOFWSpeed &speed, FWAddre
 					IOMemoryDescriptor **buf, IOByteCount * offset, IOFWRequestRefCon refcon)
 {
     UInt32 res = kFWResponseAddressError;
-    UInt64 pos;
-    UInt64 phys;
+	UInt64 pos;
 	
 	if( !isTrustedNode( nodeID ) )
 		return kFWResponseAddressError;
@@ -321,69 +320,15 @@ UInt32 IOFWPhysicalAddressSpace::doRead(UInt16 nodeID, IOFWSpeed &speed, FWAddre
 		return kFWResponseAddressError;
 		
 	UInt64 address = ((UInt64)addr.addressHi << 32) | (UInt64)addr.addressLo;	
-	UInt64 desc_length = getLength();
 	
-    pos = 0;
-    while( pos < desc_length ) 
+	if( findRange( address, len, &pos ) )
 	{
-		bool found = false;
-		UInt64 lengthOfSegment;
-        phys = getPhysicalSegment( pos, &lengthOfSegment );
-		
-		if( (address >= phys) && (address < (phys+lengthOfSegment)) )
-		{
-			UInt32 union_length = (lengthOfSegment - (address - phys));
-			
-			// check if the request extends beyond this physical segment
-			if( len <= union_length )
-			{
-				found = true;
-			}
-			else
-			{
-				// look ahead for contiguous ranges
-				
-				UInt64 contiguous_address = (phys + lengthOfSegment);
-				UInt64 contiguous_pos = (pos + lengthOfSegment);
-				UInt64 contiguous_length = len - union_length;
-				UInt64 contig_phys;
-				
-				while( contiguous_pos < desc_length )
-				{
-					contig_phys = getPhysicalSegment( contiguous_pos, &lengthOfSegment );
-					if( contiguous_address != contig_phys )
-					{	
-						// not contiguous, bail
-						break;
-					}
-					
-					if( contiguous_length <= lengthOfSegment )
-					{
-						// fits in this segment - success
-						found = true;
-						break;
-					}
-
-					contiguous_length -= lengthOfSegment;
-					contiguous_pos += lengthOfSegment;
-					contiguous_address += lengthOfSegment;
-				}
-				
-			}
-		}
-
-		if( found )
-		{
-            // OK, block is in space
-			// Set position to exact start
-			*offset = (pos + address - phys);
-            *buf = getMemoryDescriptor();
-            res = kFWResponseComplete;
-            break;
-        }
-		
-        pos += lengthOfSegment;
-    }
+		// OK, block is in space
+		// Set position to exact start
+		*offset = pos;
+		*buf = getMemoryDescriptor();
+		res = kFWResponseComplete;
+	}
 
     return res;
 }
@@ -397,7 +342,6 @@ UInt32 IOFWPhysicalAddressSpace::doWrite(UInt16 nodeID, IOFWSpeed &speed, FWAddr
 {
     UInt32 res = kFWResponseAddressError;
     UInt64 pos;
-    UInt64 phys;
 
 //	IOLog( "IOFWPhysicalAddressSpace::doWrite\n" );
 	
@@ -411,75 +355,18 @@ UInt32 IOFWPhysicalAddressSpace::doWrite(UInt16 nodeID, IOFWSpeed &speed, FWAddr
 
 	UInt64 address = ((UInt64)addr.addressHi << 32) | (UInt64)addr.addressLo;
 
-	UInt64 desc_length = getLength();
-
-    pos = 0;
-    while(pos < desc_length) 
+	if( findRange( address, len, &pos ) )
 	{
-		bool found = false;
-		UInt64 lengthOfSegment;
-        phys = getPhysicalSegment(pos, &lengthOfSegment);
+		// OK, block is in space
 
-//		IOLog( "IOFWPhysicalAddressSpace::doWrite - address = 0x%016llx phys = 0x%016llx\n", address, phys );
-		
-		if( (address >= phys) && (address < (phys+lengthOfSegment)) )
-		{
-			UInt32 union_length = (lengthOfSegment - (address - phys));
+		getMemoryDescriptor()->writeBytes( pos, buf, len);
+		getDMACommand()->writeBytes( pos, buf, len );
 			
-			// check if the request extends beyond this physical segment
-			if( len <= union_length )
-			{
-				found = true;
-			}
-			else
-			{
-				// look ahead for contiguous ranges
-				
-				UInt64 contiguous_address = (phys + lengthOfSegment);
-				UInt64 contiguous_pos = (pos + lengthOfSegment);
-				UInt64 contiguous_length = len - union_length;
-				UInt64 contig_phys;
-				
-				while( contiguous_pos < desc_length )
-				{
-					contig_phys = getPhysicalSegment( contiguous_pos, &lengthOfSegment );
-					if( contiguous_address != contig_phys )
-					{	
-						// not contiguous, bail
-						break;
-					}
-					
-					if( contiguous_length <= lengthOfSegment )
-					{
-						// fits in this segment - success
-						found = true;
-						break;
-					}
+		// make sure any bounce buffers have the new data
+	//	synchronize( kIODirectionOut );
 
-					contiguous_length -= lengthOfSegment;
-					contiguous_pos += lengthOfSegment;
-					contiguous_address += lengthOfSegment;
-				}
-				
-			}
-		}
-
-		if( found )
-		{
-            // OK, block is in space
-
-			getMemoryDescriptor()->writeBytes( pos + (address - phys), buf, len);
-			getDMACommand()->writeBytes( pos + (address - phys), buf, len );
-				
-			// make sure any bounce buffers have the new data
-		//	synchronize( kIODirectionOut );
-
-			res = kFWResponseComplete;
-            break;
-        }
-		
-        pos += lengthOfSegment;
-    }
+		res = kFWResponseComplete;
+	}
 
     return res;
 }
@@ -576,6 +463,10 @@ bool IOFWPhysicalAddressSpaceAux::init( IOFWAddressSpace * primary )
 	if( success )
 	{
 		fDMACommand = NULL;
+		fSegmentTable = NULL;
+		fSegmentCount = 0;
+		fSegmentTableSize = 0;
+		fSegmentsOverlap = false;
 	}
 	
 	if( !success )
@@ -598,6 +489,8 @@ void IOFWPhysicalAddressSpaceAux::free()
 		complete();
 	}
 
+	destroySegmentTable();
+	
 	if( fDMACommand )
 	{
 		fDMACommand->clearMemoryDescriptor();
@@ -703,6 +596,9 @@ IOReturn IOFWPhysicalAddressSpaceAux::prepare( void )
 		if( status == kIOReturnSuccess )
 		{
 			fDMACommandPrepared = true;
+			
+			// without a table we fall back to walking the segments
+			buildSegmentTable();
 		}
 	}
 	
@@ -726,6 +622,9 @@ IOReturn IOFWPhysicalAddressSpaceAux::complete( void )
 	
 	if( status == kIOReturnSuccess )
 	{
+		// the segments are only good while the command is prepared
+		destroySegmentTable();
+		
 		status = fDMACommand->complete();
 		if( status == kIOReturnSuccess )
 		{
@@ -808,3 +707,322 @@ IOReturn IOFWPhysicalAddressSpaceAux::getSegments( UInt64 * offset, FWSegment *
 	
 	return status;
 }
+
+// findRange
+//
+// find the descriptor offset backing [address, address + len), if the whole
+// range is in this space and physically contiguous
+
+bool IOFWPhysicalAddressSpaceAux::findRange( UInt64 address, UInt32 len, UInt64 * offset )
+{
+	if( fSegmentTable == NULL || fSegmentsOverlap )
+	{
+		return findRangeLinear( address, len, offset );
+	}
+	
+	// binary search for the last segment starting at or below address
+	
+	UInt32 low = 0;
+	UInt32 high = fSegmentCount;
+	while( low < high )
+	{
+		UInt32 middle = low + ((high - low) / 2);
+		if( fSegmentTable[middle].fPhysical <= address )
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	
+	if( low == 0 )
+	{
+		// below the lowest segment
+		return false;
+	}
+	
+	PhysicalSegment * segment = &fSegmentTable[low - 1];
+	UInt64 delta = address - segment->fPhysical;
+	
+	// adjacent runs were merged when the table was built, so the
+	// request has to fit in this one segment
+	if( delta >= segment->fLength || len > (segment->fLength - delta) )
+	{
+		return false;
+	}
+	
+	*offset = segment->fOffset + delta;
+	
+	return true;
+}
+
+// findRangeLinear
+//
+// walk the segments from the start of the descriptor
+
+bool IOFWPhysicalAddressSpaceAux::findRangeLinear( UInt64 address, UInt32 len, UInt64 * offset )
+{
+	bool found = false;
+	UInt64 pos;
+	UInt64 phys;
+	
+	UInt64 desc_length = ((IOFWPhysicalAddressSpace*)fPrimary)->getLength();
+	
+    pos = 0;
+    while( pos < desc_length ) 
+	{
+		UInt64 lengthOfSegment;
+        phys = getPhysicalSegment( pos, &lengthOfSegment );
+		
+		if( (address >= phys) && (address < (phys+lengthOfSegment)) )
+		{
+			UInt32 union_length = (lengthOfSegment - (address - phys));
+			
+			// check if the request extends beyond this physical segment
+			if( len <= union_length )
+			{
+				found = true;
+			}
+			else
+			{
+				// look ahead for contiguous ranges
+				
+				UInt64 contiguous_address = (phys + lengthOfSegment);
+				UInt64 contiguous_pos = (pos + lengthOfSegment);
+				UInt64 contiguous_length = len - union_length;
+				UInt64 contig_phys;
+				
+				while( contiguous_pos < desc_length )
+				{
+					contig_phys = getPhysicalSegment( contiguous_pos, &lengthOfSegment );
+					if( contiguous_address != contig_phys )
+					{	
+						// not contiguous, bail
+						break;
+					}
+					
+					if( contiguous_length <= lengthOfSegment )
+					{
+						// fits in this segment - success
+						found = true;
+						break;
+					}
+
+					contiguous_length -= lengthOfSegment;
+					contiguous_pos += lengthOfSegment;
+					contiguous_address += lengthOfSegment;
+				}
+				
+			}
+		}
+
+		if( found )
+		{
+			*offset = (pos + address - phys);
+			break;
+		}
+		
+        pos += lengthOfSegment;
+    }
+
+	return found;
+}
+
+// buildSegmentTable
+//
+// coalesce the prepared memory into physically contiguous runs and
+// sort them by physical address so requests can be checked in O(log n)
+
+IOReturn IOFWPhysicalAddressSpaceAux::buildSegmentTable( void )
+{
+	IOReturn status = kIOReturnSuccess;
+	IODMACommand::Segment64 segments[16];
+	PhysicalSegment * table = NULL;
+	UInt32 table_size = 0;
+	UInt32 count = 0;
+	bool overlap = false;
+	UInt32 pass;
+	
+	destroySegmentTable();
+	
+	UInt64 desc_length = ((IOFWPhysicalAddressSpace*)fPrimary)->getLength();
+	
+	// pass 0 sizes the table, pass 1 fills it in
+	
+	for( pass = 0; status == kIOReturnSuccess && pass < 2; pass++ )
+	{
+		UInt64 pos = 0;
+		UInt64 last_end = 0;
+		
+		count = 0;
+		while( status == kIOReturnSuccess && pos < desc_length )
+		{
+			UInt64 start = pos;
+			UInt32 num_segments = sizeof(segments) / sizeof(segments[0]);
+			
+			status = fDMACommand->gen64IOVMSegments( &pos, segments, &num_segments );
+			if( status == kIOReturnSuccess && num_segments == 0 )
+			{
+				status = kIOReturnNoMemory;
+			}
+			
+			for( UInt32 i = 0; status == kIOReturnSuccess && i < num_segments; i++ )
+			{
+				if( count > 0 && last_end == segments[i].fIOVMAddr )
+				{
+					// physically contiguous with the previous run
+					if( table )
+					{
+						table[count - 1].fLength += segments[i].fLength;
+					}
+				}
+				else if( table == NULL )
+				{
+					count++;
+				}
+				else if( count < table_size )
+				{
+					table[count].fPhysical = segments[i].fIOVMAddr;
+					table[count].fOffset = start;
+					table[count].fLength = segments[i].fLength;
+					count++;
+				}
+				else
+				{
+					// descriptor changed under us
+					status = kIOReturnNoMemory;
+				}
+				
+				last_end = segments[i].fIOVMAddr + segments[i].fLength;
+				start += segments[i].fLength;
+			}
+		}
+		
+		if( status == kIOReturnSuccess && pass == 0 )
+		{
+			table_size = count;
+			if( table_size == 0 )
+			{
+				status = kIOReturnNoResources;
+			}
+		}
+		
+		if( status == kIOReturnSuccess && pass == 0 )
+		{
+			table = (PhysicalSegment*)IOMalloc( table_size * sizeof(PhysicalSegment) );
+			if( table == NULL )
+				status = kIOReturnNoMemory;
+		}
+	}
+	
+	if( status == kIOReturnSuccess )
+	{
+		// usually already in order
+		
+		for( UInt32 i = 1; i < count; i++ )
+		{
+			if( table[i-1].fPhysical > table[i].fPhysical )
+			{
+				sortSegments( table, count );
+				break;
+			}
+		}
+		
+		for( UInt32 i = 1; i < count; i++ )
+		{
+			if( (table[i-1].fPhysical + table[i-1].fLength) > table[i].fPhysical )
+			{
+				// aliased pages, let the linear walk pick the lowest offset like it always has
+				overlap = true;
+				break;
+			}
+		}
+	}
+	
+	if( status == kIOReturnSuccess )
+	{
+		fSegmentCount = count;
+		fSegmentTableSize = table_size;
+		fSegmentsOverlap = overlap;
+		fSegmentTable = table;
+	}
+	else if( table )
+	{
+		IOFree( table, table_size * sizeof(PhysicalSegment) );
+		table = NULL;
+	}
+	
+	DebugLogCond( status != kIOReturnSuccess, "IOFWPhysicalAddressSpaceAux<%p>::buildSegmentTable - status = 0x%08lx\n", this, (long)status );
+	
+	return status;
+}
+
+// sortSegments
+//
+// heapsort by physical address
+
+void IOFWPhysicalAddressSpaceAux::sortSegments( PhysicalSegment * table, UInt32 count )
+{
+	UInt32 start = count / 2;
+	UInt32 end = count;
+	
+	while( end > 1 )
+	{
+		if( start > 0 )
+		{
+			// build the heap
+			start--;
+		}
+		else
+		{
+			// move the largest to the end
+			end--;
+			PhysicalSegment temp = table[end];
+			table[end] = table[0];
+			table[0] = temp;
+		}
+		
+		// sift down
+		UInt32 root = start;
+		while( (root * 2) + 1 < end )
+		{
+			UInt32 child = (root * 2) + 1;
+			if( (child + 1) < end && table[child].fPhysical < table[child + 1].fPhysical )
+			{
+				child++;
+			}
+			
+			if( table[root].fPhysical >= table[child].fPhysical )
+			{
+				break;
+			}
+			
+			PhysicalSegment temp = table[root];
+			table[root] = table[child];
+			table[child] = temp;
+			root = child;
+		}
+	}
+}
+
+// destroySegmentTable
+//
+//
+
+void IOFWPhysicalAddressSpaceAux::destroySegmentTable( void )
+{
+	PhysicalSegment * table = fSegmentTable;
+	
+	fSegmentTable = NULL;
+	fSegmentCount = 0;
+	fSegmentsOverlap = false;
+	
+	if( table )
+	{
+		IOFree( table, fSegmentTableSize * sizeof(PhysicalSegment) );
+	}
+	
+	fSegmentTableSize = 0;
+}
@@ -74,6 +74,24 @@ protected:
 	IODMACommand *	fDMACommand;
 	bool			fDMACommandPrepared;
 	
+	// physically contiguous runs of the prepared memory, sorted by physical address
+	struct PhysicalSegment
+	{
+		UInt64		fPhysical;
+		UInt64		fOffset;
+		UInt64		fLength;
+	};
+	
+	PhysicalSegment *	fSegmentTable;
+	UInt32				fSegmentCount;
+	UInt32				fSegmentTableSize;
+	bool				fSegmentsOverlap;
+	
+	IOReturn buildSegmentTable( void );
+	void destroySegmentTable( void );
+	static void sortSegments( PhysicalSegment * table, UInt32 count );
+	bool findRangeLinear( UInt64 address, UInt32 len, UInt64 * offset );
+	
 public:
     virtual bool init( IOFWAddressSpace * primary );
 	virtual	void free();
@@ -90,6 +108,8 @@ public:
 
 	IOReturn getSegments( UInt64 * offset, FWSegment * fw_segments, UInt32 * num_segments );
 	
+	bool findRange( UInt64 address, UInt32 len, UInt64 * offset );
+	
 private:
     OSMetaClassDeclareReservedUnused(IOFWPhysicalAddressSpaceAux, 0);
     OSMetaClassDeclareReservedUnused(IOFWPhysicalAddressSpaceAux, 1);
@@ -255,6 +275,9 @@ protected:
 
 	UInt64 getPhysicalSegment( UInt64 offset, UInt64 * length )
 		{ return ((IOFWPhysicalAddressSpaceAux*)fIOFWAddressSpaceExpansion->fAuxiliary)->getPhysicalSegment( offset, length); };
+
+	bool findRange( UInt64 address, UInt32 len, UInt64 * offset )
+		{ return ((IOFWPhysicalAddressSpaceAux*)fIOFWAddressSpaceExpansion->fAuxiliary)->findRange( address, len, offset ); };
 			
 	virtual IOFWAddressSpaceAux * createAuxiliary( void );
     	
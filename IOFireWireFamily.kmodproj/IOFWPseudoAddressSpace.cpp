@@ -175,6 +175,23 @@ bool IOFWPseudoAddressSpaceAux::intersects( IOFWAddressSpace * space )
 	return intersects;
 }
 
+// getAddressRange
+//
+// pseudo spaces only ever respond to [fBase, fBase + fLen)
+
+bool IOFWPseudoAddressSpaceAux::getAddressRange( FWAddress * base, UInt32 * length )
+{
+	IOFWPseudoAddressSpace * pseudo_space = (IOFWPseudoAddressSpace*)fPrimary;
+	
+	if( pseudo_space->fLen == 0 )
+		return false;
+	
+	*base = pseudo_space->fBase;
+	*length = pseudo_space->fLen;
+	
+	return true;
+}
+
 #pragma mark -
 	
 /*
@@ -95,6 +95,8 @@ public:
 	virtual void setARxReqIntCompleteHandler( void * refcon, IOFWARxReqIntCompleteHandler handler );
 
 	virtual bool intersects( IOFWAddressSpace * space );
+
+	virtual bool getAddressRange( FWAddress * base, UInt32 * length );
 	
 private:
 
@@ -154,7 +154,7 @@ bool IOFWReadQuadCommand::createMemberVariables( void )
 	{
 		if( success )
 		{
-			fMembers->fSubclassMembers = IOMalloc( sizeof(MemberVariables) );
+			fMembers->fSubclassMembers = allocCommandMemory( sizeof(MemberVariables) );
 			if( fMembers->fSubclassMembers == NULL )
 				success = false;
 		}
@@ -187,7 +187,7 @@ void IOFWReadQuadCommand::destroyMemberVariables( void )
 	{		
 		// free member variables
 		
-		IOFree( fMembers->fSubclassMembers, sizeof(MemberVariables) );
+		freeCommandMemory( fMembers->fSubclassMembers, sizeof(MemberVariables) );
 		fMembers->fSubclassMembers = NULL;
 	}
 }
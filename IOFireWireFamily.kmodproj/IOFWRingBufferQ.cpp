@@ -35,6 +35,8 @@
 #import <IOKit/IOTypes.h>
 //#import <IOKit/firewire/FireLog.h>
 
+using namespace IOFireWireLib ;
+
 // IOFWRingBufferQ class
 // *** This class is not multithread safe ***
 // Its usage must be lock protected to ensure only one consumer at a time
@@ -62,6 +64,26 @@ IOFWRingBufferQ * IOFWRingBufferQ::withAddressRange( mach_vm_address_t address,
 	return 0;
 }
 
+//withSharedAddressRange
+//
+
+IOFWRingBufferQ * IOFWRingBufferQ::withSharedAddressRange( mach_vm_address_t address, mach_vm_size_t length, IOOptionBits options, task_t task)
+{
+	DebugLog("IOFWRingBufferQ::withSharedAddressRange\n");
+	IOFWRingBufferQ * that = OSTypeAlloc( IOFWRingBufferQ );
+	
+	if ( that )
+	{
+		if ( that->initSharedQ( address, length, options, task ) )
+			return that;
+		
+		DebugLog("IOFWRingBufferQ::withSharedAddressRange failed initSharedQ\n");
+		that->release();
+	}
+	
+	return 0;
+}
+
 // initQ
 // inits class specific variables
 
@@ -83,10 +105,59 @@ bool IOFWRingBufferQ::initQ( mach_vm_address_t address, mach_vm_size_t length, I
 	return true;
 }
 
+// initSharedQ
+// lay out a shared control block and a power-of-two data area in the client's buffer
+// and map it into the kernel so entries can be written directly
+
+bool IOFWRingBufferQ::initSharedQ( mach_vm_address_t address, mach_vm_size_t length, IOOptionBits options, task_t task )
+{
+	DebugLog("IOFWRingBufferQ::initSharedQ\n");
+	
+	// indices are 32 bit and must stay naturally aligned in the mapping
+	if ( (address & (sizeof(UInt32) - 1)) != 0 )
+		return false;
+	
+	if ( length < sizeof(FWSharedRingControl) + kFWSharedRingAlignment || length > 0x80000000ULL )
+		return false;
+	
+	if ( !initQ( address, length, options, task ) )
+		return false;
+	
+	fMemMap = fMemDescriptor->createMappingInTask( kernel_task, 0, kIOMapAnywhere );
+	if ( !fMemMap )
+		return false;
+	
+	FWSharedRingControl * control = (FWSharedRingControl *)fMemMap->getVirtualAddress();
+	
+	// largest power of two that fits after the control block
+	UInt32 available = (UInt32)(length - sizeof(FWSharedRingControl));
+	UInt32 dataSize = 1U << (31 - __builtin_clz( available ));
+	
+	control->head = 0;
+	control->tail = 0;
+	control->dataSize = dataSize;
+	OSMemoryBarrier();
+	
+	fSharedData = (UInt8 *)(control + 1);
+	fSharedMask = dataSize - 1;
+	fBufferSize = dataSize;
+	fSharedControl = control;
+	
+	return true;
+}
+
 // free
 //
 void IOFWRingBufferQ::free()
 {
+	fSharedControl = NULL;
+	
+	if ( fMemMap )
+	{
+		fMemMap->release();
+		fMemMap = NULL;
+	}
+	
 	if ( fMemDescriptorPrepared )
 		fMemDescriptor->complete();
 	
@@ -101,6 +172,9 @@ void IOFWRingBufferQ::free()
 
 bool IOFWRingBufferQ::isEmpty( void )
 {
+	if ( fSharedControl )
+		return (fSharedControl->tail == fSharedControl->head);
+	
 	return (fQueueLength == 0);
 }
 
@@ -109,6 +183,10 @@ bool IOFWRingBufferQ::isEmpty( void )
 
 bool IOFWRingBufferQ::dequeueBytes( IOByteCount size )
 {
+	// a shared queue is drained by its consumer in user space
+	if ( fSharedControl )
+		return true;
+	
 	return dequeueBytesWithCopy(NULL, size);
 }
 
@@ -162,6 +240,9 @@ IOByteCount IOFWRingBufferQ::readBytes(IOByteCount offset, void * bytes, IOByteC
 
 bool IOFWRingBufferQ::enqueueBytes( void * bytes, IOByteCount size )
 {
+	if ( fSharedControl )
+		return bytes ? sharedEnqueue( bytes, size, NULL, 0, NULL ) : false;
+	
 	bool success = true;
 	
 	IOByteCount offset = 0;
@@ -186,6 +267,50 @@ bool IOFWRingBufferQ::enqueueBytes( void * bytes, IOByteCount size )
 	return success;
 }
 
+// enqueueBytesWithHeader
+// Insert 'header' followed by 'bytes' into queue contiguously as a single entry of
+// headerSize + size bytes, and return the offset of the header in 'offset'
+
+bool IOFWRingBufferQ::enqueueBytesWithHeader( const void * header, IOByteCount headerSize, const void * bytes, IOByteCount size, IOByteCount * offset )
+{
+	if ( fSharedControl )
+		return (header && (bytes || !size)) ? sharedEnqueue( header, headerSize, bytes, size, offset ) : false;
+	
+	bool success = true;
+	
+	IOByteCount entryOffset = 0;
+	IOByteCount paddingBytes = 0;
+	
+	if ( !header || (size && !bytes) )
+		success = false;
+	
+	// determine if the entry will fit in queue and get the appropriate insertion offset
+	if ( success )
+		success = willFitAtEnd( headerSize + size, &entryOffset, &paddingBytes );
+	
+	if ( success )
+	{
+		if ( fMemDescriptor->writeBytes(entryOffset, header, headerSize) == 0 )
+			success = false;
+		
+		if ( success && size )
+		{
+			if ( fMemDescriptor->writeBytes(entryOffset + headerSize, bytes, size) == 0 )
+				success = false;
+		}
+		
+		// only grow the queue once the whole entry is in place
+		if ( success )
+			fQueueLength = fQueueLength + headerSize + size + paddingBytes;
+	}
+	
+	if ( offset )
+		*offset = entryOffset;
+	
+	DebugLog(">>> IOFWRingBufferQ::enqueueBytesWithHeader BSize: %u Length: %u Front: %u Insert: %u/%u\n", fBufferSize, fQueueLength, fFrontOffset, entryOffset, paddingBytes);
+	return success;
+}
+
 //isSpaceAvailable
 //
 
@@ -227,6 +352,17 @@ bool IOFWRingBufferQ::isSpaceAvailable( IOByteCount size, IOByteCount * offset )
 	FireLog("-- Units Available: %lu  StartPtr: %lu  DestinationPtr: %lu --\n", drawBufAvail, drawStartOff, drawDestOff );
 #endif
 	
+	if ( fSharedControl )
+	{
+		UInt32 position = 0;
+		bool fits = sharedReserve( size, &position, NULL );
+		
+		if ( offset )
+			*offset = sizeof(FWSharedRingControl) + position + sizeof(FWSharedRingEntry);
+		
+		return fits;
+	}
+	
 	return willFitAtEnd(size, offset, NULL);
 }
 
@@ -266,6 +402,12 @@ bool IOFWRingBufferQ::front( void * copy, IOByteCount size, IOByteCount * paddin
 
 IOByteCount IOFWRingBufferQ::spaceAvailable( void )
 {
+	if ( fSharedControl )
+	{
+		UInt32 used = fSharedControl->head - fSharedControl->tail;
+		return (used > fBufferSize) ? 0 : fBufferSize - used;
+	}
+	
 	return fBufferSize - fQueueLength;
 }
 
@@ -366,3 +508,81 @@ IOByteCount IOFWRingBufferQ::frontEntryOffset( IOByteCount sizeOfEntry, IOByteCo
 	
 	return frontEntryOffset;
 }
+
+// sharedReserve
+// Checks whether an entry carrying 'size' bytes fits in a shared queue. Returns the data
+// position the entry header would be written at and the bytes skipped to get there.
+
+bool IOFWRingBufferQ::sharedReserve( IOByteCount size, UInt32 * position, UInt32 * paddingBytes )
+{
+	UInt32 head = fSharedControl->head;	// only we write head
+	UInt32 tail = fSharedControl->tail;
+	
+	// acquire - the consumer is done with everything before tail
+	OSMemoryBarrier();
+	
+	UInt32 used = head - tail;
+	UInt32 headPosition = head & fSharedMask;
+	UInt32 entrySize = (sizeof(FWSharedRingEntry) + size + (kFWSharedRingAlignment - 1)) & ~(kFWSharedRingAlignment - 1);
+	UInt32 padding = 0;
+	
+	if ( entrySize > (fSharedMask + 1) - headPosition )
+		padding = (fSharedMask + 1) - headPosition;	// wrap to start of data area
+	
+	if ( position )
+		*position = padding ? 0 : headPosition;
+	
+	if ( paddingBytes )
+		*paddingBytes = padding;
+	
+	// a tail the consumer has pushed past head is treated as a full queue
+	if ( used > fBufferSize || size > fBufferSize )
+		return false;
+	
+	return ( (IOByteCount)entrySize + padding <= fBufferSize - used );
+}
+
+// sharedEnqueue
+// Write 'header' followed by 'bytes' as one entry through the kernel mapping, then publish
+// it by advancing the shared head. 'offset' returns the offset of the entry's bytes from the
+// start of the client's buffer.
+
+bool IOFWRingBufferQ::sharedEnqueue( const void * header, IOByteCount headerSize, const void * bytes, IOByteCount size, IOByteCount * offset )
+{
+	UInt32 position = 0;
+	UInt32 padding = 0;
+	
+	if ( !sharedReserve( headerSize + size, &position, &padding ) )
+	{
+		DebugLog(">>> IOFWRingBufferQ::sharedEnqueue full Head: %u Tail: %u Size: %u\n", fSharedControl->head, fSharedControl->tail, headerSize + size);
+		return false;
+	}
+	
+	UInt32 head = fSharedControl->head;
+	
+	if ( padding )
+		((FWSharedRingEntry *)(fSharedData + (head & fSharedMask)))->size = kFWSharedRingPadEntry;
+	
+	FWSharedRingEntry * entry = (FWSharedRingEntry *)(fSharedData + position);
+	UInt8 * entryBytes = (UInt8 *)(entry + 1);
+	
+	entry->size = headerSize + size;
+	entry->reserved = 0;
+	
+	bcopy( header, entryBytes, headerSize );
+	if ( size )
+		bcopy( bytes, entryBytes + headerSize, size );
+	
+	if ( offset )
+		*offset = sizeof(FWSharedRingControl) + position + sizeof(FWSharedRingEntry);
+	
+	UInt32 entrySize = (sizeof(FWSharedRingEntry) + headerSize + size + (kFWSharedRingAlignment - 1)) & ~(kFWSharedRingAlignment - 1);
+	
+	// release - entry contents are visible before the new head
+	OSMemoryBarrier();
+	fSharedControl->head = head + padding + entrySize;
+	
+	DebugLog(">>> IOFWRingBufferQ::sharedEnqueue Head: %u Tail: %u Insert: %u/%u\n", fSharedControl->head, fSharedControl->tail, position, padding);
+	
+	return true;
+}
@@ -33,11 +33,20 @@
 
 // public
 #import <IOKit/IOMemoryDescriptor.h>
+#import <IOKit/firewire/IOFireWireFamilyCommon.h>
+
+// private
+#import "IOFireWireLibPriv.h"
 
 //using namespace IOFireWireLib;
 
 // IOFWRingBufferQ
 // Description: A ring buffered FIFO queue
+//
+// A queue made with withSharedAddressRange() keeps its head/tail indices in the
+// mapped memory itself (see FWSharedRingControl). The kernel is the only producer
+// and writes entries through a kernel mapping; user space is the only consumer and
+// releases entries by advancing the shared tail, so dequeueBytes() does nothing.
 	
 class IOFWRingBufferQ: public OSObject
 {
@@ -46,8 +55,10 @@ class IOFWRingBufferQ: public OSObject
 public:
 	
 	static IOFWRingBufferQ *	withAddressRange( mach_vm_address_t address, mach_vm_size_t length, IOOptionBits options, task_t task );
+	static IOFWRingBufferQ *	withSharedAddressRange( mach_vm_address_t address, mach_vm_size_t length, IOOptionBits options, task_t task );
 	
 	virtual bool			initQ( mach_vm_address_t address, mach_vm_size_t length, IOOptionBits options, task_t task );
+	virtual bool			initSharedQ( mach_vm_address_t address, mach_vm_size_t length, IOOptionBits options, task_t task );
 	virtual void			free( void ) APPLE_KEXT_OVERRIDE;
 	virtual bool			isEmpty( void );
 	virtual bool			dequeueBytes( IOByteCount size );
@@ -59,6 +70,12 @@ public:
 	virtual IOByteCount		spaceAvailable( void );
 	virtual bool			willFitAtEnd( IOByteCount sizeOfEntry, IOByteCount * offset, IOByteCount * paddingBytes );
 	virtual IOByteCount		frontEntryOffset( IOByteCount sizeOfEntry, IOByteCount * paddingBytes );
+	virtual bool			enqueueBytesWithHeader( const void * header, IOByteCount headerSize, const void * bytes, IOByteCount size, IOByteCount * offset );
+	bool					isShared( void ) const { return fSharedControl != NULL; }
+	
+protected:
+	bool					sharedReserve( IOByteCount size, UInt32 * position, UInt32 * paddingBytes );
+	bool					sharedEnqueue( const void * header, IOByteCount headerSize, const void * bytes, IOByteCount size, IOByteCount * offset );
 	
 private:
 	IOMemoryDescriptor *			fMemDescriptor;
@@ -66,6 +83,12 @@ private:
 	IOByteCount						fBufferSize;
 	IOByteCount						fFrontOffset;
 	IOByteCount						fQueueLength;
+	
+	// shared mode
+	IOMemoryMap *							fMemMap;
+	IOFireWireLib::FWSharedRingControl *	fSharedControl;
+	UInt8 *									fSharedData;
+	UInt32									fSharedMask;
 } ;
 
 #endif //__IOFWRingBufferQ_H__
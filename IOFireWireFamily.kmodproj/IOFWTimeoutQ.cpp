@@ -133,20 +133,58 @@ void IOFireWireController::timeoutQ::busReset()
     }
 #endif
 
-    IOFWCommand *cmd;
-    cmd = fHead;
-    while(cmd) 
+	// cancelling a command reshapes the heap and may complete or submit others,
+	// so cancel them a batch at a time, snapshotting each batch before touching
+	// any of its commands. the batch lives on the stack so a reset never needs
+	// to allocate. like the old list walk, a command submitted by a completion
+	// along the way may be cancelled too.
+	IOFWCommand * batch[kBusResetCancelBatch];
+	IOFWCommand * cmd = NULL;
+	UInt32 remaining = 0;
+	
+	while( (cmd = nextByDeadlineWalk( cmd )) )
 	{
-        IOFWCommand *next;
-        next = cmd->getNext();
-        if(cmd->cancelOnReset()) 
+		if( cmd->cancelOnReset() )
 		{
-			FWTrace( kFWTController, kTPControllerTimeoutQBusReset, (uintptr_t)(cmd->getFWIMRefCon()), (uintptr_t)cmd, 0, 0 );
-            cmd->cancel(kIOFireWireBusReset);
-        }
-        cmd = next;
-    }
+			remaining++;
+		}
+	}
 	
+	while( remaining > 0 )
+	{
+		UInt32 count = 0;
+		
+		cmd = NULL;
+		while( count < kBusResetCancelBatch && count < remaining && (cmd = nextByDeadlineWalk( cmd )) )
+		{
+			if( cmd->cancelOnReset() )
+			{
+				cmd->retain();
+				batch[count++] = cmd;
+			}
+		}
+		
+		if( count == 0 )
+		{
+			break;
+		}
+		
+		for( UInt32 i = 0; i < count; i++ )
+		{
+			cmd = batch[i];
+			
+			// skip anything completed as a side effect of an earlier cancel
+			if( containsByDeadline( cmd ) )
+			{
+				FWTrace( kFWTController, kTPControllerTimeoutQBusReset, (uintptr_t)(cmd->getFWIMRefCon()), (uintptr_t)cmd, 0, 0 );
+				cmd->cancel(kIOFireWireBusReset);
+			}
+			
+			cmd->release();
+		}
+		
+		remaining -= count;
+	}
 }
 
 // clockTick
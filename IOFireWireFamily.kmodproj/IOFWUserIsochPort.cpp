@@ -38,6 +38,7 @@
 #import <IOKit/IOBufferMemoryDescriptor.h>
 #include <IOKit/IOKitKeysPrivate.h>
 #include <IOKit/IODMACommand.h>
+#import <libkern/OSAtomic.h>
 
 // protected
 #import <IOKit/firewire/IOFireWireLink.h>
@@ -45,6 +46,7 @@
 // private
 #import "IOFireWireUserClient.h"
 #import "IOFWUserIsochPort.h"
+#import "IOFireWireLibNuDCL.h"
 
 #if 0
 // DEBUG
@@ -227,6 +229,8 @@ IOFWUserLocalIsochPort::free()
 		fDCLPool = NULL ;
 	}
 
+	releaseModifyRing() ;
+
 	// release fProgramBuffer (if we have one)
 	delete [] (UInt8*)fProgramBuffer ;
 	fProgramBuffer = NULL ;
@@ -1147,12 +1151,15 @@ IOFWUserLocalIsochPort::userNotify (
 		IOByteCount		dataSize )
 {
 	InfoLog("+IOFWUserLocalIsochPort::userNotify, numDCLs=%ld\n", numDCLs ) ;
-	if ( __builtin_expect( numDCLs > 64, false ) )
+
+	if ( !fDCLPool )
 	{
-		return kIOReturnBadArgument ;
+		return kIOReturnUnsupported ;
 	}
 
-	IOFWDCL * 			dcls[ numDCLs ] ;
+	// DCLs are handed to the program kNotifyBatchCount at a time, so there's no limit on numDCLs
+	IOFWDCL * 			dcls[ kNotifyBatchCount ] ;
+	unsigned			batchCount		= 0 ;
 	const OSArray *		program 		= fDCLPool->getProgramRef() ;
 	unsigned 			programLength	= program->getCount() ;
 	IOReturn			error			= kIOReturnSuccess ;
@@ -1161,46 +1168,20 @@ IOFWUserLocalIsochPort::userNotify (
 	{
 		case kFWNuDCLModifyNotification :
 		{
-            void * iter_data = data;
-            
-			IOMemoryMap * bufferMap = fProgram->getBufferMap() ;
-			for( unsigned index=0; index < numDCLs; ++index )
-			{
-                // don't run of the end of the data buffer
-                if( iter_data >= ((UInt8*)data + dataSize) )
-                {
-                    error = kIOReturnBadArgument;
-                    break;
-                }
-
-				unsigned dclIndex = *(unsigned*)iter_data - 1 ;
-				if ( dclIndex >= programLength )
-				{
-					DebugLog("out of range DCL dclIndex=%d, programLength=%d\n", dclIndex, programLength ) ;
-					error = kIOReturnBadArgument ;
-				}
-				else
-				{
-					dcls[ index ] = (IOFWDCL*)program->getObject( dclIndex ) ;
-					
-					iter_data = (UInt8*)iter_data + sizeof( unsigned ) ;
-					IOByteCount import_data_size = 0;
-					
-					error = dcls[ index ]->importUserDCL( (UInt8*)iter_data, import_data_size, bufferMap, program ) ;
+			UInt8 *			cursor		= (UInt8*)data ;
+			UInt8 *			end			= (UInt8*)data + dataSize ;
+			IOMemoryMap *	bufferMap	= fProgram->getBufferMap() ;
 
-					// if there is no branch set, make sure the DCL "branches" to the 
-					// dcl that comes next in the program if there is one...
-					if ( dclIndex + 1 < programLength && !dcls[ index ]->getBranch() )
-					{
-						dcls[ index ]->setBranch( (IOFWDCL*)program->getObject( dclIndex + 1 ) ) ;
-					}
-					
-					iter_data = (UInt8*)iter_data + import_data_size;
-				}
+			for( unsigned index=0; index < numDCLs && !error; ++index )
+			{
+				IOFWDCL *		dcl			= NULL ;
+				IOByteCount		consumed	= 0 ;
 
-				if ( error )
+				error = importModifiedDCL( cursor, end - cursor, consumed, program, bufferMap, & dcl ) ;
+				if ( !error )
 				{
-					break ;
+					cursor += consumed ;
+					error = batchNotify( kFWNuDCLModifyNotification, dcls, batchCount, dcl ) ;
 				}
 			}
 			
@@ -1209,59 +1190,34 @@ IOFWUserLocalIsochPort::userNotify (
 		
 		case kFWNuDCLModifyJumpNotification :
 		{
-			unsigned * dclIndexTable = (unsigned*)data ;
-            unsigned dcl_index_count = dataSize / sizeof(unsigned);
-            
-			// subtract 1 from each index in our list.
 			// when the notification type is kFWNuDCLModifyJumpNotification, the dcl list
 			// actually contains pairs of DCL indices. The first is the dcl having its branch modified,
-			// the second is the index of the DCL to branch to.
+			// the second is the index of the DCL to branch to, or 0 for none.
+			unsigned * dclIndexTable = (unsigned*)data ;
+
+			// don't run of the end of the data buffer
+			if ( (UInt64)numDCLs * 2 > dataSize / sizeof( unsigned ) )
 			{
-				unsigned index = 0 ;
-				unsigned pairIndex = 0 ;
+				error = kIOReturnBadArgument ;
+				break ;
+			}
+
+			for( unsigned pairIndex = 0; pairIndex < numDCLs && !error; ++pairIndex )
+			{
+				unsigned dclIndex		= dclIndexTable[ pairIndex << 1 ] - 1 ;
+				unsigned branchIndex	= dclIndexTable[ ( pairIndex << 1 ) + 1 ] ;
 
-				while( pairIndex < numDCLs )
+				if ( dclIndex >= programLength || branchIndex > programLength )
 				{
-                    // don't run of the end of the data buffer
-                    if( index >= dcl_index_count )
-                    {
-                        error = kIOReturnBadArgument;
-                        break;
-                    }
-                    
-					--dclIndexTable[ index ] ;
-					if ( dclIndexTable[ index ] >= programLength )
-					{
-						DebugLog("out of range DCL index=%d, dclIndices[ index ]=%d, programLength=%d\n", index, dclIndexTable[ index ], programLength ) ;
-						error = kIOReturnBadArgument ;
-						break ;
-					}
+					DebugLog("out of range DCL index=%d, dclIndex=%d, branchIndex=%d, programLength=%d\n", pairIndex, dclIndex, branchIndex, programLength ) ;
+					error = kIOReturnBadArgument ;
+					break ;
+				}
 
-					dcls[ pairIndex ] = (IOFWDCL*)program->getObject( dclIndexTable[ index ] ) ;
-					
-					++index ;
-					
-					if (dclIndexTable[ index ])
-					{
-						--dclIndexTable[ index ] ;
-						
-						if ( dclIndexTable[ index ] >= programLength )
-						{
-							DebugLog("out of range DCL index=%d, dclIndices[ index ]=%d, programLength=%d\n", index, dclIndexTable[ index ], programLength ) ;
-							error = kIOReturnBadArgument ;
-							break ;						
-						}
-						
-						dcls[ pairIndex ]->setBranch( (IOFWDCL*)program->getObject( dclIndexTable[ index ] ) ) ;
-					}
-					else
-					{
-						dcls[ pairIndex ]->setBranch( 0 ) ;
-					}
+				IOFWDCL * dcl = (IOFWDCL*)program->getObject( dclIndex ) ;
+				dcl->setBranch( branchIndex ? (IOFWDCL*)program->getObject( branchIndex - 1 ) : NULL ) ;
 
-					++index ;
-					++pairIndex ;
-				}
+				error = batchNotify( kFWNuDCLModifyJumpNotification, dcls, batchCount, dcl ) ;
 			}
 
 			break ;
@@ -1269,31 +1225,26 @@ IOFWUserLocalIsochPort::userNotify (
 		
 		case kFWNuDCLUpdateNotification :
 		{
-            unsigned dcl_indices_count = dataSize / sizeof(unsigned);
+			unsigned * dclIndices = (unsigned*)data ;
 
-            unsigned index = 0 ;
-			while ( index < numDCLs )
+			// don't run of the end of the data buffer
+			if ( numDCLs > dataSize / sizeof( unsigned ) )
 			{
-				unsigned * dclIndices = (unsigned*)data ;
-
-                // don't run of the end of the data buffer
-                if( index >= dcl_indices_count )
-                {
-                    error = kIOReturnBadArgument;
-                    break;
-                }
-                
-				--dclIndices[ index ] ;
-				if ( __builtin_expect( dclIndices[ index ] >= programLength, false ) )
+				error = kIOReturnBadArgument ;
+				break ;
+			}
+
+			for( unsigned index = 0; index < numDCLs && !error; ++index )
+			{
+				unsigned dclIndex = dclIndices[ index ] - 1 ;
+				if ( __builtin_expect( dclIndex >= programLength, false ) )
 				{
-					DebugLog("out of range DCL index=%d, dclIndices[ index ]=%d, programLength=%d\n", index, dclIndices[ index ], programLength ) ;
+					DebugLog("out of range DCL index=%d, dclIndex=%d, programLength=%d\n", index, dclIndex, programLength ) ;
 					error = kIOReturnBadArgument ;
 					break ;
 				}
 				
-				dcls[ index ] = (IOFWDCL*)program->getObject( dclIndices[ index ] ) ;
-				
-				++index ;
+				error = batchNotify( kFWNuDCLUpdateNotification, dcls, batchCount, (IOFWDCL*)program->getObject( dclIndex ) ) ;
 			}
 
 			break ;
@@ -1308,8 +1259,323 @@ IOFWUserLocalIsochPort::userNotify (
 	}
 	
 	program->release() ;
+
+	if ( !error && batchCount )
+	{
+		error = notify( (IOFWDCLNotificationType)notificationType, (DCLCommand**)dcls, batchCount ) ;
+	}
+	
+	return error ;
+}
+
+// importModifiedDCL
+//
+// 'data' holds a DCL's export index followed by its export data
+
+IOReturn
+IOFWUserLocalIsochPort::importModifiedDCL (
+		UInt8 *					data,
+		IOByteCount				dataSize,
+		IOByteCount &			consumed,
+		const OSArray *			program,
+		IOMemoryMap *			bufferMap,
+		IOFWDCL **				outDCL )
+{
+	unsigned programLength = program->getCount() ;
+
+	// don't run of the end of the data buffer
+	if ( dataSize < sizeof( UInt32 ) + sizeof( NuDCLExportData ) )
+	{
+		return kIOReturnBadArgument ;
+	}
+
+	unsigned dclIndex = *(UInt32*)data - 1 ;
+	if ( dclIndex >= programLength )
+	{
+		DebugLog("out of range DCL dclIndex=%d, programLength=%d\n", dclIndex, programLength ) ;
+		return kIOReturnBadArgument ;
+	}
+
+	// the update list follows the export data, make sure all of it is there
+	NuDCLExportData * sharedData = (NuDCLExportData*)( data + sizeof( UInt32 ) ) ;
+	if ( sharedData->updateCount > ( dataSize - sizeof( UInt32 ) - sizeof( NuDCLExportData ) ) / sizeof( uint64_t ) )
+	{
+		return kIOReturnBadArgument ;
+	}
+
+	IOFWDCL *		dcl			= (IOFWDCL*)program->getObject( dclIndex ) ;
+	IOByteCount		importSize	= 0 ;
+	
+	IOReturn error = dcl->importUserDCL( data + sizeof( UInt32 ), importSize, bufferMap, program ) ;
+
+	// if there is no branch set, make sure the DCL "branches" to the 
+	// dcl that comes next in the program if there is one...
+	if ( dclIndex + 1 < programLength && !dcl->getBranch() )
+	{
+		dcl->setBranch( (IOFWDCL*)program->getObject( dclIndex + 1 ) ) ;
+	}
+
+	consumed = sizeof( UInt32 ) + importSize ;
+	if ( !error && consumed > dataSize )
+	{
+		error = kIOReturnBadArgument ;
+	}
+
+	*outDCL = dcl ;
+
+	return error ;
+}
+
+// batchNotify
+//
+// adds 'dcl' to the batch and hands the batch to the program once it's full
+
+IOReturn
+IOFWUserLocalIsochPort::batchNotify (
+		IOFWDCLNotificationType	type,
+		IOFWDCL *				batch[],
+		unsigned &				count,
+		IOFWDCL *				dcl )
+{
+	batch[ count++ ] = dcl ;
+
+	if ( count < kNotifyBatchCount )
+	{
+		return kIOReturnSuccess ;
+	}
+
+	count = 0 ;
+
+	return notify( type, (DCLCommand**)batch, kNotifyBatchCount ) ;
+}
+
+// setModifyRing
+//
+// maps the client's DCL modification ring, a zero buffer removes it
+
+IOReturn
+IOFWUserLocalIsochPort::setModifyRing (
+		mach_vm_address_t	buffer,
+		mach_vm_size_t		size )
+{
+	// NuDCL programs only
+	if ( !fDCLPool )
+	{
+		return kIOReturnUnsupported ;
+	}
+
+	IOReturn error = kIOReturnSuccess ;
+
+	lock() ;
+
+	releaseModifyRing() ;
+
+	if ( buffer )
+	{
+		// room for the control block and at least one maximum size entry
+		if ( size < sizeof( IOFireWireLib::FWSharedRingControl ) + sizeof( IOFireWireLib::FWSharedRingEntry ) + IOFireWireLib::kFWDCLModifyRingMaxEntrySize
+				|| size > 0x80000000ULL )
+		{
+			error = kIOReturnBadArgument ;
+		}
+
+		if ( !error )
+		{
+			fModifyRingDesc = IOMemoryDescriptor::withAddressRange( buffer, size, kIODirectionOutIn, fUserClient->getOwningTask() ) ;
+			if ( !fModifyRingDesc )
+			{
+				error = kIOReturnNoMemory ;
+			}
+		}
+
+		if ( !error )
+		{
+			error = fModifyRingDesc->prepare() ;
+			if ( error )
+			{
+				fModifyRingDesc->release() ;
+				fModifyRingDesc = NULL ;
+			}
+		}
+
+		if ( !error )
+		{
+			fModifyRingMap = fModifyRingDesc->createMappingInTask( kernel_task, 0, kIOMapAnywhere ) ;
+			if ( !fModifyRingMap )
+			{
+				error = kIOReturnVMError ;
+			}
+			else if ( fModifyRingMap->getVirtualAddress() & ( IOFireWireLib::kFWSharedRingAlignment - 1 ) )
+			{
+				// entries and indices must stay naturally aligned in the mapping
+				error = kIOReturnBadArgument ;
+			}
+		}
+
+		if ( !error )
+		{
+			fModifyRecord = (UInt8*)IOMalloc( kModifyRecordBufferSize ) ;
+			if ( !fModifyRecord )
+			{
+				error = kIOReturnNoMemory ;
+			}
+		}
+
+		if ( !error )
+		{
+			fModifyRing = (IOFireWireLib::FWSharedRingControl*)fModifyRingMap->getVirtualAddress() ;
+
+			// largest power of two that fits after the control block
+			UInt32 available = (UInt32)( size - sizeof( IOFireWireLib::FWSharedRingControl ) ) ;
+			UInt32 dataSize = 1U << ( 31 - __builtin_clz( available ) ) ;
+
+			fModifyRing->head = 0 ;
+			fModifyRing->tail = 0 ;
+			fModifyRing->dataSize = dataSize ;
+			OSMemoryBarrier() ;
+
+			fModifyRingData = (UInt8*)( fModifyRing + 1 ) ;
+			fModifyRingMask = dataSize - 1 ;
+			fModifyRingTail = 0 ;
+		}
+
+		if ( error )
+		{
+			releaseModifyRing() ;
+		}
+	}
+
+	unlock() ;
+
+	return error ;
+}
+
+// applyModifyRing
+//
+// imports every entry posted to the modification ring and notifies the program in batches
+
+IOReturn
+IOFWUserLocalIsochPort::applyModifyRing ()
+{
+	IOReturn error = kIOReturnSuccess ;
+
+	lock() ;
+
+	if ( !fModifyRing )
+	{
+		unlock() ;
+		return kIOReturnNotReady ;
+	}
+
+	UInt32			head		= fModifyRing->head ;
+	UInt32			tail		= fModifyRingTail ;
+	UInt32			dataSize	= fModifyRingMask + 1 ;
+
+	// acquire - don't read entries before the head that published them
+	OSMemoryBarrier() ;
+
+	if ( head - tail > dataSize )
+	{
+		unlock() ;
+		return kIOReturnBadArgument ;
+	}
+
+	IOFWDCL * 			dcls[ kNotifyBatchCount ] ;
+	unsigned			batchCount	= 0 ;
+	const OSArray *		program		= fDCLPool->getProgramRef() ;
+	IOMemoryMap *		bufferMap	= fProgram->getBufferMap() ;
+
+	while ( tail != head && !error )
+	{
+		UInt32 position = tail & fModifyRingMask ;
+
+		if ( dataSize - position < sizeof( IOFireWireLib::FWSharedRingEntry ) || head - tail < sizeof( IOFireWireLib::FWSharedRingEntry ) )
+		{
+			error = kIOReturnBadArgument ;
+			break ;
+		}
+
+		IOFireWireLib::FWSharedRingEntry * entry = (IOFireWireLib::FWSharedRingEntry*)( fModifyRingData + position ) ;
+		UInt32 size = entry->size ;
+
+		if ( size == IOFireWireLib::kFWSharedRingPadEntry )
+		{
+			// the pad runs to the end of the data area, which must have been published
+			if ( dataSize - position > head - tail )
+			{
+				error = kIOReturnBadArgument ;
+				break ;
+			}
+			
+			tail += dataSize - position ;
+			continue ;
+		}
+
+		UInt32 entrySize = ( sizeof( IOFireWireLib::FWSharedRingEntry ) + size + ( IOFireWireLib::kFWSharedRingAlignment - 1 ) ) 
+				& ~( IOFireWireLib::kFWSharedRingAlignment - 1 ) ;
+
+		// entries never straddle the end of the data area
+		if ( size > IOFireWireLib::kFWDCLModifyRingMaxEntrySize || entrySize > head - tail || entrySize > dataSize - position )
+		{
+			error = kIOReturnBadArgument ;
+			break ;
+		}
+
+		// the client can still write the ring, so import from a copy
+		bcopy( entry + 1, fModifyRecord, size ) ;
+
+		IOFWDCL *		dcl			= NULL ;
+		IOByteCount		consumed	= 0 ;
+
+		error = importModifiedDCL( fModifyRecord, size, consumed, program, bufferMap, & dcl ) ;
+		if ( !error )
+		{
+			error = batchNotify( kFWNuDCLModifyNotification, dcls, batchCount, dcl ) ;
+		}
+
+		tail += entrySize ;
+	}
+
+	program->release() ;
+
+	if ( !error && batchCount )
+	{
+		error = notify( kFWNuDCLModifyNotification, (DCLCommand**)dcls, batchCount ) ;
+	}
+
+	// hand the space back even if an entry was bad, the client sees the error
+	fModifyRingTail = tail ;
+	fModifyRing->tail = tail ;
+
+	unlock() ;
+
+	return error ;
+}
+
+void
+IOFWUserLocalIsochPort::releaseModifyRing ()
+{
+	fModifyRing = NULL ;
+	fModifyRingData = NULL ;
 	
-	return error ? error : notify( (IOFWDCLNotificationType)notificationType, (DCLCommand**)dcls, numDCLs ) ;
+	if ( fModifyRecord )
+	{
+		IOFree( fModifyRecord, kModifyRecordBufferSize ) ;
+		fModifyRecord = NULL ;
+	}
+
+	if ( fModifyRingMap )
+	{
+		fModifyRingMap->release() ;
+		fModifyRingMap = NULL ;
+	}
+
+	if ( fModifyRingDesc )
+	{
+		fModifyRingDesc->complete() ;
+		fModifyRingDesc->release() ;
+		fModifyRingDesc = NULL ;
+	}
 }
 
 IOWorkLoop *
@@ -1340,3 +1606,107 @@ IOFWUserLocalIsochPort::createRealtimeThread()
 	
 	return workloop ;
 }
+
+#pragma mark -
+
+#undef super
+#define super IOFWBufferFillIsochPort
+
+OSDefineMetaClassAndStructors ( IOFWUserBufferFillIsochPort, super )
+
+IOFWUserBufferFillIsochPort *
+IOFWUserBufferFillIsochPort::withUserClient (
+	IOFireWireUserClient *	userclient,
+	mach_vm_address_t		buffer,
+	mach_vm_size_t			bufferSize,
+	UInt32					watermark,
+	UInt32					options )
+{
+	IOFWUserBufferFillIsochPort * port = OSTypeAlloc( IOFWUserBufferFillIsochPort ) ;
+	
+	if ( port && ! port->initWithUserClient( userclient, buffer, bufferSize, watermark, options ) )
+	{
+		port->release() ;
+		port = NULL ;
+	}
+	
+	return port ;
+}
+
+bool
+IOFWUserBufferFillIsochPort::initWithUserClient (
+	IOFireWireUserClient *	userclient,
+	mach_vm_address_t		buffer,
+	mach_vm_size_t			bufferSize,
+	UInt32					watermark,
+	UInt32					options )
+{
+	fUserClient = userclient ;
+	
+	IOMemoryDescriptor * desc = IOMemoryDescriptor::withAddressRange(	buffer, 
+																		bufferSize, 
+																		kIODirectionOutIn, 
+																		userclient->getOwningTask() ) ;
+	if ( ! desc )
+	{
+		return false ;
+	}
+	
+	// the port holds its own reference on the buffer
+	bool success = super::initWithBuffer( userclient->getOwner()->getController(), desc, watermark, options, 
+			& IOFWUserBufferFillIsochPort::s_notify, this ) ;
+	
+	desc->release() ;
+	
+	return success ;
+}
+
+IOReturn
+IOFWUserBufferFillIsochPort::setNotificationCallback (
+	OSAsyncReference64		asyncRef,
+	mach_vm_address_t		callback,
+	io_user_reference_t		refCon )
+{
+	if ( callback )
+	{
+		IOFireWireUserClient::setAsyncReference64( fNotificationAsyncRef, (mach_port_t)asyncRef[0], callback, refCon ) ;
+	}
+	else
+	{
+		fNotificationAsyncRef[0] = 0 ;
+	}
+	
+	return kIOReturnSuccess ;
+}
+
+void
+IOFWUserBufferFillIsochPort::exporterCleanup( const OSObject * self )
+{
+	IOFWUserBufferFillIsochPort * me = (IOFWUserBufferFillIsochPort*)self ;
+	
+	me->fNotificationAsyncRef[0] = 0 ;
+	me->stop() ;
+	me->releasePort() ;
+}
+
+// s_notify
+//
+// one message per watermark, the data itself is already in the shared buffer
+
+void
+IOFWUserBufferFillIsochPort::s_notify (
+	void *						refcon,
+	IOFWBufferFillIsochPort *	port,
+	UInt32						writeIndex )
+{
+	IOFWUserBufferFillIsochPort * me = (IOFWUserBufferFillIsochPort*)refcon ;
+	
+	if ( me->fNotificationAsyncRef[0] )
+	{
+		io_user_reference_t args[2] ;
+		args[0] = writeIndex ;
+		args[1] = me->getOverrunCount() ;
+		
+		IOFireWireUserClient::sendAsyncResult64( me->fNotificationAsyncRef, kIOReturnSuccess, args, 2 ) ;
+	}
+}
@@ -35,6 +35,7 @@
 
 // public
 #import <IOKit/firewire/IOFWLocalIsochPort.h>
+#import <IOKit/firewire/IOFWBufferFillIsochPort.h>
 #import <IOKit/IOLocks.h>
 #import <IOKit/OSMessageNotification.h>
 
@@ -44,6 +45,7 @@ class IODCLProgram ;
 class IOBufferMemoryDescriptor ;
 class IOFireWireUserClient ;
 class IOFWDCLPool ;
+class IOFWDCL ;
 
 class IOFWUserLocalIsochPort : public IOFWLocalIsochPort
 {
@@ -64,6 +66,21 @@ class IOFWUserLocalIsochPort : public IOFWLocalIsochPort
 		UInt8*						fProgramBuffer ; // for old style programs
 		IOFWDCLPool *				fDCLPool ;		// for new style programs
 		bool						fStarted ;
+
+		// DCL modification ring, see FWSharedRingControl
+		IOMemoryDescriptor *					fModifyRingDesc ;
+		IOMemoryMap *							fModifyRingMap ;
+		IOFireWireLib::FWSharedRingControl *	fModifyRing ;
+		UInt8 *									fModifyRingData ;
+		UInt32									fModifyRingMask ;
+		UInt32									fModifyRingTail ;	// private copy, the shared one is only published
+		UInt8 *									fModifyRecord ;		// entries are copied here before they're imported
+
+		enum
+		{
+			kNotifyBatchCount			= 64,		// DCLs handed to the program per notify()
+			kModifyRecordBufferSize		= IOFireWireLib::kFWDCLModifyRingMaxEntrySize + 64	// room for the send/receive export data tail
+		} ;
 		
 	public:
 
@@ -112,7 +129,69 @@ class IOFWUserLocalIsochPort : public IOFWLocalIsochPort
 											UInt32			numDCLs,
 											void *			data,
 											IOByteCount		dataSize ) ;
+		IOReturn					setModifyRing (
+											mach_vm_address_t	buffer,
+											mach_vm_size_t		size ) ;
+		IOReturn					applyModifyRing () ;
 		IOWorkLoop *				createRealtimeThread() ;
+
+	protected:
+
+		IOReturn					importModifiedDCL (
+											UInt8 *					data,
+											IOByteCount				dataSize,
+											IOByteCount &			consumed,
+											const OSArray *			program,
+											IOMemoryMap *			bufferMap,
+											IOFWDCL **				outDCL ) ;
+		IOReturn					batchNotify (
+											IOFWDCLNotificationType	type,
+											IOFWDCL *				batch[],
+											unsigned &				count,
+											IOFWDCL *				dcl ) ;
+		void						releaseModifyRing () ;
+} ;
+
+#pragma mark -
+
+class IOFWUserBufferFillIsochPort : public IOFWBufferFillIsochPort
+{
+	OSDeclareDefaultStructors( IOFWUserBufferFillIsochPort )
+
+	protected:
+
+		IOFireWireUserClient *		fUserClient ;
+		OSAsyncReference64			fNotificationAsyncRef ;
+
+	public:
+
+		static IOFWUserBufferFillIsochPort *	withUserClient (
+											IOFireWireUserClient *	userclient,
+											mach_vm_address_t		buffer,
+											mach_vm_size_t			bufferSize,
+											UInt32					watermark,
+											UInt32					options ) ;
+
+		bool						initWithUserClient (
+											IOFireWireUserClient *	userclient,
+											mach_vm_address_t		buffer,
+											mach_vm_size_t			bufferSize,
+											UInt32					watermark,
+											UInt32					options ) ;
+
+		IOReturn					setNotificationCallback (
+											OSAsyncReference64		asyncRef,
+											mach_vm_address_t		callback,
+											io_user_reference_t		refCon ) ;
+
+		static void					exporterCleanup( const OSObject * self );
+
+	protected:
+
+		static void					s_notify (
+											void *						refcon,
+											IOFWBufferFillIsochPort *	port,
+											UInt32						writeIndex ) ;
 } ;
 
 #endif //_IOKIT_IOFWUserIsochPortProxy_H
@@ -153,6 +153,15 @@ IOFWUserObjectExporter::free ()
 
 	removeAllObjects () ;
 
+	for ( unsigned index = 0; index < kHandleMaxChunks; ++index )
+	{
+		if ( fChunks[ index ] )
+		{
+			IOFree( fChunks[ index ], sizeof( HandleEntry ) * kHandleChunkSize ) ;
+			fChunks[ index ] = NULL ;
+		}
+	}
+	
 	if ( fLock ) {
 		IOLockFree( fLock ) ;
 		fLock = NULL;
@@ -169,6 +178,17 @@ IOFWUserObjectExporter::serialize (
 {
 	lock() ;
 
+	OSArray * objectArray = OSArray::withCapacity( fObjectCount ) ;
+	
+	for ( unsigned index = 0; objectArray && ( index < fCapacity ); ++index )
+	{
+		HandleEntry * entry = entryForIndex( index ) ;
+		if ( entry->fState & kEntryLive )
+		{
+			objectArray->setObject( entry->fObject ) ;
+		}
+	}
+	
 	const OSString * keys[ 3 ] =
 	{
 		OSString::withCString( "capacity" )
@@ -180,7 +200,7 @@ IOFWUserObjectExporter::serialize (
 	{
 		OSNumber::withNumber( (unsigned long long)fCapacity, 32 )
 		, OSNumber::withNumber( (unsigned long long)fObjectCount, 32 )
-		, fObjects ? OSArray::withObjects( fObjects, fObjectCount ) : OSArray::withCapacity(0)
+		, objectArray
 	} ;
 	
 	OSDictionary * dict = OSDictionary::withObjects( objects, keys, sizeof( keys ) / sizeof( OSObject* ) ) ;
@@ -198,91 +218,249 @@ IOFWUserObjectExporter::serialize (
 	return result ;
 }
 
-IOReturn
-IOFWUserObjectExporter::addObject ( OSObject * obj, CleanupFunction cleanupFunction, IOFireWireLib::UserObjectHandle * outHandle )
+// entryForIndex
+//
+// chunks are never freed or moved while the exporter is alive, so
+// this is safe without the lock
+
+IOFWUserObjectExporter::HandleEntry *
+IOFWUserObjectExporter::entryForIndex ( unsigned index ) const
 {
-	IOReturn error = kIOReturnSuccess ;
+	if ( index >= kHandleMaxEntries )
+	{
+		return NULL ;
+	}
 	
-	lock () ;
+	HandleEntry * chunk = fChunks[ index >> kHandleChunkShift ] ;
+	if ( !chunk )
+	{
+		return NULL ;
+	}
 	
-	if ( ! fObjects )
+	return &chunk[ index & ( kHandleChunkSize - 1 ) ] ;
+}
+
+// makeHandle
+//
+// handle is ( ( generation + 1 ) << kHandleIndexBits ) | ( index + 1 ); this means 0 is always an invalid/NULL handle...
+
+IOFireWireLib::UserObjectHandle
+IOFWUserObjectExporter::makeHandle ( unsigned index, UInt32 state )
+{
+	return (IOFireWireLib::UserObjectHandle)( ( ( ( ( state >> kEntryGenerationShift ) & kHandleGenerationMask ) + 1 ) << kHandleIndexBits ) | ( index + 1 ) ) ;
+}
+
+// decodeHandle
+//
+// outGeneration is the generation + 1, or 0 if the handle doesn't carry one
+
+bool
+IOFWUserObjectExporter::decodeHandle ( IOFireWireLib::UserObjectHandle handle, unsigned * outIndex, UInt32 * outGeneration ) const
+{
+	unsigned index = handle & kHandleIndexMask ;
+	UInt32 generation = handle >> kHandleIndexBits ;
+	
+	if ( !index || index > kHandleMaxEntries || generation > kHandleGenerationMask + 1 )
 	{
-		fCapacity = 8 ;
-		fObjects = (const OSObject **) new const OSObject * [ fCapacity ] ;
-		fCleanupFunctions = new CleanupFunctionWithExporter[ fCapacity ] ;
-		
-		if ( ! fObjects || !fCleanupFunctions )
-		{
-			DebugLog( "Couldn't make fObjects\n" ) ;
-			error = kIOReturnNoMemory ;
-		}
+		return false ;
+	}
+	
+	*outIndex = index - 1 ;
+	*outGeneration = generation ;
+	
+	return true ;
+}
+
+// generationMatches
+//
+//
+
+bool
+IOFWUserObjectExporter::generationMatches ( UInt32 state, UInt32 generation )
+{
+	return !generation || ( ( state >> kEntryGenerationShift ) & kHandleGenerationMask ) == generation - 1 ;
+}
+
+// pinEntry
+//
+// lock-free; holds off retireEntry() until unpinEntry() is called.
+// fails if the slot is free or has been reused since the handle was issued
+
+IOFWUserObjectExporter::HandleEntry *
+IOFWUserObjectExporter::pinEntry ( IOFireWireLib::UserObjectHandle handle ) const
+{
+	unsigned index ;
+	UInt32 generation ;
+	
+	if ( !decodeHandle( handle, &index, &generation ) )
+	{
+		return NULL ;
 	}
 	
-	// if at capacity, expand pool
-	if ( fObjectCount == fCapacity )
+	HandleEntry * entry = entryForIndex( index ) ;
+	if ( !entry )
 	{
-		unsigned newCapacity = fCapacity + ( fCapacity >> 1 ) ;
-		if ( newCapacity > 0xFFFE )
-			newCapacity = 0xFFFE ;
-			
-		if ( newCapacity == fCapacity )	// can't grow!
-		{
-			DebugLog( "Can't grow object exporter\n" ) ;
-			error = kIOReturnNoMemory ;
-		}
+		return NULL ;
+	}
+	
+	while ( true )
+	{
+		UInt32 state = entry->fState ;
 		
-		const OSObject ** newObjects = NULL ;
-		CleanupFunctionWithExporter * newCleanupFunctions = NULL ;
-
-		if ( ! error )
+		if ( !( state & kEntryLive ) || !generationMatches( state, generation ) )
 		{
-			newObjects = (const OSObject **) new OSObject * [ newCapacity ] ;
-		
-			if ( !newObjects )
-				error = kIOReturnNoMemory ;
+			return NULL ;
 		}
 		
-		if ( !error )
+		if ( ( state & kEntryPinMask ) == kEntryPinMask )
 		{
-			newCleanupFunctions = new CleanupFunctionWithExporter[ newCapacity ] ;
-			if ( !newCleanupFunctions )
-				error = kIOReturnNoMemory ;
+			continue ;
 		}
 		
-		if ( ! error )
+		if ( OSCompareAndSwap( state, state + 1, &entry->fState ) )
 		{
-			bcopy ( fObjects, newObjects, fCapacity * sizeof ( OSObject * ) ) ;
-			delete[] fObjects ;
+			return entry ;
+		}
+	}
+}
 
-			bcopy ( fCleanupFunctions, newCleanupFunctions, fCapacity * sizeof( CleanupFunction * ) ) ;
-			delete[] fCleanupFunctions ;
+// unpinEntry
+//
+//
 
-			fObjects = newObjects ;
-			fCleanupFunctions = newCleanupFunctions ;
-			fCapacity = newCapacity ;
-		}
+void
+IOFWUserObjectExporter::unpinEntry ( HandleEntry * entry ) const
+{
+	OSDecrementAtomic( (volatile SInt32 *)&entry->fState ) ;
+}
+
+// growTable
+//
+// add a chunk of entries to the tail of the free list. called with lock held
+
+IOReturn
+IOFWUserObjectExporter::growTable ()
+{
+	if ( fCapacity >= kHandleMaxEntries )
+	{
+		DebugLog( "Can't grow object exporter\n" ) ;
+		return kIOReturnNoMemory ;
+	}
+	
+	HandleEntry * chunk = (HandleEntry *)IOMalloc( sizeof( HandleEntry ) * kHandleChunkSize ) ;
+	if ( !chunk )
+	{
+		return kIOReturnNoMemory ;
+	}
+	
+	bzero( chunk, sizeof( HandleEntry ) * kHandleChunkSize ) ;
+	
+	unsigned count = kHandleMaxEntries - fCapacity ;
+	if ( count > kHandleChunkSize )
+		count = kHandleChunkSize ;
+	
+	for ( unsigned index = 0; index < count - 1; ++index )
+	{
+		chunk[ index ].fNextFree = fCapacity + index + 2 ;
+	}
+	
+	if ( fFreeTail )
+		entryForIndex( fFreeTail - 1 )->fNextFree = fCapacity + 1 ;
+	else
+		fFreeHead = fCapacity + 1 ;
+	
+	fFreeTail = fCapacity + count ;
+	
+	// publish the chunk to lock-free readers only after it's initialized
+	OSCompareAndSwapPtr( NULL, chunk, (void * volatile *)&fChunks[ fCapacity >> kHandleChunkShift ] ) ;
+	
+	fCapacity += count ;
+	
+	return kIOReturnSuccess ;
+}
+
+// retireEntry
+//
+// invalidate outstanding handles to an entry, wait out any lookups still
+// using it and move it to the tail of the free list. called with lock held
+
+const OSObject *
+IOFWUserObjectExporter::retireEntry ( unsigned index, CleanupFunctionWithExporter * outCleanupFunction )
+{
+	HandleEntry * entry = entryForIndex( index ) ;
+	UInt32 state ;
+	UInt32 newState ;
+	
+	do
+	{
+		state = entry->fState ;
+		newState = ( ( ( state >> kEntryGenerationShift ) + 1 ) << kEntryGenerationShift ) | ( state & kEntryPinMask ) ;
+		
+	} while ( !OSCompareAndSwap( state, newState, &entry->fState ) ) ;
+	
+	// lookups only hold a pin long enough to retain the object
+	while ( entry->fState & kEntryPinMask )
+	{
+		IODelay( 1 ) ;
+	}
+	
+	const OSObject * object = entry->fObject ;
+	*outCleanupFunction = entry->fCleanupFunction ;
+	
+	entry->fObject = NULL ;
+	entry->fCleanupFunction = NULL ;
+	entry->fNextFree = 0 ;
+	
+	// reuse free entries oldest first so stale handles are unlikely to match a reused generation
+	if ( fFreeTail )
+		entryForIndex( fFreeTail - 1 )->fNextFree = index + 1 ;
+	else
+		fFreeHead = index + 1 ;
+	
+	fFreeTail = index + 1 ;
+	
+	--fObjectCount ;
+	
+	return object ;
+}
+
+IOReturn
+IOFWUserObjectExporter::addObject ( OSObject * obj, CleanupFunction cleanupFunction, IOFireWireLib::UserObjectHandle * outHandle )
+{
+	IOReturn error = kIOReturnSuccess ;
+	
+	lock () ;
+	
+	// if no free entries, expand pool
+	if ( ! fFreeHead )
+	{
+		error = growTable() ;
 	}
 	
 	if ( ! error )
 	{
-		error = kIOReturnNoMemory ;
-		unsigned index = 0 ;
+		unsigned index = fFreeHead - 1 ;
+		HandleEntry * entry = entryForIndex( index ) ;
+		
+		fFreeHead = entry->fNextFree ;
+		if ( ! fFreeHead )
+			fFreeTail = 0 ;
 		
-		while ( index < fCapacity )
+		obj->retain () ;
+		entry->fObject = obj ;
+		entry->fCleanupFunction = (CleanupFunctionWithExporter)cleanupFunction ;
+		entry->fNextFree = 0 ;
+		
+		// free entries are never pinned, so this is only for the barrier
+		UInt32 state ;
+		do
 		{
-			if ( ! fObjects [ index ] )
-			{
-				obj->retain () ;
-				fObjects[ index ] = obj ;
-				fCleanupFunctions[ index ] = (CleanupFunctionWithExporter)cleanupFunction ;
-				*outHandle = (IOFireWireLib::UserObjectHandle)(index + 1) ;		// return index + 1; this means 0 is always an invalid/NULL index...
-				++fObjectCount ;
-				error = kIOReturnSuccess ;
-				break ;
-			}
+			state = entry->fState ;
 			
-			++index ;
-		}
+		} while ( !OSCompareAndSwap( state, state | kEntryLive, &entry->fState ) ) ;
+		
+		*outHandle = makeHandle( index, state ) ;
+		++fObjectCount ;
 	}
 	
 	unlock () ;
@@ -295,7 +473,10 @@ IOFWUserObjectExporter::addObject ( OSObject * obj, CleanupFunction cleanupFunct
 void
 IOFWUserObjectExporter::removeObject ( IOFireWireLib::UserObjectHandle handle )
 {
-	if ( !handle )
+	unsigned index ;
+	UInt32 generation ;
+	
+	if ( !decodeHandle( handle, &index, &generation ) )
 	{
 		return ;
 	}
@@ -304,25 +485,16 @@ IOFWUserObjectExporter::removeObject ( IOFireWireLib::UserObjectHandle handle )
 	
 	DebugLog("user object exporter removing handle %d\n", (uint32_t)handle);
 
-	unsigned index = (unsigned)handle - 1 ;		// handle is object's index + 1; this means 0 is always in invalid/NULL index...
-	
 	const OSObject * object = NULL ;
 	CleanupFunctionWithExporter cleanupFunction = NULL ;
 	
-	if ( fObjects && ( index < fCapacity ) )
+	HandleEntry * entry = entryForIndex( index ) ;
+	
+	if ( entry && ( entry->fState & kEntryLive ) && generationMatches( entry->fState, generation ) )
 	{
-		if ( fObjects[ index ] )
-		{
-			DebugLog( "found object %p (%s), retain count=%d\n", fObjects[ index ], fObjects[ index ]->getMetaClass()->getClassName(), fObjects[ index ]->getRetainCount() );
-			
-			object = fObjects[ index ] ;
-			fObjects[ index ] = NULL ;
-
-			cleanupFunction = fCleanupFunctions[ index ] ;				
-			fCleanupFunctions[ index ] = NULL ;
-			
-			--fObjectCount ;
-		}
+		DebugLog( "found object %p (%s), retain count=%d\n", entry->fObject, entry->fObject->getMetaClass()->getClassName(), entry->fObject->getRetainCount() );
+		
+		object = retireEntry( index, &cleanupFunction ) ;
 	}
 
 	unlock () ;
@@ -357,9 +529,12 @@ IOFWUserObjectExporter::lookupHandle ( OSObject * object ) const
 	
 	while ( index < fCapacity )
 	{
-		if( fObjects[index] == object )
+		HandleEntry * entry = entryForIndex( index ) ;
+		UInt32 state = entry->fState ;
+		
+		if( ( state & kEntryLive ) && entry->fObject == object )
 		{
-			out_handle = (IOFireWireLib::UserObjectHandle)(index + 1) ;		// return index + 1; this means 0 is always an invalid/NULL index...
+			out_handle = makeHandle( index, state ) ;
 			break;
 		}
 		
@@ -374,27 +549,20 @@ IOFWUserObjectExporter::lookupHandle ( OSObject * object ) const
 const OSObject *
 IOFWUserObjectExporter::lookupObject ( IOFireWireLib::UserObjectHandle handle ) const
 {
-	if ( !handle )
-	{
-		return NULL ;
-	}
-
 	const OSObject * result = NULL ;
 	
-	lock () ;
-	
-	unsigned index = (unsigned)handle - 1 ;
+	HandleEntry * entry = pinEntry( handle ) ;
 	
-	if ( fObjects && ( index < fCapacity ) )
+	if ( entry )
 	{
-		result = fObjects [ index ] ;
+		result = entry->fObject ;
 		if ( result )
 		{
 			result->retain() ;
 		}
-	}
 		
-	unlock () ;
+		unpinEntry( entry ) ;
+	}
 	
 	return result ;
 }
@@ -402,34 +570,27 @@ IOFWUserObjectExporter::lookupObject ( IOFireWireLib::UserObjectHandle handle )
 const OSObject *
 IOFWUserObjectExporter::lookupObjectForType( IOFireWireLib::UserObjectHandle handle, const OSMetaClass * toType ) const
 {
-	if( !handle )
-	{
-		return NULL;
-	}
-
 	const OSObject * result = NULL;
 	
-	lock ();
-	
-	unsigned index = (unsigned)handle - 1;
+	HandleEntry * entry = pinEntry( handle );
 	
-	if ( fObjects && ( index < fCapacity ) )
+	if ( entry )
 	{
-		result = fObjects [ index ];
-	}
+		result = entry->fObject;
 	
-	if( result )
-	{
-		result = (OSObject*)OSMetaClassBase::safeMetaCast( result, toType );
-	}
-	
-	if( result )
-	{
-		result->retain();
+		if( result )
+		{
+			result = (OSObject*)OSMetaClassBase::safeMetaCast( result, toType );
+		}
+		
+		if( result )
+		{
+			result->retain();
+		}
+		
+		unpinEntry( entry );
 	}
 	
-	unlock ();
-	
 	return result;
 }
 
@@ -441,34 +602,33 @@ IOFWUserObjectExporter::removeAllObjects ()
 	const OSObject ** objects = NULL ;
 	CleanupFunctionWithExporter * cleanupFunctions = NULL ;
 
-	unsigned capacity = fCapacity ;
+	unsigned count = fObjectCount ;
 
-	if ( fObjects )
+	if ( count )
 	{		
-		objects = (const OSObject **)IOMalloc( sizeof(const OSObject *) * capacity ) ;
-		cleanupFunctions = (CleanupFunctionWithExporter*)IOMalloc( sizeof( CleanupFunctionWithExporter ) * capacity ) ;
+		objects = (const OSObject **)IOMalloc( sizeof(const OSObject *) * count ) ;
+		cleanupFunctions = (CleanupFunctionWithExporter*)IOMalloc( sizeof( CleanupFunctionWithExporter ) * count ) ;
+	}
 	
-		if ( objects )
-			bcopy( fObjects, objects, sizeof( const OSObject * ) * capacity ) ;
-		
-		if ( cleanupFunctions )
-			bcopy( fCleanupFunctions, cleanupFunctions, sizeof( CleanupFunction) * capacity ) ;
-			
-		delete[] fObjects ;
-		fObjects = NULL ;
-		
-		delete[] fCleanupFunctions ;
-		fCleanupFunctions = NULL ;		
-
-		fObjectCount = 0 ;
-		fCapacity = 0 ;
+	unsigned found = 0 ;
+	
+	if ( objects && cleanupFunctions )
+	{
+		for ( unsigned index = 0; ( index < fCapacity ) && ( found < count ); ++index )
+		{
+			if ( entryForIndex( index )->fState & kEntryLive )
+			{
+				objects[ found ] = retireEntry( index, &cleanupFunctions[ found ] ) ;
+				++found ;
+			}
+		}
 	}
 	
 	unlock() ;
 
 	if ( objects && cleanupFunctions )
 	{
-		for ( unsigned index=0; index < capacity; ++index )
+		for ( unsigned index=0; index < found; ++index )
 		{
 			if ( objects[index] )
 			{
@@ -486,10 +646,13 @@ IOFWUserObjectExporter::removeAllObjects ()
                 }
 			}
 		}
-
-		IOFree( objects, sizeof(const OSObject *) * capacity ) ;
-		IOFree( cleanupFunctions, sizeof( CleanupFunction ) * capacity ) ;
 	}
+	
+	if ( objects )
+		IOFree( objects, sizeof(const OSObject *) * count ) ;
+	
+	if ( cleanupFunctions )
+		IOFree( cleanupFunctions, sizeof( CleanupFunctionWithExporter ) * count ) ;
 }
 
 // getOwner
@@ -42,13 +42,56 @@
 			
 		private :
 		
+			// the low 16 bits of a handle hold the slot index + 1 and the upper half holds the
+			// slot generation + 1. user space passes handles for method calls in the upper half
+			// of the method selector, which keeps only the low 16 bits, so a handle without a
+			// generation is looked up by index alone
+			
+			enum
+			{
+				kHandleIndexBits		= 16,
+				kHandleIndexMask		= (1 << kHandleIndexBits) - 1,
+				kHandleGenerationMask	= 0xFF,
+				kHandleMaxEntries		= kHandleIndexMask - 1,
+				kHandleChunkShift		= 8,
+				kHandleChunkSize		= 1 << kHandleChunkShift,
+				kHandleMaxChunks		= (kHandleMaxEntries + kHandleChunkSize - 1) >> kHandleChunkShift
+			};
+			
+			// HandleEntry::fState layout
+			
+			enum
+			{
+				kEntryPinMask			= 0x0000FFFF,		// lookups in progress
+				kEntryLive				= 0x00010000,
+				kEntryGenerationShift	= 24
+			};
+			
+			struct HandleEntry
+			{
+				const OSObject *				fObject;
+				CleanupFunctionWithExporter		fCleanupFunction;
+				volatile UInt32					fState;
+				UInt32							fNextFree;		// index + 1 of next free entry, 0 ends the list
+			};
+			
 			unsigned							fCapacity;
 			unsigned							fObjectCount;
-			const OSObject **					fObjects;
-			CleanupFunctionWithExporter *		fCleanupFunctions;
+			HandleEntry * volatile				fChunks[ kHandleMaxChunks ];
+			unsigned							fFreeHead;
+			unsigned							fFreeTail;
 			IOLock *							fLock;
 			OSObject *							fOwner;
 			
+			HandleEntry *			entryForIndex ( unsigned index ) const;
+			bool					decodeHandle ( IOFireWireLib::UserObjectHandle handle, unsigned * outIndex, UInt32 * outGeneration ) const;
+			static bool				generationMatches ( UInt32 state, UInt32 generation );
+			static IOFireWireLib::UserObjectHandle	makeHandle ( unsigned index, UInt32 state );
+			HandleEntry *			pinEntry ( IOFireWireLib::UserObjectHandle handle ) const;
+			void					unpinEntry ( HandleEntry * entry ) const;
+			IOReturn				growTable ();
+			const OSObject *		retireEntry ( unsigned index, CleanupFunctionWithExporter * outCleanupFunction );
+			
 		public :
 		
 			static IOFWUserObjectExporter *		createWithOwner( OSObject * owner );
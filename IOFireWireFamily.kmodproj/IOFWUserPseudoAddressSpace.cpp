@@ -318,6 +318,8 @@ IOFWUserPseudoAddressSpace::serialize(OSSerialize *s) const
 			snprintf(temp+strlen(temp), sizeof(temp), " shared") ;
 		if (fFlags & kFWAddressSpaceExclusive)
 			snprintf(temp+strlen(temp), sizeof(temp), " exclusive") ;			
+		if (fFlags & kFWAddressSpaceBatchNotify)
+			snprintf(temp+strlen(temp), sizeof(temp), " batch-notify") ;
 	}
 	else
 	{
@@ -350,6 +352,12 @@ IOFWUserPseudoAddressSpace::free()
 
 	delete fLastWrittenHeader ;
 
+	if ( fBatchRecords )
+	{
+		IOFree( fBatchRecords, sizeof(BatchRecord) * kBatchRecordCount ) ;
+		fBatchRecords = NULL ;
+	}
+
 	if( fLock )
 	{
 		IOLockFree( fLock );
@@ -402,6 +410,12 @@ IOFWUserPseudoAddressSpace::deactivate()
 		fBackingStorePrepared = false ;
 	}
 	
+	// pending batched reads and locks are abandoned along with the headers
+	fBatchFirst		= 0 ;
+	fBatchQueued	= 0 ;
+	fBatchNotified	= 0 ;
+	fBatchSkipped	= 0 ;
+	
 	fWaitingForUserCompletion = false ;
 	
 	IOLockUnlock(fLock) ;
@@ -426,12 +440,23 @@ IOFWUserPseudoAddressSpace::completeInit( IOFireWireUserClient* userclient, Addr
 		status = false ;
 	}
 
+	// batched notification publishes headers in the packet queue
+	if ( status && (fFlags & kFWAddressSpaceBatchNotify) && !params->queueBuffer )
+	{
+		DebugLog("IOFWUserPseudoAddressSpace::initAll: batch-notify address space must have a queue buffer\n") ;
+		status = false ;
+	}
+
 	// make packet queue
 	if ( status )
 	{
 		if ( params->queueBuffer )
 		{			
-			fPacketQueue = IOFWRingBufferQ::withAddressRange( params->queueBuffer, params->queueSize, kIODirectionOutIn, fUserClient->getOwningTask() ) ;
+			// batched clients consume the queue directly and release entries through the shared tail
+			if ( fFlags & kFWAddressSpaceBatchNotify )
+				fPacketQueue = IOFWRingBufferQ::withSharedAddressRange( params->queueBuffer, params->queueSize, kIODirectionOutIn, fUserClient->getOwningTask() ) ;
+			else
+				fPacketQueue = IOFWRingBufferQ::withAddressRange( params->queueBuffer, params->queueSize, kIODirectionOutIn, fUserClient->getOwningTask() ) ;
 			
 			if ( !fPacketQueue )
 			{
@@ -443,6 +468,8 @@ IOFWUserPseudoAddressSpace::completeInit( IOFireWireUserClient* userclient, Addr
 				fPacketQueuePrepared = status ;
 			}
 		}
+
+		fBackingStoreBytesLimit = params->queueSize ;
 	}
 	
 	if ( status )
@@ -462,6 +489,21 @@ IOFWUserPseudoAddressSpace::completeInit( IOFireWireUserClient* userclient, Addr
 		}
 	}
 	
+	if ( status && (fFlags & kFWAddressSpaceBatchNotify) )
+	{
+		fBatchRecords = (BatchRecord*)IOMalloc( sizeof(BatchRecord) * kBatchRecordCount ) ;
+		
+		if ( fBatchRecords )
+		{
+			bzero( fBatchRecords, sizeof(BatchRecord) * kBatchRecordCount ) ;
+		}
+		else
+		{
+			DebugLog("%s %u: couldn't allocate batch records\n", __FILE__, __LINE__) ;
+			status = false ;
+		}
+	}
+	
 	// get a backing store if needed
 	if ( status )
 		if ( 0 != params->backingStore )
@@ -607,6 +649,9 @@ IOFWUserPseudoAddressSpace::doPacket(
 	bool			skip		= false ;
 	UInt32			response	= kFWResponseComplete ;
 
+	if ( fFlags & kFWAddressSpaceBatchNotify )
+		return doBatchPacket( nodeID, speed, addr, len, buf, reqrefcon, tag ) ;
+	
 	IOLockLock(fLock) ;
 	
 	// Process:
@@ -623,7 +668,14 @@ IOFWUserPseudoAddressSpace::doPacket(
 
 	if ( !fPacketQueue ) DebugLog("\tdP fPacketQueue is invalid!\n");
 	
-	if ( tag == IOFWPacketHeader::kIncomingPacket || tag == IOFWPacketHeader::kLockPacket ) {
+	if ( tag == IOFWPacketHeader::kIncomingPacket && copiesWritesToBackingStore() ) {
+		// payload goes straight to the backing store, only the header is queued. each
+		// header is allocated, so bound the writes waiting on the client like the
+		// queue used to and skip the rest
+		destOffset = addr.addressLo - fAddress.addressLo ;
+		skip = ( backingStoreWriteCharge( len ) > fBackingStoreBytesLimit - fBackingStoreBytesPending ) ;
+	}
+	else if ( tag == IOFWPacketHeader::kIncomingPacket || tag == IOFWPacketHeader::kLockPacket ) {
 		skip = !(fPacketQueue->isSpaceAvailable(len, &destOffset));
 	}
 	
@@ -713,8 +765,13 @@ IOFWUserPseudoAddressSpace::doPacket(
 							speed,
 							addr) ;
 
-					// zzz this write should probably be eliminated when kFWAddressSpaceAutoCopyOnWrite is set..
-					enqueued = fPacketQueue->enqueueBytes((void *)buf, len);
+					if ( copiesWritesToBackingStore() )
+					{
+						enqueued = ( fDesc->writeBytes( destOffset, buf, len ) == len ) ;
+						fBackingStoreBytesPending += backingStoreWriteCharge( len ) ;
+					}
+					else
+						enqueued = fPacketQueue->enqueueBytes((void *)buf, len);
 					
 					DebugLog("\tdP Write: Copy cmd ID: 0x%llx %s\n", currentHeader->IncomingPacket.commandID, enqueued ? "succeeded" : "failed");
 					
@@ -780,6 +837,22 @@ IOFWUserPseudoAddressSpace::doPacket(
 	return response ;
 }
 
+bool
+IOFWUserPseudoAddressSpace::copiesWritesToBackingStore() const
+{
+	return (fFlags & kFWAddressSpaceAutoCopyOnWrite) && fDesc ;
+}
+
+// backingStoreWriteCharge
+//
+// what an auto-copied write counts against fBackingStoreBytesLimit, empty writes still cost a header
+
+IOByteCount
+IOFWUserPseudoAddressSpace::backingStoreWriteCharge( IOByteCount len ) const
+{
+	return ( len < sizeof( UInt32 ) ) ? sizeof( UInt32 ) : len ;
+}
+
 UInt32
 IOFWUserPseudoAddressSpace::pseudoAddrSpaceReader(
 	void*					refCon,
@@ -793,7 +866,13 @@ IOFWUserPseudoAddressSpace::pseudoAddrSpaceReader(
 {
 	IOFWUserPseudoAddressSpace*	me = (IOFWUserPseudoAddressSpace*)refCon ;
 
-	if ( 0 == me->fReadAsyncNotificationRef[0] )
+	// batched reads are published along with writes
+	if ( me->fFlags & kFWAddressSpaceBatchNotify )
+	{
+		if ( 0 == me->fPacketAsyncNotificationRef[0] )
+			return kFWResponseTypeError ;
+	}
+	else if ( 0 == me->fReadAsyncNotificationRef[0] )
 		return kFWResponseTypeError ;
 		
 	return me->doPacket( nodeID, speed, addr, len, buf, reqrefcon, IOFWPacketHeader::kReadPacket) ;
@@ -819,6 +898,14 @@ IOFWUserPseudoAddressSpace::setAsyncRef_Packet(
 	OSAsyncReference64	asyncRef)
 {
 	bcopy(asyncRef, fPacketAsyncNotificationRef, sizeof(OSAsyncReference64)) ;	
+
+	// deliver anything that arrived while notification was off
+	if ( fBatchRecords )
+	{
+		IOLockLock(fLock) ;
+		sendBatchNotification() ;
+		IOLockUnlock(fLock) ;
+	}
 }
 
 void
@@ -868,7 +955,11 @@ IOFWUserPseudoAddressSpace::clientCommandIsComplete(
 			case IOFWPacketHeader::kIncomingPacket:
 			{
 				DebugLog("\tCplt write\n");
-				fPacketQueue->dequeueBytes(oldHeader->IncomingPacket.packetSize);
+				// writes copied to the backing store never entered the queue
+				if ( type == IOFWPacketHeader::kLockPacket || !copiesWritesToBackingStore() )
+					fPacketQueue->dequeueBytes(oldHeader->IncomingPacket.packetSize);
+				else
+					fBackingStoreBytesPending -= backingStoreWriteCharge( oldHeader->IncomingPacket.packetSize ) ;
 				break ;
 			}
 				
@@ -911,20 +1002,6 @@ IOFWUserPseudoAddressSpace::sendPacketNotification(
 {	
 	if (!fWaitingForUserCompletion)
 	{
-		if ( inPacketHeader->CommonHeader.type == IOFWPacketHeader::kIncomingPacket and (fFlags & kFWAddressSpaceAutoCopyOnWrite) != 0 )
-		{
-			IOByteCount len = IOFWPacketHeaderGetSize(inPacketHeader) ;
-			void * bytes = IOMalloc( len );
-			
-			fPacketQueue->readBytes( IOFWPacketHeaderGetOffset( inPacketHeader ), bytes, len );
-			
-			fDesc->writeBytes(	inPacketHeader->IncomingPacket.addrLo - fAddress.addressLo, 
-								bytes,
-								len ) ;
-
-			IOFree( bytes, len );
-		}
-		
 		if (inPacketHeader->CommonHeader.whichAsyncRef[0])
 		{
 			DebugLog("sPN cmdID 0x%llx\n", inPacketHeader->IncomingPacket.commandID);
@@ -954,4 +1031,224 @@ IOFWUserPseudoAddressSpace::sendPacketNotification(
 	}
 }
 
+#pragma mark -
+
+// doBatchPacket
+//
+// publish a packet header (and payload) in the packet queue for kFWAddressSpaceBatchNotify
+
+UInt32
+IOFWUserPseudoAddressSpace::doBatchPacket(
+	UInt16							nodeID,
+	IOFWSpeed&						speed,
+	FWAddress						addr,
+	UInt32							len,
+	const void*						buf,
+	IOFWRequestRefCon				reqrefcon,
+	IOFWPacketHeader::QueueTag		tag)
+{
+	UInt32						response	= kFWResponseComplete ;
+	IOFireWireController *		controller	= NULL ;
+	bool						queued		= false ;
+
+	if ( fUserClient && fUserClient->getOwner() )
+		controller = fUserClient->getOwner()->getController() ;
+
+	if ( !controller )
+	{
+		// userclient is terminating?
+		return kFWResponseAddressError ;
+	}
+
+	IOLockLock(fLock) ;
+
+	if ( fPacketQueue && fBatchQueued < kBatchRecordCount )
+	{
+		BatchRecord *					record		= & fBatchRecords[ (fBatchFirst + fBatchQueued) % kBatchRecordCount ] ;
+		FWPseudoAddrSpaceBatchHeader	header ;
+		UInt32							payloadSize	= len ;
+		
+		bzero( & header, sizeof(header) ) ;
+		header.commandID	= ++fBatchCommandID ;
+		header.packetSize	= len ;
+		header.addressLo	= addr.addressLo ;
+		header.addressHi	= addr.addressHi ;
+		header.nodeID		= nodeID ;
+		header.speed		= speed ;
+		header.generation	= controller->getGeneration() ;
+		
+		switch( tag )
+		{
+			case IOFWPacketHeader::kLockPacket:
+				header.type = kFWPseudoAddrSpaceBatchLock ;
+				break ;
+				
+			case IOFWPacketHeader::kReadPacket:
+				// the data for a read comes from the backing store, nothing to queue
+				header.type = kFWPseudoAddrSpaceBatchRead ;
+				payloadSize = 0 ;
+				buf = NULL ;
+				break ;
+				
+			default:
+				header.type = kFWPseudoAddrSpaceBatchWrite ;
+				
+				// the client reads auto-copied writes from the backing store
+				if ( copiesWritesToBackingStore() )
+					payloadSize = 0 ;
+				break ;
+		}
+		
+		queued = fPacketQueue->enqueueBytesWithHeader( & header, sizeof(header), buf, payloadSize, & record->headerOffset ) ;
+		
+		if ( queued )
+		{
+			record->reqrefcon	= reqrefcon ;
+			record->queueBytes	= sizeof(header) + payloadSize ;
+			record->type		= header.type ;
+			record->packetSize	= len ;
+			record->addrLo		= addr.addressLo ;
+			record->generation	= header.generation ;
+			record->nodeID		= nodeID ;
+			record->speed		= speed ;
+			
+			++fBatchQueued ;
+		}
+	}
+	
+	if ( queued )
+	{
+		if ( tag == IOFWPacketHeader::kIncomingPacket )
+		{
+			if ( copiesWritesToBackingStore() )
+				fDesc->writeBytes( addr.addressLo - fAddress.addressLo, buf, len ) ;
+		}
+		else
+		{
+			response = kFWResponsePending ;
+		}
+	}
+	else
+	{
+		++fBatchSkipped ;
+		
+		// if we can't handle the packet, and the hardware hasn't already responded,
+		// send kFWResponseConflictError
+		if ( ! controller->isCompleteRequest( reqrefcon ) )
+			response = kFWResponseConflictError ;
+	}
+	
+	sendBatchNotification() ;
+	
+	IOLockUnlock(fLock) ;
+	
+	return response ;
+}
+
+// clientBatchIsComplete
+//
+// user space has finished every packet in the outstanding batch
+
+void
+IOFWUserPseudoAddressSpace::clientBatchIsComplete(
+	UInt32		inCount )
+{
+	IOLockLock(fLock) ;
+
+	if ( fWaitingForUserCompletion && fBatchRecords )
+	{
+		IOFireWireController *	controller = NULL ;
+		
+		if ( fUserClient && fUserClient->getOwner() )
+			controller = fUserClient->getOwner()->getController() ;
+		
+		DebugLogCond( inCount != fBatchNotified, "IOFWUserPseudoAddressSpace::clientBatchIsComplete: acked %u of %u\n", inCount, fBatchNotified ) ;
+		
+		// a batch is always acknowledged as a whole
+		for( UInt32 i = 0; i < fBatchNotified; ++i )
+		{
+			BatchRecord * record = & fBatchRecords[ (fBatchFirst + i) % kBatchRecordCount ] ;
+			
+			if ( controller )
+			{
+				switch( record->type )
+				{
+					case kFWPseudoAddrSpaceBatchLock:
+						controller->asyncLockResponse( record->generation,
+													   record->nodeID,
+													   record->speed,
+													   fDesc,
+													   record->addrLo - fAddress.addressLo,
+													   record->packetSize >> 1,
+													   (void*)record->reqrefcon ) ;
+						break ;
+						
+					case kFWPseudoAddrSpaceBatchRead:
+						controller->asyncReadResponse( record->generation,
+													   record->nodeID,
+													   record->speed,
+													   fDesc,
+													   record->addrLo - fAddress.addressLo,
+													   record->packetSize,
+													   (void*)record->reqrefcon ) ;
+						break ;
+						
+					default:
+						break ;
+				}
+			}
+			
+			fPacketQueue->dequeueBytes( record->queueBytes ) ;
+		}
+		
+		fBatchFirst		= (fBatchFirst + fBatchNotified) % kBatchRecordCount ;
+		fBatchQueued	-= fBatchNotified ;
+		fBatchNotified	= 0 ;
+		fWaitingForUserCompletion = false ;
+		
+		// send *next* batch
+		sendBatchNotification() ;
+	}
+	
+	IOLockUnlock(fLock) ;
+}
+
+// sendBatchNotification
+//
+// called with fLock held
+
+void
+IOFWUserPseudoAddressSpace::sendBatchNotification()
+{
+	if ( fWaitingForUserCompletion or !fBatchRecords )
+		return ;
+	
+	if ( 0 == fPacketAsyncNotificationRef[0] )
+		return ;
+	
+	if ( fBatchQueued == 0 && fBatchSkipped == 0 )
+		return ;
+	
+	io_user_reference_t		args[ 2 + kFWPseudoAddrSpaceMaxBatchCount ] ;
+	UInt32					count = fBatchQueued ;
+	
+	if ( count > kFWPseudoAddrSpaceMaxBatchCount )
+		count = kFWPseudoAddrSpaceMaxBatchCount ;
+	
+	args[0] = count ;
+	args[1] = fBatchSkipped ;
+	for( UInt32 i = 0; i < count; ++i )
+	{
+		args[ 2 + i ] = fBatchRecords[ (fBatchFirst + i) % kBatchRecordCount ].headerOffset ;
+	}
+	
+	DebugLog("sBN count %u skipped %u\n", count, fBatchSkipped) ;
+	
+	IOFireWireUserClient::sendAsyncResult64( fPacketAsyncNotificationRef, kIOReturnSuccess, args, 2 + count ) ;
+	
+	fBatchNotified	= count ;
+	fBatchSkipped	= 0 ;
+	fWaitingForUserCompletion = true ;
+}
+
 #endif //__IOFWUserClientPseuAddrSpace_H__
@@ -266,6 +266,10 @@ public:
 
 	// --- getters ----------
     const FWAddress& 				getBase() { return fAddress ; }
+	// kFWAddressSpaceAutoCopyOnWrite: write payloads go directly to the backing store
+	// instead of through the packet queue
+	bool							copiesWritesToBackingStore() const ;
+	IOByteCount						backingStoreWriteCharge( IOByteCount len ) const ;
 	const UInt32					getUserRefCon() { return fUserRefCon ;}
 	const IOFireWireUserClient&				getUserClient(void) { return *fUserClient ;}
 
@@ -300,6 +304,41 @@ public:
 											IOReturn				inResult ) ;
 	void							sendPacketNotification(
 											IOFWPacketHeader*		inPacketHeader) ;
+
+	// --- batched notification (kFWAddressSpaceBatchNotify) ----------
+	UInt32							doBatchPacket(
+											UInt16							nodeID,
+											IOFWSpeed&						speed,
+											FWAddress						addr,
+											UInt32							len,
+											const void*						buf,
+											IOFWRequestRefCon				reqrefcon,
+											IOFWPacketHeader::QueueTag		tag) ;
+	void							clientBatchIsComplete(
+											UInt32					inCount ) ;
+	void							sendBatchNotification() ;
+
+protected:
+	enum
+	{
+		kBatchRecordCount			= 256
+	} ;
+
+	// kernel-only completion state for a packet published in the packet queue;
+	// the header user space sees lives in the queue itself
+	struct BatchRecord
+	{
+		IOFWRequestRefCon			reqrefcon ;
+		IOByteCount					headerOffset ;
+		IOByteCount					queueBytes ;				// header + payload, dequeued on completion
+		UInt32						type ;
+		UInt32						packetSize ;
+		UInt32						addrLo ;
+		UInt32						generation ;
+		UInt16						nodeID ;
+		IOFWSpeed					speed ;
+	} ;
+
 private:
 	IOFWRingBufferQ *			fPacketQueue;					// the queue where incoming packets go before being written to the backingstore
 	IOLock*						fLock ;							// to lock this object
@@ -320,6 +359,16 @@ private:
 	
 	Boolean						fPacketQueuePrepared ;
 	Boolean						fBackingStorePrepared ;
+
+	IOByteCount					fBackingStoreBytesPending ;		// payload of auto-copied writes the client hasn't completed
+	IOByteCount					fBackingStoreBytesLimit ;		// the packet queue size, these writes used to take queue space
+
+	BatchRecord *				fBatchRecords ;					// ring of kBatchRecordCount records
+	UInt32						fBatchFirst ;					// oldest record not yet acknowledged
+	UInt32						fBatchQueued ;					// records in the packet queue
+	UInt32						fBatchNotified ;				// records in the outstanding notification
+	UInt32						fBatchSkipped ;					// packets dropped since the last notification
+	UInt64						fBatchCommandID ;
 } ;
 
 #endif //__IOFWUserClientPsduAddrSpace_H__
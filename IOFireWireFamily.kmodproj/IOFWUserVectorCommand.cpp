@@ -184,7 +184,8 @@ IOFWUserVectorCommand::submit( OSAsyncReference64 async_ref, mach_vm_address_t c
 	
 	if( status == kIOReturnSuccess )
 	{
-		fControl->closeGate();
+		// submit the whole vector as one batch so its packets go out with a single flush
+		fControl->beginSubmitBatch();
 		
 		fInflightCmds = 0;
 		fResultOffset = 0;
@@ -203,7 +204,7 @@ IOFWUserVectorCommand::submit( OSAsyncReference64 async_ref, mach_vm_address_t c
 			offset += length;
 		}
 		
-		fControl->openGate();
+		fControl->commitSubmitBatch();
 	}
 	
 	return status;
@@ -254,14 +255,11 @@ IOFWUserVectorCommand::submitOneCommand( CommandSubmitParams * params )
 	//	OSAsyncReference64 * async_ref = cmd->getAsyncReference64();
 	//	setAsyncReference64( *async_ref, (mach_port_t)async_ref[0], (mach_vm_address_t)params->callback, (io_user_reference_t)params->refCon);	
 		
-		// disable packet flushing during vector submit
-		cmd->setFlush( false );
+		// packet flushing is deferred to the end of the vector's submit batch
 		cmd->setVectorCommand( this );	// connect to vector
 		
 		status = cmd->submit( params, NULL );
 		fInflightCmds++;
-		// turn flush back on for future submits (possibly not using a vector);
-		cmd->setFlush( true );
 	}
 		
 	if( cmd )
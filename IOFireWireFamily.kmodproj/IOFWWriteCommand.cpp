@@ -134,7 +134,7 @@ bool IOFWWriteCommand::createMemberVariables( void )
 	{
 		if( success )
 		{
-			fMembers->fSubclassMembers = IOMalloc( sizeof(MemberVariables) );
+			fMembers->fSubclassMembers = allocCommandMemory( sizeof(MemberVariables) );
 			if( fMembers->fSubclassMembers == NULL )
 				success = false;
 		}
@@ -167,7 +167,7 @@ void IOFWWriteCommand::destroyMemberVariables( void )
 	{		
 		// free member variables
 		
-		IOFree( fMembers->fSubclassMembers, sizeof(MemberVariables) );
+		freeCommandMemory( fMembers->fSubclassMembers, sizeof(MemberVariables) );
 		fMembers->fSubclassMembers = NULL;
 	}
 }
@@ -185,7 +185,7 @@ bool IOFWWriteQuadCommand::createMemberVariables( void )
 	{
 		if( success )
 		{
-			fMembers->fSubclassMembers = IOMalloc( sizeof(MemberVariables) );
+			fMembers->fSubclassMembers = allocCommandMemory( sizeof(MemberVariables) );
 			if( fMembers->fSubclassMembers == NULL )
 				success = false;
 		}
@@ -218,7 +218,7 @@ void IOFWWriteQuadCommand::destroyMemberVariables( void )
 	{		
 		// free member variables
 		
-		IOFree( fMembers->fSubclassMembers, sizeof(MemberVariables) );
+		freeCommandMemory( fMembers->fSubclassMembers, sizeof(MemberVariables) );
 		fMembers->fSubclassMembers = NULL;
 	}
 }
@@ -47,6 +47,7 @@ void FireLog( const char *format, ... )
 
 extern "C" {
 #include <kern/clock.h>
+#include <kern/cpu_number.h>
 }
 
 #define kFireLogVersionKey 		0x19		// arbitrary
@@ -55,6 +56,7 @@ extern "C" {
 #define kFireLogAddressLoKey 	0x1c		// arbitrary
 #define kFireLogRandomIDKey		0x1d		// arbitrary
 #define kFireLogMaxEntrySizeKey	0x1e		// arbitrary
+#define kFireLogBinaryOffsetKey	0x1f		// arbitrary
 
 #define kFireLogTempBufferSize 255
 
@@ -131,6 +133,9 @@ IOReturn IOFireLog::initialize( void )
     
     fController = NULL;
     
+    fBinaryMode = false;
+    fBinaryHeader = NULL;
+    
     // allocate mem for log
     fLogDescriptor = IOBufferMemoryDescriptor::withCapacity( fLogSize, kIODirectionOutIn, true );
     if( fLogDescriptor == NULL )
@@ -170,6 +175,15 @@ IOReturn IOFireLog::initialize( void )
         fLogBuffer->end = 0;
     }
 
+    if( status == kIOReturnSuccess )
+    {
+        UInt32 binary = 0;
+        if( PE_parse_boot_argn( "firelogbinary", &binary, sizeof(binary) ) && binary )
+        {
+            initializeBinaryLog();
+        }
+    }
+
     if( status == kIOReturnSuccess )
     {
     	fLock = IOLockAlloc();
@@ -233,6 +247,11 @@ UInt32 IOFireLog::getRandomID( void )
 {
     return fRandomID;
 }
+
+bool IOFireLog::isBinaryMode( void )
+{
+    return fBinaryMode;
+}
     
 // firelog_putc
 //
@@ -263,6 +282,13 @@ IOFireLog * IOFireLog::getFireLog( void )
 
 void IOFireLog::logString( const char *format, va_list ap )
 {
+    if( fBinaryMode )
+    {
+        // no gate, no lock
+        logBinary( format, ap );
+        return;
+    }
+    
     UInt32 			cycleTime;
     AbsoluteTime	absolute_time;
     uint64_t 		time;
@@ -435,6 +461,314 @@ void IOFireLog::logString( const char *format, va_list ap )
 	}
 }
 
+#pragma mark -
+
+// initializeBinaryLog
+//
+// carve the log into the binary header, the format table and the per cpu rings
+// stays in text mode if they don't fit
+
+void IOFireLog::initializeBinaryLog( void )
+{
+    UInt32 format_table_offset = (sizeof(FireLogBinaryHeader) + 7) & ~7;
+    UInt32 format_area_offset = format_table_offset + kFireLogFormatSlotCount * sizeof(FireLogFormatSlot);
+    UInt32 ring_offset = (format_area_offset + kFireLogFormatAreaSize + 7) & ~7;
+    UInt32 binary_size = ring_offset + kFireLogRingCount * (sizeof(FireLogRingHeader) + kFireLogRingSize);
+
+    if( binary_size > kFireLogSize )
+    {
+        IOLog( "FireLog : binary log needs %u bytes, using text mode\n", binary_size );
+        return;
+    }
+    
+    // log was cleared by initialize()
+    
+    fBinaryHeader = (FireLogBinaryHeader*)fLogStart;
+    fBinaryHeader->version = kFireLogBinaryVersion;
+    fBinaryHeader->ringCount = kFireLogRingCount;
+    fBinaryHeader->ringSize = kFireLogRingSize;
+    fBinaryHeader->ringOffset = ring_offset;
+    fBinaryHeader->formatSlotCount = kFireLogFormatSlotCount;
+    fBinaryHeader->formatTableOffset = format_table_offset;
+    fBinaryHeader->formatAreaOffset = format_area_offset;
+    fBinaryHeader->formatAreaSize = kFireLogFormatAreaSize;
+    fBinaryHeader->formatAreaUsed = 0;
+    
+    // magic last, the reader keys off it
+    OSSynchronizeIO();
+    fBinaryHeader->magic = kFireLogBinaryMagic;
+
+    fBinaryMode = true;
+    
+    IOLog( "FireLog : binary mode, %d rings of %d bytes\n", kFireLogRingCount, kFireLogRingSize );
+}
+
+// logBinary
+//
+// capture the raw arguments and append them to this cpu's ring,
+// formatting is left to the reader
+
+void IOFireLog::logBinary( const char *format, va_list ap )
+{
+    UInt32					record[kFireLogMaxRecordSize / sizeof(UInt32)];
+    FireLogBinaryRecord *	entry = (FireLogBinaryRecord*)record;
+    AbsoluteTime			absolute_time;
+    uint64_t 				time;
+    bool					truncated = false;
+    UInt32					length;
+    
+    // binary records are timestamped with uptime only. reading the cycle timer
+    // goes through the FWIM and needs the gate, which binary mode never takes
+    IOFWGetAbsoluteTime( &absolute_time );
+    absolutetime_to_nanoseconds( absolute_time, &time );
+    
+    entry->timeHi = (UInt32)(time >> 32);
+    entry->timeLo = (UInt32)(time & 0xffffffff);
+    entry->cycleTime = 0;
+    entry->formatID = internFormat( format );
+    
+    length = sizeof(FireLogBinaryRecord);
+    length += captureArguments( format, ap, (UInt8*)(entry + 1), kFireLogMaxRecordSize - length, &truncated );
+    
+    entry->header = (kFireLogRecordMagic << 16) | 
+                    ((truncated ? kFireLogRecordTruncated : 0) << 8) | 
+                    (length >> 2);
+                    
+    appendRecord( record, length );
+}
+
+// internFormat
+//
+// returns the format table slot for this format string, copying the string
+// into the format area the first time it is seen. slots are claimed with
+// compare and swap, a racing claim may leave a duplicate slot which is harmless
+
+UInt32 IOFireLog::internFormat( const char * format )
+{
+    FireLogFormatSlot * table = getFormatTable();
+    UInt64 key = (UInt64)(uintptr_t)format;
+    UInt32 mask = kFireLogFormatSlotCount - 1;
+    UInt32 slot = ((UInt32)((key >> 2) ^ (key >> 32)) * 2654435761U) & mask;
+    UInt32 probe;
+    
+    for( probe = 0; probe < kFireLogFormatSlotCount; probe++ )
+    {
+        FireLogFormatSlot * entry = &table[slot];
+        
+        if( entry->claimed )
+        {
+            if( entry->address == key )
+            {
+                return slot;
+            }
+        }
+        else if( OSCompareAndSwap( 0, 1, &entry->claimed ) )
+        {
+            entry->address = key;
+            
+            UInt32 length = strlen( format ) + 1;
+            if( length > kFireLogMaxFormatSize )
+                length = kFireLogMaxFormatSize;
+            
+            UInt32 offset = OSAddAtomic( (length + 3) & ~3, (SInt32*)&fBinaryHeader->formatAreaUsed );
+            if( offset + length <= kFireLogFormatAreaSize )
+            {
+                char * string = ((char*)fBinaryHeader) + fBinaryHeader->formatAreaOffset + offset;
+                bcopy( format, string, length - 1 );
+                string[length - 1] = '\0';
+                entry->offset = offset;
+                
+                OSSynchronizeIO();
+                entry->length = length;
+            }
+            
+            // a full format area leaves the slot with no string
+            return slot;
+        }
+        else
+        {
+            // lost the race for this slot, look at it again
+            continue;
+        }
+        
+        slot = (slot + 1) & mask;
+    }
+    
+    return kFireLogUnknownFormat;
+}
+
+// captureArguments
+//
+// walk the conversions in format and copy out the arguments they consume.
+// returns the bytes used, always a multiple of 4
+
+UInt32 IOFireLog::captureArguments( const char * format, va_list ap, UInt8 * args, UInt32 size, bool * truncated )
+{
+    UInt32 used = 0;
+    const char * c = format;
+    
+    while( *c )
+    {
+        if( *c++ != '%' )
+            continue;
+
+        // flags, width and precision
+        while( (*c >= '0' && *c <= '9') || *c == '-' || *c == '+' || *c == ' ' || *c == '#' || *c == '.' || *c == '*' )
+        {
+            if( *c == '*' )
+            {
+                // star width or precision takes an int, keep it
+                UInt64 value = va_arg( ap, int );
+                if( used + sizeof(UInt64) > size )
+                {
+                    *truncated = true;
+                    return used;
+                }
+                bcopy( &value, args + used, sizeof(UInt64) );
+                used += sizeof(UInt64);
+            }
+            c++;
+        }
+        
+        // length modifiers
+        int longs = 0;
+        bool sized = false;
+        while( *c == 'h' || *c == 'l' || *c == 'q' || *c == 'z' )
+        {
+            if( *c == 'l' )
+                longs++;
+            else if( *c == 'q' )
+                longs = 2;
+            else if( *c == 'z' )
+                sized = true;
+            c++;
+        }
+        
+        char conversion = *c;
+        if( conversion == '\0' )
+            break;
+        c++;
+        
+        if( conversion == '%' )
+            continue;
+        
+        if( conversion == 's' || conversion == 'b' )
+        {
+            // %b takes the value before the bit description string
+            if( conversion == 'b' )
+            {
+                UInt64 value = va_arg( ap, int );
+                if( used + sizeof(UInt64) > size )
+                {
+                    *truncated = true;
+                    return used;
+                }
+                bcopy( &value, args + used, sizeof(UInt64) );
+                used += sizeof(UInt64);
+            }
+            
+            const char * string = va_arg( ap, const char * );
+            if( string == NULL )
+                string = "(null)";
+            
+            UInt32 length = strlen( string ) + 1;
+            if( length > kFireLogMaxStringSize )
+            {
+                length = kFireLogMaxStringSize;
+                *truncated = true;
+            }
+            if( used + sizeof(UInt32) + length > size )
+            {
+                if( used + sizeof(UInt32) + 4 > size )
+                {
+                    *truncated = true;
+                    return used;
+                }
+                
+                length = size - used - sizeof(UInt32);
+                *truncated = true;
+            }
+            
+            *((UInt32*)(args + used)) = length;
+            used += sizeof(UInt32);
+            bcopy( string, args + used, length - 1 );
+            args[used + length - 1] = '\0';
+            used += (length + 3) & ~3;
+        }
+        else
+        {
+            UInt64 value;
+            
+            if( conversion == 'p' )
+                value = (UInt64)(uintptr_t)va_arg( ap, void * );
+            else if( sized )
+                value = va_arg( ap, size_t );
+            else if( longs >= 2 )
+                value = va_arg( ap, unsigned long long );
+            else if( longs == 1 )
+                value = va_arg( ap, unsigned long );
+            else
+                value = va_arg( ap, unsigned int );
+            
+            if( used + sizeof(UInt64) > size )
+            {
+                *truncated = true;
+                return used;
+            }
+            bcopy( &value, args + used, sizeof(UInt64) );
+            used += sizeof(UInt64);
+        }
+    }
+    
+    return used;
+}
+
+// appendRecord
+//
+// reserve space in this cpu's ring with an atomic add and copy the record in,
+// header quadlet last. a reservation that straddles the end of the ring is
+// padded out on both sides and retried. cpu migration after picking the ring
+// is harmless, the reservation is atomic either way.
+
+void IOFireLog::appendRecord( UInt32 * record, UInt32 length )
+{
+    FireLogRingHeader * ring = getRing( cpu_number() % kFireLogRingCount );
+    char * data = (char*)(ring + 1);
+    
+    while( true )
+    {
+        UInt32 position = OSAddAtomic( length, (SInt32*)&ring->head );
+        UInt32 offset = position & (kFireLogRingSize - 1);
+        
+        if( offset + length <= kFireLogRingSize )
+        {
+            UInt32 * dest = (UInt32*)(data + offset);
+            
+            dest[0] = 0;
+            bcopy( record + 2, dest + 2, length - (2 * sizeof(UInt32)) );
+            dest[1] = position;
+            
+            OSSynchronizeIO();
+            dest[0] = record[0];
+            
+            break;
+        }
+        
+        // pad to the end of the ring and over the wrapped part at the start
+        
+        UInt32 tail = kFireLogRingSize - offset;
+        UInt32 head = length - tail;
+        
+        if( tail >= (2 * sizeof(UInt32)) )
+            ((UInt32*)(data + offset))[1] = position;
+        ((UInt32*)(data + offset))[0] = (kFireLogRecordMagic << 16) | (kFireLogRecordPad << 8) | (tail >> 2);
+        
+        if( head >= (2 * sizeof(UInt32)) )
+            ((UInt32*)data)[1] = position + tail;
+        ((UInt32*)data)[0] = (kFireLogRecordMagic << 16) | (kFireLogRecordPad << 8) | (head >> 2);
+    }
+}
+
 //////////////////////////////
 
 OSDefineMetaClassAndStructors(IOFireLogPublisher, OSObject)
@@ -597,12 +931,21 @@ IOReturn IOFireLogPublisher::initWithController( IOFireWireController* controlle
     {        
         fUnitDir->addEntry(kConfigUnitSpecIdKey, (UInt32)0x27);        
         fUnitDir->addEntry(kConfigUnitSwVersionKey, (UInt32)0x1);   
-        fUnitDir->addEntry(kFireLogVersionKey, (UInt32)3 );
+        fUnitDir->addEntry(kFireLogVersionKey, (UInt32)(fFireLog->isBinaryMode() ? 4 : 3) );
         fUnitDir->addEntry(kFireLogSizeKey, log_size );
         fUnitDir->addEntry(kFireLogAddressHiKey, (UInt32)(log_physical_address >> 16) );
         fUnitDir->addEntry(kFireLogAddressLoKey, (UInt32)(log_physical_address & 0x0000FFFF) );
         fUnitDir->addEntry(kFireLogRandomIDKey, (UInt32)(log_random_id & 0x00FFFFFF) );
-        fUnitDir->addEntry(kFireLogMaxEntrySizeKey, (UInt32)( sizeof(uint64_t) + sizeof(UInt32) + kFireLogTempBufferSize + sizeof(UInt32)) );
+        if( fFireLog->isBinaryMode() )
+        {
+            // the binary header follows the text log header
+            fUnitDir->addEntry(kFireLogMaxEntrySizeKey, (UInt32)kFireLogMaxRecordSize );
+            fUnitDir->addEntry(kFireLogBinaryOffsetKey, (UInt32)(2 * sizeof(UInt32)) );
+        }
+        else
+        {
+            fUnitDir->addEntry(kFireLogMaxEntrySizeKey, (UInt32)( sizeof(uint64_t) + sizeof(UInt32) + kFireLogTempBufferSize + sizeof(UInt32)) );
+        }
     }
     
     if( status == kIOReturnSuccess )
@@ -38,6 +38,33 @@
 #define kFireLogSize (12*1024*1024)    // 8MB
 //#define kFireLogSize (512*1024)    // 512KB
 
+// binary mode, enabled with the "firelogbinary" boot-arg
+//
+// callers append raw records to per cpu rings without taking any lock,
+// the remote reader formats them. the log is laid out as
+//
+//		FireLogHeader (unused in binary mode)
+//		FireLogBinaryHeader
+//		format table	- FireLogFormatSlot[kFireLogFormatSlotCount]
+//		format area		- the format strings the slots point at
+//		rings			- kFireLogRingCount * (FireLogRingHeader + kFireLogRingSize)
+
+#define kFireLogBinaryMagic			0x464c4f47		// 'FLOG'
+#define kFireLogBinaryVersion		1
+#define kFireLogRingCount			8
+#define kFireLogRingSize			(1024*1024)		// must be a power of 2
+#define kFireLogFormatSlotCount		2048			// must be a power of 2
+#define kFireLogFormatAreaSize		(256*1024)
+#define kFireLogMaxFormatSize		256
+#define kFireLogMaxRecordSize		256
+#define kFireLogMaxStringSize		64
+#define kFireLogUnknownFormat		0xffffffff
+
+// record header quadlet : magic(16) flags(8) length in quadlets(8)
+#define kFireLogRecordMagic			0xf10e
+#define kFireLogRecordPad			0x01
+#define kFireLogRecordTruncated		0x02
+
 class IOFireLog : public OSObject
 {
     OSDeclareAbstractStructors(IOFireLog)
@@ -50,6 +77,47 @@ protected:
         UInt32	end;
     } FireLogHeader;
     
+    typedef struct
+    {
+        UInt32			magic;
+        UInt32			version;
+        UInt32			ringCount;
+        UInt32			ringSize;				// bytes of record data per ring
+        UInt32			ringOffset;				// from the binary header
+        UInt32			formatSlotCount;
+        UInt32			formatTableOffset;		// from the binary header
+        UInt32			formatAreaOffset;		// from the binary header
+        UInt32			formatAreaSize;
+        volatile UInt32	formatAreaUsed;
+    } FireLogBinaryHeader;
+    
+    typedef struct
+    {
+        volatile UInt32	claimed;
+        UInt32			offset;					// of the string in the format area
+        UInt64			address;				// format pointer, the key for this slot
+        volatile UInt32	length;					// of the string, set last, 0 if not yet copied
+        UInt32			pad;
+    } FireLogFormatSlot;
+    
+    typedef struct
+    {
+        volatile UInt32	head;					// total bytes ever reserved in this ring
+        UInt32			pad[3];
+    } FireLogRingHeader;
+    
+    // followed by the arguments, each integer as 8 bytes and
+    // each string as a 4 byte length and quadlet padded bytes
+    typedef struct
+    {
+        UInt32			header;					// written last
+        UInt32			sequence;				// ring position this record was written at
+        UInt32			timeHi;					// uptime in ns
+        UInt32			timeLo;
+        UInt32			cycleTime;				// always 0, see logBinary
+        UInt32			formatID;				// format table slot
+    } FireLogBinaryRecord;
+    
     static OSObject * 	sFireLog;
     static int			sTempBufferIndex;
     static char 		sTempBuffer[255];
@@ -66,9 +134,23 @@ protected:
     bool						fNeedSpace;
     UInt32 						fLogSize;
     UInt32						fRandomID;
+    bool						fBinaryMode;
+    FireLogBinaryHeader *		fBinaryHeader;
 	
     static void firelog_putc( char c );
     virtual IOReturn initialize( void );
+    
+    void initializeBinaryLog( void );
+    void logBinary( const char *format, va_list ap );
+    UInt32 internFormat( const char * format );
+    UInt32 captureArguments( const char * format, va_list ap, UInt8 * args, UInt32 size, bool * truncated );
+    void appendRecord( UInt32 * record, UInt32 length );
+    
+    inline FireLogFormatSlot * getFormatTable( void )
+        { return (FireLogFormatSlot*)(((char*)fBinaryHeader) + fBinaryHeader->formatTableOffset); }
+    inline FireLogRingHeader * getRing( UInt32 index )
+        { return (FireLogRingHeader*)(((char*)fBinaryHeader) + fBinaryHeader->ringOffset + 
+                                       index * (sizeof(FireLogRingHeader) + kFireLogRingSize)); }
 
     inline char * logicalToPhysical( char * logical )
         { return (logical - ((char*)fLogBuffer) + ((char*)fLogPhysicalAddress)); }
@@ -94,6 +176,7 @@ public:
     virtual IOPhysicalAddress getLogPhysicalAddress( void );
     virtual UInt32 getLogSize( void );
     virtual UInt32 getRandomID( void );
+    virtual bool isBinaryMode( void );
 	
     virtual void logString( const char *format, va_list ap );
     
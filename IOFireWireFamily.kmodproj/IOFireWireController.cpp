@@ -63,6 +63,7 @@
 #import <IOKit/IOMessage.h>
 #import <IOKit/IOTimerEventSource.h>
 #import <IOKit/IOKitKeysPrivate.h>
+#import <IOKit/IOUserClient.h>
 
 // bsd
 #include <sys/sysctl.h>
@@ -333,6 +334,342 @@ bool IOFireWireDuplicateGUIDList::findDuplicateGUID( CSRNodeUniqueID guid, UInt3
 	return( false );
 }
 
+#pragma mark -
+
+OSDefineMetaClassAndStructors(IOFWCommandPool, OSObject);
+
+// create
+//
+//
+
+IOFWCommandPool * IOFWCommandPool::create( void )
+{
+	IOFWCommandPool * pool;
+
+	pool = OSTypeAlloc( IOFWCommandPool );
+	if( pool != NULL && !pool->init() )
+	{
+		pool->release();
+		pool = NULL;
+	}
+	
+	return pool;
+}
+
+// init
+//
+//
+
+bool IOFWCommandPool::init( void )
+{
+	bool success = OSObject::init();
+	
+	if( success )
+	{
+		fLock = IOLockAlloc();
+		if( fLock == NULL )
+			success = false;
+	}
+	
+	if( success )
+	{
+		fCommands = OSArray::withCapacity( kFWCommandPoolSize );
+		if( fCommands == NULL )
+			success = false;
+	}
+	
+	return success;
+}
+
+// free
+//
+// only runs once the controller and every command have dropped their references,
+// so nothing else can be holding the lock
+
+void IOFWCommandPool::free( void )
+{
+	// idle commands hold a reference, so there are none left by now
+	if( fCommands != NULL )
+	{
+		fCommands->release();
+		fCommands = NULL;
+	}
+	
+	while( fSyncerCount > 0 )
+	{
+		fSyncerCount--;
+		fSyncers[fSyncerCount]->release();
+		fSyncers[fSyncerCount] = NULL;
+	}
+	
+	for( unsigned int i = 0; i < kFWCommandMemoryClasses; i++ )
+	{
+		IOFWCommandMemoryClass * memory_class = &fMemory[i];
+		
+		while( memory_class->fFreeList != NULL )
+		{
+			void * block = memory_class->fFreeList;
+			memory_class->fFreeList = *(void**)block;
+			IOFree( block, memory_class->fSize );
+		}
+		
+		memory_class->fCount = 0;
+	}
+	
+	if( fLock != NULL )
+	{
+		IOLockFree( fLock );
+		fLock = NULL;
+	}
+	
+	OSObject::free();
+}
+
+// allocMemory
+//
+// served from the free list for this size when possible
+
+void * IOFWCommandPool::allocMemory( vm_size_t size )
+{
+	void * block = NULL;
+	
+	IOLockLock( fLock );
+	
+	for( unsigned int i = 0; i < kFWCommandMemoryClasses; i++ )
+	{
+		IOFWCommandMemoryClass * memory_class = &fMemory[i];
+		
+		if( memory_class->fSize == size && memory_class->fFreeList != NULL )
+		{
+			block = memory_class->fFreeList;
+			memory_class->fFreeList = *(void**)block;
+			memory_class->fCount--;
+			break;
+		}
+	}
+	
+	if( block != NULL )
+		fHits++;
+	else
+		fMisses++;
+	
+	IOLockUnlock( fLock );
+	
+	if( block == NULL )
+		block = IOMalloc( size );
+	
+	return block;
+}
+
+// freeMemory
+//
+// keep the block for the next command of this size unless the cache is full
+
+void IOFWCommandPool::freeMemory( void * block, vm_size_t size )
+{
+	bool cached = false;
+	
+	if( block == NULL )
+		return;
+	
+	if( size >= sizeof(void*) )
+	{
+		IOLockLock( fLock );
+		
+		IOFWCommandMemoryClass * memory_class = NULL;
+		
+		for( unsigned int i = 0; i < kFWCommandMemoryClasses; i++ )
+		{
+			if( fMemory[i].fSize == size )
+			{
+				memory_class = &fMemory[i];
+				break;
+			}
+			
+			if( memory_class == NULL && fMemory[i].fSize == 0 )
+			{
+				memory_class = &fMemory[i];
+			}
+		}
+		
+		if( memory_class != NULL && memory_class->fCount < kFWCommandMemoryPerClass )
+		{
+			memory_class->fSize = size;
+			*(void**)block = memory_class->fFreeList;
+			memory_class->fFreeList = block;
+			memory_class->fCount++;
+			cached = true;
+		}
+		
+		IOLockUnlock( fLock );
+	}
+	
+	if( !cached )
+		IOFree( block, size );
+}
+
+// allocSyncer
+//
+// returns a syncer holding one reference for the waiter and one released by signal()
+
+IOFWSyncer * IOFWCommandPool::allocSyncer( void )
+{
+	IOFWSyncer * syncer = NULL;
+	
+	IOLockLock( fLock );
+	
+	if( fSyncerCount > 0 )
+	{
+		syncer = fSyncers[--fSyncerCount];
+		fSyncers[fSyncerCount] = NULL;
+		fHits++;
+	}
+	else
+	{
+		fMisses++;
+	}
+	
+	IOLockUnlock( fLock );
+	
+	if( syncer != NULL )
+	{
+		syncer->reinit();
+		syncer->retain();
+	}
+	else
+	{
+		syncer = IOFWSyncer::create();
+	}
+	
+	return syncer;
+}
+
+// recycleSyncer
+//
+// takes the waiter's reference to a syncer that has been waited on
+
+void IOFWCommandPool::recycleSyncer( IOFWSyncer * syncer )
+{
+	if( syncer == NULL )
+		return;
+	
+	IOLockLock( fLock );
+	
+	if( fSyncerCount < kFWSyncerPoolSize )
+	{
+		fSyncers[fSyncerCount++] = syncer;
+		syncer = NULL;
+	}
+	
+	IOLockUnlock( fLock );
+	
+	if( syncer != NULL )
+		syncer->release();
+}
+
+// allocCommand
+//
+//
+
+IOFWAsyncCommand * IOFWCommandPool::allocCommand( const OSMetaClass * type, IOFireWireNub * device )
+{
+	IOFWAsyncCommand * cmd = NULL;
+	
+	IOLockLock( fLock );
+	
+	unsigned int count = fCommands->getCount();
+	for( unsigned int i = 0; i < count; i++ )
+	{
+		IOFWAsyncCommand * candidate = (IOFWAsyncCommand*)fCommands->getObject( i );
+		
+		// reinit keeps the device a command was made for
+		if( candidate->getMetaClass() == type && candidate->getDevice() == device )
+		{
+			cmd = candidate;
+			cmd->retain();
+			fCommands->removeObject( i );
+			break;
+		}
+	}
+	
+	if( cmd != NULL )
+		fHits++;
+	else
+		fMisses++;
+	
+	IOLockUnlock( fLock );
+	
+	return cmd;
+}
+
+// recycleCommand
+//
+// takes the caller's reference
+
+void IOFWCommandPool::recycleCommand( IOFWAsyncCommand * cmd )
+{
+	if( cmd == NULL )
+		return;
+	
+	// only idle commands nobody else is holding on to
+	if( cmd->getRetainCount() == 1 && !cmd->Busy() )
+	{
+		IOLockLock( fLock );
+		
+		if( fCommands->getCount() < kFWCommandPoolSize )
+		{
+			fCommands->setObject( cmd );
+		}
+		
+		IOLockUnlock( fLock );
+	}
+	
+	cmd->release();
+}
+
+// flushCommands
+//
+// the commands give their memory back to us as they go, so release them unlocked
+
+void IOFWCommandPool::flushCommands( void )
+{
+	while( true )
+	{
+		OSObject * cmd = NULL;
+		
+		IOLockLock( fLock );
+		
+		unsigned int count = fCommands->getCount();
+		if( count > 0 )
+		{
+			cmd = fCommands->getObject( count - 1 );
+			cmd->retain();
+			fCommands->removeObject( count - 1 );
+		}
+		
+		IOLockUnlock( fLock );
+		
+		if( cmd == NULL )
+			break;
+		
+		cmd->release();
+	}
+}
+
+// getStatistics
+//
+//
+
+void IOFWCommandPool::getStatistics( UInt32 * hits, UInt32 * misses )
+{
+	IOLockLock( fLock );
+	
+	*hits = fHits;
+	*misses = fMisses;
+	
+	IOLockUnlock( fLock );
+}
+
 OSDefineMetaClassAndStructors(IOFireWireControllerAux, IOFireWireBusAux);
 OSMetaClassDefineReservedUnused(IOFireWireControllerAux, 0);
 OSMetaClassDefineReservedUnused(IOFireWireControllerAux, 1);
@@ -653,6 +990,76 @@ bool IOFireWireController::init( IOFireWireLink *fwim )
 		if( fSpaceIterator == NULL )
 			success = false;
 	}
+
+	if( success )
+	{
+		reserved = (ExpansionData*)IOMalloc( sizeof(ExpansionData) );
+		if( reserved == NULL )
+			success = false;
+		else
+			bzero( reserved, sizeof(ExpansionData) );
+	}
+
+	//
+	// transaction label pools
+	//
+	
+	if( success )
+	{
+		// an FWIM that keys its own per-label state on (node, label) rather than the label
+		// alone advertises it, and then labels are only unique per destination. otherwise
+		// every request shares the broadcast pool and labels stay unique across the bus.
+		reserved->fPerNodeTLabels = (fFWIM->getProperty( "FWPerNodeTLabels" ) == kOSBooleanTrue);
+		
+		// allocTrans runs inside the gate, so allocate every pool it can use up front
+		unsigned int pool_index = reserved->fPerNodeTLabels ? 0 : kFWBroadcastNodeID;
+		for( ; success && pool_index <= kFWBroadcastNodeID; pool_index++ )
+		{
+			AsyncPendingTransPool * pool = (AsyncPendingTransPool*)IOMalloc( sizeof(AsyncPendingTransPool) );
+			if( pool == NULL )
+			{
+				success = false;
+			}
+			else
+			{
+				bzero( pool, sizeof(AsyncPendingTransPool) );
+				pool->fLastTrans = kMaxPendingTransfers-1;
+				reserved->fTransPools[pool_index] = pool;
+			}
+		}
+	}
+
+	if( success )
+	{
+		reserved->fUnindexedAddresses = OSSet::withCapacity( 2 );
+		if( reserved->fUnindexedAddresses == NULL )
+			success = false;
+	}
+	
+	if( success )
+	{	
+		reserved->fUnindexedSpaceIterator =  OSCollectionIterator::withCollection( reserved->fUnindexedAddresses );
+		if( reserved->fUnindexedSpaceIterator == NULL )
+			success = false;
+	}
+	
+	if( success )
+	{
+		reserved->fROMImageCache = OSDictionary::withCapacity( 8 );
+		if( reserved->fROMImageCache == NULL )
+			success = false;
+	}
+	
+	//
+	// command caches
+	//
+	
+	if( success )
+	{
+		reserved->fCommandPool = IOFWCommandPool::create();
+		if( reserved->fCommandPool == NULL )
+			success = false;
+	}
 	
 	if( success )
 	{	
@@ -668,13 +1075,6 @@ bool IOFireWireController::init( IOFireWireLink *fwim )
 			success = false;
 	}
 
-	if( success )
-	{	
-		fLocalAsyncStreamReceivers = OSSet::withCapacity(2);
-		if( fLocalAsyncStreamReceivers == NULL )
-			success = false;
-	}
-	
 	if( success )
 	{	
 		fAllocatedChannels = OSSet::withCapacity(1);	// DV channel.
@@ -712,7 +1112,6 @@ bool IOFireWireController::init( IOFireWireLink *fwim )
 	
 	if( success )
 	{				
-		fLastTrans = kMaxPendingTransfers-1;
 		fDevicePruneDelay = kNormalDevicePruneDelay;
 
 		UInt32 bad = OSSwapHostToBigInt32(0xdeadbabe);
@@ -793,6 +1192,8 @@ IOFireWireBusAux * IOFireWireController::createAuxiliary( void )
 
 void IOFireWireController::free()
 {
+	unsigned int i;
+	
 	closeGate() ;
 	
 	fInstantiated = false;
@@ -856,28 +1257,84 @@ void IOFireWireController::free()
 		fLocalAddresses = NULL;
 	}
 
-	if( fPHYPacketListenersIterator != NULL ) 
-	{
-        fPHYPacketListenersIterator->release();
-		fPHYPacketListenersIterator = NULL;
-    }
-        
-    if( fPHYPacketListeners != NULL )
-	{
-        fPHYPacketListeners->release();
-		fPHYPacketListeners = NULL;
-	}
-
-	
-	if( fLocalAsyncStreamReceivers != NULL )
+	if( reserved != NULL )
 	{
-		fLocalAsyncStreamReceivers->release();
-		fLocalAsyncStreamReceivers = NULL;
-	}
+		for( unsigned int channel = 0; channel < kFWAsyncStreamChannelCount; channel++ )
+		{
+			if( reserved->fAsyncStreamReceivers[channel] != NULL )
+			{
+				reserved->fAsyncStreamReceivers[channel]->release();
+				reserved->fAsyncStreamReceivers[channel] = NULL;
+			}
+		}
 		
-    if( fAllocChannelIterator != NULL ) 
-	{
-        fAllocChannelIterator->release();
+		if( reserved->fROMImageCache != NULL )
+		{
+			reserved->fROMImageCache->release();
+			reserved->fROMImageCache = NULL;
+		}
+		
+		if( reserved->fUnindexedSpaceIterator != NULL ) 
+		{
+			reserved->fUnindexedSpaceIterator->release();
+			reserved->fUnindexedSpaceIterator = NULL;
+		}
+			
+		if( reserved->fUnindexedAddresses != NULL )
+		{
+			reserved->fUnindexedAddresses->release();
+			reserved->fUnindexedAddresses = NULL;
+		}
+
+		if( reserved->fAddressSpaceIndex != NULL )
+		{
+			IOFree( reserved->fAddressSpaceIndex, reserved->fAddressSpaceIndexCapacity * sizeof(IOFWAddressSpaceIndexEntry) );
+			reserved->fAddressSpaceIndex = NULL;
+		}
+		
+		if( reserved->fPseudoAddressBitmap != NULL )
+		{
+			IOFree( reserved->fPseudoAddressBitmap, reserved->fPseudoAddressWords * sizeof(UInt64) );
+			reserved->fPseudoAddressBitmap = NULL;
+			reserved->fPseudoAddressWords = 0;
+		}
+		
+		for( i = 0; i <= kFWBroadcastNodeID; i++ )
+		{
+			if( reserved->fTransPools[i] != NULL )
+			{
+				IOFree( reserved->fTransPools[i], sizeof(AsyncPendingTransPool) );
+				reserved->fTransPools[i] = NULL;
+			}
+		}
+		
+		// commands still alive hold their own reference to the pool
+		if( reserved->fCommandPool != NULL )
+		{
+			reserved->fCommandPool->flushCommands();
+			reserved->fCommandPool->release();
+			reserved->fCommandPool = NULL;
+		}
+
+		IOFree( reserved, sizeof(ExpansionData) );
+		reserved = NULL;
+	}
+
+	if( fPHYPacketListenersIterator != NULL ) 
+	{
+        fPHYPacketListenersIterator->release();
+		fPHYPacketListenersIterator = NULL;
+    }
+        
+    if( fPHYPacketListeners != NULL )
+	{
+        fPHYPacketListeners->release();
+		fPHYPacketListeners = NULL;
+	}
+
+    if( fAllocChannelIterator != NULL ) 
+	{
+        fAllocChannelIterator->release();
 		fAllocChannelIterator = NULL;
 	}
 
@@ -935,8 +1392,6 @@ void IOFireWireController::free()
 		fGUIDDups = NULL;
 	}
 	
-	
-	
     IOFireWireBus::free();
 }
 
@@ -2032,24 +2487,34 @@ void IOFireWireController::suspendBus( void )
 
 	// IOLog("FireWire Bus Generation now %d\n", fBusGeneration);
 	
-	// Invalidate current topology and speed map
+	// Invalidate current topology, speed and hop maps
 	bzero( fSpeedVector, sizeof(fSpeedVector) );
+	bzero( reserved->fHopVector, sizeof(reserved->fHopVector) );
+	reserved->fHopVectorValid = false;
 	
 	// Zap all outstanding async requests
-	for( i=0; i<kMaxPendingTransfers; i++ ) 
+	for( i=0; i<=kFWBroadcastNodeID; i++ ) 
 	{
-		AsyncPendingTrans *t = &fTrans[i];
-		if( t->fHandler ) 
-		{
-			IOFWAsyncCommand * cmd = t->fHandler;
-			cmd->gotPacket(kFWResponseBusResetError, NULL, 0);
-		}
-		else if( t->fAltHandler )
+		AsyncPendingTransPool * pool = reserved->fTransPools[i];
+		if( pool == NULL )
+			continue;
+		
+		int label;
+		for( label = 0; label < kMaxPendingTransfers; label++ )
 		{
-			IOFWAsyncPHYCommand * cmd = OSDynamicCast( IOFWAsyncPHYCommand, t->fAltHandler );
-			if( cmd )
+			AsyncPendingTrans *t = &pool->fTrans[label];
+			if( t->fHandler ) 
+			{
+				IOFWAsyncCommand * cmd = t->fHandler;
+				cmd->gotPacket(kFWResponseBusResetError, NULL, 0);
+			}
+			else if( t->fAltHandler )
 			{
-				cmd->gotPacket( kFWResponseBusResetError );
+				IOFWAsyncPHYCommand * cmd = OSDynamicCast( IOFWAsyncPHYCommand, t->fAltHandler );
+				if( cmd )
+				{
+					cmd->gotPacket( kFWResponseBusResetError );
+				}
 			}
 		}
 	}
@@ -2516,7 +2981,10 @@ void IOFireWireController::startBusScan()
     // Send global resume packet
 	fFWIM->sendPHYPacket(((fLocalNodeID & 0x3f) << kFWPhyPacketPhyIDPhase) | 0x003c0000);
 
-    // Tell all active isochronous channels to re-allocate bandwidth
+    // Tell all active isochronous channels and IRM allocations to re-allocate bandwidth,
+	// the ones that don't override handleBusReset join a single reallocation pass
+	beginIRMRealloc();
+	
     IOFWIsochChannel *found;
     fAllocChannelIterator->reset();
     while( (found = (IOFWIsochChannel *)fAllocChannelIterator->getNextObject()) ) 
@@ -2531,6 +2999,10 @@ void IOFireWireController::startBusScan()
         irmAllocationfound->handleBusReset(fBusGeneration);
     }
 	
+	commitIRMRealloc();
+	
+	bzero( reserved->fROMFetchLatency, sizeof(reserved->fROMFetchLatency) );
+	
     fNumROMReads = fRootNodeID+1;
     for(i=0; i<=fRootNodeID; i++) {
         UInt16 nodeID;
@@ -2561,6 +3033,8 @@ void IOFireWireController::startBusScan()
             scan->fRead = 0;
             scan->generation = fBusGeneration;
 			scan->fRetriesBumped = 0;
+			scan->fBlockFetch = false;
+			IOFWGetAbsoluteTime( &scan->fStartTime );
             scan->fCmd = OSTypeAlloc( IOFWReadQuadCommand );
  			scan->fLockCmd = OSTypeAlloc( IOFWCompareAndSwapCommand ); 
            
@@ -2662,6 +3136,37 @@ void IOFireWireController::readDeviceROM(IOFWNodeScan *scan, IOReturn status)
 	FWTrace( kFWTController, kTPControllerReadDeviceROM, (uintptr_t)fFWIM, (uintptr_t)(scan->fCmd), status, 0 );
 	FWKLOG(( "IOFireWireController::readDeviceROM entered\n" ));
 
+	if( scan->fBlockFetch )
+	{
+		scan->fBlockFetch = false;
+		
+		if( status == kIOReturnSuccess )
+		{
+			// got the whole bus info block
+			scan->fRead = 16;
+		}
+		else if( status != kIOFireWireBusReset )
+		{
+			FWKLOG(( "IOFireWireController::readDeviceROM Node 0x%x block read of bus info block failed 0x%x, reading quadlets\n", scan->fAddr.nodeID, status ));
+			
+			// fall back to reading the bus info block a quadlet at a time at s100
+			reserved->fROMFetchFallbacks++;
+			
+			scan->fRead = 8;
+            scan->fAddr.addressLo = kConfigROMBaseAddress+8;
+            scan->fCmd->reinit(scan->fAddr, scan->fBuf+2, 1,
+                                                        &readROMGlue, scan, true);
+            scan->fCmd->setMaxSpeed( kFWSpeed100MBit );
+			scan->fCmd->setRetries( kFWCmdDefaultRetries );
+			scan->fCmd->setPingTime( true );	// ping time second quad
+			
+			FWTrace( kFWTController, kTPControllerReadDeviceROMSubmitCmd, (uintptr_t)fFWIM, (uintptr_t)(scan->fCmd), scan->fAddr.nodeID, 8 );
+			
+			scan->fCmd->submit();
+			return;
+		}
+	}
+
     if(status != kIOReturnSuccess) 
 	{
 		// If status isn't bus reset, make a dummy registry entry.
@@ -2787,6 +3292,7 @@ void IOFireWireController::readDeviceROM(IOFWNodeScan *scan, IOReturn status)
 	
 			UInt32 nodeID = FWAddressToID(scan->fAddr.nodeID);
 			fNodes[nodeID] = createDummyRegistryEntry( scan );
+			recordROMFetchLatency( scan );
 			
 			fNumROMReads--;
 			if(fNumROMReads == 0) 
@@ -2819,9 +3325,15 @@ void IOFireWireController::readDeviceROM(IOFWNodeScan *scan, IOReturn status)
             scan->fRead = 8;
             scan->fBuf[1] = OSSwapHostToBigInt32( kFWBIBBusName );	// no point reading this!
             scan->fAddr.addressLo = kConfigROMBaseAddress+8;
-            scan->fCmd->reinit(scan->fAddr, scan->fBuf+2, 1,
+			
+			// read the remaining three quadlets with one block read at the speed the 
+			// header was read at, readDeviceROM falls back to quadlets at s100 if this fails.
+			// the command keeps the max speed it read the header with (s100 unless speed
+			// checking), reinit caps the node speed to it
+			scan->fBlockFetch = true;
+			reserved->fROMFetchBlockReads++;
+            scan->fCmd->reinit(scan->fAddr, scan->fBuf+2, 3,
                                                         &readROMGlue, scan, true);
-            scan->fCmd->setMaxSpeed( kFWSpeed100MBit );
 			scan->fCmd->setRetries( kFWCmdDefaultRetries );
 			scan->fCmd->setPingTime( true );	// ping time second quad
 			
@@ -2905,6 +3417,7 @@ void IOFireWireController::readDeviceROM(IOFWNodeScan *scan, IOReturn status)
 		
 		FWKLOG(( "IOFireWireController::readDeviceROM scan for ID %lx is %lx\n",nodeID,(long) scan ));
 		fScans[nodeID] = scan;
+		recordROMFetchLatency( scan );
 		
  		updateDevice( scan );
        	
@@ -2920,6 +3433,271 @@ void IOFireWireController::readDeviceROM(IOFWNodeScan *scan, IOReturn status)
 	FWKLOG(( "IOFireWireController::readDeviceROM exited\n" ));
 }
 
+// recordROMFetchLatency
+//
+//
+
+void IOFireWireController::recordROMFetchLatency( IOFWNodeScan * scan )
+{
+	AbsoluteTime now;
+	UInt64 nanoDelta;
+	
+	IOFWGetAbsoluteTime( &now );
+	SUB_ABSOLUTETIME( &now, &scan->fStartTime );
+	absolutetime_to_nanoseconds( now, &nanoDelta );
+	
+	UInt32 micros = (UInt32)(nanoDelta / 1000);
+	reserved->fROMFetchLatency[FWAddressToID(scan->fAddr.nodeID)] = micros ? micros : 1;
+}
+
+// getROMImageKey
+//
+// checks a ROM image can be cached and returns its GUID as the cache key
+
+bool IOFireWireController::getROMImageKey( const void * bytes, unsigned int length, char * key, size_t keySize )
+{
+	const UInt32 * quads = (const UInt32 *)bytes;
+	
+	if( bytes == NULL || length < kFWROMImageMinSize || length > kFWROMImageMaxSize || (length & 3) != 0 )
+		return false;
+	
+	// only general ROMs
+	UInt32 header = OSSwapBigToHostInt32( quads[0] );
+	if( ((header & kConfigBusInfoBlockLength) >> kConfigBusInfoBlockLengthPhase) == 1 )
+		return false;
+	
+	// a ROM generation of 0 means the ROM may change without telling us, see IOFireWireROMCache::hasROMChanged
+	UInt32 bus_options = OSSwapBigToHostInt32( quads[2] );
+	if( ((bus_options & kFWBIBGeneration) >> kFWBIBGenerationPhase) == 0 )
+		return false;
+	
+	snprintf( key, keySize, "%08x%08x", OSSwapBigToHostInt32( quads[3] ), OSSwapBigToHostInt32( quads[4] ) );
+	
+	return true;
+}
+
+// copyCachedROMImage
+//
+// returns a copy of the cached ROM for the device with this header and bus info block, 
+// or NULL if we don't have one
+
+OSData * IOFireWireController::copyCachedROMImage( const UInt32 * bib, UInt32 bibSize )
+{
+	OSData * image = NULL;
+	char key[17];
+	
+	if( bibSize != kFWROMImageMinSize || !getROMImageKey( bib, bibSize, key, sizeof(key) ) )
+		return NULL;
+	
+	closeGate();
+	
+	OSData * cached = OSDynamicCast( OSData, reserved->fROMImageCache->getObject( key ) );
+	if( cached != NULL )
+	{
+		// header (with the ROM CRC), bus options (with the ROM generation) and GUID must all match
+		if( cached->getLength() > bibSize && bcmp( cached->getBytesNoCopy(), bib, bibSize ) == 0 )
+		{
+			image = OSData::withData( cached );
+		}
+		else
+		{
+			// the device has a new ROM
+			reserved->fROMImageCache->removeObject( key );
+			publishROMImageCache();
+		}
+	}
+	
+	openGate();
+	
+	FWKLOG(( "IOFireWireController::copyCachedROMImage %s - %s\n", key, image ? "hit" : "miss" ));
+	
+	return image;
+}
+
+// cacheROMImage
+//
+//
+
+void IOFireWireController::cacheROMImage( const void * bytes, unsigned int length )
+{
+	char key[17];
+	
+	// nothing to gain from caching just the bus info block
+	if( length <= kFWROMImageMinSize || !getROMImageKey( bytes, length, key, sizeof(key) ) )
+		return;
+	
+	OSData * image = OSData::withBytes( bytes, length );
+	if( image == NULL )
+		return;
+	
+	closeGate();
+	
+	OSData * cached = OSDynamicCast( OSData, reserved->fROMImageCache->getObject( key ) );
+	if( cached == NULL || !cached->isEqualTo( image ) )
+	{
+		if( cached != NULL || reserved->fROMImageCache->getCount() < kFWROMImageCacheMaxEntries )
+		{
+			reserved->fROMImageCache->setObject( key, image );
+			publishROMImageCache();
+		}
+	}
+	
+	openGate();
+	
+	image->release();
+}
+
+// flushROMImageCache
+//
+//
+
+void IOFireWireController::flushROMImageCache( void )
+{
+	closeGate();
+	
+	reserved->fROMImageCache->flushCollection();
+	publishROMImageCache();
+	
+	openGate();
+}
+
+// loadROMImageCache
+//
+// merges previously saved ROM images into the cache
+
+IOReturn IOFireWireController::loadROMImageCache( OSDictionary * images )
+{
+	IOReturn status = kIOReturnSuccess;
+	
+	OSCollectionIterator * iterator = OSCollectionIterator::withCollection( images );
+	if( iterator == NULL )
+		return kIOReturnNoMemory;
+	
+	closeGate();
+	
+	OSSymbol * key;
+	while( (key = OSDynamicCast( OSSymbol, iterator->getNextObject() )) )
+	{
+		OSData * image = OSDynamicCast( OSData, images->getObject( key ) );
+		char image_key[17];
+		
+		// images still have to match the bus info block read from the device before they are used,
+		// but don't take anything that isn't a ROM we would have cached ourselves
+		if( image == NULL || 
+			image->getLength() <= kFWROMImageMinSize ||
+			!getROMImageKey( image->getBytesNoCopy(), image->getLength(), image_key, sizeof(image_key) ) ||
+			!key->isEqualTo( image_key ) )
+		{
+			status = kIOReturnBadArgument;
+			continue;
+		}
+		
+		if( reserved->fROMImageCache->getCount() >= kFWROMImageCacheMaxEntries && reserved->fROMImageCache->getObject( key ) == NULL )
+		{
+			status = kIOReturnNoSpace;
+			break;
+		}
+		
+		OSData * copy = OSData::withData( image );
+		if( copy != NULL )
+		{
+			reserved->fROMImageCache->setObject( key, copy );
+			copy->release();
+		}
+	}
+	
+	publishROMImageCache();
+	
+	openGate();
+	
+	iterator->release();
+	
+	return status;
+}
+
+// publishROMImageCache
+//
+// called with the gate closed
+
+void IOFireWireController::publishROMImageCache( void )
+{
+	// publish a copy so serializing the registry never sees the cache change
+	OSDictionary * copy = OSDictionary::withDictionary( reserved->fROMImageCache );
+	if( copy != NULL )
+	{
+		setProperty( kFWROMImageCacheKey, copy );
+		copy->release();
+	}
+}
+
+// setProperties
+//
+//
+
+IOReturn IOFireWireController::setProperties( OSObject * properties )
+{
+	OSDictionary * dictionary = OSDynamicCast( OSDictionary, properties );
+	if( dictionary == NULL )
+		return kIOReturnBadArgument;
+	
+	OSObject * value = dictionary->getObject( kFWROMImageCacheKey );
+	if( value == NULL )
+		return IOFireWireBus::setProperties( properties );
+	
+	if( IOUserClient::clientHasPrivilege( current_task(), kIOClientPrivilegeAdministrator ) != kIOReturnSuccess )
+		return kIOReturnNotPrivileged;
+	
+	OSDictionary * images = OSDynamicCast( OSDictionary, value );
+	if( images == NULL )
+		return kIOReturnBadArgument;
+	
+	// an empty dictionary clears the cache
+	if( images->getCount() == 0 )
+	{
+		flushROMImageCache();
+		return kIOReturnSuccess;
+	}
+	
+	return loadROMImageCache( images );
+}
+
+// getROMFetchLatency
+//
+//
+
+IOReturn IOFireWireController::getROMFetchLatency( UInt16 nodeID, UInt32 * microseconds )
+{
+	IOReturn status = kIOReturnSuccess;
+	
+	nodeID &= kFWMaxNodesPerBus;
+	if( nodeID >= kFWMaxNodesPerBus )
+		return kIOReturnBadArgument;
+	
+	closeGate();
+	
+	*microseconds = reserved->fROMFetchLatency[nodeID];
+	if( *microseconds == 0 )
+		status = kIOReturnNotFound;
+	
+	openGate();
+	
+	return status;
+}
+
+// getROMFetchStatistics
+//
+//
+
+void IOFireWireController::getROMFetchStatistics( UInt32 * blockReads, UInt32 * fallbacks )
+{
+	closeGate();
+	
+	*blockReads = reserved->fROMFetchBlockReads;
+	*fallbacks = reserved->fROMFetchFallbacks;
+	
+	openGate();
+}
+
 // checkForDuplicateGUID
 //
 //
@@ -3685,6 +4463,7 @@ void IOFireWireController::buildTopology(bool doFWPlane)
     maxDepth = 0;
     root = fNodes[fRootNodeID];
     level = scanList;
+	reserved->fHopVectorValid = false;
 
     // First build the topology.
 	
@@ -3746,6 +4525,7 @@ void IOFireWireController::buildTopology(bool doFWPlane)
 		}
 		
         setNodeSpeed(i, i, speedCode);
+		setNodeHops(i, i, 0);
 		
         // Add to parent
         // Compute rest of this node's speed map entries unless it's the root.
@@ -3756,6 +4536,13 @@ void IOFireWireController::buildTopology(bool doFWPlane)
 		{
             int parentNodeNum, scanNodeNum;
             parentNodeNum = (level-1)->nodeID;
+			
+			// this node is one hop further than its parent from every higher numbered node
+			for (scanNodeNum = i + 1; scanNodeNum <= fRootNodeID; scanNodeNum++)
+			{
+				setNodeHops(i, scanNodeNum, getNodeHops(parentNodeNum, scanNodeNum) + 1);
+			}
+			
             if(doFWPlane)
             {
 				FWNodeScan * parent_level = (level-1);
@@ -3842,6 +4629,10 @@ void IOFireWireController::buildTopology(bool doFWPlane)
 	// We never speed scan the local node which means we'll never clear it otherwise.
 	setNodeSpeed(fLocalNodeID, fLocalNodeID, (FWSpeed(fLocalNodeID, fLocalNodeID) & ~kFWSpeedUnknownMask));		
 
+	// the hop map is complete, hopCount can use it until the next reset
+	reserved->fHopVectorValid = true;
+	reserved->fHopVectorGeneration = fBusGeneration;
+
 #if (DEBUGGING_LEVEL > 0)
 	IOLog("MaxDepth:%d LocalNodeID:%x\n", maxDepth, fLocalNodeID);
 	IOLog("FireWire Speed map:\n");
@@ -4610,25 +5401,36 @@ AsyncPendingTrans *IOFireWireController::allocTrans(IOFWAsyncCommand *cmd)
 
 AsyncPendingTrans *IOFireWireController::allocTrans( IOFWAsyncCommand * cmd, IOFWCommand * altcmd )
 {
-    unsigned int i;
-    unsigned int tran;
-
-    tran = fLastTrans;
-    for(i=0; i<kMaxPendingTransfers; i++) {
-        AsyncPendingTrans *t;
-        tran++;
-        if(tran >= kMaxPendingTransfers)
-            tran = 0;
-        t = &fTrans[tran];
-        if(!t->fInUse) {
-            t->fHandler = cmd;
-			t->fAltHandler = altcmd;
-            t->fInUse = true;
-            t->fTCode = tran;
-            fLastTrans = tran;
-            return t;
-        }
-    }
+	// labels are scoped by destination if the FWIM supports it, requests without
+	// one and every request on other FWIMs share the broadcast pool.
+	// the pools were allocated by init, we're called with the gate closed.
+	unsigned int pool_index = kFWBroadcastNodeID;
+	if( cmd != NULL && reserved->fPerNodeTLabels )
+	{
+		pool_index = cmd->getAddress().nodeID & 0x3f;
+	}
+	
+	AsyncPendingTransPool * pool = reserved->fTransPools[pool_index];
+	
+	if( pool != NULL && pool->fInUse != ~0ULL )
+	{
+		// round robin - take the first free label after the last one handed out,
+		// wrapping around if everything above it is busy
+		unsigned int start = (pool->fLastTrans + 1) % kMaxPendingTransfers;
+		UInt64 free_labels = ~pool->fInUse;
+		UInt64 above = free_labels & (~0ULL << start);
+		unsigned int tran = __builtin_ctzll( above ? above : free_labels );
+		
+		AsyncPendingTrans *t = &pool->fTrans[tran];
+		t->fHandler = cmd;
+		t->fAltHandler = altcmd;
+		t->fInUse = true;
+		t->fTCode = tran;
+		t->fPool = pool_index;
+		pool->fInUse |= (1ULL << tran);
+		pool->fLastTrans = tran;
+		return t;
+	}
 	
 	// Print only if its a first time
 	if ( fOutOfTLabels == 0 && fOutOfTLabelsThreshold == 0 )
@@ -4650,6 +5452,26 @@ void IOFireWireController::freeTrans(AsyncPendingTrans *trans)
     trans->fHandler = NULL;
 	trans->fAltHandler = NULL;
     trans->fInUse = false;
+	
+	AsyncPendingTransPool * pool = reserved->fTransPools[trans->fPool];
+	if( pool != NULL )
+	{
+		pool->fInUse &= ~(1ULL << trans->fTCode);
+	}
+}
+
+// findTrans
+//
+// responses are matched on (source, tLabel) when labels are per destination
+
+AsyncPendingTrans * IOFireWireController::findTrans( UInt16 sourceID, UInt32 tLabel )
+{
+	AsyncPendingTransPool * pool = reserved->fTransPools[reserved->fPerNodeTLabels ? (sourceID & 0x3f) : kFWBroadcastNodeID];
+	
+	if( pool == NULL || tLabel >= kMaxPendingTransfers )
+		return NULL;
+	
+	return &pool->fTrans[tLabel];
 }
 
 // asyncRead
@@ -5147,6 +5969,7 @@ kprintf("Received packet 0x%x size %d\n", data, size);
     UInt32	quad0;
     UInt16	sourceID;
     UInt16	destID;
+	AsyncPendingTrans * trans;
 
     // Get first quad.
     quad0 = *data;
@@ -5186,8 +6009,8 @@ kprintf("Received packet 0x%x size %d\n", data, size);
             break;
 
         case kFWTCodeWriteResponse :
-            if(fTrans[tLabel].fHandler) {
-                IOFWAsyncCommand * cmd = fTrans[tLabel].fHandler;
+            if((trans = findTrans(sourceID, tLabel)) && trans->fHandler) {
+                IOFWAsyncCommand * cmd = trans->fHandler;
 				FWAddress commandAddress = cmd->getAddress();
 				
             	if( sourceID == commandAddress.nodeID ){
@@ -5288,8 +6111,8 @@ kprintf("Received packet 0x%x size %d\n", data, size);
             break;
 
         case kFWTCodeReadQuadletResponse :
-            if(fTrans[tLabel].fHandler) {
-                IOFWAsyncCommand * cmd = fTrans[tLabel].fHandler;
+            if((trans = findTrans(sourceID, tLabel)) && trans->fHandler) {
+                IOFWAsyncCommand * cmd = trans->fHandler;
 				FWAddress commandAddress = cmd->getAddress();
 				
             	if( sourceID == commandAddress.nodeID )
@@ -5318,9 +6141,9 @@ kprintf("Received packet 0x%x size %d\n", data, size);
 
         case kFWTCodeReadBlockResponse :
         case kFWTCodeLockResponse :
-            if(fTrans[tLabel].fHandler) {
+            if((trans = findTrans(sourceID, tLabel)) && trans->fHandler) {
             	
-				IOFWAsyncCommand * cmd = fTrans[tLabel].fHandler;
+				IOFWAsyncCommand * cmd = trans->fHandler;
 				FWAddress commandAddress = cmd->getAddress();
 				
             	if( sourceID == commandAddress.nodeID )
@@ -5472,15 +6295,24 @@ IOFireWireController::getAddressSpace(FWAddress address)
     closeGate();
     
 	IOFWAddressSpace * found;
-    fSpaceIterator->reset();
-    while( (found = (IOFWAddressSpace *) fSpaceIterator->getNextObject())) {
+	UInt32 sequence = 0;
+	while( (found = nextIndexedAddressSpace( address, &sequence )) ) {
         if(found->contains(address))
             break;
     }
-    
-	openGate();
-    
-	return found;
+	
+	if( found == NULL )
+	{
+		reserved->fUnindexedSpaceIterator->reset();
+		while( (found = (IOFWAddressSpace *) reserved->fUnindexedSpaceIterator->getNextObject())) {
+			if(found->contains(address))
+				break;
+		}
+	}
+    
+	openGate();
+    
+	return found;
 }
 
 
@@ -5490,21 +6322,30 @@ IOFireWireController::getAddressSpace(FWAddress address)
 IOFWAsyncStreamReceiver * 
 IOFireWireController::allocAsyncStreamReceiver(UInt32	channel, FWAsyncStreamReceiveCallback clientProc, void	*refcon)
 {
+	if( channel >= kFWAsyncStreamChannelCount )
+		return NULL;
+	
 	closeGate();
 
-    IOFWAsyncStreamReceiver * receiver = OSTypeAlloc( IOFWAsyncStreamReceiver );
+	// one receiver per channel
+    IOFWAsyncStreamReceiver * receiver = reserved->fAsyncStreamReceivers[channel];
 	
-    if( receiver )
+	if( receiver == NULL )
 	{
-		if( receiver->initAll( this, channel ) ) 
+		receiver = OSTypeAlloc( IOFWAsyncStreamReceiver );
+	
+		if( receiver )
 		{
-			if( fLocalAsyncStreamReceivers->setObject( receiver ))
+			if( receiver->initAll( this, channel ) ) 
+			{
+				// the table keeps the allocation reference
+				reserved->fAsyncStreamReceivers[channel] = receiver;
+			}
+			else
+			{
 				receiver->release();
-		}
-		else
-		{
-			receiver->release();
-			receiver = NULL;
+				receiver = NULL;
+			}
 		}
 	}
 			
@@ -5519,35 +6360,60 @@ IOFireWireController::allocAsyncStreamReceiver(UInt32	channel, FWAsyncStreamRece
 IOFWAsyncStreamReceiver *
 IOFireWireController::getAsyncStreamReceiver( UInt32 channel )
 {
+	if( channel >= kFWAsyncStreamChannelCount )
+		return NULL;
+	
     closeGate();
     
-	IOFWAsyncStreamReceiver * found = NULL;
-	OSIterator *iterator = OSCollectionIterator::withCollection(fLocalAsyncStreamReceivers);
-	if( iterator != NULL )
-	{
-		found = NULL;
-		while( (found = OSDynamicCast(IOFWAsyncStreamReceiver, iterator->getNextObject())) ) 
-		{
-			if( found and found->listens(channel) )
-				break;
-		}
-		iterator->release();
-	}
+	IOFWAsyncStreamReceiver * found = reserved->fAsyncStreamReceivers[channel];
 	
 	openGate();
     
 	return found;
 }
 
+// getAsyncStreamReceiverStatistics
+//
+//
+IOReturn
+IOFireWireController::getAsyncStreamReceiverStatistics( UInt32 channel, UInt64 * packets, UInt64 * bytes, UInt32 * drops )
+{
+	IOReturn status = kIOReturnNotFound;
+	
+	if( channel >= kFWAsyncStreamChannelCount )
+		return kIOReturnBadArgument;
+	
+	closeGate();
+	
+	IOFWAsyncStreamReceiver * receiver = reserved->fAsyncStreamReceivers[channel];
+	if( receiver != NULL )
+	{
+		*packets = receiver->getPacketCount();
+		*bytes = receiver->getByteCount();
+		*drops = receiver->getDropCount();
+		status = kIOReturnSuccess;
+	}
+	
+	openGate();
+	
+	return status;
+}
+
 // removeAsyncStreamReceiver
 //
 //
 void
 IOFireWireController::removeAsyncStreamReceiver( IOFWAsyncStreamReceiver *receiver )
 {
+	UInt32 channel = receiver->getChannel();
+	
     closeGate();
 
-	fLocalAsyncStreamReceivers->removeObject(receiver);
+	if( channel < kFWAsyncStreamChannelCount && reserved->fAsyncStreamReceivers[channel] == receiver )
+	{
+		reserved->fAsyncStreamReceivers[channel] = NULL;
+		receiver->release();
+	}
     
 	openGate();
 }
@@ -5560,16 +6426,11 @@ IOFireWireController::activateAsyncStreamReceivers( )
 {
     closeGate();
     
-	OSIterator *iterator = OSCollectionIterator::withCollection(fLocalAsyncStreamReceivers);
-	if( iterator != NULL )
+	for( unsigned int channel = 0; channel < kFWAsyncStreamChannelCount; channel++ )
 	{
-		IOFWAsyncStreamReceiver * found = NULL;
-		while( (found = OSDynamicCast(IOFWAsyncStreamReceiver, iterator->getNextObject())) ) 
-		{
-			if( found )
-				found->activate( getBroadcastSpeed() );
-		}
-		iterator->release();
+		IOFWAsyncStreamReceiver * found = reserved->fAsyncStreamReceivers[channel];
+		if( found )
+			found->activate( getBroadcastSpeed() );
 	}
 	
 	openGate();
@@ -5583,16 +6444,11 @@ IOFireWireController::deactivateAsyncStreamReceivers( )
 {
     closeGate();
     
-	OSIterator *iterator = OSCollectionIterator::withCollection(fLocalAsyncStreamReceivers);
-	if( iterator != NULL )
+	for( unsigned int channel = 0; channel < kFWAsyncStreamChannelCount; channel++ )
 	{
-		IOFWAsyncStreamReceiver * found = NULL;
-		while( (found =  OSDynamicCast(IOFWAsyncStreamReceiver, iterator->getNextObject())) ) 
-		{
-			if( found )
-				found->deactivate();
-		}
-		iterator->release();
+		IOFWAsyncStreamReceiver * found = reserved->fAsyncStreamReceivers[channel];
+		if( found )
+			found->deactivate();
 	}
 	
 	openGate();
@@ -5606,16 +6462,11 @@ IOFireWireController::freeAllAsyncStreamReceiver()
 {
     closeGate();
     
-	OSIterator *iterator = OSCollectionIterator::withCollection(fLocalAsyncStreamReceivers);
-	if( iterator != NULL )
+	for( unsigned int channel = 0; channel < kFWAsyncStreamChannelCount; channel++ )
 	{
-		IOFWAsyncStreamReceiver * found = NULL;
-		while( (found = OSDynamicCast(IOFWAsyncStreamReceiver, iterator->getNextObject())) ) 
-		{
-			if( found )
-				removeAsyncStreamReceiver( found );
-		}
-		iterator->release();
+		IOFWAsyncStreamReceiver * found = reserved->fAsyncStreamReceivers[channel];
+		if( found )
+			removeAsyncStreamReceiver( found );
 	}
 	
 	openGate();
@@ -5628,8 +6479,8 @@ IOFireWireController::freeAllAsyncStreamReceiver()
 IOReturn IOFireWireController::allocAddress(IOFWAddressSpace *space)
 {
     /*
-     * Lots of scope for optimizations here, perhaps building a hash table for
-     * addresses etc.
+     * Spaces that can report a fixed range are kept in a sorted index so inbound
+     * requests can find them with a binary search, everything else is probed linearly.
      * Drivers may want to override this if their hardware can match addresses
      * without CPU intervention.
      */
@@ -5654,6 +6505,9 @@ IOReturn IOFireWireController::allocAddress(IOFWAddressSpace *space)
 		}
 	}
 	
+	// allocating a space twice leaves it registered once, don't index it again
+	bool registered = fLocalAddresses->containsObject( space );
+	
 	if( result == kIOReturnSuccess )
 	{
 		if(!fLocalAddresses->setObject(space))
@@ -5662,102 +6516,606 @@ IOReturn IOFireWireController::allocAddress(IOFWAddressSpace *space)
 			result = kIOReturnSuccess;
     }
 	
-	openGate();
-    
-	return result;
+	if( result == kIOReturnSuccess && !registered )
+	{
+		FWAddress base;
+		UInt32 length = 0;
+		bool added;
+		
+		if( space->getAddressRange( &base, &length ) )
+			added = addAddressSpaceToIndex( space, base, length );
+		else
+			added = reserved->fUnindexedAddresses->setObject( space );
+		
+		if( !added )
+		{
+			fLocalAddresses->removeObject( space );
+			result = kIOReturnNoMemory;
+		}
+	}
+	
+	openGate();
+    
+	return result;
+}
+
+// freeAddress
+//
+//
+
+void IOFireWireController::freeAddress(IOFWAddressSpace *space)
+{
+    closeGate();
+	
+	removeAddressSpaceFromIndex( space );
+	reserved->fUnindexedAddresses->removeObject( space );
+	fLocalAddresses->removeObject(space);
+	
+	openGate();
+}
+
+// addAddressSpaceToIndex
+//
+// insert a space into the sorted address index. the index holds no reference,
+// the space stays retained by fLocalAddresses for as long as it is indexed.
+
+bool IOFireWireController::addAddressSpaceToIndex( IOFWAddressSpace * space, FWAddress base, UInt32 length )
+{
+	UInt64 start = ((UInt64)base.addressHi << 32) | base.addressLo;
+	UInt32 low = 0;
+	UInt32 high = reserved->fAddressSpaceIndexCount;
+	UInt32 i;
+
+	if( reserved->fAddressSpaceIndexCount == reserved->fAddressSpaceIndexCapacity )
+	{
+		UInt32 new_capacity = (reserved->fAddressSpaceIndexCapacity == 0) ? 8 : (reserved->fAddressSpaceIndexCapacity * 2);
+		IOFWAddressSpaceIndexEntry * new_index = (IOFWAddressSpaceIndexEntry*)IOMalloc( new_capacity * sizeof(IOFWAddressSpaceIndexEntry) );
+		if( new_index == NULL )
+			return false;
+		
+		if( reserved->fAddressSpaceIndex != NULL )
+		{
+			bcopy( reserved->fAddressSpaceIndex, new_index, reserved->fAddressSpaceIndexCount * sizeof(IOFWAddressSpaceIndexEntry) );
+			IOFree( reserved->fAddressSpaceIndex, reserved->fAddressSpaceIndexCapacity * sizeof(IOFWAddressSpaceIndexEntry) );
+		}
+		
+		reserved->fAddressSpaceIndex = new_index;
+		reserved->fAddressSpaceIndexCapacity = new_capacity;
+	}
+	
+	// find the first entry starting after us
+	while( low < high )
+	{
+		UInt32 mid = (low + high) / 2;
+		if( reserved->fAddressSpaceIndex[mid].fStart <= start )
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	
+	if( low < reserved->fAddressSpaceIndexCount )
+	{
+		memmove( &reserved->fAddressSpaceIndex[low + 1], &reserved->fAddressSpaceIndex[low], (reserved->fAddressSpaceIndexCount - low) * sizeof(IOFWAddressSpaceIndexEntry) );
+	}
+	
+	reserved->fAddressSpaceIndex[low].fSpace = space;
+	reserved->fAddressSpaceIndex[low].fStart = start;
+	reserved->fAddressSpaceIndex[low].fEnd = start + length;
+	reserved->fAddressSpaceIndex[low].fSequence = ++reserved->fAddressSpaceSequence;
+	reserved->fAddressSpaceIndexCount++;
+	
+	// refresh the running maximum from the insertion point on
+	for( i = low; i < reserved->fAddressSpaceIndexCount; i++ )
+	{
+		UInt64 max_end = (i == 0) ? 0 : reserved->fAddressSpaceIndex[i - 1].fMaxEnd;
+		if( reserved->fAddressSpaceIndex[i].fEnd > max_end )
+			max_end = reserved->fAddressSpaceIndex[i].fEnd;
+		reserved->fAddressSpaceIndex[i].fMaxEnd = max_end;
+	}
+	
+	return true;
+}
+
+// removeAddressSpaceFromIndex
+//
+//
+
+void IOFireWireController::removeAddressSpaceFromIndex( IOFWAddressSpace * space )
+{
+	UInt32 i;
+	
+	for( i = 0; i < reserved->fAddressSpaceIndexCount; i++ )
+	{
+		if( reserved->fAddressSpaceIndex[i].fSpace == space )
+			break;
+	}
+	
+	if( i == reserved->fAddressSpaceIndexCount )
+		return;
+	
+	reserved->fAddressSpaceIndexCount--;
+	if( i < reserved->fAddressSpaceIndexCount )
+	{
+		memmove( &reserved->fAddressSpaceIndex[i], &reserved->fAddressSpaceIndex[i + 1], (reserved->fAddressSpaceIndexCount - i) * sizeof(IOFWAddressSpaceIndexEntry) );
+	}
+	
+	for( ; i < reserved->fAddressSpaceIndexCount; i++ )
+	{
+		UInt64 max_end = (i == 0) ? 0 : reserved->fAddressSpaceIndex[i - 1].fMaxEnd;
+		if( reserved->fAddressSpaceIndex[i].fEnd > max_end )
+			max_end = reserved->fAddressSpaceIndex[i].fEnd;
+		reserved->fAddressSpaceIndex[i].fMaxEnd = max_end;
+	}
+}
+
+// nextIndexedAddressSpace
+//
+// returns the indexed space containing addr that was registered soonest after *sequence.
+// overlapping spaces are handed out in registration order to match the old linear scan.
+// start with *sequence == 0 and keep calling until NULL is returned.
+
+IOFWAddressSpace * IOFireWireController::nextIndexedAddressSpace( FWAddress addr, UInt32 * sequence )
+{
+	UInt64 key = ((UInt64)addr.addressHi << 32) | addr.addressLo;
+	IOFWAddressSpaceIndexEntry * next = NULL;
+	UInt32 low = 0;
+	UInt32 high = reserved->fAddressSpaceIndexCount;
+	
+	// find the first entry starting after addr
+	while( low < high )
+	{
+		UInt32 mid = (low + high) / 2;
+		if( reserved->fAddressSpaceIndex[mid].fStart <= key )
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	
+	// walk back over the entries that could still cover addr
+	while( low > 0 && reserved->fAddressSpaceIndex[low - 1].fMaxEnd > key )
+	{
+		IOFWAddressSpaceIndexEntry * entry = &reserved->fAddressSpaceIndex[--low];
+		
+		if( entry->fEnd > key && entry->fSequence > *sequence )
+		{
+			if( next == NULL || entry->fSequence < next->fSequence )
+				next = entry;
+		}
+	}
+	
+	if( next == NULL )
+		return NULL;
+	
+	*sequence = next->fSequence;
+	
+	return next->fSpace;
+}
+
+// getAddressSpaceDispatchStatistics
+//
+//
+
+void IOFireWireController::getAddressSpaceDispatchStatistics( UInt32 * dispatches, UInt32 * probes )
+{
+	closeGate();
+	
+	*dispatches = reserved->fAddressSpaceDispatches;
+	*probes = reserved->fAddressSpaceProbes;
+	
+	openGate();
+}
+
+// pseudo address space addressHi slots
+// slot 0 is the physical range and 0xffff is CSR space, so 0xfffe slots at most
+
+enum
+{
+	kPseudoAddressSlotCount		= 0xfffe,
+	kPseudoAddressMaxWords		= (kPseudoAddressSlotCount + 63) / 64,
+	kPseudoAddressInitialWords	= 4
+};
+
+// growPseudoAddressBitmap
+//
+// called with the gate closed
+
+bool IOFireWireController::growPseudoAddressBitmap( UInt32 minimumWords )
+{
+	UInt32 words = reserved->fPseudoAddressWords ? (reserved->fPseudoAddressWords * 2) : kPseudoAddressInitialWords;
+	
+	if( words < minimumWords )
+		words = minimumWords;
+	
+	if( words > kPseudoAddressMaxWords )
+		words = kPseudoAddressMaxWords;
+	
+	if( words <= reserved->fPseudoAddressWords )
+		return false;
+	
+	UInt64 * bitmap = (UInt64*)IOMalloc( words * sizeof(UInt64) );
+	if( bitmap == NULL )
+		return false;
+	
+	bzero( bitmap, words * sizeof(UInt64) );
+	
+	if( reserved->fPseudoAddressBitmap )
+	{
+		bcopy( reserved->fPseudoAddressBitmap, bitmap, reserved->fPseudoAddressWords * sizeof(UInt64) );
+		IOFree( reserved->fPseudoAddressBitmap, reserved->fPseudoAddressWords * sizeof(UInt64) );
+	}
+	else
+	{
+		bitmap[0] = 1;		// Physical always allocated
+	}
+	
+	// bits past the last slot are never handed out
+	if( words == kPseudoAddressMaxWords && (kPseudoAddressSlotCount & 63) )
+		bitmap[words - 1] |= ~0ULL << (kPseudoAddressSlotCount & 63);
+	
+	reserved->fPseudoAddressBitmap = bitmap;
+	reserved->fPseudoAddressWords = words;
+	
+	return true;
+}
+
+// allocatePseudoAddressSlots
+//
+// find the lowest run of 'count' free slots, called with the gate closed
+
+IOReturn IOFireWireController::allocatePseudoAddressSlots( UInt32 count, UInt32 * first )
+{
+	UInt32 run_start = 0;
+	UInt32 run_length = 0;
+	
+	if( count == 0 || count >= kPseudoAddressSlotCount )
+		return kIOReturnBadArgument;
+	
+	if( reserved->fPseudoAddressBitmap == NULL && !growPseudoAddressBitmap( 0 ) )
+		return kIOReturnNoMemory;
+	
+	while( true )
+	{
+		UInt32 slot = reserved->fPseudoAddressHint * 64;
+		UInt32 limit = reserved->fPseudoAddressWords * 64;
+		
+		run_length = 0;
+		while( slot < limit && run_length < count )
+		{
+			UInt64 word = reserved->fPseudoAddressBitmap[slot >> 6];
+			
+			if( (slot & 63) == 0 && word == ~0ULL )
+			{
+				// full word
+				run_length = 0;
+				slot += 64;
+			}
+			else if( (slot & 63) == 0 && word == 0 && count > 1 )
+			{
+				// empty word
+				if( run_length == 0 )
+					run_start = slot;
+				run_length += 64;
+				slot += 64;
+			}
+			else if( run_length == 0 && count == 1 )
+			{
+				// single slot - take the first free bit at or after this one
+				UInt64 free_bits = ~word & (~0ULL << (slot & 63));
+				
+				if( free_bits )
+				{
+					run_start = (slot & ~63) + __builtin_ctzll( free_bits );
+					run_length = 1;
+				}
+				else
+				{
+					slot = (slot & ~63) + 64;
+				}
+			}
+			else
+			{
+				if( word & (1ULL << (slot & 63)) )
+				{
+					run_length = 0;
+				}
+				else
+				{
+					if( run_length == 0 )
+						run_start = slot;
+					run_length++;
+				}
+				slot++;
+			}
+		}
+		
+		if( run_length >= count )
+			break;
+		
+		// a run that reaches the end of the bitmap continues into the new words
+		if( !growPseudoAddressBitmap( reserved->fPseudoAddressWords + (count - run_length + 63) / 64 ) )
+			return kIOReturnNoMemory;
+	}
+	
+	for( UInt32 slot = run_start; slot < run_start + count; slot++ )
+	{
+		reserved->fPseudoAddressBitmap[slot >> 6] |= 1ULL << (slot & 63);
+	}
+	
+	reserved->fPseudoAddressCount += count;
+	
+	while( reserved->fPseudoAddressHint < reserved->fPseudoAddressWords && reserved->fPseudoAddressBitmap[reserved->fPseudoAddressHint] == ~0ULL )
+		reserved->fPseudoAddressHint++;
+	
+	*first = run_start;
+	
+	return kIOReturnSuccess;
+}
+
+// freePseudoAddressSlots
+//
+// called with the gate closed
+
+void IOFireWireController::freePseudoAddressSlots( UInt32 first, UInt32 count )
+{
+	// callers pass addresses from outside the family, check them even in release builds
+	if( reserved->fPseudoAddressBitmap == NULL || first == 0 || (UInt64)first + count > (UInt64)reserved->fPseudoAddressWords * 64 )
+	{
+		IOLog( "IOFireWireController::freePseudoAddressSlots - bad range, first 0x%x count %u\n", (unsigned)first, (unsigned)count );
+		return;
+	}
+	
+	for( UInt32 slot = first; slot < first + count; slot++ )
+	{
+		UInt64 bit = 1ULL << (slot & 63);
+		
+		assert( reserved->fPseudoAddressBitmap[slot >> 6] & bit );
+		if( reserved->fPseudoAddressBitmap[slot >> 6] & bit )
+		{
+			reserved->fPseudoAddressBitmap[slot >> 6] &= ~bit;
+			reserved->fPseudoAddressCount--;
+		}
+	}
+	
+	if( (first >> 6) < reserved->fPseudoAddressHint )
+		reserved->fPseudoAddressHint = first >> 6;
+}
+
+// allocatePseudoAddress
+//
+//
+
+IOReturn IOFireWireController::allocatePseudoAddress(FWAddress *addr, UInt32 lenDummy)
+{
+	UInt32 slot = 0;
+	
+    closeGate();
+    
+	IOReturn status = allocatePseudoAddressSlots( 1, &slot );
+	if( status == kIOReturnSuccess )
+	{
+		addr->addressHi = slot;
+		addr->addressLo = 0;
+	}
+	
+    openGate();
+	
+    return status;
+}
+
+// freePseudoAddress
+//
+//
+
+void IOFireWireController::freePseudoAddress(FWAddress addr, UInt32 lenDummy)
+{
+    closeGate();
+    
+	freePseudoAddressSlots( addr.addressHi, 1 );
+    
+    openGate();
+}
+
+// allocatePseudoAddressRange
+//
+//
+
+IOReturn IOFireWireController::allocatePseudoAddressRange( UInt32 count, UInt16 * firstAddressHi )
+{
+	UInt32 slot = 0;
+	
+	closeGate();
+	
+	IOReturn status = allocatePseudoAddressSlots( count, &slot );
+	if( status == kIOReturnSuccess )
+		*firstAddressHi = slot;
+	
+	openGate();
+	
+	return status;
+}
+
+// freePseudoAddressRange
+//
+//
+
+void IOFireWireController::freePseudoAddressRange( UInt16 firstAddressHi, UInt32 count )
+{
+	closeGate();
+	
+	freePseudoAddressSlots( firstAddressHi, count );
+	
+	openGate();
+}
+
+// getPseudoAddressStatistics
+//
+//
+
+void IOFireWireController::getPseudoAddressStatistics( UInt32 * allocated, UInt32 * highWater, UInt32 * freeRuns, UInt32 * largestFreeRun )
+{
+	UInt32 high = 0;
+	UInt32 runs = 0;
+	UInt32 largest = 0;
+	UInt32 run_length = 0;
+	
+	closeGate();
+	
+	// one past the highest slot in use, ignoring the reserved tail bits
+	for( UInt32 slot = 1; slot < reserved->fPseudoAddressWords * 64 && slot < kPseudoAddressSlotCount; slot++ )
+	{
+		if( reserved->fPseudoAddressBitmap[slot >> 6] & (1ULL << (slot & 63)) )
+			high = slot + 1;
+	}
+	
+	for( UInt32 slot = 1; slot < high; slot++ )
+	{
+		if( reserved->fPseudoAddressBitmap[slot >> 6] & (1ULL << (slot & 63)) )
+		{
+			run_length = 0;
+		}
+		else
+		{
+			if( run_length++ == 0 )
+				runs++;
+			if( run_length > largest )
+				largest = run_length;
+		}
+	}
+	
+	*allocated = reserved->fPseudoAddressCount;
+	*highWater = high;
+	*freeRuns = runs;
+	*largestFreeRun = largest;
+	
+	openGate();
+}
+
+// getCommandPool
+//
+//
+
+IOFWCommandPool * IOFireWireController::getCommandPool( void )
+{
+	return (reserved != NULL) ? reserved->fCommandPool : NULL;
+}
+
+// allocCommand
+//
+//
+
+IOFWAsyncCommand * IOFireWireController::allocCommand( const OSMetaClass * type, IOFireWireNub * device )
+{
+	IOFWCommandPool * pool = getCommandPool();
+	
+	return (pool != NULL) ? pool->allocCommand( type, device ) : NULL;
+}
+
+// recycleCommand
+//
+//
+
+void IOFireWireController::recycleCommand( IOFWAsyncCommand * cmd )
+{
+	IOFWCommandPool * pool = getCommandPool();
+	
+	if( pool != NULL )
+		pool->recycleCommand( cmd );
+	else if( cmd != NULL )
+		cmd->release();
+}
+
+// getCommandPoolStatistics
+//
+//
+
+void IOFireWireController::getCommandPoolStatistics( UInt32 * hits, UInt32 * misses )
+{
+	IOFWCommandPool * pool = getCommandPool();
+	
+	if( pool != NULL )
+	{
+		pool->getStatistics( hits, misses );
+	}
+	else
+	{
+		*hits = 0;
+		*misses = 0;
+	}
 }
 
-// freeAddress
+// beginSubmitBatch
 //
 //
 
-void IOFireWireController::freeAddress(IOFWAddressSpace *space)
+void IOFireWireController::beginSubmitBatch( void )
 {
-    closeGate();
+	closeGate();
 	
-	fLocalAddresses->removeObject(space);
+	reserved->fSubmitBatchDepth++;
+}
+
+// commitSubmitBatch
+//
+// issues the flush deferred by the batch and drops the gate taken in beginSubmitBatch
+
+IOReturn IOFireWireController::commitSubmitBatch( void )
+{
+	// the gate is still held from beginSubmitBatch
+	if( reserved->fSubmitBatchDepth == 0 )
+	{
+		IOLog( "IOFireWireController::commitSubmitBatch - no batch open\n" );
+		return kIOReturnNotOpen;
+	}
+	
+	reserved->fSubmitBatchDepth--;
+	
+	if( reserved->fSubmitBatchDepth == 0 )
+	{
+		reserved->fSubmitBatches++;
+		
+		if( reserved->fSubmitBatchFlushPending )
+		{
+			reserved->fSubmitBatchFlushPending = false;
+			reserved->fSubmitBatchFlushes++;
+			fFWIM->flushWaitingPackets();
+		}
+	}
 	
 	openGate();
+	
+	return kIOReturnSuccess;
 }
 
-// allocatePseudoAddress
+// flushSubmittedPackets
 //
 //
 
-IOReturn IOFireWireController::allocatePseudoAddress(FWAddress *addr, UInt32 lenDummy)
+void IOFireWireController::flushSubmittedPackets( void )
 {
-    unsigned int i, len;
-    UInt8 * data;
-    UInt8 used = 1;
-    
-    closeGate();
-    
-    if( fAllocatedAddresses == NULL ) 
-    {
-        fAllocatedAddresses = OSData::withCapacity(4);	// SBP2 + some spare
-        fAllocatedAddresses->appendBytes(&used, 1);	// Physical always allocated
-    }
-    
-    if( !fAllocatedAddresses )
-    {   
-        openGate();
-        return kIOReturnNoMemory;
-    }
-    
-    len = fAllocatedAddresses->getLength();
-    data = (UInt8*)fAllocatedAddresses->getBytesNoCopy();
-    for( i=0; i<len; i++ ) 
-    {
-        if( data[i] == 0 ) 
-        {
-            data[i] = 1;
-            addr->addressHi = i;
-            addr->addressLo = 0;
-        
-            openGate();
-            return kIOReturnSuccess;
-        }
-    }
-    
-    if( len >= 0xfffe )
-    {
-        openGate();
-		return kIOReturnNoMemory;
-    }
-    
-    if( fAllocatedAddresses->appendBytes(&used, 1)) 
-    {
-        addr->addressHi = len;
-        addr->addressLo = 0;
-    
-        openGate();
-        return kIOReturnSuccess;
-    }
-
-    openGate();
-    return kIOReturnNoMemory;      
+	if( reserved->fSubmitBatchDepth != 0 )
+	{
+		reserved->fSubmitBatchFlushPending = true;
+		reserved->fSubmitBatchDeferredFlushes++;
+	}
+	else
+	{
+		fFWIM->flushWaitingPackets();
+	}
 }
 
-// freePseudoAddress
+// getSubmitBatchStatistics
 //
 //
 
-void IOFireWireController::freePseudoAddress(FWAddress addr, UInt32 lenDummy)
+void IOFireWireController::getSubmitBatchStatistics( UInt32 * batches, UInt32 * deferredFlushes, UInt32 * flushes )
 {
-    unsigned int len;
-    UInt8 * data;
-    
-    closeGate();
-    
-    assert( fAllocatedAddresses != NULL);
-    
-    len = fAllocatedAddresses->getLength();
-    assert(addr.addressHi < len);
-    data = (UInt8*)fAllocatedAddresses->getBytesNoCopy();
-    assert(data[addr.addressHi]);
-    data[addr.addressHi] = 0;
-    
-    openGate();
+	closeGate();
+	
+	*batches = reserved->fSubmitBatches;
+	*deferredFlushes = reserved->fSubmitBatchDeferredFlushes;
+	*flushes = reserved->fSubmitBatchFlushes;
+	
+	openGate();
 }
 
 #if 0
@@ -5780,7 +7138,6 @@ void IOFireWireController::processWriteRequest(UInt16 sourceID, UInt32 tLabel,
 {
     UInt32 ret = kFWResponseAddressError;
     FWAddress addr((hdr[1] & kFWAsynchDestinationOffsetHigh) >> kFWAsynchDestinationOffsetHighPhase, hdr[2]);
-    IOFWAddressSpace * found;
 	
 #if 0
 	// Special Andy Debug code to set/clear MultiIsochReceiver channels remotely via FireBug qwrite!
@@ -5820,12 +7177,7 @@ void IOFireWireController::processWriteRequest(UInt16 sourceID, UInt32 tLabel,
 	}
 #endif	
 	
-    fSpaceIterator->reset();
-    while( (found = (IOFWAddressSpace *) fSpaceIterator->getNextObject())) {
-        ret = found->doWrite(sourceID, speed, addr, len, buf, (IOFWRequestRefCon)tLabel);
-        if(ret != kFWResponseAddressError)
-            break;
-    }
+    ret = doWriteSpace(sourceID, speed, addr, len, buf, (IOFWRequestRefCon)tLabel);
 	
 	FWTrace(kFWTController, kTPControllerProcessWriteRequest, (uintptr_t)fFWIM, sourceID, ret, tLabel);
 	
@@ -5874,13 +7226,29 @@ UInt32 IOFireWireController::doReadSpace(UInt16 nodeID, IOFWSpeed &speed, FWAddr
 {
     IOFWAddressSpace * found;
     UInt32 ret = kFWResponseAddressError;
-    fSpaceIterator->reset();
-    while( (found = (IOFWAddressSpace *) fSpaceIterator->getNextObject())) {
+	UInt32 sequence = 0;
+	
+	reserved->fAddressSpaceDispatches++;
+	
+	while( (found = nextIndexedAddressSpace( addr, &sequence )) ) {
+		reserved->fAddressSpaceProbes++;
         ret = found->doRead(nodeID, speed, addr, len, buf, offset,
                             refcon);
         if(ret != kFWResponseAddressError)
             break;
     }
+	
+	if( ret == kFWResponseAddressError )
+	{
+		reserved->fUnindexedSpaceIterator->reset();
+		while( (found = (IOFWAddressSpace *) reserved->fUnindexedSpaceIterator->getNextObject())) {
+			reserved->fAddressSpaceProbes++;
+			ret = found->doRead(nodeID, speed, addr, len, buf, offset,
+								refcon);
+			if(ret != kFWResponseAddressError)
+				break;
+		}
+	}
 
 	// hack to pass the IODMACommand for the phys address space to the FWIM
 	
@@ -5906,12 +7274,28 @@ UInt32 IOFireWireController::doWriteSpace(UInt16 nodeID, IOFWSpeed &speed, FWAdd
 {
     IOFWAddressSpace * found;
     UInt32 ret = kFWResponseAddressError;
-    fSpaceIterator->reset();
-    while( (found = (IOFWAddressSpace *) fSpaceIterator->getNextObject())) {
+	UInt32 sequence = 0;
+	
+	reserved->fAddressSpaceDispatches++;
+	
+	while( (found = nextIndexedAddressSpace( addr, &sequence )) ) {
+		reserved->fAddressSpaceProbes++;
         ret = found->doWrite(nodeID, speed, addr, len, buf, refcon);
         if(ret != kFWResponseAddressError)
             break;
     }
+	
+	if( ret == kFWResponseAddressError )
+	{
+		reserved->fUnindexedSpaceIterator->reset();
+		while( (found = (IOFWAddressSpace *) reserved->fUnindexedSpaceIterator->getNextObject())) {
+			reserved->fAddressSpaceProbes++;
+			ret = found->doWrite(nodeID, speed, addr, len, buf, refcon);
+			if(ret != kFWResponseAddressError)
+				break;
+		}
+	}
+	
     return ret;
 }
 
@@ -5925,12 +7309,27 @@ UInt32 IOFireWireController::doLockSpace(UInt16 nodeID, IOFWSpeed &speed, FWAddr
 {
     IOFWAddressSpace * found;
     UInt32 ret = kFWResponseAddressError;
-    fSpaceIterator->reset();
-    while( (found = (IOFWAddressSpace *) fSpaceIterator->getNextObject())) {
+	UInt32 sequence = 0;
+	
+	reserved->fAddressSpaceDispatches++;
+	
+	while( (found = nextIndexedAddressSpace( addr, &sequence )) ) {
+		reserved->fAddressSpaceProbes++;
         ret = found->doLock(nodeID, speed, addr, inLen, newVal, outLen, oldVal, type, refcon);
         if(ret != kFWResponseAddressError)
             break;
     }
+	
+	if( ret == kFWResponseAddressError )
+	{
+		reserved->fUnindexedSpaceIterator->reset();
+		while( (found = (IOFWAddressSpace *) reserved->fUnindexedSpaceIterator->getNextObject())) {
+			reserved->fAddressSpaceProbes++;
+			ret = found->doLock(nodeID, speed, addr, inLen, newVal, outLen, oldVal, type, refcon);
+			if(ret != kFWResponseAddressError)
+				break;
+		}
+	}
 
     if(ret != kFWResponseComplete) {
         oldVal[0] = OSSwapHostToBigInt32(0xdeadbabe);
@@ -6204,64 +7603,578 @@ void IOFireWireController::addAllocatedChannel(IOFWIsochChannel *channel)
 	openGate();
 }
 
-// removeAllocatedChannel
+// removeAllocatedChannel
+//
+//
+
+void IOFireWireController::removeAllocatedChannel(IOFWIsochChannel *channel)
+{
+    closeGate();
+    
+	fAllocatedChannels->removeObject(channel);
+    
+	openGate();
+}
+
+
+void IOFireWireController::addToIRMAllocationSet(IOFireWireIRMAllocation *anObject)
+{
+	closeGate();
+
+	fIRMAllocationsAllocated->setObject(anObject);
+	
+	openGate();
+}
+
+void IOFireWireController::removeFromIRMAllocationSet(IOFireWireIRMAllocation *anObject)
+{
+	closeGate();
+	
+	fIRMAllocationsAllocated->removeObject(anObject);
+	
+	openGate();
+}
+
+// addIRMAllocation
+//
+//
+
+void IOFireWireController::addIRMAllocation(IOFireWireIRMAllocation *irmAllocation)
+{
+    closeGate();
+	
+	if( fIRMAllocationsAllocated->containsObject(irmAllocation) )
+	{
+		fIRMAllocations->setObject(irmAllocation);
+	}
+    
+	openGate();
+}
+
+// removeIRMAllocation
+//
+//
+
+void IOFireWireController::removeIRMAllocation(IOFireWireIRMAllocation *irmAllocation)
+{
+    closeGate();
+    
+	fIRMAllocations->removeObject(irmAllocation);
+    
+	openGate();
+}
+
+// IRMReallocInfo
+//
+// handed to the reallocation thread for one bus reset
+
+struct IRMReallocInfo
+{
+	IOFireWireController *		fControl;
+	UInt32						fGeneration;
+	AbsoluteTime				fResetTime;
+	OSArray *					fChannels;
+	OSArray *					fAllocations;
+};
+
+// IRMReallocRequest
+//
+// resources one channel or allocation wants back
+
+struct IRMReallocRequest
+{
+	OSObject *					fObject;
+	bool						fIsChannel;
+	bool						fBegun;
+	UInt32						fChannel;
+	UInt32						fBandwidth;
+};
+
+// beginIRMRealloc
+//
+// called on the workloop from startBusScan before the channels and allocations
+// are told about the reset. Previously every one of them spawned its own thread,
+// each read-modify-writing the IRM's registers and colliding with the others.
+// Their handleBusReset now joins this pass instead, overrides still run.
+
+void IOFireWireController::beginIRMRealloc( void )
+{
+	IRMReallocInfo * info = NULL;
+	bool success = true;
+	
+	if( fAllocatedChannels->getCount() == 0 && fIRMAllocations->getCount() == 0 )
+	{
+		return;
+	}
+	
+	info = (IRMReallocInfo *)IOMalloc( sizeof(IRMReallocInfo) );
+	if( info == NULL )
+	{
+		success = false;
+	}
+	
+	if( success )
+	{
+		bzero( info, sizeof(IRMReallocInfo) );
+		
+		info->fControl = this;
+		info->fGeneration = fBusGeneration;
+		info->fResetTime = fResetTime;
+		info->fChannels = OSArray::withCapacity( fAllocatedChannels->getCount() );
+		info->fAllocations = OSArray::withCapacity( fIRMAllocations->getCount() );
+		if( info->fChannels == NULL || info->fAllocations == NULL )
+		{
+			success = false;
+		}
+	}
+	
+	if( success )
+	{
+		reserved->fIRMReallocPending = info;
+	}
+	else if( info )
+	{
+		// everything reallocates on its own thread as before
+		ErrorLog( "IOFireWireController::beginIRMRealloc failed to set up reallocation for generation %d\n", (uint32_t)fBusGeneration );
+		
+		if( info->fChannels )
+			info->fChannels->release();
+		
+		if( info->fAllocations )
+			info->fAllocations->release();
+		
+		IOFree( info, sizeof(IRMReallocInfo) );
+	}
+}
+
+// joinIRMRealloc
+//
+// called from IOFWIsochChannel::handleBusReset and IOFireWireIRMAllocation::handleBusReset,
+// returns false if there is no pass for this generation to join
+
+bool IOFireWireController::joinIRMRealloc( OSObject * participant, UInt32 generation )
+{
+	bool joined = false;
+	
+	closeGate();
+	
+	IRMReallocInfo * info = reserved->fIRMReallocPending;
+	if( info != NULL && info->fGeneration == generation )
+	{
+		if( OSDynamicCast( IOFWIsochChannel, participant ) )
+		{
+			joined = info->fChannels->setObject( participant );
+		}
+		else if( OSDynamicCast( IOFireWireIRMAllocation, participant ) )
+		{
+			joined = info->fAllocations->setObject( participant );
+		}
+	}
+	
+	openGate();
+	
+	return joined;
+}
+
+// commitIRMRealloc
+//
+// starts the pass for everything that joined it
+
+void IOFireWireController::commitIRMRealloc( void )
+{
+	IRMReallocInfo * info = reserved->fIRMReallocPending;
+	bool success = true;
+	
+	if( info == NULL )
+	{
+		return;
+	}
+	
+	reserved->fIRMReallocPending = NULL;
+	
+	if( info->fChannels->getCount() == 0 && info->fAllocations->getCount() == 0 )
+	{
+		success = false;
+	}
+	
+	if( success )
+	{
+		retain();	// retain ourself for the thread to use
+		
+		thread_t thread;
+		if( kernel_thread_start((thread_continue_t)irmReallocThreadFunc, info, &thread ) == KERN_SUCCESS )
+		{
+			thread_deallocate( thread );
+		}
+		else
+		{
+			release();
+			
+			ErrorLog( "IOFireWireController::commitIRMRealloc failed to start reallocation for generation %d\n", (uint32_t)fBusGeneration );
+			
+			// with no pass pending these reallocate on their own threads
+			OSObject * found;
+			
+			for( unsigned int i = 0; (found = info->fChannels->getObject( i )); i++ )
+			{
+				((IOFWIsochChannel *)found)->handleBusReset();
+			}
+			
+			for( unsigned int i = 0; (found = info->fAllocations->getObject( i )); i++ )
+			{
+				((IOFireWireIRMAllocation *)found)->handleBusReset( info->fGeneration );
+			}
+			
+			success = false;
+		}
+	}
+	
+	if( !success )
+	{
+		info->fChannels->release();
+		info->fAllocations->release();
+		IOFree( info, sizeof(IRMReallocInfo) );
+	}
+}
+
+// irmReallocThreadFunc
 //
 //
 
-void IOFireWireController::removeAllocatedChannel(IOFWIsochChannel *channel)
+void IOFireWireController::irmReallocThreadFunc( void * arg )
 {
-    closeGate();
-    
-	fAllocatedChannels->removeObject(channel);
-    
-	openGate();
+	IRMReallocInfo * info = (IRMReallocInfo *)arg;
+	IOFireWireController * control = info->fControl;
+	
+	control->reallocIRMResources( info->fGeneration, info->fChannels, info->fAllocations );
+	
+	AbsoluteTime now;
+	UInt64 nanoDelta;
+	IOFWGetAbsoluteTime( &now );
+	SUB_ABSOLUTETIME( &now, &info->fResetTime );
+	absolutetime_to_nanoseconds( now, &nanoDelta );
+	
+	UInt32 micros = (UInt32)(nanoDelta / 1000);
+	
+	control->closeGate();
+	
+	control->reserved->fIRMReallocLatency = micros;
+	if( micros > control->reserved->fIRMReallocMaxLatency )
+	{
+		control->reserved->fIRMReallocMaxLatency = micros;
+	}
+	
+	control->openGate();
+	
+	DebugLog( "IOFireWireController::irmReallocThreadFunc generation %d reallocated %d channels, %d allocations in %d us\n", 
+			  (uint32_t)info->fGeneration, info->fChannels->getCount(), info->fAllocations->getCount(), micros );
+	
+	info->fChannels->release();
+	info->fAllocations->release();
+	IOFree( info, sizeof(IRMReallocInfo) );
+	
+	control->release();		// retain occurred in commitIRMRealloc
 }
 
+// reallocIRMResources
+//
+// cannot be called on the workloop. Gathers everything the channels and
+// allocations want back, claims their channel bits with one lock per channels
+// available register and their summed bandwidth with one lock on bandwidth
+// available. If any of that fails (out of resources, contention or a reset),
+// what was claimed is returned and each one retries on its own as before.
 
-void IOFireWireController::addToIRMAllocationSet(IOFireWireIRMAllocation *anObject)
+void IOFireWireController::reallocIRMResources( UInt32 generation, OSArray * channels, OSArray * allocations )
 {
+	IOReturn status = kIOReturnSuccess;
+	UInt32 channelCount = channels->getCount();
+	UInt32 count = channelCount + allocations->getCount();
+	IRMReallocRequest * requests = NULL;
+	UInt32 irmGeneration;
+	UInt16 irmNodeID;
+	UInt32 masks[2] = { 0, 0 };	// host order bits for channels 0-31 and 32-63
+	bool claimed[2] = { false, false };
+	UInt32 bandwidth = 0;
+	bool reallocated = false;
+	UInt32 index;
+	
+	getIRMNodeID( irmGeneration, irmNodeID );
+	if( irmGeneration != generation )
+	{
+		// another reset has happened, its pass will do the work
+		return;
+	}
+	
+	requests = (IRMReallocRequest *)IOMalloc( sizeof(IRMReallocRequest) * count );
+	if( requests == NULL )
+	{
+		status = kIOReturnNoMemory;
+	}
+	
+	//
+	// lock each participant and gather what it wants back
+	//
+	
+	for( index = 0; (status == kIOReturnSuccess) && (index < count); index++ )
+	{
+		IRMReallocRequest * request = &requests[index];
+		
+		request->fIsChannel = (index < channelCount);
+		request->fChannel = 64;
+		request->fBandwidth = 0;
+		
+		if( request->fIsChannel )
+		{
+			IOFWIsochChannel * channel = (IOFWIsochChannel *)channels->getObject( index );
+			request->fObject = channel;
+			request->fBegun = channel->beginRealloc( generation, &request->fChannel, &request->fBandwidth );
+		}
+		else
+		{
+			IOFireWireIRMAllocation * allocation = (IOFireWireIRMAllocation *)allocations->getObject( index - channelCount );
+			UInt8 isochChannel = 64;
+			request->fObject = allocation;
+			request->fBegun = allocation->beginRealloc( generation, &isochChannel, &request->fBandwidth );
+			request->fChannel = isochChannel;
+		}
+		
+		if( !request->fBegun )
+		{
+			continue;
+		}
+		
+		if( request->fChannel < 64 )
+		{
+			UInt32 word = request->fChannel >> 5;
+			UInt32 bit = 1 << (31 - (request->fChannel & 31));
+			
+			if( masks[word] & bit )
+			{
+				// two of them want the same channel, only one can have it
+				status = kIOFireWireChannelNotAvailable;
+			}
+			
+			masks[word] |= bit;
+		}
+		
+		bandwidth += request->fBandwidth;
+	}
+	
+	//
+	// claim the channels, one lock per register
+	//
+	
+	for( UInt32 word = 0; (status == kIOReturnSuccess) && (word < 2); word++ )
+	{
+		if( masks[word] )
+		{
+			status = claimIRMChannels( generation, irmNodeID, word ? kCSRChannelsAvailable63_32 : kCSRChannelsAvailable31_0, masks[word] );
+			claimed[word] = (status == kIOReturnSuccess);
+		}
+	}
+	
+	//
+	// claim the bandwidth, one lock for all of it
+	//
+	
+	if( (status == kIOReturnSuccess) && bandwidth )
+	{
+		status = claimIRMBandwidth( generation, irmNodeID, bandwidth );
+	}
+	
+	reallocated = (status == kIOReturnSuccess);
+	
+	if( !reallocated )
+	{
+		DebugLog( "IOFireWireController::reallocIRMResources generation %d combined reallocation failed with 0x%08x, reallocating individually\n", (uint32_t)generation, status );
+		
+		// give back what we claimed (note: will fail if generation has changed)
+		for( UInt32 word = 0; word < 2; word++ )
+		{
+			if( claimed[word] )
+			{
+				for( UInt32 bit = 0; bit < 32; bit++ )
+				{
+					if( masks[word] & (1 << (31 - bit)) )
+					{
+						releaseIRMChannelInGeneration( (word << 5) | bit, generation );
+					}
+				}
+			}
+		}
+	}
+	
+	//
+	// unlock the participants, those we couldn't restore reallocate on their own
+	//
+	
+	UInt32 begun = 0;
+	
+	for( UInt32 done = 0; requests && (done < index); done++ )
+	{
+		IRMReallocRequest * request = &requests[done];
+		
+		if( !request->fBegun )
+		{
+			continue;
+		}
+		
+		begun++;
+		
+		if( request->fIsChannel )
+		{
+			((IOFWIsochChannel *)request->fObject)->endRealloc( generation, reallocated );
+		}
+		else
+		{
+			((IOFireWireIRMAllocation *)request->fObject)->endRealloc( generation, reallocated );
+		}
+	}
+	
+	//
+	// anything we never got to also reallocates on its own
+	//
+	
+	for( ; index < count; index++ )
+	{
+		if( index < channelCount )
+		{
+			((IOFWIsochChannel *)channels->getObject( index ))->reallocBandwidth( generation );
+		}
+		else
+		{
+			IOFireWireIRMAllocation * allocation = (IOFireWireIRMAllocation *)allocations->getObject( index - channelCount );
+			UInt8 isochChannel;
+			UInt32 bandwidthUnits;
+			
+			if( allocation->beginRealloc( generation, &isochChannel, &bandwidthUnits ) )
+			{
+				allocation->endRealloc( generation, false );
+			}
+		}
+		
+		begun++;
+	}
+	
 	closeGate();
-
-	fIRMAllocationsAllocated->setObject(anObject);
+	
+	if( reallocated )
+		reserved->fIRMReallocCoalesced += begun;
+	else
+		reserved->fIRMReallocFallbacks += begun;
 	
 	openGate();
+	
+	if( requests )
+	{
+		IOFree( requests, sizeof(IRMReallocRequest) * count );
+	}
 }
 
-void IOFireWireController::removeFromIRMAllocationSet(IOFireWireIRMAllocation *anObject)
+// claimIRMChannels
+//
+// clear all of mask (host order) in one of the IRM's channels available registers
+
+IOReturn IOFireWireController::claimIRMChannels( UInt32 generation, UInt16 irmNodeID, UInt32 addressLo, UInt32 mask )
 {
-	closeGate();
+	IOReturn res = kIOReturnSuccess;
+	IOFWCompareAndSwapCommand * lockCmd;
+	FWAddress addr( 0xFFFF, addressLo, irmNodeID );
+	UInt32 expectedOldVal, newVal;
+	UInt32 actualOldVal;
+	bool lockSuccessful = false;
+	UInt32 retries = 2;
 	
-	fIRMAllocationsAllocated->removeObject(anObject);
+	// Start with the default, no channels allocated value for the old val!
+	expectedOldVal = OSSwapHostToBigInt32(0xFFFFFFFF);
 	
-	openGate();
+	lockCmd = OSTypeAlloc( IOFWCompareAndSwapCommand );
+	if( !lockCmd )
+		return kIOReturnNoMemory;
+	
+	if( !lockCmd->initAll( this, generation, addr, NULL, NULL, 0, NULL, NULL ) )
+	{
+		lockCmd->release();
+		return kIOReturnError;
+	}
+	
+	while( retries > 0 )
+	{
+		// Make sure none of the channels is already allocated
+		if( (OSSwapBigToHostInt32(expectedOldVal) & mask) != mask )
+		{
+			res = kIOFireWireChannelNotAvailable;
+			break;
+		}
+		
+		newVal = OSSwapHostToBigInt32( OSSwapBigToHostInt32(expectedOldVal) & ~mask );
+		
+		res = lockCmd->reinit( generation, addr, &expectedOldVal, &newVal, 1, NULL, NULL );
+		if( res != kIOReturnSuccess )
+			break;
+		
+		res = lockCmd->submit();
+		
+		if( res == kIOReturnSuccess )
+			lockSuccessful = lockCmd->locked( &actualOldVal );
+		else
+			lockSuccessful = false;
+		
+		if( res == kIOFireWireBusReset || lockSuccessful )
+			break;
+		
+		retries -= 1;
+		
+		if( res == kIOReturnSuccess )
+			res = kIOFireWireChannelNotAvailable;
+		
+		expectedOldVal = actualOldVal;
+	}
+	
+	lockCmd->release();
+	
+	return res;
 }
 
-// addIRMAllocation
-//
+// claimIRMBandwidth
 //
+// subtract bandwidthUnits from the IRM's bandwidth available register
 
-void IOFireWireController::addIRMAllocation(IOFireWireIRMAllocation *irmAllocation)
+IOReturn IOFireWireController::claimIRMBandwidth( UInt32 generation, UInt16 irmNodeID, UInt32 bandwidthUnits )
 {
-    closeGate();
+	IOReturn res = kIOReturnSuccess;
 	
-	if( fIRMAllocationsAllocated->containsObject(irmAllocation) )
+	UInt32 irmGeneration;
+	UInt16 currentIRMNodeID;
+	
+	getIRMNodeID( irmGeneration, currentIRMNodeID );
+	if( irmGeneration != generation || currentIRMNodeID != irmNodeID )
 	{
-		fIRMAllocations->setObject(irmAllocation);
+		res = kIOFireWireBusReset;
 	}
-    
-	openGate();
+	
+	if( res == kIOReturnSuccess )
+	{
+		// same compare/swap loop as a single allocation, on the sum
+		res = allocateIRMBandwidthInGeneration( bandwidthUnits, generation );
+	}
+	
+	return res;
 }
 
-// removeIRMAllocation
+// getIRMReallocStatistics
 //
 //
 
-void IOFireWireController::removeIRMAllocation(IOFireWireIRMAllocation *irmAllocation)
+void IOFireWireController::getIRMReallocStatistics( UInt32 * latency, UInt32 * maxLatency, UInt32 * coalesced, UInt32 * fallbacks )
 {
-    closeGate();
-    
-	fIRMAllocations->removeObject(irmAllocation);
-    
+	closeGate();
+	
+	*latency = reserved->fIRMReallocLatency;
+	*maxLatency = reserved->fIRMReallocMaxLatency;
+	*coalesced = reserved->fIRMReallocCoalesced;
+	*fallbacks = reserved->fIRMReallocFallbacks;
+	
 	openGate();
 }
 
@@ -6917,79 +8830,72 @@ IOReturn IOFireWireController::getBusCycleTime(UInt32 &busTime, UInt32 &cycleTim
 
 // hopCount
 //
-//
+// looked up in the hop map built with the topology
 
 UInt32 IOFireWireController::hopCount(UInt16 nodeAAddress, UInt16 nodeBAddress )
 {	
+	UInt32 hops;
+	
 	nodeAAddress &= kFWMaxNodesPerBus;
 	nodeBAddress &= kFWMaxNodesPerBus;
 	
-	UInt16 lowNode = nodeAAddress > nodeBAddress ? nodeBAddress : nodeAAddress;
+	closeGate();
 	
-    struct FWNodeScan
-    {
-        int nodeID;
-        int childrenRemaining;
-    };
+	if( !reserved->fHopVectorValid )
+	{
+		// the self IDs didn't build a proper tree (or haven't been processed yet)
+		hops = 0xFFFFFFFF;	// this seems like the best thing to return here, impossibly large
+	}
+	else if( nodeAAddress > fRootNodeID || nodeBAddress > fRootNodeID )
+	{
+		hops = 0;
+	}
+	else
+	{
+		hops = getNodeHops( nodeAAddress, nodeBAddress );
+	}
 	
-    FWNodeScan scanList[fRootNodeID];
-    FWNodeScan *level;
-	level = scanList;
+	openGate();
 	
-	const unsigned int maxNodes = fRootNodeID+1;
-	UInt8 hopArray[maxNodes*(maxNodes+1)];
-	bzero(hopArray, sizeof(hopArray));
+	return hops;
+}
+
+// getTopologySnapshot
+//
+//
+
+IOReturn IOFireWireController::getTopologySnapshot( IOFWTopologySnapshot * snapshot )
+{
+	IOReturn status = kIOReturnSuccess;
 	
 	closeGate();
 	
-	// this is the same basic algorithm used in buildTopology
-    int i;
-	// stop once we've found the lower node because there's enough info in the hop count table at that point
-	for( i = fRootNodeID; i >= lowNode; i-- )
+	if( !reserved->fHopVectorValid )
 	{
-		// Add node to bottom of tree
-		level->nodeID = i;
-		level->childrenRemaining = countNodeIDChildren( i );
+		status = kIOReturnNotReady;
+	}
+	
+	if( status == kIOReturnSuccess )
+	{
+		bzero( snapshot, sizeof(IOFWTopologySnapshot) );
 		
-		if (i != fRootNodeID) 
-		{
-			int parentNodeNum, scanNodeNum;
-			parentNodeNum = (level-1)->nodeID;
-			for (scanNodeNum = i + 1; scanNodeNum <= fRootNodeID; scanNodeNum++)
-			{
-				UInt8 hops = hopArray[(maxNodes + 1)*parentNodeNum + scanNodeNum];
-				
-				// fill out entire table so we don't have to use extra math to use a triangular matrix
-				hopArray[(maxNodes + 1)*i + scanNodeNum] = hops + 1;
-				hopArray[(maxNodes + 1)*scanNodeNum + i] = hops + 1;
-				//IOLog("Calc Hops %d-%d: %d dervied from %d-%d:%d\n", i, scanNodeNum, hops+1, parentNodeNum, scanNodeNum, hops);
-			}
-		}
+		snapshot->fGeneration = reserved->fHopVectorGeneration;
+		snapshot->fLocalNodeID = fLocalNodeID;
+		snapshot->fRootNodeID = fRootNodeID;
 		
-		// Find next child port.
-		if (i > 0) 
+		for( UInt16 nodeA = 0; nodeA <= fRootNodeID; nodeA++ )
 		{
-			while (level->childrenRemaining == 0) 
+			for( UInt16 nodeB = 0; nodeB <= fRootNodeID; nodeB++ )
 			{
-				// Go up one level in tree.
-				level--;
-				if(level < scanList) 
-				{
-					ErrorLog("FireWire: SelfIDs don't build a proper tree for hop counts (missing selfIDS?)!!\n");
-					return 0xFFFFFFFF;	// this seems like the best thing to return here, impossibly large
-				}
-				// One less child to scan.
-				level->childrenRemaining--;
+				snapshot->fHopCounts[nodeA][nodeB] = getNodeHops( nodeA, nodeB );
+				snapshot->fSpeeds[nodeA][nodeB] = (UInt8)FWSpeed( nodeA, nodeB );
 			}
-			// Go down one level in tree.
-			level++;
 		}
 	}
-
+	
 	openGate();
 	
-	// since both sides of matrix are filled in, no special math is necessary
-	return hopArray[(maxNodes + 1)*nodeAAddress + nodeBAddress];
+	return status;
 }
 
 // hopCount
@@ -7073,6 +8979,42 @@ void IOFireWireController::setNodeSpeed( UInt16 nodeA, UInt16 nodeB, UInt8 speed
 	//IOLog("setNodeSpeed( A:%d, B:%d, Speed:0x%x)\n", nodeA, nodeB, speed);
 }
 
+// setNodeHops
+//
+//
+
+void IOFireWireController::setNodeHops( UInt16 nodeA, UInt16 nodeB, UInt8 hops )
+{
+	nodeA &= kFWMaxNodesPerBus;
+	nodeB &= kFWMaxNodesPerBus;
+	
+	if ( nodeA < kFWMaxNodesPerBus && nodeB < kFWMaxNodesPerBus )
+	{
+		if ( nodeA < nodeB )
+			reserved->fHopVector[nodeA + ((nodeB * (nodeB + 1))/2)] = hops;
+		else
+			reserved->fHopVector[nodeB + ((nodeA * (nodeA + 1))/2)] = hops;
+	}
+}
+
+// getNodeHops
+//
+//
+
+UInt8 IOFireWireController::getNodeHops( UInt16 nodeA, UInt16 nodeB ) const
+{
+	nodeA &= kFWMaxNodesPerBus;
+	nodeB &= kFWMaxNodesPerBus;
+	
+	if ( nodeA >= kFWMaxNodesPerBus || nodeB >= kFWMaxNodesPerBus )
+		return 0;
+	
+	if ( nodeA < nodeB )
+		return reserved->fHopVector[nodeA + ((nodeB * (nodeB + 1))/2)];
+	else
+		return reserved->fHopVector[nodeB + ((nodeA * (nodeA + 1))/2)];
+}
+
 void IOFireWireController::setNodeSpeed( UInt16 nodeAddress, UInt8 speed )
 {
 	setNodeSpeed(nodeAddress, fLocalNodeID, speed);
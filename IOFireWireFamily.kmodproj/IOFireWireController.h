@@ -72,6 +72,10 @@ class IOFWAsyncPHYCommand;
 class IOFWPHYPacketListener;
 class IOFWUserPHYPacketListener;
 class IOFireWireUserClient;
+class IOFWSyncer;
+class IOFWCommand;
+class IOFWAsyncCommand;
+struct IRMReallocInfo;
 
 #if FIRELOGCORE
 class IOFireLog;
@@ -260,6 +264,82 @@ struct AsyncPendingTrans {
     IOFWCommand *		fAltHandler;
     int			fTCode;
     bool		fInUse;
+    UInt8		fPool;		// index of the AsyncPendingTransPool this label belongs to
+};
+
+// AsyncPendingTransPool
+//
+// Transaction labels are only unique per (source, destination) pair, so when the
+// FWIM supports it each destination phy ID gets its own set of 64 labels.
+// fInUse has one bit per label.
+
+struct AsyncPendingTransPool {
+	UInt64				fInUse;
+	UInt32				fLastTrans;
+	AsyncPendingTrans	fTrans[kFWAsynchTTotal];
+};
+
+// IOFWAddressSpaceIndexEntry
+//
+// One entry in the controller's sorted index of local address spaces.
+// fStart and fEnd are 48 bit (addressHi:addressLo) keys, fEnd is exclusive.
+// fMaxEnd is the largest fEnd of this entry and all entries before it, which
+// lets a lookup stop walking backwards as soon as nothing earlier can overlap.
+
+struct IOFWAddressSpaceIndexEntry {
+	IOFWAddressSpace *	fSpace;
+	UInt64				fStart;
+	UInt64				fEnd;
+	UInt64				fMaxEnd;
+	UInt32				fSequence;		// registration order, used to break ties between overlapping spaces
+};
+
+//
+// IOFWCommandPool cache of command allocations of one size (MemberVariables
+// structs and the like). Idle blocks are linked through their first word.
+
+struct IOFWCommandMemoryClass {
+	vm_size_t			fSize;
+	void *				fFreeList;
+	UInt32				fCount;
+};
+
+enum
+{
+	kFWCommandMemoryClasses		= 8,
+	kFWCommandMemoryPerClass	= 32,
+	kFWCommandPoolSize			= 32,
+	kFWSyncerPoolSize			= 8
+};
+
+enum
+{
+	kFWAsyncStreamChannelCount	= 64
+};
+
+//
+// ROM image cache, see IOFireWireController::copyCachedROMImage
+
+#define kFWROMImageCacheKey			"FireWire ROM Image Cache"
+
+enum
+{
+	kFWROMImageCacheMaxEntries	= 64,
+	kFWROMImageMinSize			= 20,		// ROM header + general bus info block
+	kFWROMImageMaxSize			= 1024
+};
+
+//
+// Copy of the hop count and speed maps for one bus generation, see
+// IOFireWireController::getTopologySnapshot. Entries are indexed
+// [nodeA][nodeB] by node number and only valid up to fRootNodeID.
+
+struct IOFWTopologySnapshot {
+	UInt32				fGeneration;
+	UInt16				fLocalNodeID;
+	UInt16				fRootNodeID;
+	UInt8				fHopCounts[kFWMaxNodesPerBus][kFWMaxNodesPerBus];
+	UInt8				fSpeeds[kFWMaxNodesPerBus][kFWMaxNodesPerBus];
 };
 
 struct IOFWNodeScan {
@@ -282,6 +362,8 @@ struct IOFWNodeScan {
     bool						fIRMCheckingLock;
 	int							fRetriesBumped;
 	bool						fMustNotBeRoot;
+	bool						fBlockFetch;	// fCmd is reading the rest of the bus info block in one block read
+	AbsoluteTime				fStartTime;		// when the scan of this node started
 };
 
 
@@ -320,6 +402,47 @@ public:
 	
 };
 
+// IOFWCommandPool
+//
+// Recycled command memory, syncers and idle commands. The controller and every command
+// allocated from the pool hold a reference, so a command can give its memory back after
+// the controller is gone. Idle commands hold the pool too, the controller breaks that
+// cycle with flushCommands before dropping its reference.
+
+class IOFWCommandPool : public OSObject
+{
+    OSDeclareDefaultStructors(IOFWCommandPool);
+
+private:
+	IOLock *					fLock;
+	IOFWCommandMemoryClass		fMemory[kFWCommandMemoryClasses];
+	IOFWSyncer *				fSyncers[kFWSyncerPoolSize];
+	UInt32						fSyncerCount;
+	OSArray *					fCommands;
+	UInt32						fHits;
+	UInt32						fMisses;
+	
+protected:
+	virtual bool init( void ) APPLE_KEXT_OVERRIDE;
+    virtual void free( void ) APPLE_KEXT_OVERRIDE;
+    
+public:
+
+	static IOFWCommandPool * create( void );
+
+	void * allocMemory( vm_size_t size );
+	void freeMemory( void * block, vm_size_t size );
+	
+	IOFWSyncer * allocSyncer( void );
+	void recycleSyncer( IOFWSyncer * syncer );
+	
+	IOFWAsyncCommand * allocCommand( const OSMetaClass * type, IOFireWireNub * device );
+	void recycleCommand( IOFWAsyncCommand * cmd );
+	void flushCommands( void );
+	
+	void getStatistics( UInt32 * hits, UInt32 * misses );
+};
+
 #define kMaxPendingTransfers kFWAsynchTTotal
 
 class IOFireWireController;
@@ -425,6 +548,8 @@ protected:
 		
     struct timeoutQ: public IOFWCmdQ
     {
+        enum { kBusResetCancelBatch = 32 };	// commands cancelled per pass in busReset
+        
         IOTimerEventSource *fTimer;
         virtual void headChanged(IOFWCommand *oldHead);
         void busReset();
@@ -464,6 +589,7 @@ protected:
 	friend class IOFWAsyncStreamListener;
 	friend class IOFireWireLocalNode;
 	friend class IOFireWireIRMAllocation;
+	friend class IOFWIsochChannel;
 	friend class IOFWUserVectorCommand;
 	friend class IOFWAsyncPHYCommand;
 	friend class IOFWUserPHYPacketListener;
@@ -521,6 +647,7 @@ protected:
     IOMemoryDescriptor *		fBadReadResponse;	// Send back easily identified bad data to out of range addrs. 
 
     // Array for outstanding requests (up to 64)
+    // unused, kept for layout. outstanding requests are tracked in reserved->fTransPools
     AsyncPendingTrans			fTrans[kMaxPendingTransfers];
     int							fLastTrans;
 
@@ -549,7 +676,7 @@ protected:
     void *						fFireLogPublisher;
 #endif
 
-    OSData *					fAllocatedAddresses;
+    OSData *					fAllocatedAddresses;	// unused, see reserved->fPseudoAddressBitmap
 
 	UInt32						fDevicePruneDelay;
 	
@@ -587,6 +714,7 @@ protected:
 	UInt32						fHubPort;
 	UInt32						fDebugIgnoreNode;
 
+	// unused, see reserved->fAsyncStreamReceivers
 	OSSet *						fLocalAsyncStreamReceivers; 
     OSIterator *				fAsyncStreamReceiverIterator;
 
@@ -612,8 +740,69 @@ protected:
     
 /*! @struct ExpansionData
     @discussion This structure will be used to expand the capablilties of the class in the future.
+    State added since the class layout was fixed lives here so the layout stays unchanged.
+    It holds, among others, the sorted index of local address spaces. Spaces that declare
+    their range are dispatched through the index, the rest (physical spaces etc.) are kept
+    in fUnindexedAddresses and probed linearly.
     */    
-    struct ExpansionData { };
+    struct ExpansionData
+	{
+		IOFWAddressSpaceIndexEntry *	fAddressSpaceIndex;
+		UInt32							fAddressSpaceIndexCount;
+		UInt32							fAddressSpaceIndexCapacity;
+		UInt32							fAddressSpaceSequence;
+		OSSet *							fUnindexedAddresses;
+		OSIterator *					fUnindexedSpaceIterator;
+
+		UInt32							fAddressSpaceDispatches;	// inbound requests dispatched to local address spaces
+		UInt32							fAddressSpaceProbes;		// doRead/doWrite/doLock calls made while dispatching
+
+		bool							fPerNodeTLabels;			// FWIM advertised FWPerNodeTLabels, see allocTrans
+
+		// config ROM images of devices seen, keyed by GUID, see copyCachedROMImage
+		OSDictionary *					fROMImageCache;
+
+		// bus info block fetch statistics for the last bus scan
+		UInt32							fROMFetchLatency[kFWMaxNodesPerBus];	// microseconds, 0 if not scanned
+		UInt32							fROMFetchBlockReads;
+		UInt32							fROMFetchFallbacks;
+
+		// hops between two nodes, same layout as fSpeedVector
+		UInt8							fHopVector[((kFWMaxNodesPerBus+1)*kFWMaxNodesPerBus)/2];
+		bool							fHopVectorValid;			// fHopVector was built from the current self IDs
+		UInt32							fHopVectorGeneration;		// bus generation fHopVector was built for
+
+		// async stream receivers indexed by channel, each holds the listeners for its channel
+		IOFWAsyncStreamReceiver *		fAsyncStreamReceivers[kFWAsyncStreamChannelCount];
+
+		// pseudo address space addressHi slots, one bit per slot
+		// all words below fPseudoAddressHint are full
+		UInt64 *						fPseudoAddressBitmap;
+		UInt32							fPseudoAddressWords;
+		UInt32							fPseudoAddressHint;
+		UInt32							fPseudoAddressCount;
+
+		// Outstanding requests, indexed by destination phy ID. Requests with no destination
+		// (PHY packets), and all requests unless the FWIM supports per node labels, use the
+		// broadcast pool. Allocated by init.
+		AsyncPendingTransPool *			fTransPools[kFWBroadcastNodeID+1];
+
+		// submit batching, see beginSubmitBatch
+		UInt32							fSubmitBatchDepth;
+		bool							fSubmitBatchFlushPending;
+		UInt32							fSubmitBatches;
+		UInt32							fSubmitBatchDeferredFlushes;
+		UInt32							fSubmitBatchFlushes;
+
+		IOFWCommandPool *				fCommandPool;				// recycled command memory and syncers
+
+		// IRM resource reallocation after bus reset, see beginIRMRealloc
+		IRMReallocInfo *				fIRMReallocPending;			// reallocation pass being joined
+		UInt32							fIRMReallocLatency;			// microseconds from reset to end of the last pass
+		UInt32							fIRMReallocMaxLatency;
+		UInt32							fIRMReallocCoalesced;		// allocations restored by the pass's combined locks
+		UInt32							fIRMReallocFallbacks;		// allocations that had to reallocate on their own
+	};
 
 /*! @var reserved
     Reserved for future use.  (Internal use only)  */
@@ -662,6 +851,10 @@ protected:
     virtual IOReturn allocAddress(IOFWAddressSpace *space);
     virtual void freeAddress(IOFWAddressSpace *space);
 
+	bool addAddressSpaceToIndex( IOFWAddressSpace * space, FWAddress base, UInt32 length );
+	void removeAddressSpaceFromIndex( IOFWAddressSpace * space );
+	IOFWAddressSpace * nextIndexedAddressSpace( FWAddress addr, UInt32 * sequence );
+
 	IOFireWireBusAux * createAuxiliary( void ) APPLE_KEXT_OVERRIDE;
 	
 public:
@@ -837,10 +1030,86 @@ public:
     // Are we currently scanning the bus?
     bool scanningBus() const;
 
+	// Number of inbound requests dispatched to local address spaces and the number of
+	// address space handlers called to service them
+	void getAddressSpaceDispatchStatistics( UInt32 * dispatches, UInt32 * probes );
+
+	// Reserve 'count' contiguous pseudo address space addressHi values (with addressLo 0).
+	// Slots can be released one at a time with freePseudoAddress or all at once.
+	IOReturn allocatePseudoAddressRange( UInt32 count, UInt16 * firstAddressHi );
+	void freePseudoAddressRange( UInt16 firstAddressHi, UInt32 count );
+
+	// Pseudo addressHi occupancy: slots in use, one past the highest slot in use, and the
+	// number and longest of the free runs below that
+	void getPseudoAddressStatistics( UInt32 * allocated, UInt32 * highWater, UInt32 * freeRuns, UInt32 * largestFreeRun );
+
+	// Command allocation cache. Commands retain it and recycle their MemberVariables
+	// and the syncers used by synchronous submits through it, see IOFWCommandPool.
+	IOFWCommandPool * getCommandPool( void );
+
+	// Idle command pool. recycleCommand takes the caller's reference and keeps the command,
+	// fully initialized, if nothing else holds it. allocCommand returns a retained pooled
+	// command of exactly the given class made for the given device (NULL for commands made
+	// with the controller), or NULL. The caller must reinit it before use.
+	IOFWAsyncCommand * allocCommand( const OSMetaClass * type, IOFireWireNub * device );
+	template <class T> T * allocCommand( IOFireWireNub * device ) { return OSDynamicCast( T, allocCommand( T::metaClass, device ) ); }
+	void recycleCommand( IOFWAsyncCommand * cmd );
+
+	// Allocations served from the command pool and allocations that missed it
+	void getCommandPoolStatistics( UInt32 * hits, UInt32 * misses );
+
+	// Submit batching. beginSubmitBatch closes the gate and holds it until the matching
+	// commitSubmitBatch. Packet flushes requested by commands submitted in between are
+	// deferred and issued once at commit, so the FWIM can post all of the batch's
+	// requests together. Only asynchronous commands may be submitted inside a batch.
+	void beginSubmitBatch( void );
+	IOReturn commitSubmitBatch( void );
+	inline bool inSubmitBatch( void ) const
+		{ return reserved->fSubmitBatchDepth != 0; }
+	void getSubmitBatchStatistics( UInt32 * batches, UInt32 * deferredFlushes, UInt32 * flushes );
+
+	// Time the last bus scan took to read the bus info block of nodeID, and how many
+	// block reads of bus info blocks were tried and had to fall back to quadlet reads.
+	IOReturn getROMFetchLatency( UInt16 nodeID, UInt32 * microseconds );
+	void getROMFetchStatistics( UInt32 * blockReads, UInt32 * fallbacks );
+
+	// Time from the last bus reset until its isoch channels and IRM allocations were
+	// restored (and the worst seen), and how many were restored by the combined IRM locks
+	// of the reallocation pass versus reallocating one at a time.
+	void getIRMReallocStatistics( UInt32 * latency, UInt32 * maxLatency, UInt32 * coalesced, UInt32 * fallbacks );
+
+	// ROM image cache. Devices store the config ROM they have read by GUID, and a device
+	// that comes back with the same bus info block (header CRC and ROM generation included)
+	// starts from the cached image instead of reading its directories over the bus again.
+	// The cache is published as kFWROMImageCacheKey so it can be saved, and an administrator
+	// can load a saved copy back through setProperties.
+	OSData * copyCachedROMImage( const UInt32 * bib, UInt32 bibSize );
+	void cacheROMImage( const void * bytes, unsigned int length );
+	void flushROMImageCache( void );
+	IOReturn loadROMImageCache( OSDictionary * images );
+	virtual IOReturn setProperties( OSObject * properties ) APPLE_KEXT_OVERRIDE;
+
+	// Copies the hop counts and speeds between every pair of nodes computed when the
+	// topology was last built. Returns kIOReturnNotReady while the self IDs are being processed.
+	IOReturn getTopologySnapshot( IOFWTopologySnapshot * snapshot );
+
+	// called by commands with the gate closed in place of fFWIM->flushWaitingPackets
+	void flushSubmittedPackets( void );
+
 protected:
 
     void openGate();
     void closeGate();
+	
+	// one pass per bus reset restores the isoch channels and IRM allocations that
+	// join it from handleBusReset, sharing the IRM lock transactions between them
+	void beginIRMRealloc( void );
+	bool joinIRMRealloc( OSObject * participant, UInt32 generation );
+	void commitIRMRealloc( void );
+	static void irmReallocThreadFunc( void * arg );
+	void reallocIRMResources( UInt32 generation, OSArray * channels, OSArray * allocations );
+	IOReturn claimIRMChannels( UInt32 generation, UInt16 irmNodeID, UInt32 addressLo, UInt32 mask );
+	IOReturn claimIRMBandwidth( UInt32 generation, UInt16 irmNodeID, UInt32 bandwidthUnits );
 		
 protected:    
 	virtual void doBusReset( void );
@@ -866,6 +1135,15 @@ protected:
     virtual IOReturn allocatePseudoAddress(FWAddress *addr, UInt32 lenDummy);
     virtual void freePseudoAddress(FWAddress addr, UInt32 lenDummy);
 	
+	void recordROMFetchLatency( IOFWNodeScan * scan );
+	
+	static bool getROMImageKey( const void * bytes, unsigned int length, char * key, size_t keySize );
+	void publishROMImageCache( void );
+	
+	bool growPseudoAddressBitmap( UInt32 minimumWords );
+	IOReturn allocatePseudoAddressSlots( UInt32 count, UInt32 * first );
+	void freePseudoAddressSlots( UInt32 first, UInt32 count );
+	
 	virtual IORegistryEntry * createDummyRegistryEntry( IOFWNodeScan *scan );
 
 	static IOFireWireLocalNode * getLocalNode(IOFireWireController *control);
@@ -887,6 +1165,8 @@ protected:
 	virtual void destroyPendingQ( void );
 
 	virtual UInt32 countNodeIDChildren( UInt16 nodeID, int hub_port = 0, int * hubChildRemainder = NULL, bool * hubParentFlag = NULL );
+	void setNodeHops( UInt16 nodeA, UInt16 nodeB, UInt8 hops );
+	UInt8 getNodeHops( UInt16 nodeA, UInt16 nodeB ) const;
 
 public:
 	virtual UInt32 hopCount(UInt16 nodeAAddress, UInt16 nodeBAddress ) APPLE_KEXT_OVERRIDE;
@@ -995,6 +1275,11 @@ private:
 
 	void deactivateAsyncStreamReceivers();
 
+public:
+
+	// per channel receive counters, returns kIOReturnNotFound if nothing listens on channel
+	IOReturn getAsyncStreamReceiverStatistics( UInt32 channel, UInt64 * packets, UInt64 * bytes, UInt32 * drops );
+
 protected:
 	IOService *findKeyswitchDevice( void );
 	void suspendBus( void );
@@ -1034,6 +1319,7 @@ public:
 	
 private:
 	AsyncPendingTrans * allocTrans( IOFWAsyncCommand * cmd, IOFWCommand * altcmd );
+	AsyncPendingTrans * findTrans( UInt16 sourceID, UInt32 tLabel );
 
 public:
 
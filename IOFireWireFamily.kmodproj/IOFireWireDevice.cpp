@@ -572,6 +572,10 @@ void IOFireWireDevice::free()
     
 	if( fDeviceROM )
 	{
+		// keep whatever the drivers read since the last scan for when we come back
+		saveROMImage( fDeviceROM );
+		
+
 		fDeviceROM->setROMState( IOFireWireROMCache::kROMStateInvalid );
         fDeviceROM->release();
 		fDeviceROM = NULL;
@@ -783,10 +787,26 @@ void IOFireWireDevice::setNodeROM(UInt32 gen, UInt16 localID, const IOFWNodeScan
     }
     
 	//
-	// create new ROM cache
+	// create new ROM cache, starting from the controller's copy of our 
+	// ROM if we've been seen before with this bus info block
 	//
 	
-	rom = IOFireWireROMCache::withOwnerAndBytes( this, info->fBuf, newROMSize, fGeneration );
+	OSData * image = NULL;
+	if( newROMSize == 20 )
+	{
+		image = fControl->copyCachedROMImage( info->fBuf, newROMSize );
+	}
+	
+	if( image != NULL )
+	{
+		FWKLOG(( "IOFireWireDevice@%p::setNodeROM using cached ROM image of %d bytes\n", this, image->getLength() ));
+		rom = IOFireWireROMCache::withOwnerAndBytes( this, image->getBytesNoCopy(), image->getLength(), fGeneration );
+		image->release();
+	}
+	else
+	{
+		rom = IOFireWireROMCache::withOwnerAndBytes( this, info->fBuf, newROMSize, fGeneration );
+	}
     setProperty( gFireWireROM, rom );
 
 	// release and invalidate the old one if necessary
@@ -1004,6 +1024,9 @@ void IOFireWireDevice::processROM( RomScan *romScan )
 		messageClients( kIOMessageServiceIsResumed );	// Safe to continue
 		
 		fControl->openGate();
+		
+		// remember the directories we just read for the next time this ROM shows up
+		saveROMImage( rom );
 	}
 
 	// if we've got a non-bus reset error reading the rom
@@ -1065,6 +1088,34 @@ void IOFireWireDevice::processROM( RomScan *romScan )
 	FWKLOG(( "IOFireWireDevice@%p::processROM generation %ld exited\n", this, generation ));
 }
 
+// saveROMImage
+//
+// not called with the gate closed, the gate is taken after the ROM lock elsewhere
+
+void IOFireWireDevice::saveROMImage( IOFireWireROMCache * rom )
+{
+	OSData * image = NULL;
+	
+	if( fControl == NULL || rom == NULL )
+		return;
+	
+	rom->lock();
+	
+	// a suspended ROM is still the last one we saw, an invalid one may be half read
+	if( rom->getROMState() != IOFireWireROMCache::kROMStateInvalid )
+	{
+		image = OSData::withBytes( rom->getBytesNoCopy(), rom->getLength() );
+	}
+	
+	rom->unlock();
+	
+	if( image != NULL )
+	{
+		fControl->cacheROMImage( image->getBytesNoCopy(), image->getLength() );
+		image->release();
+	}
+}
+
 // preprocessDirectories
 //
 //
@@ -154,6 +154,8 @@ protected:
     
     void	processROM(RomScan *romScan);
     
+    void	saveROMImage( IOFireWireROMCache * rom );
+    
     virtual void free();
     
 public:
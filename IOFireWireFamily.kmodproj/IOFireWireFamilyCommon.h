@@ -732,6 +732,33 @@ typedef enum
 	kFWIsochRequireLastContext			= BIT(4),	// private
 } IOFWIsochPortOptions ;
 
+// buffer-fill isoch port options
+typedef enum
+{
+	kFWBufferFillDefaultOptions		= 0,
+	kFWBufferFillStripHeader		= BIT(1),	// don't store the isoch header quadlet
+	kFWBufferFillStripTimeStamp		= BIT(2)	// don't store the receive timestamp quadlet
+} IOFWBufferFillOptions ;
+
+// A buffer-fill isoch port's buffer starts with this control block, followed by a
+// power-of-two data area. Each received packet is appended to the data area as
+// [header] payload [timestamp]; the stream wraps at the end of the data area.
+// With the header kept the payload is padded to a quadlet, and the header and the
+// timestamp (in cycle time format) are host endian. Without the header payloads are
+// stored back to back. The port only writes 'writeIndex' and 'overrunCount', the
+// client only writes 'readIndex'. Both indices are free-running byte counts; the data
+// position is index & (dataSize - 1). A packet that does not fit is dropped whole.
+
+typedef struct
+{
+	volatile UInt32		writeIndex ;
+	UInt32				dataSize ;
+	volatile UInt32		overrunCount ;
+	UInt32				reserved0[13] ;			// keep producer and consumer on separate cache lines
+	volatile UInt32		readIndex ;
+	UInt32				reserved1[15] ;
+} FWBufferFillControl ;
+
 // =================================================================
 // DCL opcode defs.
 // =================================================================
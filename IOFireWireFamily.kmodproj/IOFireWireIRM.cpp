@@ -571,7 +571,16 @@ void IOFireWireIRMAllocation::handleBusReset(UInt32 generation)
 		return;
 	}
 	
-	// Spawn a thread to do the reallocation
+	IORecursiveLockUnlock(fLock);
+	
+	// The controller's reallocation pass restores us along with everyone else.
+	// Joining takes the workloop gate, so don't hold our lock across it
+	if (fControl->joinIRMRealloc(this, generation))
+		return;
+	
+	IORecursiveLockLock(fLock);
+	
+	// No pass to join, spawn a thread to do the reallocation
 	IRMAllocationThreadInfo * threadInfo = (IRMAllocationThreadInfo *)IOMalloc( sizeof(IRMAllocationThreadInfo) );
 	if( threadInfo ) 
 	{
@@ -638,48 +647,99 @@ void IOFireWireIRMAllocation::threadFunc( void * arg )
     IOFireWireIRMAllocation *pIRMAllocation = threadInfo->fIRMAllocation;
 	IORecursiveLock * fLock = threadInfo->fLock;
 	UInt32 generation = threadInfo->fGeneration;
-	UInt32 irmGeneration;
-	UInt16 irmNodeID;
 	
 	// Take the lock
 	IORecursiveLockLock(fLock);
 
+	res = pIRMAllocation->reallocInGeneration(generation, threadInfo->fIsochChannel, threadInfo->fBandwidthUnits);
+	
+	// Unlock the lock
+	IORecursiveLockUnlock(fLock);
+	
+	// clean up thread info
+	IOFree( threadInfo, sizeof(IRMAllocationThreadInfo) );
+    pIRMAllocation->release();		// retain occurred in handleBusReset
+    pIRMAllocation=NULL;
+	
+	FWTrace( kFWTIsoch, kTPIsochIRMThreadFunc, (uintptr_t)(threadInfo->fControl->getLink()), threadInfo->fIsochChannel, threadInfo->fBandwidthUnits, res );
+}
+
+// IOFireWireIRMAllocation::reallocInGeneration
+//
+// called with the lock held
+IOReturn IOFireWireIRMAllocation::reallocInGeneration(UInt32 generation, UInt8 isochChannel, UInt32 bandwidthUnits)
+{
+	IOReturn res = kIOReturnSuccess;
+	UInt32 irmGeneration;
+	UInt16 irmNodeID;
+
 	// Get the current generation
-	threadInfo->fControl->getIRMNodeID(irmGeneration, irmNodeID);
+	fControl->getIRMNodeID(irmGeneration, irmNodeID);
 	
-	if ((irmGeneration == generation) && (pIRMAllocation->getAllocationGeneration() != 0xFFFFFFFF))
+	if ((irmGeneration == generation) && (getAllocationGeneration() != 0xFFFFFFFF))
 	{
-		if (threadInfo->fIsochChannel < 64)
+		if (isochChannel < 64)
 		{
 			// Attempt to reallocate isoch channel
-			res = threadInfo->fControl->allocateIRMChannelInGeneration(threadInfo->fIsochChannel,generation);
+			res = fControl->allocateIRMChannelInGeneration(isochChannel,generation);
 		}
 		
-		if ((res == kIOReturnSuccess) && (threadInfo->fBandwidthUnits > 0))
+		if ((res == kIOReturnSuccess) && (bandwidthUnits > 0))
 		{
 			// Attempt to reallocate isoch bandwidth
-			res = threadInfo->fControl->allocateIRMBandwidthInGeneration(threadInfo->fBandwidthUnits,generation);
+			res = fControl->allocateIRMBandwidthInGeneration(bandwidthUnits,generation);
 			if (res != kIOReturnSuccess) 
 			{
 				// Need to free the isoch channel (note: will fail if generation has changed)
-				threadInfo->fControl->releaseIRMChannelInGeneration(threadInfo->fIsochChannel,generation);
+				fControl->releaseIRMChannelInGeneration(isochChannel,generation);
 			}
 		}
 
 		if ((res != kIOReturnSuccess) && (res != kIOFireWireBusReset))
 		{
 			// We failed to reallocate (and not due to a bus-reset).
-			pIRMAllocation->failedToRealloc();
+			failedToRealloc();
 		}
 	}
 	
+	return res;
+}
+
+// IOFireWireIRMAllocation::beginRealloc
+//
+//
+bool IOFireWireIRMAllocation::beginRealloc(UInt32 generation, UInt8 *pIsochChannel, UInt32 *pBandwidthUnits)
+{
+	// Take the lock, held until endRealloc
+	IORecursiveLockLock(fLock);
+
+	if (!isAllocated || (fAllocationGeneration == generation))
+	{
+		IORecursiveLockUnlock(fLock);
+		return false;
+	}
+	
+	*pIsochChannel = fIsochChannel;
+	*pBandwidthUnits = fBandwidthUnits;
+	
+	return true;
+}
+
+// IOFireWireIRMAllocation::endRealloc
+//
+//
+void IOFireWireIRMAllocation::endRealloc(UInt32 generation, bool reallocated)
+{
+	IOReturn res = kIOReturnSuccess;
+	
+	if (!reallocated)
+	{
+		// Restore our resources on our own
+		res = reallocInGeneration(generation, fIsochChannel, fBandwidthUnits);
+	}
+	
 	// Unlock the lock
 	IORecursiveLockUnlock(fLock);
 	
-	// clean up thread info
-	IOFree( threadInfo, sizeof(IRMAllocationThreadInfo) );
-    pIRMAllocation->release();		// retain occurred in handleBusReset
-    pIRMAllocation=NULL;
-	
-	FWTrace( kFWTIsoch, kTPIsochIRMThreadFunc, (uintptr_t)(threadInfo->fControl->getLink()), threadInfo->fIsochChannel, threadInfo->fBandwidthUnits, res );
+	FWTrace( kFWTIsoch, kTPIsochIRMThreadFunc, (uintptr_t)(fControl->getLink()), fIsochChannel, fBandwidthUnits, res );
 }
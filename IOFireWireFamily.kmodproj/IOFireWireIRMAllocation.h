@@ -85,12 +85,20 @@ protected:
 		virtual void free( void );
 
 		// Controller will call this to notify about bus-reset complete.
+		// Joins the controller's reallocation pass, or reallocates on its own thread.
 		virtual void handleBusReset(UInt32 generation);
 	
 		virtual void failedToRealloc(void);
 		virtual UInt32 getAllocationGeneration(void);
 		static void threadFunc( void * arg );
 
+		// Controller's reallocation pass after bus-reset. beginRealloc returns the
+		// resources to restore with the lock held, endRealloc releases it, first
+		// reallocating on our own if the pass could not restore them.
+		bool beginRealloc(UInt32 generation, UInt8 *pIsochChannel, UInt32 *pBandwidthUnits);
+		void endRealloc(UInt32 generation, bool reallocated);
+		IOReturn reallocInGeneration(UInt32 generation, UInt8 isochChannel, UInt32 bandwidthUnits);
+
 private:
 	
 	AllocationLostNotificationProc fAllocationLostProc;
@@ -523,9 +523,21 @@ IOReturn IOFireWireROMCache::updateROMCache( UInt32 offset, UInt32 length )
 			buff = (UInt32 *)IOMalloc(bufLen);
 			cmd = fOwner->createReadQuadCommand( FWAddress(kCSRRegisterSpaceBaseAddressHi, kFWBIBHeaderAddress+romLength),
 												buff, bufLen/sizeof(UInt32), NULL, NULL, true );
-			cmd->setMaxSpeed( kFWSpeed100MBit );
+			
+			// try block reads at the speed found during the bus scan first, 
+			// a ROM that can't handle that gets one more try at s100
 			cmd->setGeneration( generation );
 			status = cmd->submit();
+			if( status != kIOReturnSuccess && status != kIOFireWireBusReset )
+			{
+				FWKLOG(( "%p: err 0x%x reading ROM, retrying at s100\n", this, status ));
+				
+				cmd->reinit( FWAddress(kCSRRegisterSpaceBaseAddressHi, kFWBIBHeaderAddress+romLength),
+							 buff, bufLen/sizeof(UInt32), NULL, NULL, true );
+				cmd->setMaxSpeed( kFWSpeed100MBit );
+				cmd->setGeneration( generation );
+				status = cmd->submit();
+			}
 			cmd->release();
 			
 			// 
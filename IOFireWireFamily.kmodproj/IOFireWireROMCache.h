@@ -167,6 +167,9 @@ public:
 	virtual IOReturn checkROMState( UInt32 &generation );
 	virtual IOReturn checkROMState( void );
 	
+	// current state without waiting for a suspended ROM to resume
+	inline ROMState getROMState( void ) const { return fState; }
+	
 	virtual bool serialize( OSSerialize * s ) const APPLE_KEXT_OVERRIDE;
 	
 private:
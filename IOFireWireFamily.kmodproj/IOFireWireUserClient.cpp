@@ -335,20 +335,41 @@ IOFWUserDebugInfo::serialize (
 {
 	s->clearText() ;
 	
-	const unsigned objectCount = 1 ;
-	const OSObject * objects[ objectCount ] = 
-	{ 
-		fUserClient->fExporter
-//		, fIsochCallbacks
-	} ;
-	
-	const OSSymbol * keys[ objectCount ] = 
-	{ 
-		OSSymbol::withCStringNoCopy("user objects")
-//		, OSSymbol::withCStringNoCopy( "total isoch callbacks" )
-	} ;
-	
-	OSDictionary * dict = OSDictionary::withObjects( objects, keys, objectCount ) ;
+	UInt32 fastCalls ;
+	UInt32 slowCalls ;
+	fUserClient->getFastPathStatistics( & fastCalls, & slowCalls ) ;
+	
+	OSNumber * fastCallCount = OSNumber::withNumber( fastCalls, 32 ) ;
+	OSNumber * slowCallCount = OSNumber::withNumber( slowCalls, 32 ) ;
+	
+	OSDictionary * dict = NULL ;
+	if ( fastCallCount && slowCallCount )
+	{
+		const unsigned objectCount = 3 ;
+		const OSObject * objects[ objectCount ] = 
+		{ 
+			fUserClient->fExporter
+			, fastCallCount
+			, slowCallCount
+//			, fIsochCallbacks
+		} ;
+		
+		const OSSymbol * keys[ objectCount ] = 
+		{ 
+			OSSymbol::withCStringNoCopy("user objects")
+			, OSSymbol::withCStringNoCopy( "fast path calls" )
+			, OSSymbol::withCStringNoCopy( "slow path calls" )
+//			, OSSymbol::withCStringNoCopy( "total isoch callbacks" )
+		} ;
+		
+		dict = OSDictionary::withObjects( objects, keys, objectCount ) ;
+	}
+	
+	if ( fastCallCount )
+		fastCallCount->release() ;
+	if ( slowCallCount )
+		slowCallCount->release() ;
+	
 	if ( !dict )
 		return false ;
 		
@@ -456,6 +477,35 @@ IOFireWireUserClient::start( IOService * provider )
             result = false ;
     }
     
+    if( result )
+    {
+        fFastPathLock = IOLockAlloc ();
+        if( !fFastPathLock )
+        {
+            result = false;
+        }
+    }
+    
+    if( result )
+    {
+		// wired kernel buffer for small synchronous reads and writes
+        fBounceBuffer = IOBufferMemoryDescriptor::withCapacity( kFastBounceBufferSize, kIODirectionOutIn );
+        if( !fBounceBuffer )
+        {
+            result = false;
+        }
+    }
+    
+    if( result )
+    {
+        if( fBounceBuffer->prepare() != kIOReturnSuccess )
+        {
+            fBounceBuffer->release();
+            fBounceBuffer = NULL;
+            result = false;
+        }
+    }
+    
 #if IOFIREWIREUSERCLIENTDEBUG > 0
 	if (result)
 	{
@@ -517,6 +567,28 @@ IOFireWireUserClient::free()
 		fExporter = NULL ;
 	}
 	
+	for( unsigned index = 0; index < kFastCommandCount; ++index )
+	{
+		if ( fFastCommands[ index ] )
+		{
+			fFastCommands[ index ]->release() ;
+			fFastCommands[ index ] = NULL ;
+		}
+	}
+	
+	if ( fBounceBuffer )
+	{
+		fBounceBuffer->complete() ;
+		fBounceBuffer->release() ;
+		fBounceBuffer = NULL ;
+	}
+	
+    if( fFastPathLock )
+    {
+        IOLockFree( fFastPathLock );
+        fFastPathLock = NULL;
+    }
+    
     if( fController )
     {
         fController->release();
@@ -633,10 +705,10 @@ static UInt32 getSelectorObjectLookupIndex(UInt32 selector)
 		// The follwing selectors all are handled by object exporter managed objects
 		/////////////////////////////////////////////////////////////////////////////////
 		case kPhysicalAddrSpace_GetSegmentCount_d:			// Handled by a IOFWUserPhysicalAddressSpace object
-		case kIsochPort_AllocatePort_d:						// Handled by a IOFWUserLocalIsochPort object
-		case kIsochPort_ReleasePort_d:						// Handled by a IOFWUserLocalIsochPort object
-		case kIsochPort_Start_d:							// Handled by a IOFWUserLocalIsochPort object
-		case kIsochPort_Stop_d:								// Handled by a IOFWUserLocalIsochPort object
+		case kIsochPort_AllocatePort_d:						// Handled by a IOFWIsochPort object
+		case kIsochPort_ReleasePort_d:						// Handled by a IOFWIsochPort object
+		case kIsochPort_Start_d:							// Handled by a IOFWIsochPort object
+		case kIsochPort_Stop_d:								// Handled by a IOFWIsochPort object
 		case kLocalIsochPort_ModifyJumpDCL_d:				// Handled by a IOFWUserLocalIsochPort object
 		case kLocalIsochPort_Notify_d:						// Handled by a IOFWUserLocalIsochPort object
 		case kIsochChannel_UserReleaseChannelComplete_d:	// Handled by a IOFWUserIsochChannel object
@@ -649,6 +721,9 @@ static UInt32 getSelectorObjectLookupIndex(UInt32 selector)
 		case kPHYPacketListenerActivate:					// Handled by a IOFWUserPHYPacketListener object
 		case kPHYPacketListenerDeactivate:					// Handled by a IOFWUserPHYPacketListener object
 		case kPHYPacketListenerClientCommandIsComplete:		// Handled by a IOFWUserPHYPacketListener object
+		case kBufferFillIsochPort_SetNotificationCallback_d:	// Handled by a IOFWUserBufferFillIsochPort object
+		case kLocalIsochPort_SetModifyRing_d:				// Handled by a IOFWUserLocalIsochPort object
+		case kLocalIsochPort_ApplyModifyRing_d:				// Handled by a IOFWUserLocalIsochPort object
 			selectorObjectLookupIndex = 0;  // Note: A 0 here specifies a lookup into the object exporter!
 			break;
 
@@ -1095,6 +1170,21 @@ IOFireWireUserClient::externalMethod( uint32_t selector,
             break;
         }
             
+		case kPseudoAddrSpace_ClientBatchIsComplete:
+        {
+            IOFireWireUserClient * fw_uc = OSDynamicCast( IOFireWireUserClient, targetObject );
+            if( fw_uc )
+            {
+                result = fw_uc->addressSpace_ClientBatchIsComplete((UserObjectHandle)arguments->scalarInput[0],
+															(UInt32)arguments->scalarInput[1]);
+            }
+            else
+            {
+                result = kIOReturnBadArgument;
+            }
+            break;
+        }
+            
 		case kPhysicalAddrSpace_Allocate:
         {
             IOFireWireUserClient * fw_uc = OSDynamicCast( IOFireWireUserClient, targetObject );
@@ -1527,7 +1617,7 @@ IOFireWireUserClient::externalMethod( uint32_t selector,
 		
 		case kIsochPort_AllocatePort_d:
         {
-            IOFWUserLocalIsochPort * fw_isoch_port = OSDynamicCast( IOFWUserLocalIsochPort, targetObject );
+            IOFWIsochPort * fw_isoch_port = OSDynamicCast( IOFWIsochPort, targetObject );
             if( fw_isoch_port )
             {
                 result = fw_isoch_port->allocatePort((IOFWSpeed)arguments->scalarInput[0],
@@ -1542,7 +1632,7 @@ IOFireWireUserClient::externalMethod( uint32_t selector,
 		
 		case kIsochPort_ReleasePort_d:
         {
-            IOFWUserLocalIsochPort * fw_isoch_port = OSDynamicCast( IOFWUserLocalIsochPort, targetObject );
+            IOFWIsochPort * fw_isoch_port = OSDynamicCast( IOFWIsochPort, targetObject );
             if( fw_isoch_port )
             {
                 result = fw_isoch_port->releasePort();
@@ -1556,7 +1646,7 @@ IOFireWireUserClient::externalMethod( uint32_t selector,
 		
 		case kIsochPort_Start_d:
         {
-            IOFWUserLocalIsochPort * fw_isoch_port = OSDynamicCast( IOFWUserLocalIsochPort, targetObject );
+            IOFWIsochPort * fw_isoch_port = OSDynamicCast( IOFWIsochPort, targetObject );
             if( fw_isoch_port )
             {
                 result = fw_isoch_port->start();
@@ -1570,7 +1660,7 @@ IOFireWireUserClient::externalMethod( uint32_t selector,
 		
 		case kIsochPort_Stop_d:
         {
-            IOFWUserLocalIsochPort * fw_isoch_port = OSDynamicCast( IOFWUserLocalIsochPort, targetObject );
+            IOFWIsochPort * fw_isoch_port = OSDynamicCast( IOFWIsochPort, targetObject );
             if( fw_isoch_port )
             {
                 result = fw_isoch_port->stop();
@@ -1667,6 +1757,40 @@ IOFireWireUserClient::externalMethod( uint32_t selector,
                         result = kIOReturnVMError;
                     }
                 }
+                else if ( arguments->structureInputDescriptor )
+                {
+                    // large index lists arrive out-of-line
+                    IOMemoryDescriptor * indexDesc = arguments->structureInputDescriptor ;
+                    IOByteCount indexSize = indexDesc->getLength() ;
+                    UInt8 * indexBuffer = new UInt8[ indexSize ] ;
+
+                    if ( !indexBuffer )
+                    {
+                        result = kIOReturnNoMemory ;
+                    }
+                    else
+                    {
+                        result = indexDesc->prepare() ;
+                        if ( !result )
+                        {
+                            if ( indexDesc->readBytes( 0, indexBuffer, indexSize ) < indexSize )
+                            {
+                                result = kIOReturnVMError ;
+                            }
+                            indexDesc->complete() ;
+                        }
+
+                        if ( !result )
+                        {
+                            result = fw_isoch_port->userNotify((UInt32)arguments->scalarInput[0],
+                                                            (UInt32)arguments->scalarInput[1],
+                                                            (void *) indexBuffer,
+                                                            indexSize);
+                        }
+
+                        delete [] indexBuffer ;
+                    }
+                }
                 else
                 {	result = fw_isoch_port->userNotify((UInt32)arguments->scalarInput[0],
                                                 (UInt32)arguments->scalarInput[1],
@@ -1681,6 +1805,35 @@ IOFireWireUserClient::externalMethod( uint32_t selector,
             break;
         }
 		
+		case kLocalIsochPort_SetModifyRing_d:
+        {
+            IOFWUserLocalIsochPort * fw_isoch_port = OSDynamicCast( IOFWUserLocalIsochPort, targetObject );
+            if( fw_isoch_port )
+            {
+                result = fw_isoch_port->setModifyRing((mach_vm_address_t)arguments->scalarInput[0],
+                                                      (mach_vm_size_t)arguments->scalarInput[1]);
+            }
+            else
+            {
+                result = kIOReturnBadArgument;
+            }
+            break;
+        }
+
+		case kLocalIsochPort_ApplyModifyRing_d:
+        {
+            IOFWUserLocalIsochPort * fw_isoch_port = OSDynamicCast( IOFWUserLocalIsochPort, targetObject );
+            if( fw_isoch_port )
+            {
+                result = fw_isoch_port->applyModifyRing();
+            }
+            else
+            {
+                result = kIOReturnBadArgument;
+            }
+            break;
+        }
+
 		case kLocalIsochPort_SetChannel:
         {
             IOFireWireUserClient * fw_uc = OSDynamicCast( IOFireWireUserClient, targetObject );
@@ -2545,6 +2698,42 @@ IOFireWireUserClient::externalMethod( uint32_t selector,
             break;
         }
 			
+		case kBufferFillIsochPort_Create:
+        {
+            IOFireWireUserClient * fw_uc = OSDynamicCast( IOFireWireUserClient, targetObject );
+            if( fw_uc )
+            {
+				UserObjectHandle kernel_ref = 0;
+				result = fw_uc->createBufferFillIsochPort( (mach_vm_address_t)arguments->scalarInput[0],
+															(mach_vm_size_t)arguments->scalarInput[1],
+															(UInt32)arguments->scalarInput[2],
+															(UInt32)arguments->scalarInput[3],
+															&kernel_ref );
+				arguments->scalarOutput[0] = (uint64_t)kernel_ref;
+            }
+            else
+            {
+                result = kIOReturnBadArgument;
+            }
+            break;
+        }
+
+		case kBufferFillIsochPort_SetNotificationCallback_d:
+        {
+            IOFWUserBufferFillIsochPort * fill_port = OSDynamicCast( IOFWUserBufferFillIsochPort, targetObject );
+            if( fill_port )
+            {
+                result = fill_port->setNotificationCallback(	arguments->asyncReference,
+                                                            (mach_vm_address_t)arguments->scalarInput[0],
+                                                            (io_user_reference_t)arguments->scalarInput[1] );
+            }
+            else
+            {
+                result = kIOReturnBadArgument;
+            }
+            break;
+        }
+			
 		default:
 			// NONE OF THE ABOVE :(
 			break;
@@ -2772,18 +2961,58 @@ IOReturn
 IOFireWireUserClient::readQuad ( const ReadQuadParams* params, UInt32* outVal )
 {
 	IOReturn 				err ;
-	IOFWReadQuadCommand*	cmd ;
+	IOFWReadQuadCommand*	cmd = NULL ;
+	unsigned				slot = params->isAbs ? kFastReadQuadAbs : kFastReadQuad ;
+	bool					fast = IOLockTryLock( fFastPathLock ) ;
 
-	if ( params->isAbs )
-		cmd = this->createReadQuadCommand( params->generation, params->addr, outVal, 1, NULL, NULL ) ;
-	else
+	// reuse the cached command unless another thread has the fast path
+	if ( fast && fFastCommands[ slot ] )
 	{
-		if ( (cmd = getOwner ()->createReadQuadCommand( params->addr, outVal, 1, NULL, NULL, params->failOnReset )) )
-			cmd->setGeneration( params->generation ) ;
+		cmd = (IOFWReadQuadCommand*)fFastCommands[ slot ] ;
+		
+		if ( params->isAbs )
+			err = cmd->reinit( params->generation, params->addr, outVal, 1, NULL, NULL ) ;
+		else
+		{
+			if ( !(err = cmd->reinit( params->addr, outVal, 1, NULL, NULL, params->failOnReset )) )
+				cmd->setGeneration( params->generation ) ;
+		}
+		
+		if ( err )
+		{
+			// drop the stale command, a fresh one takes its slot below
+			cmd->release() ;
+			cmd = NULL ;
+			fFastCommands[ slot ] = NULL ;
+		}
+		else
+			cmd->retain() ;
+	}
+	
+	if ( !cmd )
+	{
+		if ( params->isAbs )
+			cmd = this->createReadQuadCommand( params->generation, params->addr, outVal, 1, NULL, NULL ) ;
+		else
+		{
+			if ( (cmd = getOwner ()->createReadQuadCommand( params->addr, outVal, 1, NULL, NULL, params->failOnReset )) )
+				cmd->setGeneration( params->generation ) ;
+		}
+		
+		if ( cmd && fast && !fFastCommands[ slot ] )
+		{
+			cmd->retain() ;
+			fFastCommands[ slot ] = cmd ;
+		}
 	}
 			
 	if(!cmd)
+	{
+		if ( fast )
+			IOLockUnlock( fFastPathLock ) ;
+		
 		return kIOReturnNoMemory;
+	}
 
 	err = cmd->submit();        // We block here until the command finishes
 
@@ -2792,6 +3021,14 @@ IOFireWireUserClient::readQuad ( const ReadQuadParams* params, UInt32* outVal )
 
 	cmd->release();
 
+	if ( fast )
+	{
+		++fFastPathCalls ;
+		IOLockUnlock( fFastPathLock ) ;
+	}
+	else
+		++fSlowPathCalls ;
+	
 	return err;
 }
 
@@ -2804,6 +3041,17 @@ IOFireWireUserClient::read ( const ReadParams* params, IOByteCount* outBytesTran
 
 	*outBytesTransferred = 0 ;
 
+	// small reads from the owning task go through the bounce buffer
+	if ( params->size <= kFastBounceBufferSize && current_task() == fTask && IOLockTryLock( fFastPathLock ) )
+	{
+		err = fastRead( params, outBytesTransferred ) ;
+		IOLockUnlock( fFastPathLock ) ;
+		
+		return err ;
+	}
+	
+	++fSlowPathCalls ;
+	
 	mem = IOMemoryDescriptor::withAddressRange(params->buf, params->size, kIODirectionIn, fTask);
 	if(!mem)
 	{
@@ -2859,18 +3107,58 @@ IOReturn
 IOFireWireUserClient::writeQuad( const WriteQuadParams* params)
 {
 	IOReturn 				err;
-	IOFWWriteQuadCommand*	cmd ;
+	IOFWWriteQuadCommand*	cmd = NULL ;
+	unsigned				slot = params->isAbs ? kFastWriteQuadAbs : kFastWriteQuad ;
+	bool					fast = IOLockTryLock( fFastPathLock ) ;
 
-	if ( params->isAbs )
-		cmd = this->createWriteQuadCommand( params->generation, params->addr, (UInt32*) & params->val, 1, NULL, NULL ) ;
-	else
+	// reuse the cached command unless another thread has the fast path
+	if ( fast && fFastCommands[ slot ] )
 	{
-		cmd = getOwner ()->createWriteQuadCommand( params->addr, (UInt32*)&params->val, 1, NULL, NULL, params->failOnReset ) ;
-		cmd->setGeneration( params->generation ) ;
+		cmd = (IOFWWriteQuadCommand*)fFastCommands[ slot ] ;
+		
+		if ( params->isAbs )
+			err = cmd->reinit( params->generation, params->addr, (UInt32*) & params->val, 1, NULL, NULL ) ;
+		else
+		{
+			if ( !(err = cmd->reinit( params->addr, (UInt32*) & params->val, 1, NULL, NULL, params->failOnReset )) )
+				cmd->setGeneration( params->generation ) ;
+		}
+		
+		if ( err )
+		{
+			// drop the stale command, a fresh one takes its slot below
+			cmd->release() ;
+			cmd = NULL ;
+			fFastCommands[ slot ] = NULL ;
+		}
+		else
+			cmd->retain() ;
+	}
+	
+	if ( !cmd )
+	{
+		if ( params->isAbs )
+			cmd = this->createWriteQuadCommand( params->generation, params->addr, (UInt32*) & params->val, 1, NULL, NULL ) ;
+		else
+		{
+			if ( (cmd = getOwner ()->createWriteQuadCommand( params->addr, (UInt32*)&params->val, 1, NULL, NULL, params->failOnReset )) )
+				cmd->setGeneration( params->generation ) ;
+		}
+		
+		if ( cmd && fast && !fFastCommands[ slot ] )
+		{
+			cmd->retain() ;
+			fFastCommands[ slot ] = cmd ;
+		}
 	}
 	
 	if(!cmd)
+	{
+		if ( fast )
+			IOLockUnlock( fFastPathLock ) ;
+		
 		return kIOReturnNoMemory;
+	}
 
 
 	err = cmd->submit();	// We block here until the command finishes
@@ -2880,6 +3168,14 @@ IOFireWireUserClient::writeQuad( const WriteQuadParams* params)
 	
 	cmd->release();
 
+	if ( fast )
+	{
+		++fFastPathCalls ;
+		IOLockUnlock( fFastPathLock ) ;
+	}
+	else
+		++fSlowPathCalls ;
+	
 	return err;
 }
 
@@ -2891,6 +3187,17 @@ IOFireWireUserClient::write( const WriteParams* params, IOByteCount* outBytesTra
 
 	*outBytesTransferred = 0 ;
 
+	// small writes from the owning task go through the bounce buffer
+	if ( params->size <= kFastBounceBufferSize && current_task() == fTask && IOLockTryLock( fFastPathLock ) )
+	{
+		IOReturn error = fastWrite( params, outBytesTransferred ) ;
+		IOLockUnlock( fFastPathLock ) ;
+		
+		return error ;
+	}
+	
+	++fSlowPathCalls ;
+	
 	mem = IOMemoryDescriptor::withAddressRange(params->buf, params->size, kIODirectionOut, fTask);
 	if(!mem)
 	{
@@ -2941,24 +3248,186 @@ IOFireWireUserClient::write( const WriteParams* params, IOByteCount* outBytesTra
 	return error ;
 }
 
+// fastRead
+//
+// read into the wired bounce buffer with a cached command and copy out,
+// no descriptor over the user buffer. called with fFastPathLock held
+
+IOReturn
+IOFireWireUserClient::fastRead ( const ReadParams* params, IOByteCount* outBytesTransferred )
+{
+	IOReturn			err = kIOReturnSuccess ;
+	unsigned			slot = params->isAbs ? kFastReadAbs : kFastRead ;
+	IOFWReadCommand*	cmd = (IOFWReadCommand*)fFastCommands[ slot ] ;
+
+	// commands take their transfer size from the descriptor
+	fBounceBuffer->setLength( params->size ) ;
+	
+	if ( cmd )
+	{
+		if ( params->isAbs )
+			err = cmd->reinit( params->generation, params->addr, fBounceBuffer, NULL, NULL ) ;
+		else
+		{
+			if ( !(err = cmd->reinit( params->addr, fBounceBuffer, NULL, NULL, params->failOnReset )) )
+				cmd->setGeneration( params->generation ) ;
+		}
+		
+		if ( err )
+		{
+			cmd->release() ;
+			cmd = NULL ;
+			fFastCommands[ slot ] = NULL ;
+		}
+	}
+	
+	if ( !cmd )
+	{
+		if ( params->isAbs )
+			cmd = this->createReadCommand( params->generation, params->addr, fBounceBuffer, NULL, NULL ) ;
+		else
+		{
+			if ( (cmd = getOwner ()->createReadCommand( params->addr, fBounceBuffer, NULL, NULL, params->failOnReset )) )
+				cmd->setGeneration( params->generation ) ;
+		}
+		
+		if ( !cmd )
+			return kIOReturnNoMemory ;
+		
+		fFastCommands[ slot ] = cmd ;
+	}
+	
+	err = cmd->submit();	// We block here until the command finishes
+	
+	if( !err )
+		err = cmd->getStatus();
+	
+	*outBytesTransferred = cmd->getBytesTransferred() ;
+	
+	if ( *outBytesTransferred )
+	{
+		if ( copyout( fBounceBuffer->getBytesNoCopy(), params->buf, *outBytesTransferred ) && !err )
+			err = kIOReturnVMError ;
+	}
+	
+	++fFastPathCalls ;
+	
+	return err ;
+}
+
+// fastWrite
+//
+// copy in to the wired bounce buffer and write it with a cached command.
+// called with fFastPathLock held
+
+IOReturn
+IOFireWireUserClient::fastWrite ( const WriteParams* params, IOByteCount* outBytesTransferred )
+{
+	IOReturn			err = kIOReturnSuccess ;
+	unsigned			slot = params->isAbs ? kFastWriteAbs : kFastWrite ;
+	IOFWWriteCommand*	cmd = (IOFWWriteCommand*)fFastCommands[ slot ] ;
+
+	if ( copyin( params->buf, fBounceBuffer->getBytesNoCopy(), params->size ) )
+		return kIOReturnVMError ;
+	
+	// commands take their transfer size from the descriptor
+	fBounceBuffer->setLength( params->size ) ;
+	
+	if ( cmd )
+	{
+		if ( params->isAbs )
+			err = cmd->reinit( params->generation, params->addr, fBounceBuffer, NULL, NULL ) ;
+		else
+		{
+			if ( !(err = cmd->reinit( params->addr, fBounceBuffer, NULL, NULL, params->failOnReset )) )
+				cmd->setGeneration( params->generation ) ;
+		}
+		
+		if ( err )
+		{
+			cmd->release() ;
+			cmd = NULL ;
+			fFastCommands[ slot ] = NULL ;
+		}
+	}
+	
+	if ( !cmd )
+	{
+		if ( params->isAbs )
+			cmd = this->createWriteCommand( params->generation, params->addr, fBounceBuffer, NULL, NULL ) ;
+		else
+		{
+			if ( (cmd = getOwner ()->createWriteCommand( params->addr, fBounceBuffer, NULL, NULL, params->failOnReset )) )
+				cmd->setGeneration( params->generation ) ;
+		}
+		
+		if ( !cmd )
+			return kIOReturnNoMemory ;
+		
+		fFastCommands[ slot ] = cmd ;
+	}
+	
+	err = cmd->submit();	// We block here until the command finishes
+	
+	if( !err )
+		err = cmd->getStatus();
+	
+	if ( !err )
+		*outBytesTransferred = cmd->getBytesTransferred() ;
+	
+	++fFastPathCalls ;
+	
+	return err ;
+}
+
 IOReturn
 IOFireWireUserClient::compareSwap( const CompareSwapParams* params, UInt32* oldVal )
 {
 	IOReturn 							err ;
 	IOFWCompareAndSwapCommand*			cmd ;
+	IOFireWireController *				control = getOwner ()->getController() ;
 	
 	if ( params->size > 2 )
 		return kIOReturnBadArgument ;
 	
+	// start from an idle command from the controller's pool when there is one
 	if ( params->isAbs )
 	{
-        cmd = this->createCompareAndSwapCommand( params->generation, params->addr, (UInt32*)& params->cmpVal, 
-				(UInt32*)& params->swapVal, params->size, NULL, NULL ) ;
+		if ( (cmd = control->allocCommand<IOFWCompareAndSwapCommand>( NULL )) )
+		{
+			if ( cmd->reinit( params->generation, params->addr, (UInt32*)& params->cmpVal, 
+					(UInt32*)& params->swapVal, params->size, NULL, NULL ) )
+			{
+				cmd->release() ;
+				cmd = NULL ;
+			}
+		}
+		
+		if ( !cmd )
+		{
+			cmd = this->createCompareAndSwapCommand( params->generation, params->addr, (UInt32*)& params->cmpVal, 
+					(UInt32*)& params->swapVal, params->size, NULL, NULL ) ;
+		}
 	}
 	else
 	{
-        if ( (cmd = getOwner ()->createCompareAndSwapCommand( params->addr, (UInt32*)& params->cmpVal, (UInt32*)& params->swapVal, 
-				params->size, NULL, NULL, params->failOnReset )) )
+		if ( (cmd = control->allocCommand<IOFWCompareAndSwapCommand>( getOwner () )) )
+		{
+			if ( cmd->reinit( params->addr, (UInt32*)& params->cmpVal, (UInt32*)& params->swapVal, 
+					params->size, NULL, NULL, params->failOnReset ) )
+			{
+				cmd->release() ;
+				cmd = NULL ;
+			}
+		}
+		
+		if ( !cmd )
+		{
+			cmd = getOwner ()->createCompareAndSwapCommand( params->addr, (UInt32*)& params->cmpVal, (UInt32*)& params->swapVal, 
+					params->size, NULL, NULL, params->failOnReset ) ;
+		}
+		
+		if ( cmd )
 		{
 			cmd->setGeneration( params->generation ) ;
 		}
@@ -2978,7 +3447,8 @@ IOFireWireUserClient::compareSwap( const CompareSwapParams* params, UInt32* oldV
 //			err = kIOReturnCannotLock;
 	}
 
-	cmd->release();
+	// hand it back for the next lock
+	control->recycleCommand( cmd );
 
 	return err ;
 }
@@ -3482,6 +3952,31 @@ IOFireWireUserClient::addressSpace_ClientCommandIsComplete (
 	return result ;
 }
 
+IOReturn
+IOFireWireUserClient::addressSpace_ClientBatchIsComplete (
+	UserObjectHandle		addressSpaceHandle,
+	UInt32					inCount)
+{
+	const OSObject * object = fExporter->lookupObject( addressSpaceHandle ) ;
+	if ( !object )
+	{
+		return kIOReturnBadArgument ;
+	}
+
+	IOFWUserPseudoAddressSpace *	me	= OSDynamicCast( IOFWUserPseudoAddressSpace, object ) ;
+	if (!me)
+	{
+		object->release() ;
+        object = NULL;
+		return kIOReturnBadArgument ;
+	}
+	
+	me->clientBatchIsComplete ( inCount ) ;
+	me->release() ;
+	
+	return kIOReturnSuccess ;
+}
+
 IOReturn
 IOFireWireUserClient::setAsyncRef_Packet (
 	OSAsyncReference64		asyncRef,
@@ -4407,7 +4902,7 @@ IOFireWireUserClient::localIsochPort_GetSupported(
 		return kIOReturnBadArgument ;
 	}
 	
-	IOFWUserLocalIsochPort * port = OSDynamicCast ( IOFWUserLocalIsochPort, object ) ;
+	IOFWIsochPort * port = OSDynamicCast ( IOFWIsochPort, object ) ;
 	if ( ! port )
 	{
 		object->release() ;
@@ -5741,3 +6236,35 @@ IOFireWireUserClient::createPHYPacketListener( UInt32 queue_count, UserObjectHan
 	
 	return status;
 }
+
+// createBufferFillIsochPort
+//
+//
+
+IOReturn
+IOFireWireUserClient::createBufferFillIsochPort( mach_vm_address_t buffer, mach_vm_size_t bufferSize, 
+	UInt32 watermark, UInt32 options, UserObjectHandle * kernel_ref )
+{
+	IOReturn status = kIOReturnSuccess;
+
+	IOFWUserBufferFillIsochPort * port = NULL;
+	if( status == kIOReturnSuccess )
+	{
+		port = IOFWUserBufferFillIsochPort::withUserClient( this, buffer, bufferSize, watermark, options );
+		if( !port )
+			status = kIOReturnNoMemory;
+	}
+	
+	if( status == kIOReturnSuccess )
+	{
+		status = fExporter->addObject( port, (IOFWUserObjectExporter::CleanupFunction)&IOFWUserBufferFillIsochPort::exporterCleanup, kernel_ref );
+	}
+	
+	if( port )
+	{
+		port->release();			// we need to release this in all cases
+		port = NULL;
+	}
+	
+	return status;
+}
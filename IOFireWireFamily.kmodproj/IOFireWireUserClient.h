@@ -149,6 +149,7 @@
 #import "IOFireWireLibPriv.h"
 #import <IOKit/IOMemoryCursor.h>
 #import <IOKit/IOUserClient.h>
+#import <IOKit/IOBufferMemoryDescriptor.h>
 #import <IOKit/firewire/IOFWCommand.h>
 
 using namespace IOFireWireLib ;
@@ -222,6 +223,31 @@ class IOFireWireUserClient : public IOUserClient
         IOFireWireController  *             fController;
     
         IOLock *                            fUserClientLock;
+	
+		// synchronous read/write fast path, one thread at a time
+		enum
+		{
+			kFastReadQuad = 0,
+			kFastReadQuadAbs,
+			kFastRead,
+			kFastReadAbs,
+			kFastWriteQuad,
+			kFastWriteQuadAbs,
+			kFastWrite,
+			kFastWriteAbs,
+			kFastCommandCount
+		} ;
+		
+		enum
+		{
+			kFastBounceBufferSize = 4096
+		} ;
+		
+		IOLock *							fFastPathLock ;
+		IOBufferMemoryDescriptor *			fBounceBuffer ;
+		IOFWAsyncCommand *					fFastCommands[ kFastCommandCount ] ;
+		UInt32								fFastPathCalls ;
+		UInt32								fSlowPathCalls ;
     
 	public:
 	
@@ -300,6 +326,10 @@ class IOFireWireUserClient : public IOUserClient
 		IOReturn		 				writeQuad ( const WriteQuadParams* inParams ) ;
 		IOReturn		 				write ( const WriteParams* inParams, IOByteCount* outBytesTransferred ) ;
 		IOReturn		 				compareSwap ( const CompareSwapParams* inParams, UInt32* oldVal) ;
+		IOReturn						fastRead ( const ReadParams* inParams, IOByteCount* outBytesTransferred ) ;
+		IOReturn						fastWrite ( const WriteParams* inParams, IOByteCount* outBytesTransferred ) ;
+		void							getFastPathStatistics ( UInt32* outFastCalls, UInt32* outSlowCalls ) const
+														{ *outFastCalls = fFastPathCalls ; *outSlowCalls = fSlowPathCalls ; }
 	
 #pragma mark -
 		// --- other -----------------
@@ -372,6 +402,9 @@ class IOFireWireUserClient : public IOUserClient
 												UserObjectHandle		inAddrSpaceRef,
 												FWClientCommandID		inCommandID,
 												IOReturn				inResult ) ;	
+		IOReturn						addressSpace_ClientBatchIsComplete (
+												UserObjectHandle		inAddrSpaceRef,
+												UInt32					inCount ) ;
 
 		IOReturn						setAsyncStreamRef_Packet (
 												OSAsyncReference64		asyncRef,
@@ -729,5 +762,8 @@ class IOFireWireUserClient : public IOUserClient
 
 		IOReturn						createPHYPacketListener( UInt32 queue_count, UserObjectHandle * kernel_ref );
 
+		IOReturn						createBufferFillIsochPort( mach_vm_address_t buffer, mach_vm_size_t bufferSize, 
+												UInt32 watermark, UInt32 options, UserObjectHandle * kernel_ref );
+
 } ;
 
@@ -58,6 +58,10 @@ IORemoteConfigDirectory::initWithOwnerOffset( IOFireWireROMCache *rom,
         return false;       
     }
 
+	// remote ROM contents never change under a directory, a new ROM
+	// generation gets new directories, so parse this one up front
+	createIndex();
+	
     return true;
 }
 
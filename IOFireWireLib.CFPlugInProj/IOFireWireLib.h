@@ -240,6 +240,15 @@ IODestroyPlugInInterface(). Do not call Release() on it.
 // device/unit/nub interfaces (newest first)
 // ============================================================
 
+//
+// version 10
+//
+// kIOFireWireDeviceInterface_v10
+//		uuid: 9B6A811B-9D36-4827-80F3-ADD458726FF1
+#define kIOFireWireDeviceInterfaceID_v10	CFUUIDGetConstantUUIDWithBytes( kCFAllocatorDefault,\
+											0x9B, 0x6A, 0x81, 0x1B, 0x9D, 0x36, 0x48, 0x27, \
+											0x80, 0xF3, 0xAD, 0xD4, 0x58, 0x72, 0x6F, 0xF1 )
+
 //
 // version 9  // 10.5 Leopard
 //
@@ -573,6 +582,7 @@ typedef struct 	IOFireWireDCLCommandPoolInterface_t**		IOFireWireLibDCLCommandPo
 typedef struct	IOFireWireNuDCLPoolInterface_t**			IOFireWireLibNuDCLPoolRef ;
 typedef struct  IOFWAsyncStreamListenerInterface_t**		IOFWAsyncStreamListenerInterfaceRef;
 typedef struct  IOFireWireLibPHYPacketListenerInterface_t**	IOFireWireLibPHYPacketListenerRef;
+typedef struct	IOFireWireBufferFillIsochPortInterface_t**	IOFireWireLibBufferFillIsochPortRef ;
 
 #pragma mark -
 #pragma mark CALLBACK TYPES
@@ -1222,6 +1232,9 @@ typedef struct IOFireWireDeviceInterface_t
 					using the contents of the backing store. The user process will not be notified of reads.</li>
 				<li>kFWAddressSpaceAutoCopyOnWrite -- Writes to this address space will be made directly
 					to the backing store at the same time the user process is notified of a write.</li>
+				<li>kFWAddressSpaceBatchNotify -- Incoming packets are described by headers placed in the queue
+					buffer and several packets are delivered to the user process per notification. The whole
+					batch is acknowledged to the kernel once every packet in it has been completed.</li>
 			</ul>
 		@param iid An ID number, of type CFUUIDBytes (see CFUUID.h), identifying the
 			type of interface to be returned for the created pseudo address space object.
@@ -1453,6 +1466,9 @@ typedef struct IOFireWireDeviceInterface_t
 				<li>kFWAddressSpaceExclusive -- Ensures that the allocation of this address space will fail if any portion
 					of this address range is already allocated. If the allocation is successful this flag ensures that any 
 					future allocations overlapping this range will fail even if allocted with kFWAddressSpaceShareIfExists.</li>
+				<li>kFWAddressSpaceBatchNotify -- Incoming packets are described by headers placed in the queue
+					buffer and several packets are delivered to the user process per notification. The whole
+					batch is acknowledged to the kernel once every packet in it has been completed.</li>
 			</ul>
 		@param iid An ID number, of type CFUUIDBytes (see CFUUID.h), identifying the
 			type of interface to be returned for the created pseudo address space object.
@@ -1937,6 +1953,32 @@ typedef struct IOFireWireDeviceInterface_t
 			@param outUpTime A pointer to a UInt64 to hold the result
 			@result An IOReturn error code.	*/	
 		IOReturn (*GetCycleTimeAndUpTime)( IOFireWireLibDeviceRef  self, UInt32*  outCycleTime, UInt64*  outUpTime) ;
+
+	//
+	// v10
+	//
+	
+		/*!	@function CreateBufferFillIsochPort
+			@abstract Creates a local isochronous listener that streams received packets into one large buffer.
+			@discussion The port needs no DCL program. Add it to an isoch channel as a listener; while the
+				channel runs, each packet received on it is appended to the port's buffer and the notification
+				handler is called about every 'watermark' bytes, on the isoch runloop. 
+				See IOFireWireBufferFillIsochPortInterface.
+				Availability: IOFireWireDeviceInterface_v10 and newer
+			@param self			The device interface to use.
+			@param bufferSize	Size of the buffer to allocate. The usable data area is the largest power of 
+								two that fits, after a small control block.
+			@param watermark	Number of bytes after which the notification handler is called, 0 for a quarter 
+								of the data area.
+			@param options		IOFWBufferFillOptions, e.g. kFWBufferFillStripHeader.
+			@param iid			An ID number, of type CFUUIDBytes (see CFUUID.h), identifying the
+								type of interface to be returned for the created port.
+			@result An IOFireWireLibBufferFillIsochPortRef. Returns 0 upon failure */
+		IOFireWireLibBufferFillIsochPortRef	(*CreateBufferFillIsochPort)(	IOFireWireLibDeviceRef	self,
+																			UInt32					bufferSize,
+																			UInt32					watermark,
+																			UInt32					options,
+																			REFIID					iid ) ;
 					
 } IOFireWireDeviceInterface, IOFireWireUnitInterface, IOFireWireNubInterface ;
 #endif // ifdef KERNEL
@@ -1958,7 +2000,8 @@ typedef enum
 	kFWAddressSpaceAutoReadReply	= (1 << 3) ,
 	kFWAddressSpaceAutoCopyOnWrite	= (1 << 4) ,
 	kFWAddressSpaceShareIfExists	= (1 << 5) ,
-	kFWAddressSpaceExclusive		= (1 << 6)
+	kFWAddressSpaceExclusive		= (1 << 6) ,
+	kFWAddressSpaceBatchNotify		= (1 << 7)
 } FWAddressSpaceFlags ;
 
 #ifndef KERNEL
@@ -8,5 +8,287 @@
  *	$ Log:IOFireWireLibBufferFillIsochPort.cpp,v $
  */
 
-// Deprecated
+#import "IOFireWireLibBufferFillIsochPort.h"
+#import "IOFireWireLibDevice.h"
 
+#import <IOKit/iokitmig.h>
+#import <mach/mach.h>
+#import <libkern/OSAtomic.h>
+
+namespace IOFireWireLib {
+
+	BufferFillIsochPort::Interface	BufferFillIsochPort::sInterface =
+	{
+		INTERFACEIMP_INTERFACE
+		,1,0
+
+		,& IsochPortCOM::SGetSupported
+		,& IsochPortCOM::SAllocatePort
+		,& IsochPortCOM::SReleasePort
+		,& IsochPortCOM::SStart
+		,& IsochPortCOM::SStop
+		,& IsochPortCOM::SSetRefCon
+		,& IsochPortCOM::SGetRefCon
+
+		,& BufferFillIsochPort::SSetNotificationHandler
+		,& BufferFillIsochPort::SGetData
+		,& BufferFillIsochPort::SConsumeData
+		,& BufferFillIsochPort::SGetBytesAvailable
+		,& BufferFillIsochPort::SGetBufferSize
+		,& BufferFillIsochPort::SGetOverrunCount
+	} ;
+
+	// ============================================================
+	//
+	// BufferFillIsochPort
+	//
+	// ============================================================
+
+	BufferFillIsochPort::BufferFillIsochPort( Device & userclient, UInt32 bufferSize, UInt32 watermark, UInt32 options )
+	: IsochPortCOM( reinterpret_cast<const IUnknownVTbl &>( sInterface ), userclient, false ),
+	  mBuffer( 0 ),
+	  mBufferSize( 0 ),
+	  mControl( 0 ),
+	  mData( 0 ),
+	  mDataMask( 0 ),
+	  mReadIndex( 0 ),
+	  mHandler( 0 )
+	{
+		// the kernel wires this buffer and writes packets straight into it
+		IOReturn error = vm_allocate( mach_task_self(), & mBuffer, bufferSize, true /*anywhere*/ ) ;
+		if ( error )
+		{
+			mBuffer = 0 ;
+			throw error ;
+		}
+
+		mBufferSize = bufferSize ;
+
+		{
+			uint32_t outputCnt = 1;
+			uint64_t outputVal = 0;
+			const uint64_t inputs[4] = {	(const uint64_t)mBuffer,
+											(const uint64_t)mBufferSize,
+											(const uint64_t)watermark,
+											(const uint64_t)options } ;
+
+			error = IOConnectCallScalarMethod(	mDevice.GetUserClientConnection(),
+												kBufferFillIsochPort_Create,
+												inputs,4,
+												&outputVal,&outputCnt);
+
+			mKernPortRef = (UserObjectHandle) outputVal;
+		}
+
+		if ( error )
+		{
+			DebugLog( "Couldn't create kernel buffer-fill isoch port (error=%x)\n", error ) ;
+			
+			// the destructor won't run
+			mKernPortRef = 0 ;
+			ReleaseBuffer() ;
+			throw error ;
+		}
+
+		// the kernel has set up the control block
+		mControl = (FWBufferFillControl *) mBuffer ;
+		mData = (UInt8 *)( mControl + 1 ) ;
+		mDataMask = mControl->dataSize - 1 ;
+
+		{
+			uint64_t refrncData[kOSAsyncRef64Count];
+			refrncData[kIOAsyncCalloutFuncIndex] = (uint64_t) 0;
+			refrncData[kIOAsyncCalloutRefconIndex] = (unsigned long) 0;
+			const uint64_t inputs[2] = {	(const uint64_t) & BufferFillIsochPort::s_NotificationHandler,
+											(const uint64_t) this } ;
+			uint32_t outputCnt = 0;
+
+			error = IOConnectCallAsyncScalarMethod(	mDevice.GetUserClientConnection(),
+													mDevice.MakeSelectorWithObject( kBufferFillIsochPort_SetNotificationCallback_d, mKernPortRef ),
+													mDevice.GetIsochAsyncPort(),
+													refrncData,kOSAsyncRef64Count,
+													inputs,2,
+													NULL,&outputCnt);
+		}
+
+		if ( error )
+		{
+			// the destructor won't run
+			ReleaseBuffer() ;
+			throw error ;
+		}
+	}
+
+	BufferFillIsochPort::~BufferFillIsochPort()
+	{
+		ReleaseBuffer() ;
+	}
+
+	void
+	BufferFillIsochPort::ReleaseBuffer()
+	{
+		// release the kernel port first so nothing writes to the buffer once it's gone
+		if ( mKernPortRef )
+		{
+			uint32_t outputCnt = 0;
+			const uint64_t inputs[1]={(const uint64_t)mKernPortRef};
+			IOReturn error = IOConnectCallScalarMethod(	mDevice.GetUserClientConnection(),
+														kReleaseUserObject,
+														inputs,1,NULL,&outputCnt);
+
+			DebugLogCond( error, "Couldn't release kernel buffer-fill port" ) ;
+
+			mKernPortRef = 0 ;
+		}
+
+		if ( mBuffer )
+		{
+			vm_deallocate( mach_task_self(), mBuffer, mBufferSize ) ;
+			mBuffer = 0 ;
+		}
+	}
+
+	IUnknownVTbl**
+	BufferFillIsochPort::Alloc( Device & userclient, UInt32 bufferSize, UInt32 watermark, UInt32 options )
+	{
+		BufferFillIsochPort *	me = nil ;
+
+		try
+		{
+			me = new BufferFillIsochPort( userclient, bufferSize, watermark, options ) ;
+		}
+		catch(...)
+		{
+		}
+
+		return ( nil == me ) ? nil : reinterpret_cast < IUnknownVTbl ** > ( & me->GetInterface () ) ;
+	}
+
+	HRESULT
+	BufferFillIsochPort::QueryInterface( REFIID iid, void ** ppv )
+	{
+		HRESULT		result			= S_OK ;
+		CFUUIDRef	interfaceID		= CFUUIDCreateFromUUIDBytes(kCFAllocatorDefault, iid) ;
+
+		*ppv = nil ;
+
+		if ( CFEqual(interfaceID, IUnknownUUID)
+				|| CFEqual(interfaceID, kIOFireWireBufferFillIsochPortInterfaceID )
+			)
+		{
+			* ppv = & GetInterface () ;
+			AddRef () ;
+		}
+		else
+		{
+			DebugLog("unknown buffer-fill isoch port interface UUID\n") ;
+
+			* ppv = nil ;
+			result = E_NOINTERFACE ;
+		}
+
+		:: CFRelease ( interfaceID ) ;
+		return result ;
+	}
+
+	BufferFillIsochPort::NotificationHandler
+	BufferFillIsochPort::SetNotificationHandler( NotificationHandler handler )
+	{
+		NotificationHandler oldHandler = mHandler ;
+		mHandler = handler ;
+
+		return oldHandler ;
+	}
+
+	UInt32
+	BufferFillIsochPort::GetBytesAvailable()
+	{
+		UInt32 available = mControl->writeIndex - mReadIndex ;
+
+		// acquire - don't read record bytes before the index that published them
+		OSMemoryBarrier() ;
+
+		return available ;
+	}
+
+	void *
+	BufferFillIsochPort::GetData( UInt32 * outLength )
+	{
+		UInt32 available = GetBytesAvailable() ;
+		UInt32 position = mReadIndex & mDataMask ;
+		UInt32 contiguous = mDataMask + 1 - position ;
+
+		*outLength = ( available < contiguous ) ? available : contiguous ;
+
+		return mData + position ;
+	}
+
+	void
+	BufferFillIsochPort::ConsumeData( UInt32 length )
+	{
+		UInt32 available = GetBytesAvailable() ;
+
+		if ( length > available )
+		{
+			DebugLog( "BufferFillIsochPort::ConsumeData - consuming %u bytes, only %u available\n", (unsigned)length, (unsigned)available ) ;
+			length = available ;
+		}
+
+		mReadIndex += length ;
+
+		// release - we're done with the bytes before the kernel can reuse them
+		OSMemoryBarrier() ;
+		mControl->readIndex = mReadIndex ;
+	}
+
+	void
+	BufferFillIsochPort::s_NotificationHandler( void * refcon, IOReturn result, void ** args, int numArgs )
+	{
+		BufferFillIsochPort * me = (BufferFillIsochPort *) refcon ;
+
+		// args[0] is the kernel's write index; report what's unread as of now instead
+		if ( me->mHandler )
+		{
+			(*me->mHandler)(	(PortRef) & me->GetInterface(),
+								me->GetBytesAvailable(),
+								(UInt32)(unsigned long) args[1],
+								me->GetRefCon() ) ;
+		}
+	}
+
+	BufferFillIsochPort::NotificationHandler
+	BufferFillIsochPort::SSetNotificationHandler( PortRef self, NotificationHandler handler )
+	{
+		return GetThis( self )->SetNotificationHandler( handler ) ;
+	}
+
+	void *
+	BufferFillIsochPort::SGetData( PortRef self, UInt32 * outLength )
+	{
+		return GetThis( self )->GetData( outLength ) ;
+	}
+
+	void
+	BufferFillIsochPort::SConsumeData( PortRef self, UInt32 length )
+	{
+		GetThis( self )->ConsumeData( length ) ;
+	}
+
+	UInt32
+	BufferFillIsochPort::SGetBytesAvailable( PortRef self )
+	{
+		return GetThis( self )->GetBytesAvailable() ;
+	}
+
+	UInt32
+	BufferFillIsochPort::SGetBufferSize( PortRef self )
+	{
+		return GetThis( self )->GetBufferSize() ;
+	}
+
+	UInt32
+	BufferFillIsochPort::SGetOverrunCount( PortRef self )
+	{
+		return GetThis( self )->GetOverrunCount() ;
+	}
+}
@@ -6,7 +6,71 @@
  *  Copyright (c) 2003 Apple Computer, Inc. All rights reserved.
  *
  *	$Log: not supported by cvs2svn $
- *	
+ *
  */
 
-// Deprecated
\ No newline at end of file
+#import "IOFireWireLibIsochPort.h"
+
+namespace IOFireWireLib {
+
+	class Device ;
+
+	// ============================================================
+	//
+	// BufferFillIsochPort
+	//
+	// ============================================================
+
+#pragma mark -
+	class BufferFillIsochPort: public IsochPortCOM
+	{
+		typedef ::IOFireWireBufferFillIsochPortInterface		Interface ;
+		typedef ::IOFireWireLibBufferFillIsochPortRef			PortRef ;
+		typedef ::IOFireWireLibBufferFillIsochPortCallback		NotificationHandler ;
+
+		protected:
+
+			static Interface		sInterface ;
+
+			vm_address_t			mBuffer ;
+			vm_size_t				mBufferSize ;
+			FWBufferFillControl *	mControl ;
+			UInt8 *					mData ;
+			UInt32					mDataMask ;
+			UInt32					mReadIndex ;		// private copy, the shared one is only published
+			NotificationHandler		mHandler ;
+
+		public:
+
+			BufferFillIsochPort( Device & userclient, UInt32 bufferSize, UInt32 watermark, UInt32 options ) ;
+			virtual ~BufferFillIsochPort() ;
+
+			// --- IUNKNOWN support ----------------
+			static IUnknownVTbl**	Alloc( Device & userclient, UInt32 bufferSize, UInt32 watermark, UInt32 options ) ;
+			virtual HRESULT			QueryInterface( REFIID iid, void ** ppv ) ;
+
+			// --- buffer-fill port methods --------
+			NotificationHandler		SetNotificationHandler( NotificationHandler handler ) ;
+			void *					GetData( UInt32 * outLength ) ;
+			void					ConsumeData( UInt32 length ) ;
+			UInt32					GetBytesAvailable() ;
+			UInt32					GetBufferSize() const						{ return mDataMask + 1 ; }
+			UInt32					GetOverrunCount() const						{ return mControl->overrunCount ; }
+
+		protected:
+
+			inline static BufferFillIsochPort *	GetThis( PortRef self )
+													{ return IOFireWireIUnknown::InterfaceMap<BufferFillIsochPort>::GetThis( self ) ; }
+
+			static void				s_NotificationHandler( void * refcon, IOReturn result, void ** args, int numArgs ) ;
+			void					ReleaseBuffer() ;
+
+			// --- static methods ------------------
+			static NotificationHandler	SSetNotificationHandler( PortRef self, NotificationHandler handler ) ;
+			static void *			SGetData( PortRef self, UInt32 * outLength ) ;
+			static void				SConsumeData( PortRef self, UInt32 length ) ;
+			static UInt32			SGetBytesAvailable( PortRef self ) ;
+			static UInt32			SGetBufferSize( PortRef self ) ;
+			static UInt32			SGetOverrunCount( PortRef self ) ;
+	} ;
+}
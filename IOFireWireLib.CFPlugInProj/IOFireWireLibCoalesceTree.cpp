@@ -22,6 +22,7 @@ namespace IOFireWireLib {
 	CoalesceTree::CoalesceTree()
 	{
 		mTop = nil ;
+		mCount = 0 ;
 	}
 	
 	CoalesceTree::~CoalesceTree()
@@ -47,79 +48,183 @@ namespace IOFireWireLib {
 			return ;
 	
 		// ranges must be page aligned and have lengths in multiples of the vm page size only:
-		IOVirtualRange range = { trunc_page(inRange.address), (IOByteCount)round_page( (inRange.address & getpagesize() - 1) + inRange.length - 1) } ;
+		IOVirtualRange range = { trunc_page(inRange.address), (IOByteCount)round_page( (inRange.address & getpagesize() - 1) + inRange.length ) } ;
 	
-		if (mTop)
-			CoalesceRange(range, mTop) ;
-		else
+		// absorb every node that overlaps or abuts the new range; each node
+		// is removed at most once, so this is O(log n) amortized per range
+		while ( Node* node = FindTouching( range ) )
 		{
-			mTop					= new Node ;
-			mTop->left 				= nil ;
-			mTop->right				= nil ;
-			mTop->range.address		= range.address ;
-			mTop->range.length		= range.length ;
+			IOVirtualAddress	start	= MIN( range.address, node->range.address ) ;
+			IOVirtualAddress	end		= MAX( range.address + range.length, node->range.address + node->range.length ) ;
+			
+			mTop = Remove( node->range.address, mTop ) ;
+			--mCount ;
+			
+			range.address	= start ;
+			range.length	= end - start ;
 		}
+		
+		mTop = Insert( range, mTop ) ;
+		++mCount ;
 	}
 	
-	void
-	CoalesceTree::CoalesceRange(const IOVirtualRange& inRange, Node* inNode)
+	CoalesceTree::Node*
+	CoalesceTree::FindTouching(const IOVirtualRange& inRange) const
 	{
-		if (inRange.address > inNode->range.address)
+		Node* node = mTop ;
+		
+		while (node)
 		{
-			if ( (inRange.address - inNode->range.address) <= inNode->range.length)
-			{
-				// merge
-				inNode->range.length = MAX( inNode->range.length, ( inRange.address + inRange.length - inNode->range.address) ) ;
-			}
+			if ( inRange.address + inRange.length < node->range.address )
+				node = node->left ;
+			else if ( inRange.address > node->range.address + node->range.length )
+				node = node->right ;
 			else
-				if (inNode->right)
-					CoalesceRange(inRange, inNode->right) ;
-				else
-				{
-					inNode->right 					= new Node ;
-					inNode->right->left				= nil ;
-					inNode->right->right			= nil ;
-					
-					inNode->right->range.address	= inRange.address ;
-					inNode->right->range.length		= inRange.length ;
-				}
+				break ;
 		}
-		else	
+		
+		return node ;
+	}
+	
+	CoalesceTree::Node*
+	CoalesceTree::Insert(const IOVirtualRange& inRange, Node* inNode)
+	{
+		if (!inNode)
 		{
-			if ((inNode->range.address - inRange.address) <= inRange.length)
-			{
-				// merge
-				inNode->range.length 	= MAX( inRange.length, ( inNode->range.address + inNode->range.length - inRange.address) ) ;
-				inNode->range.address 	= inRange.address ;
-			}
-			else
-				if (inNode->left)
-					CoalesceRange(inRange, inNode->left) ;
-				else
-				{
-					inNode->left					= new Node ;
-					inNode->left->left			= nil ;
-					inNode->left->right			= nil ;
-					
-					inNode->left->range.address	= inRange.address ;
-					inNode->left->range.length	= inRange.length ;
-				}
+			Node* node 			= new Node ;
+			node->left			= nil ;
+			node->right			= nil ;
+			node->height		= 1 ;
+			node->range			= inRange ;
+
+			return node ;
 		}
+		
+		// caller has already merged anything touching inRange
+		if (inRange.address < inNode->range.address)
+			inNode->left = Insert(inRange, inNode->left) ;
+		else
+			inNode->right = Insert(inRange, inNode->right) ;
+		
+		return Balance(inNode) ;
 	}
 	
-	const UInt32
-	CoalesceTree::GetCount() const
+	CoalesceTree::Node*
+	CoalesceTree::Remove(IOVirtualAddress inAddress, Node* inNode)
+	{
+		if (!inNode)
+			return nil ;
+		
+		if (inAddress < inNode->range.address)
+			inNode->left = Remove(inAddress, inNode->left) ;
+		else if (inAddress > inNode->range.address)
+			inNode->right = Remove(inAddress, inNode->right) ;
+		else
+		{
+			Node* left	= inNode->left ;
+			Node* right	= inNode->right ;
+			
+			delete inNode ;
+			
+			if (!right)
+				return left ;
+			
+			Node* min ;
+			right = RemoveMin(right, & min) ;
+			
+			min->left	= left ;
+			min->right	= right ;
+			
+			return Balance(min) ;
+		}
+		
+		return Balance(inNode) ;
+	}
+	
+	CoalesceTree::Node*
+	CoalesceTree::RemoveMin(Node* inNode, Node** outMin)
 	{
-		return GetCount(mTop) ;
+		if (!inNode->left)
+		{
+			*outMin = inNode ;
+			return inNode->right ;
+		}
+		
+		inNode->left = RemoveMin(inNode->left, outMin) ;
+		
+		return Balance(inNode) ;
+	}
+	
+	CoalesceTree::Node*
+	CoalesceTree::Balance(Node* inNode)
+	{
+		UpdateHeight(inNode) ;
+		
+		int balance = Height(inNode->left) - Height(inNode->right) ;
+		
+		if (balance > 1)
+		{
+			if ( Height(inNode->left->left) < Height(inNode->left->right) )
+				inNode->left = RotateLeft(inNode->left) ;
+
+			return RotateRight(inNode) ;
+		}
+		
+		if (balance < -1)
+		{
+			if ( Height(inNode->right->right) < Height(inNode->right->left) )
+				inNode->right = RotateRight(inNode->right) ;
+			
+			return RotateLeft(inNode) ;
+		}
+		
+		return inNode ;
+	}
+	
+	CoalesceTree::Node*
+	CoalesceTree::RotateLeft(Node* inNode)
+	{
+		Node* top		= inNode->right ;
+		
+		inNode->right	= top->left ;
+		top->left		= inNode ;
+		
+		UpdateHeight(inNode) ;
+		UpdateHeight(top) ;
+		
+		return top ;
+	}
+	
+	CoalesceTree::Node*
+	CoalesceTree::RotateRight(Node* inNode)
+	{
+		Node* top		= inNode->left ;
+		
+		inNode->left	= top->right ;
+		top->right		= inNode ;
+		
+		UpdateHeight(inNode) ;
+		UpdateHeight(top) ;
+		
+		return top ;
+	}
+	
+	int
+	CoalesceTree::Height(const Node* inNode)
+	{
+		return inNode ? inNode->height : 0 ;
+	}
+	
+	void
+	CoalesceTree::UpdateHeight(Node* inNode)
+	{
+		inNode->height = 1 + MAX( Height(inNode->left), Height(inNode->right) ) ;
 	}
 	
 	const UInt32
-	CoalesceTree::GetCount(Node* inNode) const
+	CoalesceTree::GetCount() const
 	{
-		if (inNode)
-			return 1 + GetCount(inNode->left) + GetCount(inNode->right) ;
-		else
-			return 0 ;
+		return mCount ;
 	}
 	
 	void
@@ -23,10 +23,14 @@ namespace IOFireWireLib {
 	
 	class CoalesceTree
 	{
+		// nodes hold disjoint, non-adjacent page ranges kept in an AVL tree
+		// ordered by address
+		
 		struct Node
 		{
 			Node*				left ;
 			Node*				right ;
+			int					height ;
 			IOVirtualRange		range ;
 		} ;
 	
@@ -44,13 +48,21 @@ namespace IOFireWireLib {
 		protected:
 		
 			void				DeleteNode(Node* inNode) ;
-			void				CoalesceRange(const IOVirtualRange& inRange, Node* inNode) ;
-			const UInt32		GetCount(Node* inNode) const ;
+			Node*				FindTouching(const IOVirtualRange& inRange) const ;
+			Node*				Insert(const IOVirtualRange& inRange, Node* inNode) ;
+			Node*				Remove(IOVirtualAddress inAddress, Node* inNode) ;
+			Node*				RemoveMin(Node* inNode, Node** outMin) ;
+			Node*				Balance(Node* inNode) ;
+			Node*				RotateLeft(Node* inNode) ;
+			Node*				RotateRight(Node* inNode) ;
+			static int			Height(const Node* inNode) ;
+			static void			UpdateHeight(Node* inNode) ;
 			void				GetCoalesceList(IOVirtualRange* outRanges, Node* inNode, UInt32* pIndex) const ;
 	
 		protected:
 		
 			Node *	mTop ;
+			UInt32	mCount ;
 	} ;
 	
 } // namespace
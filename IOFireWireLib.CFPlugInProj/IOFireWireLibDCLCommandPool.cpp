@@ -79,33 +79,25 @@ namespace IOFireWireLib {
 	
 	TraditionalDCLCommandPool::TraditionalDCLCommandPool( const IUnknownVTbl & interface, Device& inUserClient, IOByteCount inSize )
 	: IOFireWireIUnknown( interface ),
-	mUserClient(inUserClient)
+	mUserClient(inUserClient),
+	mChunks( nil ),
+	mLargeFreeBlocks( nil ),
+	mStorageSize( 0 ),
+	mBytesRemaining( 0 )
 	{
-		mUserClient.AddRef() ;
-	
-		mFreeBlocks				= CFArrayCreateMutable(kCFAllocatorDefault, 0, nil) ;
-		mFreeBlockSizes			= CFArrayCreateMutable(kCFAllocatorDefault, 0, nil) ;
-		mAllocatedBlocks		= CFArrayCreateMutable(kCFAllocatorDefault, 0, nil) ;
-		mAllocatedBlockSizes	= CFArrayCreateMutable(kCFAllocatorDefault, 0, nil) ;
-	
-//		mStorage = new UInt8[inSize] ;
-		IOReturn		error = vm_allocate ( mach_task_self (), (vm_address_t *) & mStorage, inSize, true /*anywhere*/ ) ;
+		bzero( mFreeLists, sizeof( mFreeLists ) ) ;
+
+		IOReturn error = AddChunk( inSize ) ;
 		if ( error )
 			throw error ;
-			
-		if ( ! mStorage )
-			throw kIOReturnVMError ;
-				
-		mBytesRemaining = inSize ;
-		mStorageSize = inSize ;
+		
+		mUserClient.AddRef() ;
 
 #ifdef __LP64__
-		DebugLog( "TraditionalDCLCommandPool::TraditionalDCLCommandPool mStorage=%p, mStorageSize=%u\n", mStorage, (UInt32)mStorageSize ) ;
+		DebugLog( "TraditionalDCLCommandPool::TraditionalDCLCommandPool mStorage=%p, mStorageSize=%u\n", mChunks->storage, (UInt32)mStorageSize ) ;
 #else
-		DebugLog( "TraditionalDCLCommandPool::TraditionalDCLCommandPool mStorage=%p, mStorageSize=%lu\n", mStorage, (UInt32)mStorageSize ) ;
+		DebugLog( "TraditionalDCLCommandPool::TraditionalDCLCommandPool mStorage=%p, mStorageSize=%lu\n", mChunks->storage, (UInt32)mStorageSize ) ;
 #endif
-		::CFArrayAppendValue ( mFreeBlocks, mStorage ) ;
-		::CFArrayAppendValue ( mFreeBlockSizes, (const void *) inSize ) ;
 		
 		pthread_mutex_init( & mMutex, nil ) ;
 	}
@@ -114,22 +106,16 @@ namespace IOFireWireLib {
 	{
 		Lock() ;
 	
-		if (mStorage)
+		while ( mChunks )
 		{
-//			delete[] mStorage ;
-			vm_deallocate ( mach_task_self (), (vm_address_t) mStorage, mStorageSize ) ;
-			mStorage = nil ;
-			mStorageSize = 0 ;
+			Chunk * chunk = mChunks ;
+			mChunks = chunk->next ;
+			
+			vm_deallocate ( mach_task_self (), (vm_address_t) chunk->storage, chunk->size ) ;
+			delete chunk ;
 		}
 		
-		if (mFreeBlocks)
-			CFRelease(mFreeBlocks) ;
-		if (mFreeBlockSizes)
-			CFRelease(mFreeBlockSizes) ;
-		if (mAllocatedBlocks)
-			CFRelease(mAllocatedBlocks) ;
-		if (mAllocatedBlockSizes)
-			CFRelease(mAllocatedBlockSizes) ;
+		mStorageSize = 0 ;
 	
 		Unlock() ;
 		
@@ -142,54 +128,68 @@ namespace IOFireWireLib {
 	TraditionalDCLCommandPool::Allocate(
 		IOByteCount 					inSize )
 	{
-		unsigned long		blockSize ;
-		UInt32 				remainder ;
-		UInt32 				index			= 0 ;
-		const UInt8*		foundFreeBlock	= 0 ;
-		DCLCommand*	allocatedBlock	= nil ;
-		UInt32				freeBlockCount	= CFArrayGetCount(mFreeBlocks) ;
-	
+		// round up so every block, and the header in front of the next one, stays aligned
+		IOByteCount		blockSize	= inSize ? ( inSize + kBlockGranule - 1 ) & ~(IOByteCount)( kBlockGranule - 1 ) : kBlockGranule ;
+		IOByteCount		totalSize	= sizeof( BlockHeader ) + blockSize ;
+		BlockHeader *	header		= nil ;
+		
+		if ( blockSize > 0xFFFFFFFFULL - sizeof( BlockHeader ) )
+			return nil ;
+		
 		Lock() ;
 		
-		do
+		if ( blockSize <= kBlockGranule * kNumSizeClasses )
 		{
-			blockSize	= (unsigned long) CFArrayGetValueAtIndex(mFreeBlockSizes, index) ;
-			remainder	= blockSize - inSize ;
-	
-			if ( blockSize >= inSize )
+			// DCLs come in a handful of fixed sizes, reuse a freed block of exactly this size
+			FreeBlock ** list = & mFreeLists[ ( blockSize / kBlockGranule ) - 1 ] ;
+			if ( *list )
+			{
+				header = (BlockHeader*) *list - 1 ;
+				*list = (*list)->next ;
+			}
+		}
+		else
+		{
+			for( FreeBlock ** link = & mLargeFreeBlocks; *link; link = & (*link)->next )
 			{
-				// found a free block w/ enough space,
-				// use it to allocate. we allocate from the end of the free block, not the beginning
-				foundFreeBlock	= (const UInt8*) CFArrayGetValueAtIndex(mFreeBlocks, index) ;
-				allocatedBlock	= (DCLCommand*) (foundFreeBlock + remainder) ;
-				
-				CFArrayAppendValue(mAllocatedBlockSizes, (const void*) inSize) ;
-				CFArrayAppendValue(mAllocatedBlocks, allocatedBlock ) ;
-	
-				if (remainder > 0)
+				BlockHeader * candidate = (BlockHeader*) *link - 1 ;
+				if ( candidate->size >= blockSize )
 				{
-					//
-					// if we didn't use up all of this free block,
-					// resize the block to reflect the new size
-	//				CFArraySetValueAtIndex(mFreeBlocks, index, (UInt32) CFArrayGetValueAtIndex(mFreeBlocks, index)) ;
-					CFArraySetValueAtIndex(mFreeBlockSizes, index, (const void*) remainder) ;
+					// large blocks aren't split; the whole block stays with the DCL
+					header = candidate ;
+					totalSize = sizeof( BlockHeader ) + candidate->size ;
+					*link = (*link)->next ;
+					break ;
 				}
-				else
+			}
+		}
+		
+		if ( !header )
+		{
+			// carve a new block from the first chunk with room for it
+			for( Chunk * chunk = mChunks; chunk; chunk = chunk->next )
+			{
+				if ( chunk->size - chunk->used >= totalSize )
 				{
-					//
-					// otherwise remove the block from the free list
-					CFArrayRemoveValueAtIndex(mFreeBlocks, index) ;
-					CFArrayRemoveValueAtIndex(mFreeBlockSizes, index) ;
+					header = (BlockHeader*)( chunk->storage + chunk->used ) ;
+					header->size = blockSize ;
+					chunk->used += totalSize ;
+					break ;
 				}
-				
-				// update reminaing size to reflect successful allocation
-				mBytesRemaining -= inSize ;
 			}
-		} while( (++index < freeBlockCount) && (foundFreeBlock == nil) ) ;
+		}
+		
+		if ( header )
+		{
+			header->state = kBlockAllocated ;
+			
+			// update remaining size to reflect successful allocation
+			mBytesRemaining -= totalSize ;
+		}
 		
 		Unlock() ;
 		
-		return allocatedBlock ;
+		return header ? (DCLCommand*)( header + 1 ) : nil ;
 	}
 	
 	IOReturn
@@ -454,32 +454,21 @@ namespace IOFireWireLib {
 	{
 		Lock() ;
 		
-		// 1. find this block in allocated list
-		CFRange searchRange = {0, CFArrayGetCount(mAllocatedBlocks) } ;
-		CFIndex	foundIndex = CFArrayGetFirstIndexOfValue(mAllocatedBlocks, searchRange, (const void*) inDCL);
-		if (foundIndex >= 0)
+		BlockHeader * header = (BlockHeader*) inDCL - 1 ;
+		
+		// ignore anything we didn't hand out, or that has been freed already
+		if ( inDCL && FindChunk( header ) && header->state == kBlockAllocated )
 		{
-			unsigned long foundBlockSize = (unsigned long) CFArrayGetValueAtIndex(mAllocatedBlockSizes, foundIndex) ;
-			
-			// 2. if found, return block to free list
+			FreeBlock *		block	= (FreeBlock*) inDCL ;
+			FreeBlock **	list	= ( header->size <= kBlockGranule * kNumSizeClasses ) 
+										? & mFreeLists[ ( header->size / kBlockGranule ) - 1 ] : & mLargeFreeBlocks ;
 			
-			CFIndex index = 0 ;
-			{
-				CFIndex count = ::CFArrayGetCount( mFreeBlocks ) ;
-				while ( (index < count) && (CFArrayGetValueAtIndex(mFreeBlocks, index) <= inDCL) )
-					++index ;
-			}
+			header->state = kBlockFree ;
+			block->next = *list ;
+			*list = block ;
 			
 			// update free space counter to reflect returning block to free list
-			mBytesRemaining += foundBlockSize ;
-	
-			CFArrayRemoveValueAtIndex(mAllocatedBlocks, foundIndex) ;
-			CFArrayRemoveValueAtIndex(mAllocatedBlockSizes, foundIndex) ;
-			
-			CFArrayInsertValueAtIndex(mFreeBlocks, index, inDCL) ;
-			CFArrayInsertValueAtIndex(mFreeBlockSizes, index, (const void*) foundBlockSize) ;
-			
-			CoalesceFreeBlocks() ;
+			mBytesRemaining += sizeof( BlockHeader ) + header->size ;
 		}
 		
 		Unlock() ;
@@ -495,35 +484,62 @@ namespace IOFireWireLib {
 		
 		if (inSize > mStorageSize)
 		{
-			UInt8*	newStorage = 0 ;// = new UInt8[inSize] ;
-			IOReturn error = vm_allocate ( mach_task_self (), (vm_address_t *) & newStorage, inSize, true /*anywhere*/ ) ;
-			if ( error )
-				return false ;
-				
-			if ( ! newStorage )
-				return false ;
-			
 			Lock() ;
 			
-			::CFArrayAppendValue ( mFreeBlocks, mStorage + mStorageSize ) ;
-			::CFArrayAppendValue ( mFreeBlockSizes, (const void *)( inSize - mStorageSize ) ) ;
+			// add the difference as a new chunk; blocks already handed out stay where they are
+			IOReturn error = AddChunk( inSize - mStorageSize ) ;
 			
-			CoalesceFreeBlocks() ;			
-	
-			mBytesRemaining += inSize - mStorageSize ;
+			Unlock() ;
 			
-			bcopy ( mStorage, newStorage, mStorageSize ) ;
+			if ( error )
+				return false ;
+		}
+		
+		return true ;
+	}
 
-//			delete[] mStorage ;
-			vm_deallocate ( mach_task_self (), (vm_address_t) mStorage, mStorageSize ) ;
-				
-			mStorage = newStorage ;
-			mStorageSize = inSize ;
+	IOReturn
+	TraditionalDCLCommandPool::AddChunk(
+		IOByteCount						inSize )
+	{
+		UInt8 *		storage = 0 ;
+		IOReturn	error = vm_allocate ( mach_task_self (), (vm_address_t *) & storage, inSize, true /*anywhere*/ ) ;
+		if ( error )
+			return error ;
 			
-			Unlock() ;
+		if ( ! storage )
+			return kIOReturnVMError ;
+		
+		Chunk * chunk = new Chunk ;
+		chunk->storage	= storage ;
+		chunk->size		= inSize ;
+		chunk->used		= 0 ;
+		
+		// newest chunk last, so allocation keeps filling the oldest chunks first
+		Chunk ** link = & mChunks ;
+		while ( *link )
+			link = & (*link)->next ;
+		
+		chunk->next = nil ;
+		*link = chunk ;
+		
+		mStorageSize += inSize ;
+		mBytesRemaining += inSize ;
+		
+		return kIOReturnSuccess ;
+	}
+	
+	TraditionalDCLCommandPool::Chunk *
+	TraditionalDCLCommandPool::FindChunk(
+		const void *					block ) const
+	{
+		for( Chunk * chunk = mChunks; chunk; chunk = chunk->next )
+		{
+			if ( (const UInt8*) block >= chunk->storage && (const UInt8*) block < chunk->storage + chunk->used )
+				return chunk ;
 		}
 		
-		return true ;
+		return nil ;
 	}
 
 	void
@@ -538,37 +554,6 @@ namespace IOFireWireLib {
 		pthread_mutex_unlock( & mMutex ) ;
 	}
 	
-	void
-	TraditionalDCLCommandPool::CoalesceFreeBlocks()
-	{		
-		UInt32			freeBlockCount	 	= CFArrayGetCount(mFreeBlocks) ;
-		UInt32			index				= 1 ;
-		unsigned long		preceedingBlockSize = (unsigned long) CFArrayGetValueAtIndex(mFreeBlockSizes, 0) ;
-		unsigned long		blockSize ;
-	
-		while (index < freeBlockCount)
-		{
-			blockSize = (unsigned long) CFArrayGetValueAtIndex(mFreeBlockSizes, index) ;
-			
-			if ( ((UInt8*)CFArrayGetValueAtIndex(mFreeBlocks, index - 1) + preceedingBlockSize) == (UInt8*)CFArrayGetValueAtIndex(mFreeBlocks, index) )
-			{
-				// resize preceeding block to include current block
-				CFArraySetValueAtIndex(mFreeBlockSizes, index-1, (const void*)(preceedingBlockSize + blockSize) ) ;
-				
-				// remove current block since preceeding block now includes it.
-				CFArrayRemoveValueAtIndex(mFreeBlocks, index) ;
-				CFArrayRemoveValueAtIndex(mFreeBlockSizes, index) ;
-	
-				preceedingBlockSize += blockSize ;
-			}
-			else
-			{
-				++index ;
-				preceedingBlockSize = blockSize ;
-			}
-		}
-	}
-	
 	// ============================================================
 	// TraditionalDCLCommandPoolCOM
 	// ============================================================
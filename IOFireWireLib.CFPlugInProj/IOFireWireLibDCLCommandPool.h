@@ -42,12 +42,40 @@ namespace IOFireWireLib {
 	{
 		protected:
 		
+			// storage is never moved once handed out; growing the pool adds a chunk
+			struct Chunk
+			{
+				Chunk *			next ;
+				UInt8 *			storage ;
+				IOByteCount		size ;
+				IOByteCount		used ;
+			} ;
+			
+			// precedes every block; blocks are handed out right after it
+			struct BlockHeader
+			{
+				UInt32			size ;			// rounded size of the block, not including this header
+				UInt32			state ;
+			} ;
+			
+			// freed blocks are linked through their first word
+			struct FreeBlock
+			{
+				FreeBlock *		next ;
+			} ;
+			
+			enum
+			{
+				kBlockGranule		= 8,		// block sizes are rounded to this, keeps DCLs pointer aligned
+				kNumSizeClasses		= 32,		// blocks up to kBlockGranule * kNumSizeClasses bytes are kept per size
+				kBlockAllocated		= 'DCLa',
+				kBlockFree			= 'DCLf'
+			} ;
+			
 			Device&				mUserClient ;
-			CFMutableArrayRef	mFreeBlocks ;
-			CFMutableArrayRef	mFreeBlockSizes ;
-			CFMutableArrayRef	mAllocatedBlocks ;
-			CFMutableArrayRef	mAllocatedBlockSizes ;	
-			UInt8*				mStorage ;
+			Chunk *				mChunks ;
+			FreeBlock *			mFreeLists[ kNumSizeClasses ] ;		// indexed by (size / kBlockGranule) - 1
+			FreeBlock *			mLargeFreeBlocks ;					// everything bigger, first fit
 			IOByteCount			mStorageSize ;
 			IOByteCount			mBytesRemaining ;
 			pthread_mutex_t		mMutex ;
@@ -110,7 +138,8 @@ namespace IOFireWireLib {
 		
 			void				Lock() ;
 			void				Unlock() ;
-			void				CoalesceFreeBlocks() ;
+			IOReturn			AddChunk( IOByteCount size ) ;
+			Chunk *				FindChunk( const void * block ) const ;
 	} ;
 	
 	
@@ -22,6 +22,7 @@
 #import "IOFireWireLibIRMAllocation.h"
 #import "IOFireWireLibVectorCommand.h"
 #import "IOFireWireLibPHYPacketListener.h"
+#import "IOFireWireLibBufferFillIsochPort.h"
 
 #import <IOKit/iokitmig.h>
 #import <mach/mach.h>
@@ -167,6 +168,10 @@ namespace IOFireWireLib {
 				// v9
 				
 				|| CFEqual( interfaceID, kIOFireWireDeviceInterfaceID_v9 )
+
+				// v10
+				
+				|| CFEqual( interfaceID, kIOFireWireDeviceInterfaceID_v10 )
 				)
 		{
 			*ppv = & GetInterface() ;
@@ -1257,7 +1262,7 @@ namespace IOFireWireLib {
 		{
 			// we allocate a user space pseudo address space with the reference we
 			// got from the kernel
-			IUnknownVTbl**	iUnknown = PseudoAddressSpace::Alloc(*this, addrSpaceRef, queueBuffer, inQueueBufferSize, inBackingStore, inRefCon) ;
+			IUnknownVTbl**	iUnknown = PseudoAddressSpace::Alloc(*this, addrSpaceRef, queueBuffer, inQueueBufferSize, inBackingStore, inRefCon, inFlags) ;
 			
 			// we got a new iUnknown from the object. Query it for the interface
 			// requested in iid...
@@ -1691,6 +1696,25 @@ namespace IOFireWireLib {
 		
 		return result;
 	}
+
+	IOFireWireLibBufferFillIsochPortRef 
+	Device::CreateBufferFillIsochPort( 
+		UInt32	bufferSize,
+		UInt32	watermark,
+		UInt32	options,
+		REFIID	iid )
+	{
+		IOFireWireLibBufferFillIsochPortRef	result = 0;
+											
+		IUnknownVTbl** iUnknown = BufferFillIsochPort::Alloc( *this, bufferSize, watermark, options );
+		if( iUnknown )
+		{
+			(*iUnknown)->QueryInterface( iUnknown, iid, (void**)&result );
+			(*iUnknown)->Release( iUnknown );
+		}
+		
+		return result;
+	}
 	
 	IOReturn Device::AllocateIRMBandwidthInGeneration(UInt32 bandwidthUnits, UInt32 generation)
 	{
@@ -2017,6 +2041,8 @@ namespace IOFireWireLib {
 		, &DeviceCOM::S_CreateAsyncStreamCommand
 		
 		, &DeviceCOM::SGetCycleTimeAndUpTime
+		
+		, &DeviceCOM::S_CreateBufferFillIsochPort
 	} ;
 	
 	DeviceCOM::DeviceCOM( CFDictionaryRef propertyTable, io_service_t service )
@@ -2683,6 +2709,17 @@ namespace IOFireWireLib {
 	{
 			return IOFireWireIUnknown::InterfaceMap<DeviceCOM>::GetThis(self)->CreatePHYPacketListener( queueCount, iid );
 	}
+
+	IOFireWireLibBufferFillIsochPortRef 
+	DeviceCOM::S_CreateBufferFillIsochPort( 
+		IOFireWireLibDeviceRef	self,
+		UInt32					bufferSize,
+		UInt32					watermark,
+		UInt32					options,
+		REFIID					iid )
+	{
+		return IOFireWireIUnknown::InterfaceMap<DeviceCOM>::GetThis(self)->CreateBufferFillIsochPort( bufferSize, watermark, options, iid );
+	}
 	
 	IOReturn DeviceCOM::S_AllocateIRMBandwidthInGeneration(IOFireWireLibDeviceRef self, UInt32 bandwidthUnits, UInt32 generation)
 	{
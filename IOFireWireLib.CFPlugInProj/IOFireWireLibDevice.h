@@ -426,6 +426,11 @@ namespace IOFireWireLib {
 
 			IOReturn GetCycleTimeAndUpTime(	UInt32*		outCycleTime,
 											UInt64*		outUpTime );
+
+			IOFireWireLibBufferFillIsochPortRef	CreateBufferFillIsochPort(	UInt32	bufferSize,
+																		UInt32	watermark,
+																		UInt32	options,
+																		REFIID	iid );
 	} ;
 	
 	
@@ -850,6 +855,12 @@ namespace IOFireWireLib {
 			static IOFireWireLibPHYPacketListenerRef S_CreatePHYPacketListener(	IOFireWireLibDeviceRef self,
 																				UInt32	queueCount,  
 																				REFIID iid );
+
+			static IOFireWireLibBufferFillIsochPortRef S_CreateBufferFillIsochPort(	IOFireWireLibDeviceRef	self,
+																					UInt32					bufferSize,
+																					UInt32					watermark,
+																					UInt32					options,
+																					REFIID					iid );
 																				
 			static	IOFireWireLibCommandRef	S_CreateAsyncStreamCommand(	IOFireWireLibDeviceRef			self, 
 																		UInt32							channel,
@@ -104,6 +104,15 @@
 											0xD3, 0x83, 0x76, 0x70, 0x44, 0x63, 0x11, 0xD7,\
 											0xB7, 0x9A, 0x00, 0x03, 0x93, 0x8B, 0xEB, 0x0A)
 
+//
+// buffer-fill isoch port
+//
+
+//	uuid string: 9B0C6A2E-3F41-4D8C-A57E-1C2D83F0B6A4
+#define kIOFireWireBufferFillIsochPortInterfaceID CFUUIDGetConstantUUIDWithBytes( kCFAllocatorDefault,\
+											0x9B, 0x0C, 0x6A, 0x2E, 0x3F, 0x41, 0x4D, 0x8C,\
+											0xA5, 0x7E, 0x1C, 0x2D, 0x83, 0xF0, 0xB6, 0xA4)
+
 //  uuid string: 6D1FDE59-50CE-4ED4-880A-9D13A4624038
 #define kIOFireWireAsyncStreamListenerInterfaceID  CFUUIDGetConstantUUIDWithBytes(kCFAllocatorDefault,\
 											0x6D, 0x1F, 0xDE, 0x59, 0x50, 0xCE, 0x4E, 0xD4,\
@@ -129,6 +138,12 @@ typedef IOReturn	(*IOFireWireLibIsochPortGetSupportedCallback)(
 
 typedef IOReturn	(*IOFireWireLibIsochPortFinalizeCallback)( void* refcon ) ;
 
+typedef void		(*IOFireWireLibBufferFillIsochPortCallback)(
+	IOFireWireLibBufferFillIsochPortRef	interface,
+	UInt32								bytesAvailable,
+	UInt32								overrunCount,
+	void *								refCon) ;
+
 // ============================================================
 //
 // IOFireWireIsochPort
@@ -989,6 +1004,80 @@ typedef struct IOFireWireNuDCLPoolInterface_t
 
 } IOFireWireNuDCLPoolInterface ;
 
+#pragma mark -
+#pragma mark BUFFER FILL ISOCH PORT INTERFACE
+// ============================================================
+// IOFireWireBufferFillIsochPort Interface
+// ============================================================
+
+/*!	@class
+	@abstract FireWire user client buffer-fill isochronous port object.
+	@discussion A local isochronous listener without a DCL program. Received packets
+		are written into one buffer, shared with the kernel, as a continuous byte stream
+		that wraps at the end of the buffer. Each packet is stored as
+		[header] payload [timestamp], see FWBufferFillControl and IOFWBufferFillOptions.
+		
+		Instead of a callback per packet the notification handler is called on the
+		isoch runloop each time the watermark is crossed, and once more when the
+		port stops. The client reads data with GetData() and hands space back
+		with ConsumeData(); it can also poll GetData() without any notification.
+		Packets that do not fit are dropped and counted in the overrun count.
+		
+		The port is added to an IOFireWireIsochChannelInterface with AddListener().
+		Receiving requires a link that supports multi-isoch receive.
+	*/
+typedef struct IOFireWireBufferFillIsochPortInterface_t
+{
+	IUNKNOWN_C_GUTS ;
+	/*! Interface revision. */
+	UInt32 revision;
+	/*! Interface version. */
+	UInt32 version;
+
+	IOFIREWIRELIBISOCHPORT_C_GUTS ;
+
+	/*!	@function SetNotificationHandler
+		@abstract Set the handler called when the watermark is crossed.
+		@param self The buffer-fill port interface to use.
+		@param handler The handler to set, or nil for none.
+		@result Returns the handler that was previously set or nil for none.*/
+	IOFireWireLibBufferFillIsochPortCallback (*SetNotificationHandler)( IOFireWireLibBufferFillIsochPortRef self, IOFireWireLibBufferFillIsochPortCallback handler ) ;
+
+	/*!	@function GetData
+		@abstract Returns the oldest unread data that is contiguous in the buffer.
+		@discussion When the unread data wraps around the end of the buffer, call
+			GetData() again after consuming the first part to get the rest.
+		@param self The buffer-fill port interface to use.
+		@param outLength Set to the number of contiguous bytes at the returned address.
+		@result The address of the oldest unread byte.*/
+	void*		(*GetData)( IOFireWireLibBufferFillIsochPortRef self, UInt32 * outLength ) ;
+
+	/*!	@function ConsumeData
+		@abstract Hands 'length' bytes of read data back to the port for reuse.
+		@param self The buffer-fill port interface to use.
+		@param length Number of bytes, at most the number of unread bytes.*/
+	void		(*ConsumeData)( IOFireWireLibBufferFillIsochPortRef self, UInt32 length ) ;
+
+	/*!	@function GetBytesAvailable
+		@abstract Returns the number of unread bytes, including any that wrap.
+		@param self The buffer-fill port interface to use.
+		@result The number of unread bytes.*/
+	UInt32		(*GetBytesAvailable)( IOFireWireLibBufferFillIsochPortRef self ) ;
+
+	/*!	@function GetBufferSize
+		@abstract Returns the size of the data area.
+		@param self The buffer-fill port interface to use.
+		@result The size of the data area, a power of two.*/
+	UInt32		(*GetBufferSize)( IOFireWireLibBufferFillIsochPortRef self ) ;
+
+	/*!	@function GetOverrunCount
+		@abstract Returns the number of packets dropped because the buffer was full.
+		@param self The buffer-fill port interface to use.
+		@result The overrun count.*/
+	UInt32		(*GetOverrunCount)( IOFireWireLibBufferFillIsochPortRef self ) ;
+
+} IOFireWireBufferFillIsochPortInterface ;
+
 #pragma mark -
 #pragma mark ASYNCSTREAM LISTENER INTERFACE
 // ============================================================
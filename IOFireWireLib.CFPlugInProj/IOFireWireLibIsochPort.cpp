@@ -173,6 +173,7 @@
 #import <IOKit/iokitmig.h>
 #import <mach/mach.h>
 #import <System/libkern/OSCrossEndian.h>
+#import <libkern/OSAtomic.h>
 
 #define IOFIREWIREISOCHPORTIMP_INTERFACE	\
 	& IsochPortCOM::SGetSupported,	\
@@ -700,6 +701,12 @@ namespace IOFireWireLib {
 	, mBufferRanges( nil )
 	, mBufferAddressRanges( nil )
 	, mStarted( false )
+	, mModifyRing( 0 )
+	, mModifyRingControl( nil )
+	, mModifyRingData( nil )
+	, mModifyRingMask( 0 )
+	, mModifyRingHead( 0 )
+	, mModifyRingUnavailable( false )
 	{
 		// sorry about the spaghetti.. hope you're hungry:
 		
@@ -950,6 +957,8 @@ namespace IOFireWireLib {
 	
 	LocalIsochPort::~LocalIsochPort ()
 	{
+		ReleaseModifyRing() ;
+
 		delete[] mBufferRanges ;
 		delete[] mBufferAddressRanges;
 		
@@ -1472,6 +1481,14 @@ namespace IOFireWireLib {
 		{
 			case kFWNuDCLModifyNotification:
 			{
+				// post to the modification ring if we can, it saves allocating and
+				// wiring a buffer for every notification
+				error = PostModifications( (NuDCL**)inDCLList, numDCLs ) ;
+				if ( error != kIOReturnNoSpace && error != kIOReturnUnsupported )
+				{
+					break ;
+				}
+
 				IOByteCount dataSize = 0 ;
 				for( unsigned index=0; index < numDCLs; ++index )
 				{
@@ -1516,7 +1533,13 @@ namespace IOFireWireLib {
 			{
 				unsigned pairCount = numDCLs << 1 ;
 				
-				unsigned dcls[ pairCount ] ;
+				// there's no limit on numDCLs, keep the index list off the stack
+				unsigned * dcls = new unsigned[ pairCount ] ;
+				if ( !dcls )
+				{
+					error = kIOReturnNoMemory ;
+					break ;
+				}
 				
 				{
 					unsigned index = 0 ;
@@ -1557,15 +1580,21 @@ namespace IOFireWireLib {
 				error = IOConnectCallMethod(mDevice.GetUserClientConnection(),
 											Device::MakeSelectorWithObject( kLocalIsochPort_Notify_d, mKernPortRef ), 
 											inputs,2,
-											dcls,sizeof( dcls ),
+											dcls,pairCount * sizeof( unsigned ),
 											NULL,&outputCnt,
 											NULL,&outputStructSize);
+				delete[] dcls ;
 				break ;
 			}
 			
 			case kFWNuDCLUpdateNotification:
 			{
-				unsigned dcls[ numDCLs ] ;
+				unsigned * dcls = new unsigned[ numDCLs ] ;
+				if ( !dcls )
+				{
+					error = kIOReturnNoMemory ;
+					break ;
+				}
 
 				for( unsigned index=0; index < numDCLs; ++index )
 				{
@@ -1585,9 +1614,10 @@ namespace IOFireWireLib {
 				error = IOConnectCallMethod(mDevice.GetUserClientConnection(),
 											Device::MakeSelectorWithObject( kLocalIsochPort_Notify_d, mKernPortRef ), 
 											inputs,2,
-											dcls,sizeof( dcls ),
+											dcls,numDCLs * sizeof( unsigned ),
 											NULL,&outputCnt,
 											NULL,&outputStructSize);
+				delete[] dcls ;
 				break ;
 			}
 			
@@ -1604,6 +1634,199 @@ namespace IOFireWireLib {
 		return error ;
 	}
 
+	// CreateModifyRing
+	//
+	// hands the kernel a DCL modification ring, only NuDCL programs can have one
+
+	IOReturn
+	LocalIsochPort::CreateModifyRing ()
+	{
+		IOReturn error = kIOReturnSuccess ;
+
+#ifndef __LP64__		
+		// the kernel reads the ring's control block and entries in its own byte order
+		ROSETTA_ONLY(
+			{
+				error = kIOReturnUnsupported ;
+			}
+		);
+#endif
+
+		if ( !error && mDCLProgram->opcode != kDCLNuDCLLeaderOp )
+		{
+			error = kIOReturnUnsupported ;
+		}
+
+		const vm_size_t ringSize = sizeof( FWSharedRingControl ) + kModifyRingDataSize ;
+
+		if ( !error )
+		{
+			error = vm_allocate( mach_task_self(), & mModifyRing, ringSize, true /*anywhere*/ ) ;
+			if ( error )
+			{
+				mModifyRing = 0 ;
+			}
+		}
+
+		if ( !error )
+		{
+			uint32_t outputCnt = 0;
+			const uint64_t inputs[2] = { (const uint64_t)mModifyRing, (const uint64_t)ringSize } ;
+
+			error = IOConnectCallScalarMethod(	mDevice.GetUserClientConnection(),
+												Device::MakeSelectorWithObject( kLocalIsochPort_SetModifyRing_d, mKernPortRef ),
+												inputs,2,
+												NULL,&outputCnt);
+			if ( error )
+			{
+				vm_deallocate( mach_task_self(), mModifyRing, ringSize ) ;
+				mModifyRing = 0 ;
+			}
+		}
+
+		if ( error )
+		{
+			// don't try again on every notification
+			DebugLog( "Couldn't create DCL modification ring (error=%x)\n", error ) ;
+			mModifyRingUnavailable = true ;
+
+			return kIOReturnUnsupported ;
+		}
+
+		// the kernel has set up the control block
+		mModifyRingControl = (FWSharedRingControl*) mModifyRing ;
+		mModifyRingData = (UInt8*)( mModifyRingControl + 1 ) ;
+		mModifyRingMask = mModifyRingControl->dataSize - 1 ;
+		mModifyRingHead = mModifyRingControl->head ;
+
+		return kIOReturnSuccess ;
+	}
+
+	void
+	LocalIsochPort::ReleaseModifyRing ()
+	{
+		if ( !mModifyRing )
+		{
+			return ;
+		}
+
+		// take the ring away from the kernel before the memory goes
+		uint32_t outputCnt = 0;
+		const uint64_t inputs[2] = { 0, 0 } ;
+		IOReturn error = IOConnectCallScalarMethod(	mDevice.GetUserClientConnection(),
+													Device::MakeSelectorWithObject( kLocalIsochPort_SetModifyRing_d, mKernPortRef ),
+													inputs,2,
+													NULL,&outputCnt);
+		DebugLogCond( error, "Couldn't release DCL modification ring" ) ;
+
+		vm_deallocate( mach_task_self(), mModifyRing, sizeof( FWSharedRingControl ) + kModifyRingDataSize ) ;
+		mModifyRing = 0 ;
+		mModifyRingControl = nil ;
+		mModifyRingData = nil ;
+	}
+
+	// PostModifications
+	//
+	// posts the DCLs to the modification ring and has the kernel apply them in one call.
+	// returns kIOReturnNoSpace or kIOReturnUnsupported if the caller should use
+	// kLocalIsochPort_Notify_d instead; nothing has been posted in that case.
+
+	IOReturn
+	LocalIsochPort::PostModifications (
+		NuDCL ** 					dcls, 
+		UInt32 						numDCLs )
+	{
+		Lock() ;
+
+		IOReturn error = kIOReturnSuccess ;
+
+		if ( mModifyRingUnavailable )
+		{
+			error = kIOReturnUnsupported ;
+		}
+		else if ( !mModifyRingControl )
+		{
+			error = CreateModifyRing() ;
+		}
+
+		UInt32	dataSize	= mModifyRingMask + 1 ;
+		UInt32	head		= mModifyRingHead ;
+
+		// make sure they all fit before posting any of them
+		if ( !error )
+		{
+			UInt32 tail = mModifyRingControl->tail ;
+			UInt32 end = head ;
+
+			// acquire - the kernel is done with everything before tail
+			OSMemoryBarrier() ;
+
+			for( unsigned index=0; index < numDCLs && !error; ++index )
+			{
+				UInt32 size = sizeof( UInt32 ) + dcls[ index ]->Export( NULL, NULL, 0 ) ;
+				UInt32 entrySize = ( sizeof( FWSharedRingEntry ) + size + ( kFWSharedRingAlignment - 1 ) ) & ~( kFWSharedRingAlignment - 1 ) ;
+				UInt32 position = end & mModifyRingMask ;
+
+				if ( entrySize > dataSize - position )
+				{
+					end += dataSize - position ;
+				}
+
+				end += entrySize ;
+
+				if ( size > kFWDCLModifyRingMaxEntrySize || end - tail > dataSize )
+				{
+					error = kIOReturnNoSpace ;
+				}
+			}
+		}
+
+		if ( !error )
+		{
+			for( unsigned index=0; index < numDCLs; ++index )
+			{
+				NuDCL * dcl = dcls[ index ] ;
+				UInt32 size = sizeof( UInt32 ) + dcl->Export( NULL, NULL, 0 ) ;
+				UInt32 entrySize = ( sizeof( FWSharedRingEntry ) + size + ( kFWSharedRingAlignment - 1 ) ) & ~( kFWSharedRingAlignment - 1 ) ;
+				UInt32 position = head & mModifyRingMask ;
+
+				// entries never straddle the end of the data area
+				if ( entrySize > dataSize - position )
+				{
+					((FWSharedRingEntry*)( mModifyRingData + position ))->size = kFWSharedRingPadEntry ;
+					head += dataSize - position ;
+					position = 0 ;
+				}
+
+				FWSharedRingEntry * entry = (FWSharedRingEntry*)( mModifyRingData + position ) ;
+				entry->size = size ;
+
+				UInt8 * exportCursor = (UInt8*)( entry + 1 ) ;
+				*(UInt32*)exportCursor = dcl->GetExportIndex() ;
+				exportCursor += sizeof( UInt32 ) ;
+
+				dcl->Export( (IOVirtualAddress*) & exportCursor, mBufferRanges, mBufferRangeCount ) ;
+
+				head += entrySize ;
+			}
+
+			// release - publish the entries only once all of them are in place
+			OSMemoryBarrier() ;
+			mModifyRingHead = head ;
+			mModifyRingControl->head = head ;
+
+			uint32_t outputCnt = 0;
+			error = IOConnectCallScalarMethod(	mDevice.GetUserClientConnection(),
+												Device::MakeSelectorWithObject( kLocalIsochPort_ApplyModifyRing_d, mKernPortRef ),
+												NULL,0,
+												NULL,&outputCnt);
+		}
+
+		Unlock() ;
+
+		return error ;
+	}
+
 #pragma mark -
 	// ============================================================
 	//
@@ -40,6 +40,7 @@ namespace IOFireWireLib {
 	class IsochChannel ;
 	class Device ;
 	class CoalesceTree ;
+	class NuDCL ;
 	
 #pragma mark -
 	class IsochPort: public IOFireWireIUnknown
@@ -222,6 +223,16 @@ namespace IOFireWireLib {
 			
 			pthread_mutex_t					mMutex ;
 			bool							mStarted ; 
+
+			// DCL modification ring, see FWSharedRingControl
+			enum { kModifyRingDataSize = 64 * 1024 } ;
+
+			vm_address_t					mModifyRing ;
+			FWSharedRingControl *			mModifyRingControl ;
+			UInt8 *							mModifyRingData ;
+			UInt32							mModifyRingMask ;
+			UInt32							mModifyRingHead ;		// private copy, the shared one is only published
+			bool							mModifyRingUnavailable ;
 				
 		public:
 		
@@ -236,6 +247,11 @@ namespace IOFireWireLib {
 			IOReturn				ExportDCLs( 
 													IOVirtualAddress *		exportBuffer, 
 													IOByteCount *			exportBytes ) ;
+			IOReturn				CreateModifyRing () ;
+			void					ReleaseModifyRing () ;
+			IOReturn				PostModifications (
+													NuDCL ** 				dcls, 
+													UInt32 					numDCLs ) ;
 	
 		public:
 		
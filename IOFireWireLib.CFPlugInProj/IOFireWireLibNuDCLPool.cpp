@@ -36,42 +36,39 @@
 #define OUTPUT_FILE stdout
 namespace IOFireWireLib {
 
-	static void cfArrayReleaseNuDCLObject(CFAllocatorRef allocator,const void *ptr)
-	{
-		const NuDCL *	dcl = reinterpret_cast< const NuDCL* >( ptr ) ;
-		delete dcl;
-	}
-
 	NuDCLPool::NuDCLPool( const IUnknownVTbl & vTable, Device& device, UInt32 capacity )
 	: super( vTable )
 	,fDevice( device )
+	,fDCLs( nil )
+	,fDCLCount( 0 )
+	,fDCLCapacity( 0 )
+	,fProgram( nil )
 	,fCurrentTag( 0 )
 	,fCurrentSync( 0 )
 	{
-		CFArrayCallBacks arrayCallbacks;
-	
-		// Initialize callbacks
-		arrayCallbacks.version = 0;
-		arrayCallbacks.retain = NULL;
-		arrayCallbacks.copyDescription = NULL;
-		arrayCallbacks.equal = NULL;
-		arrayCallbacks.release = cfArrayReleaseNuDCLObject;
-	
-		// Create fProgram array
-		fProgram = ::CFArrayCreateMutable( kCFAllocatorDefault, capacity, &arrayCallbacks );
+		if ( capacity )
+		{
+			fDCLs = new NuDCL*[ capacity ] ;
+			fDCLCapacity = capacity ;
+		}
 	}
 
 	NuDCLPool::~NuDCLPool()
 	{
-		// Release the fProgram array. The array's release callback will delete all the elements!
+		// fProgram doesn't own its values, the pool deletes the DCLs itself
 		if (fProgram)
 			CFRelease(fProgram);
+		
+		for( UInt32 index=0; index < fDCLCount; ++index )
+			delete fDCLs[ index ] ;
+		
+		delete[] fDCLs ;
 	}
 
 	DCLCommand*
 	NuDCLPool::GetProgram()
 	{
-		if ( ::CFArrayGetCount( fProgram ) == 0 )
+		if ( fDCLCount == 0 )
 			return nil ;
 
 		fLeader.pNextDCLCommand = nil ;
@@ -84,14 +81,38 @@ namespace IOFireWireLib {
 	CFArrayRef
 	NuDCLPool::GetDCLs()
 	{
-		if ( fProgram )
+		if ( !fProgram )
 		{
-			::CFRetain( fProgram ) ;
+			CFArrayCallBacks arrayCallbacks = { 0, NULL, NULL, NULL, NULL } ;
+			fProgram = ::CFArrayCreateMutable( kCFAllocatorDefault, 0, &arrayCallbacks ) ;
+			
+			if ( !fProgram )
+				return nil ;
 		}
 		
+		// DCLs are only ever appended, so bring the array up to date from where it left off
+		for( CFIndex index = ::CFArrayGetCount( fProgram ); index < (CFIndex)fDCLCount; ++index )
+		{
+			::CFArrayAppendValue( fProgram, fDCLs[ index ] ) ;
+		}
+		
+		::CFRetain( fProgram ) ;
+		
 		return fProgram ;
 	}
 
+	NuDCL *
+	NuDCLPool::FindNextDCL( const NuDCL * dcl ) const
+	{
+		// the export index is the DCL's position in fDCLs + 1, which makes it the index of the next DCL
+		unsigned index = dcl->GetExportIndex() ;
+		
+		if ( index == 0 || index >= fDCLCount || fDCLs[ index - 1 ] != dcl )
+			return nil ;
+		
+		return fDCLs[ index ] ;
+	}
+
 	void
 	NuDCLPool::SetCurrentTagAndSync ( UInt8 tag, UInt8 sync )
 	{
@@ -108,9 +129,24 @@ namespace IOFireWireLib {
 			{
 				::CFSetSetValue( saveBag, dcl ) ;
 			}
+
+			if ( fDCLCount == fDCLCapacity )
+			{
+				UInt32		newCapacity = fDCLCapacity ? fDCLCapacity << 1 : 64 ;
+				NuDCL **	newDCLs = new NuDCL*[ newCapacity ] ;
 				
-			::CFArrayAppendValue( fProgram, dcl ) ;
-			dcl->SetExportIndex( ::CFArrayGetCount( fProgram ) ) ;
+				if ( fDCLs )
+				{
+					bcopy( fDCLs, newDCLs, fDCLCount * sizeof( NuDCL* ) ) ;
+					delete[] fDCLs ;
+				}
+				
+				fDCLs = newDCLs ;
+				fDCLCapacity = newCapacity ;
+			}
+			
+			fDCLs[ fDCLCount++ ] = dcl ;
+			dcl->SetExportIndex( fDCLCount ) ;
 		}
 		
 		return dcl ;
@@ -144,14 +180,11 @@ namespace IOFireWireLib {
 		IOVirtualRange			bufferRanges[],
 		unsigned				bufferRangeCount ) const
 	{
-		unsigned programCount = ::CFArrayGetCount( fProgram ) ;
 		IOByteCount exportBytes = 0 ;
 		
-		for( unsigned index=0; index < programCount; ++index )
+		for( unsigned index=0; index < fDCLCount; ++index )
 		{
-			const NuDCL *	dcl = reinterpret_cast< const NuDCL* >(::CFArrayGetValueAtIndex( fProgram, index ) ) ;
-
-			exportBytes += dcl->Export( NULL, NULL, 0 ) ;		// find export data size needed
+			exportBytes += fDCLs[ index ]->Export( NULL, NULL, 0 ) ;		// find export data size needed
 		}
 		
 		vm_allocate( mach_task_self(), (vm_address_t*)outExportData, exportBytes, true /*anywhere*/ ) ;
@@ -159,11 +192,9 @@ namespace IOFireWireLib {
 		{
 			IOVirtualAddress exportCursor = *outExportData ;
 			
-			for ( unsigned index = 0 ; index < programCount ; ++index )
+			for ( unsigned index = 0 ; index < fDCLCount ; ++index )
 			{
-				const NuDCL *	dcl = reinterpret_cast< const NuDCL* >(::CFArrayGetValueAtIndex( fProgram, index ) ) ;
-	
-				dcl->Export( & exportCursor, bufferRanges, bufferRangeCount ) ;			// make export data.. we don't care about the returned size
+				fDCLs[ index ]->Export( & exportCursor, bufferRanges, bufferRangeCount ) ;			// make export data.. we don't care about the returned size
 			}
 		}
 		
@@ -176,10 +207,9 @@ namespace IOFireWireLib {
 	void
 	NuDCLPool::CoalesceBuffers ( CoalesceTree & toTree ) const
 	{
-		CFIndex count = ::CFArrayGetCount( fProgram ) ;
-		for ( CFIndex index = 0 ; index < count ; ++index )
+		for ( UInt32 index = 0 ; index < fDCLCount ; ++index )
 		{
-			reinterpret_cast< const NuDCL* >( ::CFArrayGetValueAtIndex( fProgram, index ) )->CoalesceBuffers( toTree ) ;
+			fDCLs[ index ]->CoalesceBuffers( toTree ) ;
 		}
 	}
 
@@ -306,12 +336,11 @@ namespace IOFireWireLib {
 	NuDCLPoolCOM::S_PrintProgram( IOFireWireLibNuDCLPoolRef self )
 	{
 		NuDCLPoolCOM* me = IOFireWireIUnknown::InterfaceMap< NuDCLPoolCOM >::GetThis( self ) ;
-		CFIndex count = ::CFArrayGetCount( me->fProgram ) ;
 		
-		for( CFIndex index=0; index < count; ++index )
+		for( UInt32 index=0; index < me->fDCLCount; ++index )
 		{
-			fprintf( OUTPUT_FILE, "%ld:", index ) ;
-			reinterpret_cast<const NuDCL*>( ::CFArrayGetValueAtIndex( me->fProgram, index ) )->Print( OUTPUT_FILE ) ; 
+			fprintf( OUTPUT_FILE, "%u:", (unsigned)index ) ;
+			me->fDCLs[ index ]->Print( OUTPUT_FILE ) ; 
 		}
 	}
 	
@@ -425,14 +454,7 @@ namespace IOFireWireLib {
 	{
 		CHECK_DCL_NULL( NuDCL*, dcl ) ;
 		
-		NuDCLPoolCOM* me = IOFireWireIUnknown::InterfaceMap<NuDCLPoolCOM>::GetThis( self ) ;
-		
-		CFIndex count = ::CFArrayGetCount( me->fProgram ) ;
-		CFIndex index = ::CFArrayGetFirstIndexOfValue( me->fProgram, ::CFRangeMake( 0, count ),  dcl ) ;
-		if ( index == kCFNotFound || index == count )
-			return 0 ;
-
-		return (NuDCLRef)::CFArrayGetValueAtIndex( me->fProgram, index+1 ) ;
+		return reinterpret_cast<NuDCLRef>( IOFireWireIUnknown::InterfaceMap<NuDCLPoolCOM>::GetThis( self )->FindNextDCL( CAST_DCL( NuDCL*, dcl ) ) ) ;
 	}
 	
 	IOReturn
@@ -47,7 +47,10 @@ namespace IOFireWireLib {
 		
 			Device &			fDevice ;
 			DCLNuDCLLeader		fLeader ;
-			CFMutableArrayRef	fProgram ;
+			NuDCL **			fDCLs ;				// program order; fDCLs[ n ] has export index n + 1
+			UInt32				fDCLCount ;
+			UInt32				fDCLCapacity ;
+			CFMutableArrayRef	fProgram ;			// built on demand for GetDCLs()
 			UInt8				fCurrentTag ;
 			UInt8				fCurrentSync ;
 	
@@ -62,6 +65,7 @@ namespace IOFireWireLib {
 		
 			void						PrintDCLs( NuDCLRef dcl ) ;
 			void						PrintDCL( NuDCLRef dcl ) ;
+			NuDCL *						FindNextDCL( const NuDCL * dcl ) const ;
 
 			// Allocating
 			NuDCL *						AppendDCL( 
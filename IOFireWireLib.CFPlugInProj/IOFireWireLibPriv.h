@@ -393,6 +393,78 @@ namespace IOFireWireLib {
 		UInt32		addressLo ;
 	}  __attribute__ ((packed));
 
+	// batched pseudo address space notification (kFWAddressSpaceBatchNotify):
+	// each packet is published in the packet queue as one of these headers,
+	// immediately followed by the packet payload (writes and locks only).
+	// The packet queue is a shared ring (FWSharedRingControl) in this mode.
+	// A batch notification carries { count, skippedPacketCount, header offset[count] };
+	// user space advances the ring tail past the batch and then acknowledges it with
+	// kPseudoAddrSpace_ClientBatchIsComplete.
+	
+	enum
+	{
+		kFWPseudoAddrSpaceBatchWrite	= 0,
+		kFWPseudoAddrSpaceBatchLock,
+		kFWPseudoAddrSpaceBatchRead
+	} ;
+	
+	enum
+	{
+		kFWPseudoAddrSpaceMaxBatchCount	= 14		// kMaxAsyncArgs less count and skipped count
+	} ;
+	
+	struct FWPseudoAddrSpaceBatchHeader
+	{
+		UInt64					commandID ;
+		UInt32					type ;
+		UInt32					packetSize ;
+		UInt32					addressLo ;
+		UInt16					addressHi ;
+		UInt16					nodeID ;
+		UInt32					speed ;
+		UInt32					generation ;
+	}  __attribute__ ((packed));
+
+	// shared ring (IOFWRingBufferQ shared mode): the control block sits at the start
+	// of the queue buffer and is followed by a power-of-two data area. The kernel
+	// produces and only writes 'head', user space consumes and only writes 'tail'.
+	// Both are free-running byte counts; the data position is index & (dataSize - 1).
+	// Each entry is a FWSharedRingEntry followed by its bytes, padded to
+	// kFWSharedRingAlignment. An entry that would straddle the end of the data area
+	// is preceded by a kFWSharedRingPadEntry marker and placed at the start instead.
+	
+	enum
+	{
+		kFWSharedRingAlignment		= 8,
+		kFWSharedRingPadEntry		= 0xFFFFFFFF
+	} ;
+	
+	struct FWSharedRingControl
+	{
+		volatile UInt32			head ;
+		UInt32					dataSize ;
+		UInt32					reserved0[14] ;			// keep producer and consumer on separate cache lines
+		volatile UInt32			tail ;
+		UInt32					reserved1[15] ;
+	} ;
+	
+	struct FWSharedRingEntry
+	{
+		UInt32					size ;					// bytes following this entry header
+		UInt32					reserved ;
+	} ;
+
+	// DCL modification ring (kLocalIsochPort_SetModifyRing_d): a shared ring laid out as
+	// above, but with the roles swapped - user space produces and only writes 'head', the
+	// kernel consumes and only writes 'tail'. Each entry holds a NuDCL's export index
+	// followed by its export data, exactly as one DCL in a kFWNuDCLModifyNotification.
+	// Posted entries are applied together by kLocalIsochPort_ApplyModifyRing_d.
+	
+	enum
+	{
+		kFWDCLModifyRingMaxEntrySize	= 4096		// larger entries go through kLocalIsochPort_Notify_d
+	} ;
+
 	struct FWUserAsyncStreamListenerCreateParams
 	{
 		UInt32					channel;
@@ -572,6 +644,11 @@ namespace IOFireWireLib {
 		kPHYPacketListenerActivate,
 		kPHYPacketListenerDeactivate,
 		kPHYPacketListenerClientCommandIsComplete,
+		kPseudoAddrSpace_ClientBatchIsComplete,
+		kBufferFillIsochPort_Create,
+		kBufferFillIsochPort_SetNotificationCallback_d,
+		kLocalIsochPort_SetModifyRing_d,
+		kLocalIsochPort_ApplyModifyRing_d,
 		kNumMethods
 	} ;
 
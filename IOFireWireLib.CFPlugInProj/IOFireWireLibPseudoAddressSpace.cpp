@@ -33,6 +33,7 @@
 
 #import <IOKit/iokitmig.h>
 #import <System/libkern/OSCrossEndian.h>
+#import <libkern/OSAtomic.h>
 
 namespace IOFireWireLib {
 	
@@ -55,12 +56,12 @@ namespace IOFireWireLib {
 	
 	IUnknownVTbl** 
 	PseudoAddressSpace::Alloc( Device& userclient, UserObjectHandle inKernAddrSpaceRef, void* inBuffer, UInt32 inBufferSize, 
-			void* inBackingStore, void* inRefCon )
+			void* inBackingStore, void* inRefCon, UInt32 inFlags )
 	{
 		PseudoAddressSpace* me = nil ;
 		
 		try {
-			me = new PseudoAddressSpace(userclient, inKernAddrSpaceRef, inBuffer, inBufferSize, inBackingStore, inRefCon) ;
+			me = new PseudoAddressSpace(userclient, inKernAddrSpaceRef, inBuffer, inBufferSize, inBackingStore, inRefCon, inFlags) ;
 		} catch (...) {
 		}
 		
@@ -170,7 +171,8 @@ namespace IOFireWireLib {
 	// ============================================================
 	
 	PseudoAddressSpace::PseudoAddressSpace( Device& userclient, UserObjectHandle inKernAddrSpaceRef,
-												void* inBuffer, UInt32 inBufferSize, void* inBackingStore, void* inRefCon) 
+												void* inBuffer, UInt32 inBufferSize, void* inBackingStore, void* inRefCon,
+												UInt32 inFlags) 
 	: IOFireWireIUnknown( reinterpret_cast<const IUnknownVTbl &>( sInterface ) ),
 		mNotifyIsOn(false),
 		mWriter( nil ),
@@ -181,7 +183,10 @@ namespace IOFireWireLib {
 		mBuffer((char*)inBuffer),
 		mBufferSize(inBufferSize),
 		mBackingStore(inBackingStore),
-		mRefCon(inRefCon)
+		mRefCon(inRefCon),
+		mFlags(inFlags),
+		mBatchCount(0),
+		mBatchOutstanding(0)
 	{
 		userclient.AddRef() ;
 
@@ -307,7 +312,8 @@ namespace IOFireWireLib {
 			uint64_t refrncData[kOSAsyncRef64Count];
 			refrncData[kIOAsyncCalloutFuncIndex] = (uint64_t) 0;
 			refrncData[kIOAsyncCalloutRefconIndex] = (unsigned long)0;
-			const uint64_t inputs[3] = {(const uint64_t)mKernAddrSpaceRef, (const uint64_t)&PseudoAddressSpace::Writer, (const uint64_t)callBackRefCon};
+			uint64_t packetCallback = ( mFlags & kFWAddressSpaceBatchNotify ) ? (uint64_t)&PseudoAddressSpace::BatchWriter : (uint64_t)&PseudoAddressSpace::Writer ;
+			const uint64_t inputs[3] = {(const uint64_t)mKernAddrSpaceRef, packetCallback, (const uint64_t)callBackRefCon};
 			uint32_t outputCnt = 0;
 			err = IOConnectCallAsyncScalarMethod(connection,
 												 kSetAsyncRef_Packet,
@@ -442,6 +448,15 @@ namespace IOFireWireLib {
 				
 			delete[] (args-1) ;
 		}
+		
+		if ( mFlags & kFWAddressSpaceBatchNotify )
+		{
+			// the kernel only hears about a batch once every packet in it is complete
+			if ( mBatchOutstanding > 0 && --mBatchOutstanding == 0 )
+				BatchIsComplete() ;
+			
+			return ;
+		}
 	
 		uint32_t outputCnt = 0;		
 		const uint64_t inputs[3] = {(const uint64_t)mKernAddrSpaceRef, (const uint64_t)commandID, (const uint64_t)status};
@@ -496,11 +511,14 @@ namespace IOFireWireLib {
 		}
 		else
 		{
+			// auto copy-on-write payloads are only written to the backing store
+			char * packetBase = me->CopiesWritesToBackingStore() ? (char*)me->mBackingStore : me->mBuffer ;
+			
 			(me->mWriter)(
 				(AddressSpaceRef) refcon,
 				(FWClientCommandID) args[0],						// commandID,
 				(unsigned long)(args[1]),									// packetSize
-				me->mBuffer + (unsigned long)(args[2]),					// packet
+				packetBase + (unsigned long)(args[2]),					// packet
 				(UInt16)(unsigned long)(args[3]),							// nodeID
 				(unsigned long)(args[5]),									// addr.addressHi, addr.addressLo
 				(unsigned long)(args[6]),
@@ -509,6 +527,161 @@ namespace IOFireWireLib {
 		}
 	}
 	
+	void
+	PseudoAddressSpace::BatchIsComplete()
+	{
+		// hand the batch's entries back to the kernel through the shared ring tail
+		FWSharedRingControl *	control	= (FWSharedRingControl*) mBuffer ;
+		char *					data	= mBuffer + sizeof(FWSharedRingControl) ;
+		UInt32					mask	= control->dataSize - 1 ;
+		UInt32					tail	= control->tail ;
+		
+		for( UInt32 index = 0; index < mBatchCount; ++index )
+		{
+			FWSharedRingEntry * entry = (FWSharedRingEntry*)( data + (tail & mask) ) ;
+			
+			if ( entry->size == kFWSharedRingPadEntry )
+			{
+				tail += (mask + 1) - (tail & mask) ;
+				entry = (FWSharedRingEntry*) data ;
+			}
+			
+			tail += ( sizeof(FWSharedRingEntry) + entry->size + (kFWSharedRingAlignment - 1) ) & ~(kFWSharedRingAlignment - 1) ;
+		}
+		
+		// release - we're done with the entries before the kernel can reuse them
+		OSMemoryBarrier() ;
+		control->tail = tail ;
+		
+		uint32_t outputCnt = 0;		
+		const uint64_t inputs[2] = {(const uint64_t)mKernAddrSpaceRef, (const uint64_t)mBatchCount};
+
+		#if IOFIREWIREUSERCLIENTDEBUG > 0
+		OSStatus err = 
+		#endif
+		
+		IOConnectCallScalarMethod(mUserClient.GetUserClientConnection(), 
+								  kPseudoAddrSpace_ClientBatchIsComplete,
+								  inputs,2,
+								  NULL,&outputCnt);
+
+		mBatchCount = 0 ;
+		
+#ifdef __LP64__		
+		DebugLogCond( err, "PseudoAddressSpace::BatchIsComplete: err=0x%08X\n", (UInt32)err ) ;
+#else
+		DebugLogCond( err, "PseudoAddressSpace::BatchIsComplete: err=0x%08lX\n", (UInt32)err ) ;
+#endif
+	}
+	
+	void
+	PseudoAddressSpace::BatchWriter( AddressSpaceRef refcon, IOReturn result, void** args, int numArgs)
+	{
+		PseudoAddressSpace* me = IOFireWireIUnknown::InterfaceMap<PseudoAddressSpace>::GetThis(refcon) ;
+		
+		// args: count, skipped packet count, header offset[count]
+		UInt32	count	= (unsigned long)args[0] ;
+		UInt32	skipped	= (unsigned long)args[1] ;
+		
+		if ( count > (UInt32)(numArgs - 2) )
+			count = numArgs - 2 ;
+		
+		// every packet (and the skipped packet report) is completed through
+		// ClientCommandIsComplete; count them all before calling out so that
+		// handlers which complete synchronously don't ack the batch early
+		me->mBatchCount			= count ;
+		me->mBatchOutstanding	= count + 1 ;
+		if ( skipped && me->mSkippedPacketHandler )
+			++me->mBatchOutstanding ;
+		
+		if ( skipped && me->mSkippedPacketHandler )
+			(me->mSkippedPacketHandler)( refcon, 0, skipped ) ;
+		
+		for( UInt32 index = 0; index < count; ++index )
+		{
+			unsigned long					offset	= (unsigned long)args[ 2 + index ] ;
+			FWPseudoAddrSpaceBatchHeader *	header	= (FWPseudoAddrSpaceBatchHeader *)( me->mBuffer + offset ) ;
+			unsigned long					payload	= offset + sizeof(FWPseudoAddrSpaceBatchHeader) ;
+			FWClientCommandID				commandID = (FWClientCommandID)(unsigned long)header->commandID ;
+			
+			switch( header->type )
+			{
+				case kFWPseudoAddrSpaceBatchWrite:
+					if ( me->mWriter )
+					{
+						(me->mWriter)(
+							(AddressSpaceRef) refcon,
+							commandID,
+							header->packetSize,
+							me->CopiesWritesToBackingStore() ? (char*)me->mBackingStore + (header->addressLo - me->mFWAddress.addressLo) : me->mBuffer + payload,
+							header->nodeID,
+							header->addressHi,
+							header->addressLo,
+							(void*) me->mRefCon) ;
+					}
+					else
+						me->ClientCommandIsComplete( commandID, kFWResponseTypeError ) ;
+					break ;
+					
+				case kFWPseudoAddrSpaceBatchLock:
+					if ( me->mWriter && me->mReader )
+					{
+						// same layout Writer() receives from the kernel for a lock,
+						// plus the extra leading refcon ClientCommandIsComplete expects
+						void** lockValues = (void**) new UInt32 *[8+1] ;
+						
+						lockValues[0] = refcon ;
+						lockValues[1] = commandID ;
+						lockValues[2] = (void*)(unsigned long)header->packetSize ;
+						lockValues[3] = (void*)payload ;
+						lockValues[4] = (void*)(unsigned long)header->nodeID ;
+						lockValues[5] = (void*)(unsigned long)header->speed ;
+						lockValues[6] = (void*)(unsigned long)header->addressHi ;
+						lockValues[7] = (void*)(unsigned long)header->addressLo ;
+						lockValues[8] = (void*)1 ;
+						
+						::CFDictionaryAddValue( me->mPendingLocks, commandID, lockValues ) ;
+						
+						(me->mReader)( (AddressSpaceRef) refcon,
+										commandID,
+										header->packetSize,
+										header->addressLo,		// !!! hack - all address spaces have 0 for addressLo
+										header->nodeID,
+										header->addressHi,
+										header->addressLo,
+										(void*) me->mRefCon) ;
+					}
+					else
+						me->ClientCommandIsComplete( commandID, kFWResponseTypeError ) ;
+					break ;
+					
+				case kFWPseudoAddrSpaceBatchRead:
+					if ( me->mReader )
+					{
+						(me->mReader)( (AddressSpaceRef) refcon,
+										commandID,
+										header->packetSize,
+										header->addressLo - me->mFWAddress.addressLo,	// packetOffset
+										header->nodeID,
+										header->addressHi,
+										header->addressLo,
+										(void*) me->mRefCon) ;
+					}
+					else
+						me->ClientCommandIsComplete( commandID, kFWResponseTypeError ) ;
+					break ;
+					
+				default:
+					me->ClientCommandIsComplete( commandID, kFWResponseTypeError ) ;
+					break ;
+			}
+		}
+		
+		// drop the guard count taken above
+		if ( --me->mBatchOutstanding == 0 )
+			me->BatchIsComplete() ;
+	}
+	
 	void
 	PseudoAddressSpace::SkippedPacket( AddressSpaceRef refcon, IOReturn result, FWClientCommandID commandID, UInt32 packetCount)
 	{
@@ -49,7 +49,7 @@ namespace IOFireWireLib {
 			// static allocator
 			static IUnknownVTbl** 	Alloc( Device& userclient, UserObjectHandle inKernAddrSpaceRef, 
 											void* inBuffer, UInt32 inBufferSize, void* inBackingStore, 
-											void* inRefCon) ;
+											void* inRefCon, UInt32 inFlags = 0) ;
 		
 			// QueryInterface
 			virtual HRESULT	QueryInterface(REFIID iid, void **ppv );
@@ -94,7 +94,8 @@ namespace IOFireWireLib {
 											void*							inBuffer,
 											UInt32							inBufferSize,
 											void*							inBackingStore,
-											void*							inRefCon = 0) ;
+											void*							inRefCon = 0,
+											UInt32							inFlags = 0) ;
 			virtual					~PseudoAddressSpace() ;
 					
 			// --- callback methods ----------------
@@ -104,6 +105,8 @@ namespace IOFireWireLib {
 											int numArgs) ;
 			static void				SkippedPacket( AddressSpaceRef refCon, IOReturn result, FWClientCommandID commandID,
 											UInt32 packetCount) ;
+			static void				BatchWriter( AddressSpaceRef refcon, IOReturn result, void** args,
+											int numArgs) ;
 
 			// --- notification methods ----------
 			virtual const WriteHandler			SetWriteHandler( WriteHandler inWriter ) ;
@@ -113,6 +116,7 @@ namespace IOFireWireLib {
 			virtual Boolean						TurnOnNotification( void* callBackRefCon ) ;
 			virtual void						TurnOffNotification() ;
 			virtual void						ClientCommandIsComplete( FWClientCommandID commandID, IOReturn status) ;
+			void								BatchIsComplete() ;
 		
 			virtual const FWAddress& 			GetFWAddress() ;
 			virtual void*						GetBuffer() ;
@@ -122,6 +126,7 @@ namespace IOFireWireLib {
 			const ReadHandler					GetReader()	const											{ return mReader ; }
 			const WriteHandler					GetWriter() const 											{ return mWriter ; }
 			const SkippedPacketHandler			GetSkippedPacketHandler() const								{ return mSkippedPacketHandler ; }
+			Boolean								CopiesWritesToBackingStore() const							{ return (mFlags & kFWAddressSpaceAutoCopyOnWrite) && mBackingStore ; }
 			
 		protected:
 			// callback mgmt.
@@ -142,5 +147,10 @@ namespace IOFireWireLib {
 			void*							mRefCon ;
 			
 			CFMutableDictionaryRef			mPendingLocks ;
+			
+			// kFWAddressSpaceBatchNotify
+			UInt32							mFlags ;
+			UInt32							mBatchCount ;			// packets in the current batch
+			UInt32							mBatchOutstanding ;		// completions still expected before the batch is acked
 	} ;	
 }